@@ -1,15 +1,16 @@
 #include "tcp_server.h"
 #include "log.h"
 #include "bytearray.h"
+#include "config.h"
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
 
-// 选择EchoServer输出类型: 1文本类型 2二进制类型
+// 选择EchoServer输出类型: 1文本类型 2二进制类型 3回显给客户端(不输出，用于压测)
 static int EchoServerType = 1;
 
 /**
  * @brief echo服务器
- * @details 将收到的客户端数据原封不动地打印出来
+ * @details 将收到的客户端数据原封不动地打印出来，或者原样发回给客户端
 */
 class EchoServer : public sylar::TcpServer {
 public:
@@ -55,7 +56,7 @@ void EchoServer::handleClient(sylar::Socket::ptr client) {
         std::vector<iovec> buffers;
         ba->getWriteBuffers(buffers, 1024);    // 获取可写入的内存地址
 
-        size_t rt = client->recv(&buffers[0], buffers.size());
+        ssize_t rt = client->recv(&buffers[0], buffers.size());
         // SYLAR_LOG_INFO(g_logger) << rt << "  " << (char*)buffers[0].iov_base;
         if(rt == 0) {    // 连接关闭
             SYLAR_LOG_INFO(g_logger) << "client Socket close: " << client->toString();
@@ -69,6 +70,17 @@ void EchoServer::handleClient(sylar::Socket::ptr client) {
         ba->setPosition(ba->getPosition() + rt);  // 内存光标移到新存储数据最后一位的下一位，新起点
         ba->setPosition(0);  // 为了toString()
 
+        if(EchoServerType == 3) {
+            // 原样发回
+            std::vector<iovec> out;
+            ba->getReadBuffers(out, rt);
+            if(client->send(&out[0], out.size()) <= 0) {
+                SYLAR_LOG_INFO(g_logger) << "client Socket send error: " << client->toString();
+                return;
+            }
+            continue;
+        }
+
         if(EchoServerType == 1) {
             // 文本输出
             std::cout << ba->toString();// << std::endl;
@@ -109,9 +121,11 @@ void echo_server() {
 
 // 执行echo_server时，默认argc==1  argv[0]==./echo_server
 // [./echo_server -t]  argc==2  argv[1]==-t
+// [./echo_server -e -u 1]  回显模式，使用io_uring后端，1个调度线程
 int main(int argc, char** argv) {
     if(argc < 2) {
-        SYLAR_LOG_INFO(g_logger) << "used as[" << argv[0] << " -t] or [" << argv[0] << " -b]";
+        SYLAR_LOG_INFO(g_logger) << "used as[" << argv[0] << " -t] or [" << argv[0] << " -b] or ["
+                                 << argv[0] << " -e], append [-u] to use io_uring backend and [threads]";
         return 0;
     }
 
@@ -119,8 +133,21 @@ int main(int argc, char** argv) {
     if(strcmp(argv[1], "-b") == 0) {
         EchoServerType = 2;
     }
+    // [./echo_server -e] 回显模式，关闭INFO日志，避免日志输出的系统调用干扰压测
+    else if(strcmp(argv[1], "-e") == 0) {
+        EchoServerType = 3;
+        g_logger->setLevel(sylar::LogLevel::ERROR);
+        SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::ERROR);
+    }
+
+    // [-u] 使用io_uring后端，IOManager构造时读取该配置
+    if(argc > 2 && strcmp(argv[2], "-u") == 0) {
+        sylar::Config::Lookup<std::string>("iomanager.backend")->setValue("io_uring");
+    }
 
-    sylar::IOManager iom(2);
+    // 调度线程数，默认2个
+    int threads = argc > 3 ? atoi(argv[3]) : 2;
+    sylar::IOManager iom(threads > 0 ? threads : 2);
     iom.scheduler(&echo_server);
 
     return 0;
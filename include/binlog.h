@@ -0,0 +1,376 @@
+#ifndef __SYLAR_BINLOG_H__
+#define __SYLAR_BINLOG_H__
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "log.h"
+#include "noncopyable.h"
+#include "segment_array.h"
+#include "thread.h"
+#include "util.h"
+
+
+/**
+ * @brief 以二进制方式将日志级别level的日志写入到logger
+ * @details fmt必须是字符串字面量,语法同printf(不支持*宽度);参数不做格式化,
+ *          按类型编码后交给Appender,BinaryLogAppender直接写入环形文件,由binlog_decode离线还原
+ */
+#define SYLAR_LOG_BIN_LEVEL(logger, level, fmt, ...) \
+    do { \
+        if(logger->getLevel() <= level) { \
+            static const sylar::BinLogSite sylar_binlog_site(__FILE__, __LINE__, fmt); \
+            sylar::BinLogSite::Log(logger, level, sylar_binlog_site, ##__VA_ARGS__); \
+        } \
+    } while(0)
+
+// 以二进制方式将日志级别debug的日志写入到logger
+#define SYLAR_LOG_BIN_DEBUG(logger, fmt, ...) SYLAR_LOG_BIN_LEVEL(logger, sylar::LogLevel::DEBUG, fmt, ##__VA_ARGS__)
+
+// 以二进制方式将日志级别info的日志写入到logger
+#define SYLAR_LOG_BIN_INFO(logger, fmt, ...) SYLAR_LOG_BIN_LEVEL(logger, sylar::LogLevel::INFO, fmt, ##__VA_ARGS__)
+
+// 以二进制方式将日志级别warn的日志写入到logger
+#define SYLAR_LOG_BIN_WARN(logger, fmt, ...) SYLAR_LOG_BIN_LEVEL(logger, sylar::LogLevel::WARN, fmt, ##__VA_ARGS__)
+
+// 以二进制方式将日志级别error的日志写入到logger
+#define SYLAR_LOG_BIN_ERROR(logger, fmt, ...) SYLAR_LOG_BIN_LEVEL(logger, sylar::LogLevel::ERROR, fmt, ##__VA_ARGS__)
+
+// 以二进制方式将日志级别fatal的日志写入到logger
+#define SYLAR_LOG_BIN_FATAL(logger, fmt, ...) SYLAR_LOG_BIN_LEVEL(logger, sylar::LogLevel::FATAL, fmt, ##__VA_ARGS__)
+
+
+namespace sylar {
+
+//二进制日志参数的编码和还原
+//每个参数编码为 1字节类型 + 数据: 整数/浮点数/指针8字节,char 1字节,字符串 4字节长度 + 内容
+class BinLogArgs {
+public:
+    //参数类型
+    enum Type {
+        INT = 'i',        //有符号整数
+        UINT = 'u',       //无符号整数和bool
+        DOUBLE = 'd',     //浮点数
+        STRING = 's',     //字符串
+        POINTER = 'p',    //指针
+        CHAR = 'c'        //字符
+    };
+
+    //编码参数追加到buf末尾
+    static void Encode(std::string& buf) {}
+
+    template<class T, class... Args>
+    static void Encode(std::string& buf, const T& v, const Args&... args) {
+        Put(buf, v);
+        Encode(buf, args...);
+    }
+
+    /**
+     * @brief 按printf格式fmt还原参数,文本追加到out末尾
+     * @details 参数类型和转换说明不一致时按参数的类型输出,缺少的参数原样输出转换说明
+     * @return 参数数据完整返回true
+     */
+    static bool Format(std::string& out, const char* fmt, const char* data, size_t len);
+
+private:
+    static void PutRaw(std::string& buf, Type type, const void* v, size_t len) {
+        buf.push_back((char)type);
+        buf.append((const char*)v, len);
+    }
+
+    static void PutString(std::string& buf, const char* str, size_t len) {
+        uint32_t n = len;
+        PutRaw(buf, STRING, &n, sizeof(n));
+        buf.append(str, len);
+    }
+
+    static void Put(std::string& buf, char v) { PutRaw(buf, CHAR, &v, 1); }
+    static void Put(std::string& buf, bool v) { uint64_t u = v; PutRaw(buf, UINT, &u, sizeof(u)); }
+    static void Put(std::string& buf, const char* v) { v = v ? v : "(null)"; PutString(buf, v, strlen(v)); }
+    static void Put(std::string& buf, const std::string& v) { PutString(buf, v.data(), v.size()); }
+
+    template<class T>
+    static typename std::enable_if<(std::is_integral<T>::value && std::is_signed<T>::value)
+                                   || std::is_enum<T>::value>::type
+    Put(std::string& buf, T v) {
+        int64_t i = (int64_t)v;
+        PutRaw(buf, INT, &i, sizeof(i));
+    }
+
+    template<class T>
+    static typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type
+    Put(std::string& buf, T v) {
+        uint64_t u = v;
+        PutRaw(buf, UINT, &u, sizeof(u));
+    }
+
+    template<class T>
+    static typename std::enable_if<std::is_floating_point<T>::value>::type
+    Put(std::string& buf, T v) {
+        double d = v;
+        PutRaw(buf, DOUBLE, &d, sizeof(d));
+    }
+
+    template<class T>
+    static void Put(std::string& buf, const T* v) {
+        uint64_t u = (uint64_t)(uintptr_t)v;
+        PutRaw(buf, POINTER, &u, sizeof(u));
+    }
+};
+
+
+//二进制日志的调用点: 文件名、行号、格式串,进程内唯一的id
+//SYLAR_LOG_BIN_*宏在每个调用点定义一个静态对象,每条日志只记录id,文件名和格式串每个文件只写一次
+class BinLogSite : Noncopyable {
+public:
+    /**
+     * @brief 构造函数,分配id
+     * @param[in] file 文件名(字面量)
+     * @param[in] line 行号
+     * @param[in] fmt 格式串(字面量)
+     */
+    BinLogSite(const char* file, int32_t line, const char* fmt);
+
+    //返回调用点id,从1开始
+    uint32_t getId() const { return m_id; }
+
+    //返回文件名
+    const char* getFile() const { return m_file; }
+
+    //返回行号
+    int32_t getLine() const { return m_line; }
+
+    //返回格式串
+    const char* getFormat() const { return m_fmt; }
+
+    /**
+     * @brief 文本日志(SYLAR_LOG_*)写入二进制Appender时使用的调用点,格式串为"%s"
+     * @details 按(file, line)在首次使用时创建,之后不释放
+     */
+    static const BinLogSite* GetTextSite(const char* file, int32_t line);
+
+    /**
+     * @brief 写二进制日志,参数编码到事件中,不做格式化
+     */
+    template<class... Args>
+    static void Log(const std::shared_ptr<Logger>& logger, LogLevel::Level level
+                    , const BinLogSite& site, const Args&... args) {
+        LogEvent::ptr event = LogEvent::Create(logger, level, site.m_file, site.m_line, 0
+                                    , sylar::getThreadId(), sylar::getFiberId(), time(0)
+                                    , Thread::getCurrThreadName());
+        event->setBinSite(&site);
+        BinLogArgs::Encode(event->getBinArgs(), args...);
+        logger->log(level, event);
+    }
+
+private:
+    uint32_t m_id;
+    const char* m_file;
+    int32_t m_line;
+    const char* m_fmt;
+};
+
+
+//二进制日志文件格式
+//环形文件: 4KB文件头 + 数据区(2的幂),数据区中的记录8字节对齐,不跨越数据区末尾
+//元数据文件(文件名.meta): 调用点、日志器名称、线程名称,每个id第一次出现时追加一条
+struct BinLogFormat {
+    //文件头大小
+    static const uint32_t HEADER_SIZE = 4096;
+    //文件版本
+    static const uint32_t VERSION = 1;
+
+    //环形文件头
+    struct FileHeader {
+        char magic[8];                      //"SYBINLOG"
+        uint32_t version;                   //文件版本
+        uint32_t headerSize;                //文件头大小
+        uint64_t capacity;                  //数据区大小
+        std::atomic<uint64_t> writePos;     //逻辑写入位置(累计写入的字节数)
+        uint64_t createTime;                //创建时间(秒)
+        uint32_t pid;                       //写入进程
+    };
+
+    //记录头,后面紧跟编码后的参数
+    //end(逻辑起始位置+记录长度)在其他字段和参数写完后最后写入,解码时用来确认记录完整
+    //调用点为0表示填充(记录放不下时数据区末尾剩余的部分)
+    struct Record {
+        uint64_t end;           //逻辑结束位置
+        uint32_t site;          //调用点id
+        uint32_t argsLen;       //参数长度
+        uint64_t time;          //时间(秒)
+        uint32_t threadId;      //线程id
+        uint32_t fiberId;       //协程id
+        uint32_t elapse;        //累计毫秒数
+        uint16_t loggerId;      //日志器id
+        uint8_t level;          //日志级别
+        uint8_t reserved;
+    };
+
+    //元数据类型
+    enum MetaType {
+        META_SITE = 'S',        //调用点: id, 行号, 文件名, 格式串
+        META_LOGGER = 'L',      //日志器: id, 名称
+        META_THREAD = 'T'       //线程: id, 名称
+    };
+};
+
+
+//输出到二进制环形文件的Appender
+//日志不经过LogFormatter,记录头和编码后的参数直接拷贝到mmap的环形文件中:
+//写入位置在文件头中原子递增,多个线程同时写不加锁;写满后覆盖最旧的记录
+//文件在进程崩溃后仍然完整,启动时上一次的文件改名为 文件名.old 保留
+class BinaryLogAppender : public LogAppender {
+public:
+    typedef std::shared_ptr<BinaryLogAppender> ptr;
+    typedef Mutex MetaMutexType;
+
+    /**
+     * @brief 构造函数
+     * @param[in] filename 环形文件路径,元数据写入filename.meta
+     * @param[in] size 数据区大小,向上取整为2的幂,最小64KB
+     */
+    BinaryLogAppender(const std::string& filename, uint64_t size = 64 * 1024 * 1024);
+
+    //析构函数: 解除映射,关闭文件
+    ~BinaryLogAppender();
+
+    //写入日志
+    void log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override;
+
+    //将日志输出目标的配置转成YAML String
+    std::string toYamlString() override;
+
+    //返回文件路径
+    const std::string& getFilename() const { return m_filename; }
+
+    //返回数据区大小
+    uint64_t getCapacity() const { return m_capacity; }
+
+    //返回累计写入的字节数
+    uint64_t getWritePos() const;
+
+    //返回因为单条日志过大(超过数据区的1/4)而丢弃的条数
+    uint64_t getDropped() const { return m_dropped; }
+
+    //文件是否打开成功
+    bool isOpen() const { return m_header != nullptr; }
+
+    //把映射的数据同步写回文件
+    void flush();
+
+private:
+    //创建并映射文件
+    bool openFile();
+
+    //预留size字节,返回逻辑位置;跨越数据区末尾时把剩余部分填充掉重新预留
+    uint64_t reserve(uint32_t size);
+
+    //在逻辑位置pos写一条长度为size的填充记录
+    void writePadding(uint64_t pos, uint32_t size);
+
+    //调用点、日志器、线程第一次出现时写元数据
+    void writeMeta(const BinLogSite* site, const std::shared_ptr<Logger>& logger
+                   , const LogEvent::ptr& event);
+
+    //id对应的标记,第一次调用返回true;超出范围时返回false(不写元数据)
+    static bool FirstSeen(SegmentArray<std::atomic<bool> >& seen, size_t id);
+
+private:
+    std::string m_filename;    //文件路径
+    uint64_t m_capacity = 0;    //数据区大小
+    uint64_t m_mask = 0;    //数据区大小-1
+    int m_fd = -1;    //环形文件
+    int m_metaFd = -1;    //元数据文件
+    void* m_map = nullptr;    //映射的地址
+    size_t m_mapSize = 0;    //映射的长度
+    BinLogFormat::FileHeader* m_header = nullptr;    //文件头
+    char* m_data = nullptr;    //数据区
+    std::atomic<uint64_t> m_dropped = {0};    //丢弃的条数
+
+    MetaMutexType m_metaMutex;    //元数据文件锁
+    SegmentArray<std::atomic<bool> > m_sites;    //已写入元数据的调用点
+    SegmentArray<std::atomic<bool> > m_loggers;    //已写入元数据的日志器
+    SegmentArray<std::atomic<bool> > m_threads;    //已写入元数据的线程
+};
+
+
+//二进制日志文件的读取,binlog_decode用它把记录还原成LogEvent再用LogFormatter输出
+class BinLogReader : Noncopyable {
+public:
+    typedef std::function<void(LogEvent::ptr event)> Callback;
+
+    //构造函数
+    BinLogReader();
+
+    //析构函数
+    ~BinLogReader();
+
+    /**
+     * @brief 打开环形文件和元数据文件
+     * @return 文件格式正确返回true,错误信息见getError()
+     */
+    bool open(const std::string& filename);
+
+    /**
+     * @brief 按写入顺序遍历数据区中完整的记录
+     * @param[in] cb 回调,事件的日志内容已经还原
+     * @param[in] skip 跳过最前面的条数
+     * @return 遍历到的记录条数(包括跳过的)
+     */
+    uint64_t foreach(Callback cb, uint64_t skip = 0);
+
+    //返回错误信息
+    const std::string& getError() const { return m_error; }
+
+    //返回累计写入的字节数
+    uint64_t getWritePos() const { return m_writePos; }
+
+    //返回数据区大小
+    uint64_t getCapacity() const { return m_capacity; }
+
+    //返回解码时跳过的不完整或无法识别的记录数
+    uint64_t getCorrupted() const { return m_corrupted; }
+
+private:
+    //元数据中的调用点
+    struct Site {
+        int32_t line = 0;
+        std::string file;
+        std::string fmt;
+    };
+
+    //读取元数据文件
+    bool loadMeta(const std::string& filename);
+
+    //逻辑位置pos处是否是一条完整的记录,是则返回记录长度,否则返回0
+    uint32_t check(uint64_t pos, uint64_t limit) const;
+
+    //返回id对应的日志器,元数据中没有时名称为"logger_<id>"
+    std::shared_ptr<Logger> getLogger(uint32_t id);
+
+private:
+    std::string m_error;
+    int m_fd = -1;
+    void* m_map = nullptr;
+    size_t m_mapSize = 0;
+    const char* m_data = nullptr;
+    uint64_t m_capacity = 0;
+    uint64_t m_mask = 0;
+    uint64_t m_writePos = 0;
+    uint64_t m_corrupted = 0;
+    std::map<uint32_t, Site> m_sites;
+    std::map<uint32_t, std::shared_ptr<Logger> > m_loggers;
+    std::map<uint32_t, std::string> m_threads;
+};
+
+}
+
+#endif
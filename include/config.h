@@ -1,6 +1,7 @@
 #ifndef __SYLAR_CONFIG_H__
 #define __SYLAR_CONFIG_H__
 
+#include <atomic>
 #include <memory>
 #include <string>
 #include <sstream>
@@ -288,6 +289,9 @@ public:
 //FromStr: T operator()(const std::string&)
 //ToStr: std::string operator()(const T&)
 //配置参数模板子类,保存对应类型的参数值
+//参数值保存为只读快照(shared_ptr),修改时生成新快照整体替换并增加版本号;
+//每个线程缓存一份快照和它的版本号,读取时版本号没变就直接使用缓存,只有一次原子加载,不加锁;
+//旧快照在所有线程的缓存都换成新快照之后自动释放
 template<class T, class FromStr = LexicalCast<std::string, T>
                 ,class ToStr = LexicalCast<T, std::string> >
 class ConfigVar : public ConfigVarBase {
@@ -295,40 +299,55 @@ public:
     typedef std::shared_ptr<ConfigVar> ptr;
     typedef std::function<void(const T& oldVal, const T& newVal)> on_change_cb;
     typedef RWMutex RWMutexType;
+    typedef Mutex MutexType;
 
     //构造函数，其中name参数名称有效字符为[0-9a-z_.]
     ConfigVar(const std::string& name, const T& val, const std::string& description = "") 
-        :ConfigVarBase(name, description),
-        m_val(val) {
+        :ConfigVarBase(name, description)
+        ,m_val(std::make_shared<T>(val))
+        ,m_version(1)
+        ,m_slot(s_slots.fetch_add(1, std::memory_order_relaxed)) {
     }
 
-    //获取当前参数的值
-    const T& getValue() const { 
-        RWMutexType::ReadLock lock(m_mutex);
-        return m_val; 
+    //获取当前参数的值,版本号没变时无锁
+    //返回的是快照的副本,参数被修改后不受影响;
+    //vector/map/set/string等类型每次调用都要整体复制一次,遍历或查找时用getSnapshot()
+    T getValue() const { 
+        return *getCache().val;
+    }
+
+    //获取当前参数的只读快照,版本号没变时无锁
+    //持有返回的快照期间它一直有效,值较大又需要避免复制时使用
+    std::shared_ptr<const T> getSnapshot() const {
+        return getCache().val;
     }
 
     //设置当前参数的值
+    //多次修改串行执行;回调函数在新值生效前调用,回调中getValue()得到的仍是旧值,
+    //回调中不能再修改同一个参数
     void setValue(const T& val) {
+        MutexType::Lock lock(m_setMutex);
+        std::shared_ptr<const T> old = getSnapshot();
+        if(val == *old) {
+            return;
+        }
         {
             RWMutexType::ReadLock lock(m_mutex);
-            if(val == m_val) {
-                return;
-            }
             for(auto& it : m_cbs) {       //遍历所有的回调函数
-                it.second(m_val, val);
+                it.second(*old, val);
             }
         }
-        RWMutexType::WriteLock lock(m_mutex);
-        m_val = val;
+        std::shared_ptr<const T> snapshot = std::make_shared<T>(val);
+        RWMutexType::WriteLock lock2(m_valMutex);
+        m_val.swap(snapshot);
+        m_version.fetch_add(1, std::memory_order_release);
     }
 
     //将参数的值转成字符串，当转换失败时抛出异常
     std::string toString() override {
         try {
             //return boost::lexical_cast<std::string>(m_val);
-            RWMutexType::ReadLock lock(m_mutex);
-            return ToStr()(m_val);
+            return ToStr()(getValue());
         } 
         catch (boost::bad_lexical_cast& e) {    //lexical_cast无法执行转换操作时会抛出异常bad_lexical_cast
             SYLAR_LOG_ERROR(SYLAR_LOG_ROOT()) << "ConfigVar::toString exception "
@@ -386,11 +405,42 @@ public:
     }
 
 private:
-    T m_val;    //对应类型的参数值
+    //线程缓存的快照
+    struct SnapshotCache {
+        uint64_t version = 0;
+        std::shared_ptr<const T> val;
+    };
+
+    //当前线程中本参数的缓存,版本号变化时先换成最新的快照
+    //返回的引用只能在下一次调用之前使用(期间不能切换协程)
+    SnapshotCache& getCache() const {
+        static thread_local std::vector<SnapshotCache> t_caches;
+        if(m_slot >= t_caches.size()) {
+            t_caches.resize(m_slot + 1);
+        }
+        SnapshotCache& cache = t_caches[m_slot];
+        if(cache.version != m_version.load(std::memory_order_acquire)) {
+            RWMutexType::ReadLock lock(m_valMutex);
+            cache.val = m_val;
+            cache.version = m_version.load(std::memory_order_relaxed);
+        }
+        return cache;
+    }
+
+private:
+    std::shared_ptr<const T> m_val;    //当前参数值的快照,在m_valMutex内读写
+    std::atomic<uint64_t> m_version;    //快照的版本号,每次替换快照后加1
+    size_t m_slot;    //线程缓存中的下标,同类型的参数各不相同
+    static std::atomic<size_t> s_slots;    //已分配的下标数
+    mutable RWMutexType m_valMutex;    //保护m_val
+    MutexType m_setMutex;    //串行化setValue
     std::map<uint64_t, on_change_cb> m_cbs;  //变更回调函数组,key唯一
-    mutable RWMutexType m_mutex;    //读写锁
+    mutable RWMutexType m_mutex;    //回调函数组的读写锁
 };
 
+template<class T, class FromStr, class ToStr>
+std::atomic<size_t> ConfigVar<T, FromStr, ToStr>::s_slots(0);
+
 
 //ConfigVar的管理类，提供便捷的方法创建/访问ConfigVar
 class Config {
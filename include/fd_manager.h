@@ -1,10 +1,12 @@
 #ifndef __SYLAR_FD_MANAGER_H__
 #define __SYLAR_FD_MANAGER_H__
 
+#include <atomic>
 #include <memory>
 #include <vector>
 #include "thread.h"
 #include "singleton.h"
+#include "segment_array.h"
 
 namespace sylar {
 
@@ -14,11 +16,17 @@ namespace sylar {
  *          是否阻塞,是否关闭,读/写超时时间
  */
 class FdCtx : public std::enable_shared_from_this<FdCtx> {
+friend class FdManager;
 public:
     typedef std::shared_ptr<FdCtx> ptr;
 
-    // 通过文件句柄构造FdCtx
-    FdCtx(int fd);
+    /**
+     * @brief 通过文件句柄构造FdCtx
+     * @param[in] fd 文件句柄
+     * @param[in] flags 已知是socket时传入其文件状态标志(如accept4得到的O_NONBLOCK)，
+     *            省去fstat和fcntl(F_GETFL)；-1表示未知，需要查询
+     */
+    FdCtx(int fd, int flags = -1);
 
     // 析构函数
     ~FdCtx();
@@ -60,7 +68,7 @@ public:
 
 private:
     //初始化
-    bool init();
+    bool init(int flags);
 
 private:
     int m_fd;                   // 文件句柄
@@ -71,6 +79,7 @@ private:
     bool m_systemNonblock: 1;   // 是否hook非阻塞(默认非阻塞)
     uint64_t m_recvTimeout;     // 读超时时间(毫秒)
     uint64_t m_sendTimeout;     // 写超时时间(毫秒)
+    FdCtx::ptr m_self;          // 文件句柄集合持有的引用,删除后等到没有线程在读取时才释放
 };
 
 // 文件句柄管理类
@@ -86,16 +95,26 @@ public:
      * @details 如果fd存在则直接获取；若不存在则根据auto_create来选择是否创建
      * @param[in] fd 文件句柄
      * @param[in] auto_create 是否自动创建
+     * @param[in] flags 创建时已知是socket则传入其文件状态标志，-1表示未知(见FdCtx::FdCtx)
      * @return 返回对应文件句柄类FdCtx::ptr
      */
-    FdCtx::ptr getFdCtx(int fd, bool auto_create = false);
+    FdCtx::ptr getFdCtx(int fd, bool auto_create = false, int flags = -1);
 
     // 删除集合中的文件句柄类
     void deleteFdCtx(int fd);
 
 private:
-    RWMutexType m_mutex;               // 读写锁
-    std::vector<FdCtx::ptr> m_datas;   // 文件句柄集合
+    // 释放已经没有线程在读取的FdCtx(需要持有m_retireMutex)
+    void reclaim();
+
+private:
+    // 文件句柄集合，以fd为下标，分段分配且地址不变，
+    // 槽位保存裸指针，读取只需要一次acquire加载，不需要任何锁
+    SegmentArray<std::atomic<FdCtx*> > m_datas;
+    // 保护m_retired
+    Mutex m_retireMutex;
+    // 已从集合中删除、等待释放的FdCtx及删除时的纪元
+    std::vector<std::pair<uint64_t, FdCtx::ptr> > m_retired;
 };
 
 // 文件句柄管理类的单例模式
@@ -5,6 +5,7 @@
 #include <functional>
 #include <ucontext.h>
 #include "log.h"
+#include "fiber_context.h"
 
 namespace sylar {
 
@@ -66,6 +67,17 @@ public:
     //返回协程状态
     State getState() const { return m_state; }
 
+    //返回协程绑定的线程id，-1表示没有绑定
+    int getPinThread() const { return m_pinThread; }
+
+    /**
+     * @brief 把协程绑定到线程上
+     * @details 绑定后协程等待IO、定时器或YieldToReady之后都会回到该线程恢复，
+     *          只有明确要求本线程处理到底的任务(如reuseport模式下的accept和新连接)才应该绑定
+     * @param[in] thread 线程id，-1表示取消绑定
+     */
+    void setPinThread(int thread) { m_pinThread = thread; }
+
 public:
     //设置当前线程的运行协程
     static void SetThis(Fiber* f);
@@ -82,6 +94,19 @@ public:
     //返回当前协程的总数量
     static uint64_t TotalFibers();
 
+    //协程栈池统计信息
+    struct StackStats {
+        uint64_t inUse;       //正在使用的栈数量
+        uint64_t highWater;   //同时使用的栈数量的最高值
+        uint64_t cached;      //所有线程栈池中缓存的栈数量
+        uint64_t mmaps;       //通过mmap新分配栈的次数
+        uint64_t reused;      //从栈池复用栈的次数
+        uint64_t guarded;     //带保护页的栈数量
+    };
+
+    //返回协程栈池的统计信息
+    static StackStats GetStackStats();
+
     //协程执行函数
     static void MainFunc();
 
@@ -91,14 +116,22 @@ public:
     //获取当前协程id
     static uint64_t GetFiberId();
 
+    //返回当前协程绑定的线程id，没有协程或者没有绑定时返回-1
+    static int GetPinThread();
+
 private:
     uint64_t m_id = 0;            //协程id
     uint32_t m_stacksize = 0;     //协程运行栈大小
     State m_state = INIT;         //协程状态
     std::function<void()> m_cb;   //协程运行函数
+#ifdef SYLAR_FIBER_ASM_CONTEXT
+    void* m_ctx = nullptr;        //协程上下文(切换出去时保存的栈顶指针)
+#else
     ucontext_t m_ctx;             //协程上下文
+#endif
     void* m_stack = nullptr;      //协程运行栈指针
     bool m_runInScheduler = true; //记录该协程是否通过调度器来运行
+    int m_pinThread = -1;         //协程绑定的线程id，-1表示可以在任意线程恢复
 
 };
 
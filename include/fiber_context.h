@@ -0,0 +1,47 @@
+#ifndef __SYLAR_FIBER_CONTEXT_H__
+#define __SYLAR_FIBER_CONTEXT_H__
+
+#include <stddef.h>
+
+/**
+ * @brief 协程上下文切换后端
+ * @details 默认在x86-64和aarch64上使用汇编实现的上下文切换，只保存callee-saved寄存器，
+ *          不像swapcontext那样每次切换都要调用rt_sigprocmask系统调用保存信号掩码
+ *          编译时定义 SYLAR_FIBER_UCONTEXT (cmake -DFIBER_UCONTEXT=ON) 则回退到ucontext实现
+ */
+#if !defined(SYLAR_FIBER_UCONTEXT) && (defined(__x86_64__) || defined(__aarch64__))
+#   define SYLAR_FIBER_ASM_CONTEXT 1
+#endif
+
+#ifdef SYLAR_FIBER_ASM_CONTEXT
+
+extern "C" {
+
+/**
+ * @brief 切换协程上下文
+ * @details 将当前callee-saved寄存器压入当前栈，把栈顶指针保存到*from_sp，
+ *          然后切换到to_sp指向的栈并恢复寄存器
+ * @param[out] from_sp 保存当前上下文的栈顶指针
+ * @param[in] to_sp 要切换到的上下文的栈顶指针
+ */
+void sylar_swap_context(void** from_sp, void* to_sp);
+
+}
+
+namespace sylar {
+
+/**
+ * @brief 在栈上构造一个初始上下文
+ * @details 第一次切换到该上下文时从fn开始执行，fn不能返回
+ * @param[in] stack 栈内存起始地址
+ * @param[in] size 栈大小
+ * @param[in] fn 入口函数
+ * @return 可以传给sylar_swap_context的栈顶指针
+ */
+void* MakeFiberContext(void* stack, size_t size, void (*fn)());
+
+}
+
+#endif
+
+#endif
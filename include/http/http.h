@@ -5,7 +5,7 @@
 #include <map>
 #include <vector>
 #include <string.h>
-#include <boost/lexical_cast.hpp>
+#include "http_headers.h"
 
 namespace sylar {
 namespace http {
@@ -191,11 +191,10 @@ T GetMapValue(const MapType& m, const std::string& key, T def = T()) {
     if(it == m.end()) {
         return def;
     }
-    try {
-        // it->second为string类型，可以通过lexical_cast转换为int、float、double类型等
-        return boost::lexical_cast<T>(it->second);
-    }
-    catch(...) {
+    // 整数、浮点数直接解析，不抛异常也不分配内存
+    T value;
+    if(ConvertValue(it->second.c_str(), it->second.size(), value)) {
+        return value;
     }
     return def;
 }
@@ -212,19 +211,11 @@ T GetMapValue(const MapType& m, const std::string& key, T def = T()) {
 template<class MapType, class T>
 bool CheckGetMapValue(const MapType& m, const std::string& key, T& value, T def = T()) {
     auto it = m.find(key);
-    if(it == m.end()) {
+    if(it == m.end() || !ConvertValue(it->second.c_str(), it->second.size(), value)) {
         value = def;
         return false;
     }
-    try {
-        // it->second为string类型，可以通过lexical_cast转换为int、float、double类型等
-        value = boost::lexical_cast<T>(it->second);
-        return true;
-    }
-    catch(...) {
-        value = def;
-    }
-    return false;
+    return true;
 }
 
 
@@ -260,19 +251,19 @@ public:
     bool isClose() const { return m_close; }
     
     // 获取HTTP请求路径
-    const std::string& getPath() const { return m_path; }
+    const std::string& getPath() const { InitSlice(m_pathSlice, m_path); return m_path; }
 
     // 获取HTTP请求参数
-    const std::string& getQuery() const { return m_query; }
+    const std::string& getQuery() const { InitSlice(m_querySlice, m_query); return m_query; }
 
     // 获取片段标识符
-    const std::string& getFragment() const { return m_fragment; }
+    const std::string& getFragment() const { InitSlice(m_fragmentSlice, m_fragment); return m_fragment; }
 
     // 获取HTTP请求消息体
-    const std::string& getBody() const { return m_body; }
+    const std::string& getBody() const { InitSlice(m_bodySlice, m_body); return m_body; }
 
-    // 获取HTTP请求头部 map
-    const MapType& getHeaders() const { return m_headers; }
+    // 获取HTTP请求头部
+    const HttpHeaders& getHeaders() const { return m_headers; }
 
     // 获取HTTP请求参数 map
     const MapType& getParams() const { return m_params; }
@@ -293,19 +284,57 @@ public:
     void setClose(bool v) { m_close = v; }
 
     // 设置HTTP请求路径
-    void setPath(const std::string& path) { m_path = path; }
+    void setPath(const std::string& path) { m_pathSlice = StringSlice(); m_path = path; }
 
     // 设置HTTP请求参数
-    void setQuery(const std::string& query) { m_query = query; }
+    void setQuery(const std::string& query) { m_querySlice = StringSlice(); m_query = query; }
 
     // 设置片段标识符
-    void setFragment(const std::string& fragment) { m_fragment = fragment; }
+    void setFragment(const std::string& fragment) { m_fragmentSlice = StringSlice(); m_fragment = fragment; }
 
     // 设置HTTP请求消息体
-    void setBody(const std::string& body) { m_body = body; }
+    void setBody(const std::string& body) { m_bodySlice = StringSlice(); m_body = body; }
 
-    // 设置HTTP请求头部 map
-    void setHeaders(const MapType& headers) { m_headers = headers; }
+    // 设置HTTP请求消息体，接管body的内存
+    void setBody(std::string&& body) { m_bodySlice = StringSlice(); m_body = std::move(body); }
+
+    // 设置HTTP请求头部
+    void setHeaders(const HttpHeaders& headers) { m_headers = headers; }
+
+    // 用map设置HTTP请求头部
+    void setHeaders(const MapType& headers);
+
+    /**
+     * @brief 零拷贝解析: 以下片段直接指向接收缓存，第一次通过get接口访问时才拷贝成std::string
+     * @attention 缓存被复用前必须调用detachBuffer()，由HttpSession负责
+     */
+    void setPathSlice(const char* data, size_t len) { m_pathSlice = StringSlice(data, len); }
+    void setQuerySlice(const char* data, size_t len) { m_querySlice = StringSlice(data, len); }
+    void setFragmentSlice(const char* data, size_t len) { m_fragmentSlice = StringSlice(data, len); }
+    void setBodySlice(const char* data, size_t len) { m_bodySlice = StringSlice(data, len); }
+
+    // 零拷贝解析: 追加一个指向接收缓存的头部
+    void addHeaderSlice(const char* key, size_t klen, const char* val, size_t vlen) {
+        m_headers.addRef(key, klen, val, vlen);
+    }
+
+    // 追加一个头部(拷贝)，同名头部以最后一个为准
+    void addHeader(const char* key, size_t klen, const char* val, size_t vlen) {
+        m_headers.add(key, klen, val, vlen);
+    }
+
+    /**
+     * @brief 根据key值获取HTTP请求头部的value值，不拷贝
+     * @return 返回的片段在头部被修改或缓存被复用前有效，不存在返回空片段
+     */
+    StringSlice getHeaderSlice(const std::string& key) const { return m_headers.get(key); }
+    StringSlice getHeaderSlice(HttpHeaderId id) const { return m_headers.get(id); }
+
+    // 是否还有片段指向接收缓存
+    bool isBufferAttached() const;
+
+    // 把所有指向接收缓存的片段拷贝成std::string，之后请求不再依赖接收缓存
+    void detachBuffer();
 
     // 设置HTTP请求参数 map
     void setParams(const MapType& params) { m_params = params; }
@@ -314,10 +343,11 @@ public:
     void setCookies(const MapType& cookies) { m_cookies = cookies; }
 
     /**
-     * @brief 根据key值获取HTTP请求头部的value值
+     * @brief 根据key值获取HTTP请求头部的value值(拷贝)
      * @return 若存在返回value值，若不存在返回默认值def
+     * @attention 头部值不再以std::string保存，只读比较时用getHeaderSlice避免拷贝
     */
-    const std::string& getHeader(const std::string& key, const std::string& def = "") const;
+    std::string getHeader(const std::string& key, const std::string& def = "") const;
 
     /**
      * @brief 根据key值获取HTTP请求参数的value值
@@ -392,8 +422,16 @@ public:
      * @return 返回转换成功后的值，若转换失败返回默认值
     */
     template<class T>
-    T getHeaderValue(const std::string& key, T def = T()) {
-        return GetMapValue<MapType, T>(m_headers, key, def);
+    T getHeaderValue(const std::string& key, T def = T()) const {
+        T value;
+        return m_headers.getAs(key, value) ? value : def;
+    }
+
+    // 获取预置HTTP请求头部的value，并转换为T类型值
+    template<class T>
+    T getHeaderValue(HttpHeaderId id, T def = T()) const {
+        T value;
+        return m_headers.getAs(id, value) ? value : def;
     }
 
     /**
@@ -405,8 +443,12 @@ public:
      *         返回false: 不存在或者转换失败，value = def
     */
     template<class T>
-    bool checkGetHeaderValue(const std::string& key, T& value, T def = T()) {
-        return CheckGetMapValue<MapType, T>(m_headers, key, value, def);
+    bool checkGetHeaderValue(const std::string& key, T& value, T def = T()) const {
+        if(m_headers.getAs(key, value)) {
+            return true;
+        }
+        value = def;
+        return false;
     }
 
     /**
@@ -463,19 +505,34 @@ public:
     // 字符串方式输出HTTP请求所有信息
     std::string toString() const;
 
+private:
+    // 片段还指向接收缓存时，拷贝到str并清空片段
+    static void InitSlice(StringSlice& slice, std::string& str) {
+        if(slice.data) {
+            str.assign(slice.data, slice.size);
+            slice = StringSlice();
+        }
+    }
+
 private:
     HttpMethod m_method;        // HTTP请求方法
     uint8_t m_version;          // HTTP版本号
     bool m_websocket;           // 是否为websocket
     bool m_close;               // 是否已关闭
-    std::string m_path;         // 请求路径
-    std::string m_query;        // 请求参数
-    std::string m_fragment;     // 片段标识符
-    std::string m_body;         // 请求消息体
-    MapType m_headers;          // 请求头部 map
+    // 零拷贝解析时下面的std::string在第一次访问时才从对应片段拷贝，所以声明为mutable
+    mutable std::string m_path;         // 请求路径
+    mutable std::string m_query;        // 请求参数
+    mutable std::string m_fragment;     // 片段标识符
+    mutable std::string m_body;         // 请求消息体
+    HttpHeaders m_headers;      // 请求头部
     MapType m_params;           // 请求参数 map
     MapType m_cookies;          // 请求Cookie map
 
+    mutable StringSlice m_pathSlice;      // 请求路径片段
+    mutable StringSlice m_querySlice;     // 请求参数片段
+    mutable StringSlice m_fragmentSlice;  // 片段标识符片段
+    mutable StringSlice m_bodySlice;      // 请求消息体片段
+
     /**
      * @brief URL:http://www.aspxfans.com:8080/news/index.asp?boardID=5&ID=24618&page=1#name
      * @param[http]                       协议
@@ -534,12 +591,18 @@ public:
     // 获取HTTP响应消息体
     const std::string& getBody() const { return m_body; }
 
-    // 获取HTTP响应头部map
-    const MapType& getHeaders() const { return m_headers; }
+    // 获取HTTP响应头部
+    const HttpHeaders& getHeaders() const { return m_headers; }
 
     // 获取HTTP响应Cookie
     const std::vector<std::string>& getCookies() { return m_cookies; }
 
+    // 是否已经由HttpResponseWriter流式发送
+    bool isStreaming() const { return m_streaming; }
+
+    // 设置是否已经流式发送，设置后HttpServer不再发送该响应
+    void setStreaming(bool v) { m_streaming = v; }
+
     // 设置HTTP响应状态
     void setStatus(HttpStatus s) { m_status = s; }
 
@@ -558,23 +621,63 @@ public:
     // 设置HTTP响应消息体
     void setBody(const std::string& body) { m_body = body; }
 
-    // 设置HTTP响应头部map
-    void setHeaders(const MapType& headers) { m_headers = headers; }
+    // 设置HTTP响应消息体，接管body的内存，避免拷贝大的消息体
+    void setBody(std::string&& body) { m_body = std::move(body); }
+
+    /**
+     * @brief 设置文件消息体
+     * @details 发送时在头部之后用sendfile从文件fd的offset处发送length字节，数据不经过用户态内存；
+     *          没有设置Content-Length时自动添加。holder在响应发送完之前保持fd有效(例如打开文件缓存中的项)
+     */
+    void setFileBody(int fd, off_t offset, size_t length, std::shared_ptr<void> holder = nullptr);
+
+    // 是否有文件消息体
+    bool hasFileBody() const { return m_fileFd >= 0; }
+
+    // 文件消息体的文件句柄，没有返回-1
+    int getFileFd() const { return m_fileFd; }
+
+    // 文件消息体在文件中的开始位置
+    off_t getFileOffset() const { return m_fileOffset; }
+
+    // 文件消息体的长度
+    size_t getFileLength() const { return m_fileLength; }
+
+    // 设置HTTP响应头部
+    void setHeaders(const HttpHeaders& headers) { m_headers = headers; }
+
+    // 用map设置HTTP响应头部
+    void setHeaders(const MapType& headers);
 
     // 设置HTTP响应Cookie
     void setCookies(const std::vector<std::string>& cookies) { m_cookies = cookies; }
 
     /**
-     * @brief 根据key值获取HTTP响应头部的value值
+     * @brief 根据key值获取HTTP响应头部的value值(拷贝)
      * @return 若存在返回value值，若不存在返回默认值def
     */
-    const std::string& getHeader(const std::string& key, const std::string& def = "") const;
+    std::string getHeader(const std::string& key, const std::string& def = "") const;
+
+    /**
+     * @brief 根据key值获取HTTP响应头部的value值，不拷贝
+     * @return 返回的片段在头部被修改前有效，不存在返回空片段
+     */
+    StringSlice getHeaderSlice(const std::string& key) const { return m_headers.get(key); }
+    StringSlice getHeaderSlice(HttpHeaderId id) const { return m_headers.get(id); }
 
     /**
      * @brief 根据key值设置HTTP响应头部的value值
     */
     void setHeader(const std::string& key, const std::string& value);
 
+    // 设置预置的HTTP响应头部，名称不需要查找
+    void setHeader(HttpHeaderId id, const std::string& value) { m_headers.set(id, value.c_str(), value.size()); }
+
+    // 追加一个头部(拷贝)，不替换同名头部，用于Set-Cookie等可以重复的头部
+    void addHeader(const char* key, size_t klen, const char* val, size_t vlen) {
+        m_headers.add(key, klen, val, vlen);
+    }
+
     /**
      * @brief 根据key值删除HTTP响应头部的value值
     */
@@ -595,8 +698,16 @@ public:
      * @return 返回转换成功后的值，若转换失败返回默认值
     */
     template<class T>
-    T getHeaderValue(const std::string& key, T def = T()) {
-        return GetMapValue<MapType, T>(m_headers, key, def);
+    T getHeaderValue(const std::string& key, T def = T()) const {
+        T value;
+        return m_headers.getAs(key, value) ? value : def;
+    }
+
+    // 获取预置HTTP响应头部的value，并转换为T类型值
+    template<class T>
+    T getHeaderValue(HttpHeaderId id, T def = T()) const {
+        T value;
+        return m_headers.getAs(id, value) ? value : def;
     }
 
     /**
@@ -608,8 +719,12 @@ public:
      *         返回false: 不存在或者转换失败，value = def
     */
     template<class T>
-    bool checkGetHeaderValue(const std::string& key, T& value, T def = T()) {
-        return CheckGetMapValue<MapType, T>(m_headers, key, value, def);
+    bool checkGetHeaderValue(const std::string& key, T& value, T def = T()) const {
+        if(m_headers.getAs(key, value)) {
+            return true;
+        }
+        value = def;
+        return false;
     }
 
     // 可读性输出HTTP请求所有信息
@@ -618,15 +733,26 @@ public:
     // 字符串方式输出HTTP请求所有信息
     std::string toString();
 
+    /**
+     * @brief 把状态行和头部(包括结尾的空行)追加到out，不包含消息体
+     * @details 与dump输出的头部一致，发送时头部和getBody()用一次writev发出，消息体不会被拷贝
+     */
+    void dumpHeader(std::string& out) const;
+
 private:
     HttpStatus m_status;                // HTTP响应状态
     uint8_t m_version;                  // HTTP版本号
     bool m_websocket;                   // 是否为websocket
     bool m_close;                       // 是否已关闭
+    bool m_streaming;                   // 是否已经流式发送
     std::string m_reason;               // 响应状态的原因
     std::string m_body;                 // 响应消息体
-    MapType m_headers;                  // 响应头部map
+    HttpHeaders m_headers;              // 响应头部
     std::vector<std::string> m_cookies; // 响应Cookie
+    int m_fileFd;                       // 文件消息体的文件句柄，-1表示没有
+    off_t m_fileOffset;                 // 文件消息体在文件中的开始位置
+    size_t m_fileLength;                // 文件消息体的长度
+    std::shared_ptr<void> m_fileHolder; // 保持文件句柄有效的对象
     
     /**
      * @example response
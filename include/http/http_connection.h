@@ -6,7 +6,11 @@
 #include "socket_stream.h"
 #include "uri.h"
 #include <list>
+#include <vector>
 #include "thread.h"
+#include "fiber.h"
+#include "scheduler.h"
+#include "timer.h"
 
 namespace sylar {
 namespace http {
@@ -34,7 +38,8 @@ struct HttpResult {
         SEND_SOCKET_ERROR = 6,      /// 发送请求产生Socket错误
         TIMEOUT = 7,                /// 超时
         POOL_GET_CONNECTION = 8,    /// 从连接池中取连接失败
-        POOL_INVALID_CONNECTION = 9 /// 无效的连接
+        POOL_INVALID_CONNECTION = 9,/// 无效的连接
+        CLOSE_BY_PEER = 10          /// 管线中排在后面的请求，连接已被对端关闭
     };  
 
     /**
@@ -61,6 +66,56 @@ struct HttpResult {
     std::string description;    // 状态描述
 };
 
+/**
+ * @brief 异步HTTP请求的结果
+ * @details 结果只设置一次，设置后依次唤醒等待者，再执行回调
+ *          协程中调用get()时挂起当前协程，不占用线程；非调度线程中调用时阻塞线程
+ *          同时向多个连接池发出请求后依次get()，总耗时取决于最慢的那个请求
+ */
+class HttpFuture {
+public:
+    typedef std::shared_ptr<HttpFuture> ptr;
+    typedef std::function<void(HttpResult::ptr)> Callback;
+    typedef Mutex MutexType;
+
+    /**
+     * @brief 构造函数
+     * @param[in] cb 结果回调，在设置结果的协程中执行，不要在回调里长时间阻塞
+     */
+    HttpFuture(Callback cb = nullptr);
+
+    /**
+     * @brief 等待并返回结果
+     */
+    HttpResult::ptr get();
+
+    /**
+     * @brief 是否已经有结果
+     */
+    bool isDone();
+
+    /**
+     * @brief 设置结果，只有第一次生效
+     */
+    void setResult(HttpResult::ptr result);
+
+private:
+    /**
+     * @brief 等待结果的协程或线程
+     */
+    struct Waiter {
+        Scheduler* scheduler;   // 协程所属的调度器
+        Fiber::ptr fiber;       // 等待的协程
+        int thread;             // 协程所在的线程，唤醒时放回该线程，避免协程还没让出就被别的线程执行
+        Semaphore* sem;         // 非调度线程等待用的信号量
+    };
+
+    MutexType m_mutex;
+    HttpResult::ptr m_result;           // 结果
+    Callback m_cb;                      // 结果回调
+    std::vector<Waiter> m_waiters;      // 等待者
+};
+
 class HttpConnectionPool;
 
 /**
@@ -194,21 +249,49 @@ public:
      *         <0 Socket异常
      */
     ssize_t sendHttpRequest(HttpRequest::ptr request);
+
+    /**
+     * @brief 读数据，先返回接收响应时多读的数据
+     * @details 例如WebSocket握手响应后面紧跟着的数据帧
+     */
+    ssize_t read(void* buff, size_t length) override;
+    ssize_t read(ByteArray::ptr buff, size_t length) override;
     
 private:
     uint64_t m_createTime = 0;  // 该连接的创建时间
     uint64_t m_request = 0;     // 该连接的请求次数(使用次数)
+    std::string m_pending;      // 读多的数据，即下一个响应的开头(管线化时多个响应连在一起到达)
 };
 
 /**
  * @brief HTTPConnection连接池
  * @details 该连接池中存放着许多Keep-Alive到固定域名的HTTPConnection
+ *          空闲连接优先放在当前线程的缓存里，取放都是原子交换，不加锁；线程缓存满了再放入共享的m_pool
+ *          过期的空闲连接由IOManager定时器定期回收，不必等到下次取连接时才发现
  */
-class HttpConnectionPool {
+class HttpConnectionPool : public std::enable_shared_from_this<HttpConnectionPool> {
 public:
     typedef std::shared_ptr<HttpConnectionPool> ptr;
     typedef Mutex MutexType;
 
+    /**
+     * @brief 连接池统计数据
+     */
+    struct Stats {
+        uint64_t hits = 0;          // 取到空闲连接的次数
+        uint64_t misses = 0;        // 没有空闲连接的次数
+        uint64_t connects = 0;      // 新建连接成功的次数
+        uint64_t connectFails = 0;  // 新建连接失败的次数
+        uint64_t evictions = 0;     // 因断开、过期、达到最大请求次数或超出容量而释放的连接数
+        uint32_t total = 0;         // 当前的连接数(包括正在使用的)
+        uint32_t idle = 0;          // 当前的空闲连接数
+
+        /**
+         * @brief 可读性输出
+         */
+        std::string toString() const;
+    };
+
     /**
      * @brief 创建一个HTTPConnection连接池
      * @param[in] uri 请求的字符串uri
@@ -240,6 +323,31 @@ public:
                     uint32_t maxAliveTime,
                     uint32_t maxRequest);
 
+    /**
+     * @brief 析构函数，释放所有空闲连接
+     * @details 借出的连接放回时仍会访问连接池，析构前必须全部放回
+     */
+    ~HttpConnectionPool();
+
+    /**
+     * @brief 在当前IOManager上启动定时回收过期的空闲连接
+     * @details CreateConnectionPool在IOManager中调用时会自动启动；
+     *          定时器通过weak_ptr引用连接池，所以连接池必须由shared_ptr管理
+     * @param[in] interval_ms 回收间隔(毫秒)，0表示使用配置http.client.reap_interval
+     * @return 不在IOManager中、已经启动或者连接池不是由shared_ptr管理时返回false
+     */
+    bool startReaper(uint64_t interval_ms = 0);
+
+    /**
+     * @brief 回收所有线程缓存和共享列表中失效的空闲连接，以及不再使用的管线化连接
+     */
+    void reap();
+
+    /**
+     * @brief 获取统计数据
+     */
+    Stats getStats() const;
+
     /**
     * @brief 从连接池中拿连接，如果没有则创建新连接
     * @param[in] timeout_ms 超时时间(毫秒)
@@ -338,7 +446,66 @@ public:
     HttpResult::ptr doRequest(HttpRequest::ptr request
                             ,uint64_t timeout_ms);
 
+    /**
+     * @brief 异步发送HTTP请求
+     * @details 请求放入管线化连接的发送队列后立即返回，不需要每个请求一个协程
+     *          每个管线化连接有一个发送协程和一个接收协程，请求连续发送，响应按发送顺序对应到请求
+     *          优先选择在途请求最少的连接，都达到管线深度并且连接数未达到m_maxSize时新建连接
+     *          连接出错时该连接上所有在途的请求都返回失败，不会重发
+     *          必须在IOManager中调用，否则退化为同步的doRequest
+     * @param[in] method 请求类型
+     * @param[in] uri 请求的字符串uri
+     * @param[in] timeout_ms 超时时间(毫秒)
+     * @param[in] headers HTTP请求头部参数
+     * @param[in] body 请求消息体
+     * @param[in] cb 结果回调，可以为空
+     * @return 返回异步结果
+     */
+    HttpFuture::ptr doRequestAsync(HttpMethod method
+                            ,const std::string& uri
+                            ,uint64_t timeout_ms
+                            ,const HttpRequest::MapType& headers = {}
+                            ,const std::string& body = ""
+                            ,HttpFuture::Callback cb = nullptr);
+
+    /**
+     * @brief 异步发送HTTP请求
+     * @param[in] req HTTP请求结构体
+     * @param[in] timeout_ms 超时时间(毫秒)
+     * @param[in] cb 结果回调，可以为空
+     * @return 返回异步结果
+     */
+    HttpFuture::ptr doRequestAsync(HttpRequest::ptr request
+                            ,uint64_t timeout_ms
+                            ,HttpFuture::Callback cb = nullptr);
+
+    /**
+     * @brief 设置每个连接的管线深度(在途请求数)
+     */
+    void setMaxPipeline(uint32_t v) { m_maxPipeline = v ? v : 1; }
+
+    /**
+     * @brief 返回每个连接的管线深度
+     */
+    uint32_t getMaxPipeline() const { return m_maxPipeline; }
+
 private:
+    class Pipeline;
+
+    /**
+     * @brief 创建请求，填充Host和Keep-Alive
+     */
+    HttpRequest::ptr createRequest(HttpMethod method
+                            ,const std::string& uri
+                            ,const HttpRequest::MapType& headers
+                            ,const std::string& body);
+
+    /**
+     * @brief 解析地址并建立连接
+     * @return 失败返回nullptr
+     */
+    static HttpConnection* Connect(const std::string& host, uint32_t port, uint64_t timeout_ms);
+
     /**
     * @brief 处理用完之后的连接
     * @details 如果该连接已失效则直接删掉，如果还可以继续用就放回连接池
@@ -347,7 +514,26 @@ private:
     */
     static void ReleasePtr(HttpConnection* ptr, HttpConnectionPool* pool);
 
+    /**
+     * @brief 空闲连接是否还能继续使用
+     */
+    bool isValid(HttpConnection* ptr, uint64_t now) const;
+
+    /**
+     * @brief 释放连接并计数
+     */
+    void evict(HttpConnection* ptr);
+
+    /**
+     * @brief 当前线程的连接缓存，线程序号(GetThreadIndex)不小于MAX_THREAD_CACHES时返回nullptr
+     */
+    struct ThreadCache;
+    ThreadCache* getThreadCache();
+
 private:
+    // 最多为多少个同时存活的线程建立连接缓存，其余线程只使用共享的m_pool
+    static const size_t MAX_THREAD_CACHES = 64;
+
     std::string m_host;         // 该连接池连接到的固定域名
     std::string m_vhost;        // 固定域名
     uint32_t m_port;            // 端口号
@@ -355,9 +541,19 @@ private:
     uint32_t m_maxAliveTime;    // 连接池中连接的最大存活时间
     uint32_t m_maxRequest;      // 连接池中连接的最大请求次数
 
-    MutexType m_mutex;
+    mutable MutexType m_mutex;
     std::list<HttpConnection*> m_pool;      // 连接池
     std::atomic<uint32_t> m_total = {0};    // 连接池数量
+    uint32_t m_maxPipeline;                 // 每个管线化连接的最大在途请求数
+    std::vector<std::shared_ptr<Pipeline> > m_pipelines;    // 管线化连接，doRequestAsync使用
+    std::atomic<ThreadCache*> m_caches[MAX_THREAD_CACHES];  // 线程缓存，由线程第一次放回连接时创建
+    Timer::ptr m_reapTimer;                 // 回收定时器
+
+    std::atomic<uint64_t> m_hits = {0};
+    std::atomic<uint64_t> m_misses = {0};
+    std::atomic<uint64_t> m_connects = {0};
+    std::atomic<uint64_t> m_connectFails = {0};
+    std::atomic<uint64_t> m_evictions = {0};
 
     // m_maxSize并不是绝对的连接池最大数量，如果当前连接数已经达到m_maxSize，又有新的连接要用，则还是要继续创建
     // 只不过当连接用完放回去的时候，如果连接池达到m_maxSize，则直接释放掉该连接，相当于短连接
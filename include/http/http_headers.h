@@ -0,0 +1,364 @@
+#ifndef __SYLAR_HTTP_HEADERS_H__
+#define __SYLAR_HTTP_HEADERS_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <type_traits>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <boost/lexical_cast.hpp>
+
+namespace sylar {
+namespace http {
+
+/* Well-known Headers */
+#define HTTP_HEADER_MAP(XX)                                 \
+  XX(ACCEPT,                Accept)                         \
+  XX(ACCEPT_ENCODING,       Accept-Encoding)                \
+  XX(ACCEPT_LANGUAGE,       Accept-Language)                \
+  XX(ACCEPT_RANGES,         Accept-Ranges)                  \
+  XX(AUTHORIZATION,         Authorization)                  \
+  XX(CACHE_CONTROL,         Cache-Control)                  \
+  XX(CONNECTION,            Connection)                     \
+  XX(CONTENT_ENCODING,      Content-Encoding)               \
+  XX(CONTENT_LENGTH,        Content-Length)                 \
+  XX(CONTENT_RANGE,         Content-Range)                  \
+  XX(CONTENT_TYPE,          Content-Type)                   \
+  XX(COOKIE,                Cookie)                         \
+  XX(DATE,                  Date)                           \
+  XX(ETAG,                  ETag)                           \
+  XX(EXPECT,                Expect)                         \
+  XX(HOST,                  Host)                           \
+  XX(IF_MODIFIED_SINCE,     If-Modified-Since)              \
+  XX(IF_NONE_MATCH,         If-None-Match)                  \
+  XX(IF_RANGE,              If-Range)                       \
+  XX(KEEP_ALIVE,            Keep-Alive)                     \
+  XX(LAST_MODIFIED,         Last-Modified)                  \
+  XX(LOCATION,              Location)                       \
+  XX(ORIGIN,                Origin)                         \
+  XX(PRAGMA,                Pragma)                         \
+  XX(RANGE,                 Range)                          \
+  XX(REFERER,               Referer)                        \
+  XX(SEC_WEBSOCKET_ACCEPT,  Sec-WebSocket-Accept)           \
+  XX(SEC_WEBSOCKET_KEY,     Sec-WebSocket-Key)              \
+  XX(SEC_WEBSOCKET_VERSION, Sec-WebSocket-Version)          \
+  XX(SERVER,                Server)                         \
+  XX(SET_COOKIE,            Set-Cookie)                     \
+  XX(TRANSFER_ENCODING,     Transfer-Encoding)              \
+  XX(UPGRADE,               Upgrade)                        \
+  XX(USER_AGENT,            User-Agent)                     \
+  XX(X_FORWARDED_FOR,       X-Forwarded-For)                \
+  XX(X_REAL_IP,             X-Real-IP)                      \
+
+/**
+ * @brief 预置的常用头部名称枚举
+ * @details 头部名称是这些之一时只保存编号，比较时比较编号，不需要逐字符忽略大小写比较
+ */
+enum class HttpHeaderId : int16_t {
+#define XX(name, string) name,
+    HTTP_HEADER_MAP(XX)
+#undef XX
+    UNKNOWN
+};
+
+/**
+ * @brief 忽略大小写查找预置的头部名称
+ * @return 不是预置的头部返回HttpHeaderId::UNKNOWN
+ */
+HttpHeaderId StringToHttpHeaderId(const char* name, size_t len);
+
+/**
+ * @brief 返回预置头部的规范名称，UNKNOWN返回空串
+ */
+const char* HttpHeaderIdToString(HttpHeaderId id);
+
+
+/**
+ * @brief 指向外部缓存的字符串片段(类似C++17的std::string_view)
+ * @details 不拥有数据，指向的缓存被覆盖或释放后失效
+ */
+struct StringSlice {
+    const char* data;   // 起始地址
+    size_t size;        // 长度
+
+    StringSlice() : data(nullptr), size(0) {}
+    StringSlice(const char* d, size_t len) : data(d), size(len) {}
+
+    // 是否为空
+    bool empty() const { return size == 0; }
+
+    // 转成std::string(拷贝)
+    std::string toString() const { return data ? std::string(data, size) : std::string(); }
+
+    // 忽略大小写与str比较是否相等
+    bool equalsIgnoreCase(const char* str, size_t len) const {
+        return size == len && strncasecmp(data, str, len) == 0;
+    }
+};
+
+
+/**
+ * @brief 把[data, data + len)转换为T类型的值，不分配内存
+ * @details 整数和浮点数直接在原数据上解析，前后的空白被忽略；其他类型退回boost::lexical_cast
+ * @return 数据格式不对或者溢出返回false，value不变
+ */
+template<class T>
+typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, bool>::type
+ConvertValue(const char* data, size_t len, T& value) {
+    const char* p = data;
+    const char* end = data + len;
+    while(p < end && (*p == ' ' || *p == '\t')) {
+        ++p;
+    }
+    while(end > p && (end[-1] == ' ' || end[-1] == '\t')) {
+        --end;
+    }
+    bool neg = false;
+    if(p < end && (*p == '-' || *p == '+')) {
+        neg = *p == '-';
+        ++p;
+    }
+    if(p == end || (neg && !std::is_signed<T>::value)) {
+        return false;
+    }
+    typedef typename std::make_unsigned<T>::type UT;
+    // 允许的最大绝对值，负数比正数多1
+    UT limit = std::is_signed<T>::value ? (UT)((UT)(-1) >> 1) + (neg ? 1 : 0) : (UT)(-1);
+    UT v = 0;
+    for(; p < end; ++p) {
+        if(*p < '0' || *p > '9') {
+            return false;
+        }
+        UT d = *p - '0';
+        if(v > (limit - d) / 10) {
+            return false;
+        }
+        v = v * 10 + d;
+    }
+    value = neg ? (T)(0 - v) : (T)v;
+    return true;
+}
+
+/**
+ * @brief 把[data, data + len)转换为bool，接受0/1/true/false(忽略大小写)
+ */
+inline bool ConvertValue(const char* data, size_t len, bool& value) {
+    if((len == 1 && *data == '1') || (len == 4 && strncasecmp(data, "true", 4) == 0)) {
+        value = true;
+        return true;
+    }
+    if((len == 1 && *data == '0') || (len == 5 && strncasecmp(data, "false", 5) == 0)) {
+        value = false;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief 把[data, data + len)转换为浮点数，数据拷贝到栈上以补'\0'
+ */
+template<class T>
+typename std::enable_if<std::is_floating_point<T>::value, bool>::type
+ConvertValue(const char* data, size_t len, T& value) {
+    char buf[64];
+    if(len == 0 || len >= sizeof(buf)) {
+        return false;
+    }
+    memcpy(buf, data, len);
+    buf[len] = '\0';
+    char* end = nullptr;
+    long double v = strtold(buf, &end);
+    while(*end == ' ' || *end == '\t') {
+        ++end;
+    }
+    if(end == buf || *end != '\0') {
+        return false;
+    }
+    value = (T)v;
+    return true;
+}
+
+/**
+ * @brief 转换为std::string，直接拷贝
+ */
+inline bool ConvertValue(const char* data, size_t len, std::string& value) {
+    value.assign(data, len);
+    return true;
+}
+
+/**
+ * @brief 其他类型退回boost::lexical_cast
+ */
+template<class T>
+typename std::enable_if<!std::is_arithmetic<T>::value, bool>::type
+ConvertValue(const char* data, size_t len, T& value) {
+    try {
+        value = boost::lexical_cast<T>(data, len);
+        return true;
+    } catch(...) {
+    }
+    return false;
+}
+
+
+/**
+ * @brief HTTP头部容器
+ * @details 按添加顺序保存头部，名称忽略大小写，同名头部以最后一个为准
+ *          前INLINE_FIELDS个头部和前INLINE_BYTES字节的名称/值保存在对象内部，超出后才分配堆内存；
+ *          名称和值一起追加到内部的缓存块中，块不会移动，所以已有头部的地址在修改其他头部时不变
+ *          预置头部(HttpHeaderId)的名称不占缓存，比较时只比较编号
+ *          addRef添加的头部直接指向外部缓存(零拷贝解析)，外部缓存失效前必须调用detach()拷贝进来
+ */
+class HttpHeaders {
+public:
+    static const size_t INLINE_FIELDS = 16;     // 对象内部保存的头部数量
+    static const size_t INLINE_BYTES = 256;     // 对象内部保存名称/值的字节数
+
+    /**
+     * @brief 一个头部
+     */
+    struct Field {
+        const char* name;   // 名称
+        const char* value;  // 值
+        uint32_t nameLen;   // 名称长度
+        uint32_t valueLen;  // 值长度
+        HttpHeaderId id;    // 预置头部的编号
+        bool external;      // 是否指向外部缓存
+
+        // 名称片段
+        StringSlice getName() const { return StringSlice(name, nameLen); }
+        // 值片段
+        StringSlice getValue() const { return StringSlice(value, valueLen); }
+    };
+
+    typedef const Field* const_iterator;
+
+    HttpHeaders();
+    HttpHeaders(const HttpHeaders& rhs);
+    HttpHeaders& operator=(const HttpHeaders& rhs);
+
+    // 头部数量
+    size_t size() const { return m_size; }
+
+    // 是否没有头部
+    bool empty() const { return m_size == 0; }
+
+    // 按添加顺序遍历
+    const_iterator begin() const { return m_fields; }
+    const_iterator end() const { return m_fields + m_size; }
+
+    /**
+     * @brief 追加一个头部(拷贝)，不检查同名头部
+     */
+    void add(const char* name, size_t nlen, const char* value, size_t vlen);
+
+    /**
+     * @brief 追加一个指向外部缓存的头部(不拷贝)，不检查同名头部
+     */
+    void addRef(const char* name, size_t nlen, const char* value, size_t vlen);
+
+    /**
+     * @brief 设置头部，已存在时替换最后一个并删除其余同名头部，不存在时追加
+     */
+    void set(const char* name, size_t nlen, const char* value, size_t vlen);
+    void set(const std::string& name, const std::string& value) {
+        set(name.c_str(), name.size(), value.c_str(), value.size());
+    }
+    void set(HttpHeaderId id, const char* value, size_t vlen);
+
+    /**
+     * @brief 查找头部，有多个同名头部时返回最后一个
+     * @return 不存在返回nullptr
+     */
+    const Field* find(const char* name, size_t len) const;
+    const Field* find(const std::string& name) const { return find(name.c_str(), name.size()); }
+    const Field* find(HttpHeaderId id) const;
+
+    /**
+     * @brief 获取头部的值
+     * @return 不存在返回data为nullptr的空片段
+     */
+    StringSlice get(const std::string& name) const { return toValue(find(name)); }
+    StringSlice get(const char* name, size_t len) const { return toValue(find(name, len)); }
+    StringSlice get(HttpHeaderId id) const { return toValue(find(id)); }
+
+    /**
+     * @brief 获取头部的值并转换为T类型，整数和浮点数不分配内存
+     * @param[out] value 保存转换后的值
+     * @return 不存在或者转换失败返回false，value不变
+     */
+    template<class T, class K>
+    bool getAs(const K& key, T& value) const {
+        const Field* f = find(key);
+        return f && ConvertValue(f->value, f->valueLen, value);
+    }
+
+    /**
+     * @brief 删除所有同名头部
+     * @return 删除的数量
+     */
+    size_t del(const char* name, size_t len);
+    size_t del(const std::string& name) { return del(name.c_str(), name.size()); }
+    size_t del(HttpHeaderId id);
+
+    // 清空所有头部
+    void clear();
+
+    // 是否还有头部指向外部缓存
+    bool isAttached() const { return m_external > 0; }
+
+    // 把指向外部缓存的头部拷贝进来
+    void detach();
+
+private:
+    // 找到的头部转成值片段
+    static StringSlice toValue(const Field* f) {
+        return f ? f->getValue() : StringSlice();
+    }
+
+    // 是否同名
+    static bool Match(const Field& f, HttpHeaderId id, const char* name, size_t len);
+
+    // 查找最后一个同名头部的下标，不存在返回-1
+    int findIndex(HttpHeaderId id, const char* name, size_t len) const;
+
+    // 追加一个空的头部
+    Field& append();
+
+    // 在缓存块中保存数据，返回保存后的地址
+    const char* store(const char* data, size_t len);
+
+    // 替换下标为idx的头部的值，并删除其他同名头部
+    void replace(int idx, HttpHeaderId id, const char* name, size_t nlen, const char* value, size_t vlen);
+
+    // 设置头部
+    void set(HttpHeaderId id, const char* name, size_t nlen, const char* value, size_t vlen);
+
+    // 删除下标为idx的头部
+    void erase(size_t idx);
+
+    // 废弃的数据过多时重新整理缓存
+    void compactIfNeeded();
+
+private:
+    Field* m_fields;                        // 头部数组，指向m_inlineFields或m_heapFields
+    size_t m_size;                          // 头部数量
+    size_t m_capacity;                      // 头部数组容量
+    size_t m_external;                      // 指向外部缓存的头部数量
+    char* m_cur;                            // 当前缓存块的可用位置
+    size_t m_left;                          // 当前缓存块的剩余字节数
+    size_t m_used;                          // 已使用的缓存字节数
+    size_t m_garbage;                       // 被替换或删除而废弃的缓存字节数
+    std::vector<Field> m_heapFields;        // 超出INLINE_FIELDS后的头部数组
+    std::vector<std::unique_ptr<char[]> > m_blocks;   // 超出INLINE_BYTES后分配的缓存块
+    Field m_inlineFields[INLINE_FIELDS];    // 对象内部的头部数组
+    char m_inlineBytes[INLINE_BYTES];       // 对象内部的缓存
+};
+
+}
+}
+
+#endif
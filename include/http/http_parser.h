@@ -20,8 +20,17 @@ public:
     /**
      * @brief 构造函数
      * @details 初始化m_parser，创建m_data数据内存
+     * @param[in] zero_copy 是否零拷贝解析
+     *            零拷贝解析时路径、参数、头部等以片段的形式指向被解析的数据，不拷贝成std::string，
+     *            调用方要保证请求使用期间数据不被覆盖，或者在覆盖前调用HttpRequest::detachBuffer()
     */
-    HttpRequestParser();
+    HttpRequestParser(bool zero_copy = false);
+
+    // 重置解析器，用于解析下一个请求，复用同一个解析器
+    void reset();
+
+    // 是否零拷贝解析
+    bool isZeroCopy() const { return m_zeroCopy; }
 
     // 获取解析器
     const http_parser& getParser() { return m_parser; }
@@ -39,6 +48,7 @@ public:
      *         返回1000: 遇到无效的请求方法
      *         返回1001: 遇到无效的HTTP版本号
      *         返回1002: 遇到无效的请求头部
+     *         返回1003: 无效的Content-Length(由getContentLen设置)
     */
     int hasError();
 
@@ -54,11 +64,12 @@ public:
      * @brief 解析HTTP请求协议
      * @param[in] data 待解析的协议数据
      * @param[in] len 待解析的协议数据长度
-     * @return 返回实际解析的长度，并且将已解析的数据移除
+     * @param[in] move 是否将已解析的数据移除，零拷贝解析时必须为false
+     * @return 返回实际解析的长度
     */
-    size_t execute(char *data, size_t len);
+    size_t execute(char *data, size_t len, bool move = true);
 
-    // 获取HTTP请求消息体的长度
+    // 获取HTTP请求消息体的长度，值无效时设置错误码1003并返回0
     uint64_t getContentLen();
     
 public:
@@ -78,6 +89,8 @@ private:
     /// 1001: invalid version
     /// 1002: invalid field
     int m_error;
+    /// 是否零拷贝解析
+    bool m_zeroCopy;
 };
 
 
@@ -0,0 +1,144 @@
+#ifndef __SYLAR_HTTP_ROUTER_H__
+#define __SYLAR_HTTP_ROUTER_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sylar {
+namespace http {
+
+class HttpServlet;
+
+/**
+ * @brief 路由树
+ * @details 把路由模式按'/'拆成路径段组织成前缀树，匹配时逐段查找，耗时只和路径的段数有关，与路由数量无关
+ *          路由模式支持三种路径段:
+ *              静态段      /api/user
+ *              参数段      /api/user/:id          匹配任意非空的一段，捕获为参数id
+ *              通配段      /static/[*] 或 /static/[*]path  只能是最后一段，匹配剩余的整个路径(可以为空)，
+ *                                                     带名称时捕获为参数
+ *          同一位置优先匹配静态段，其次参数段，最后通配段，前面的分支匹配失败时回溯
+ *          同一位置的参数段只能有一个名称
+ *          本身不加锁，ServletDispatch复制出新的路由树修改后整体替换
+ */
+class HttpRouter {
+public:
+    typedef std::shared_ptr<HttpRouter> ptr;
+    typedef std::vector<std::pair<std::string, std::string> > ParamList;
+    typedef std::shared_ptr<HttpServlet> ServletPtr;
+
+    /**
+     * @brief 构造函数
+     */
+    HttpRouter();
+
+    /**
+     * @brief 拷贝构造函数，复制整个路由树
+     */
+    HttpRouter(const HttpRouter& rhs);
+
+    /**
+     * @brief 赋值运算符，复制整个路由树
+     */
+    HttpRouter& operator=(const HttpRouter& rhs);
+
+    /**
+     * @brief 析构函数
+     */
+    ~HttpRouter();
+
+    /**
+     * @brief 添加路由，已存在时替换
+     * @param[in] pattern 路由模式，必须以'/'开头
+     * @param[in] servlet servlet
+     * @return 路由模式非法或者与已有的参数名冲突时返回false
+     */
+    bool add(const std::string& pattern, ServletPtr servlet);
+
+    /**
+     * @brief 删除路由
+     * @param[in] pattern 路由模式
+     * @return 路由不存在返回false
+     */
+    bool del(const std::string& pattern);
+
+    /**
+     * @brief 通过路由模式获取servlet(不做匹配)
+     * @param[in] pattern 路由模式
+     */
+    ServletPtr get(const std::string& pattern) const;
+
+    /**
+     * @brief 匹配请求路径
+     * @param[in] path 请求路径
+     * @param[out] params 非空时追加捕获的参数
+     * @return 没有匹配的路由返回nullptr
+     */
+    ServletPtr match(const std::string& path, ParamList* params = nullptr) const;
+
+    /**
+     * @brief 返回路由数量
+     */
+    size_t size() const { return m_size; }
+
+    /**
+     * @brief 清空路由
+     */
+    void clear();
+
+private:
+    struct Node;
+    // 静态子节点，按路径段排序，二分查找
+    typedef std::vector<std::pair<std::string, Node*> > StaticList;
+
+    /**
+     * @brief 路由树节点，对应一个路径段
+     */
+    struct Node {
+        Node() :param(nullptr) {}
+        ~Node();
+
+        // 复制节点及其子节点
+        Node* clone() const;
+
+        // 查找静态子节点
+        Node* findStatic(const char* seg, size_t len) const;
+
+        // 节点上没有任何路由时可以删除
+        bool empty() const;
+
+        StaticList statics;             // 静态子节点
+        Node* param;                    // 参数子节点
+        std::string paramName;          // 参数名
+        ServletPtr wildcard;            // 通配段的servlet
+        std::string wildcardName;       // 通配段的参数名，可以为空
+        ServletPtr servlet;             // 路由在该节点结束时的servlet
+    };
+
+    /**
+     * @brief 把路由模式拆成路径段
+     * @return 路由模式非法返回false
+     */
+    static bool Split(const std::string& pattern, std::vector<std::string>& segs);
+
+    /**
+     * @brief 从pos('/'的位置)开始匹配路径的剩余部分
+     */
+    ServletPtr match(const Node* node, const std::string& path,
+                     size_t pos, ParamList* params) const;
+
+    /**
+     * @brief 删除路由，删除后子节点为空时一并释放
+     */
+    bool del(Node* node, const std::vector<std::string>& segs, size_t idx);
+
+private:
+    Node* m_root;       // 根节点
+    size_t m_size;      // 路由数量
+};
+
+}
+}
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef __SYLAR_HTTP_SERVLET_H__
 #define __SYLAR_HTTP_SERVLET_H__
 
+#include <atomic>
 #include <memory>
 #include <functional>
 #include <unordered_map>
@@ -8,7 +9,9 @@
 #include <string.h>
 #include "http.h"
 #include "http_session.h"
+#include "http_router.h"
 #include "thread.h"
+#include "segment_array.h"
 
 namespace sylar {
 namespace http {
@@ -56,8 +59,19 @@ public:
      */
     void setName(const std::string& name) { m_name = name; }
 
+    /**
+     * @brief 是否流式读取请求消息体
+     * @details 为true时HttpServer只解析请求头部就调用handle，
+     *          消息体通过HttpBodyStream(session)或session->readBody边读边处理，不会预先读入req->getBody()
+     */
+    bool isStreamBody() const { return m_streamBody; }
+
+    // 设置是否流式读取请求消息体
+    void setStreamBody(bool v) { m_streamBody = v; }
+
 protected:
     std::string m_name;     // 名称
+    bool m_streamBody;      // 是否流式读取请求消息体
 };
 
 
@@ -127,11 +141,16 @@ private:
 /**
  * @brief Servlet分发器
  * @details 管理Servlet，用于指定某个请求路径该用哪个Servlet来处理
+ *          匹配顺序: 精准匹配 > 路由树(HttpRouter) > 模糊匹配(按添加顺序fnmatch) > 默认
+ *          路由数量多时优先用addRoute，匹配耗时与路由数量无关
+ *          匹配表是只读的快照，修改时加锁复制一份修改后整体替换并递增版本号；
+ *          每个线程缓存一份快照，版本号没变时直接使用，查找路径上不加锁
+ *          路由一般只在启动或者模块重新加载时修改，每次修改的开销和表的大小成正比
  */
 class ServletDispatch : public HttpServlet {
 public:
     typedef std::shared_ptr<ServletDispatch> ptr;
-    typedef RWMutex MutexType;
+    typedef Mutex MutexType;
 
     /**
      * @brief 构造函数
@@ -177,6 +196,22 @@ public:
      */
     void addGlobServlet(const std::string& uri, FunctionServlet::FuncType cb);
 
+    /**
+     * @brief 添加路由servlet
+     * @param[in] pattern 路由模式，如 /user/:id、/static/[*]path，见HttpRouter
+     * @param[in] servlet servlet
+     * @return 路由模式非法或者参数名冲突返回false
+     */
+    bool addRoute(const std::string& pattern, HttpServlet::ptr servlet);
+
+    /**
+     * @brief 添加路由servlet
+     * @param[in] pattern 路由模式
+     * @param[in] cb FunctionServlet回调函数
+     * @return 路由模式非法或者参数名冲突返回false
+     */
+    bool addRoute(const std::string& pattern, FunctionServlet::FuncType cb);
+
     /**
      * @brief 删除精准匹配servlet
      * @param[in] uri uri
@@ -189,6 +224,12 @@ public:
      */
     void delGlobServlet(const std::string& uri);
 
+    /**
+     * @brief 删除路由servlet
+     * @param[in] pattern 路由模式
+     */
+    void delRoute(const std::string& pattern);
+
     /**
      * @brief 通过uri获取精准匹配servlet
      * @param[in] uri uri
@@ -203,29 +244,101 @@ public:
      */
     HttpServlet::ptr getGlobServlet(const std::string& uri);
 
+    /**
+     * @brief 通过路由模式获取路由servlet
+     * @param[in] pattern 路由模式
+     * @return 返回对应的servlet
+     */
+    HttpServlet::ptr getRouteServlet(const std::string& pattern);
+
     /**
      * @brief 通过uri获取servlet
      * @param[in] uri uri
-     * @return 优先精准匹配,其次模糊匹配,最后返回默认
+     * @return 优先精准匹配,其次路由,再次模糊匹配,最后返回默认
      */
     HttpServlet::ptr getMatchServlet(const std::string& uri);
 
+    /**
+     * @brief 通过请求路径获取servlet，路由捕获的参数写入req的请求参数
+     * @param[in] req HTTP请求
+     * @return 优先精准匹配,其次路由,再次模糊匹配,最后返回默认
+     */
+    HttpServlet::ptr getMatchServlet(HttpRequest::ptr req);
+
     /**
      * @brief 返回默认servlet
      */
-    HttpServlet::ptr getDefault() const { return m_default; }
+    HttpServlet::ptr getDefault() const;
 
     /**
      * @brief 设置默认servlet
      * @param[in] v servlet
      */
-    void setDefault(HttpServlet::ptr servlet) { m_default = servlet; }
+    void setDefault(HttpServlet::ptr servlet);
+
+private:
+    /**
+     * @brief 模糊匹配项
+     * @details 模式中第一个通配符之前的部分是固定前缀，先比较前缀，前缀相同才调用fnmatch
+     */
+    struct GlobItem {
+        std::string pattern;        // 模式
+        size_t prefixLen;           // 固定前缀的长度
+        HttpServlet::ptr servlet;   // servlet
+    };
+
+    /**
+     * @brief 匹配表快照，发布后不再修改
+     */
+    struct RouteTable {
+        typedef std::shared_ptr<RouteTable> ptr;
+
+        std::unordered_map<std::string, HttpServlet::ptr> datas;    // 精准匹配
+        HttpRouter routes;              // 路由
+        std::vector<GlobItem> globs;    // 模糊匹配
+        HttpServlet::ptr def;           // 默认servlet，所有路径都没匹配到时使用
+    };
+
+    /**
+     * @brief 按匹配顺序查找servlet，params非空时写入路由捕获的参数
+     */
+    HttpServlet::ptr match(const std::string& uri, HttpRouter::ParamList* params) const;
+
+    /**
+     * @brief 添加模糊匹配项，已存在时替换
+     */
+    void addGlob(const std::string& uri, HttpServlet::ptr servlet);
+
+    /**
+     * @brief 线程缓存的快照
+     */
+    struct CacheSlot {
+        uint64_t version = 0;       // 快照的版本号，0表示还没有缓存
+        RouteTable::ptr table;      // 快照
+    };
+
+    /**
+     * @brief 返回当前线程缓存的快照
+     * @details 缓存按GetThreadIndex()保存在分发器自己的m_caches中，分发器析构时一起释放；
+     *          版本号没变时不加锁，返回的指针在当前线程下次调用getTable之前有效。
+     *          线程退出阶段没有线程序号或者序号超出缓存容量时不使用缓存，
+     *          最新快照的引用放入hold，返回的指针在hold释放之前有效
+     * @param[out] hold 不使用缓存时持有返回的快照
+     */
+    const RouteTable* getTable(RouteTable::ptr& hold) const;
+
+    /**
+     * @brief 复制当前快照，交给cb修改后发布
+     * @param[in] cb 返回false时放弃修改
+     * @return cb的返回值
+     */
+    bool update(std::function<bool(RouteTable& table)> cb);
 
 private:
-    MutexType m_mutex;              // 读写互斥量
-    std::unordered_map<std::string, HttpServlet::ptr> m_datas;      // 精准匹配
-    std::vector<std::pair<std::string, HttpServlet::ptr> > m_globs; // 模糊匹配
-    HttpServlet::ptr m_default;     // 默认servlet，所有路径都没匹配到时使用
+    mutable MutexType m_mutex;          // 修改快照和读取最新快照时加锁
+    RouteTable::ptr m_table;            // 最新快照
+    std::atomic<uint64_t> m_version;    // 最新快照的版本号，从1开始
+    mutable SegmentArray<CacheSlot, 6> m_caches;    // 各线程缓存的快照，下标为线程序号，只由所属线程读写
 };
 
 }
@@ -2,7 +2,9 @@
 #define __SYLAR_HTTP_SESSION_H__
 
 #include <memory>
+#include <vector>
 #include "http.h"
+#include "http_parser.h"
 #include "socket_stream.h"
 
 namespace sylar {
@@ -15,11 +17,23 @@ namespace http {
 /**
  * @brief HTTPSession封装
  * @details session是服务器端accept成功产生的socket
+ *          每个连接持有一块复用的接收缓存(大小为http.request.max_header_size)和一个复用的零拷贝解析器，
+ *          请求的路径、参数、头部以及能放进缓存的消息体都以片段的形式指向接收缓存，
+ *          servlet访问时才拷贝成std::string。接收下一个请求前，如果上一个请求还被外部持有，
+ *          会先调用HttpRequest::detachBuffer()把它从缓存中分离
+ *          支持HTTP/1.1管线化: 多读到的后续请求保留在接收缓存中，
+ *          queueHttpResponse放入发送队列的响应在下一次需要从socket读数据、写数据或关闭前用一次writev发送，
+ *          连续到达的请求的响应因此合并成一次系统调用
+ *          发送时只把状态行和头部渲染到复用的头部缓存中，消息体直接引用HttpResponse::getBody()，
+ *          头部和消息体一起用writev发送，大的消息体不会被拷贝；文件消息体(HttpResponse::setFileBody)用sendfile发送
  */
 class HttpSession : public SocketStream {
 public:
     typedef std::shared_ptr<HttpSession> ptr;
 
+    // 未读完的请求消息体最多丢弃的字节数，超过时不再丢弃，直接关闭连接
+    static const uint64_t MAX_SKIP_BODY_SIZE = 64 * 1024;
+
     /**
      * @brief 构造函数
      * @param[in] sock Socket类型
@@ -29,12 +43,45 @@ public:
      */
     HttpSession(Socket::ptr sock, bool owner = false);
 
+    // 析构函数
+    ~HttpSession();
+
     /**
      * @brief 接收HTTP请求
      * @details 接收到HTTP数据并且进行解析
+     *          上一个请求的消息体没有读完时先丢弃剩余部分
+     * @param[in] read_body 是否读取完整的消息体到HttpRequest::getBody()
+     *                      为false时只解析头部，消息体由recvHttpBody一次读取，或者由readBody/HttpBodyStream流式读取
      * @return 返回解析后的HttpRequest封装数据
     */
-    HttpRequest::ptr recvHttpRequest();
+    HttpRequest::ptr recvHttpRequest(bool read_body = true);
+
+    /**
+     * @brief 读取当前请求剩余的完整消息体到req->getBody()
+     * @details 支持Content-Length和Transfer-Encoding: chunked，超过http.request.max_body_size时失败
+     * @return 成功返回true，失败返回false(不关闭连接)
+     */
+    bool recvHttpBody(HttpRequest::ptr req);
+
+    /**
+     * @brief 流式读取当前请求的消息体
+     * @details chunked消息体在读取过程中累计长度，超过http.request.max_body_size时失败(errno=EMSGSIZE)；
+     *          请求带有Expect: 100-continue时，第一次读取前先回复100 Continue
+     * @return >0 读取到的字节数
+     *         =0 消息体已读完
+     *         <0 连接断开、格式错误或者消息体过大
+     */
+    ssize_t readBody(void* buff, size_t length);
+
+    // 当前请求的消息体是否已经读完
+    bool isBodyDone() const { return m_bodyDone; }
+
+    /**
+     * @brief 丢弃当前请求未读的消息体
+     * @param[in] max_size 最多丢弃的字节数
+     * @return 全部丢弃返回true；超过max_size、读取失败或者客户端还在等待100 Continue时返回false，此时应关闭连接
+     */
+    bool skipBody(uint64_t max_size = MAX_SKIP_BODY_SIZE);
 
     /**
      * @brief 发生HTTP响应
@@ -44,10 +91,190 @@ public:
      *         <0 Socket异常
      */
     ssize_t sendHttpResponse(HttpResponse::ptr response);
-    
+
+    /**
+     * @brief 把HTTP响应放入发送队列，不立即发送
+     * @details 在下一次从socket读数据、写数据、关闭或调用flush()时和队列中的其他响应一起发送；
+     *          队列中的响应过多时立即发送
+     * @return 立即发送失败时返回<0，否则返回>=0
+     */
+    ssize_t queueHttpResponse(HttpResponse::ptr response);
+
+    /**
+     * @brief 用一次writev发送队列中的所有响应
+     * @return 返回发送的字节数，队列为空返回0，失败返回<0
+     */
+    ssize_t flush();
+
+    /**
+     * @brief 发送iovec数组中的全部数据
+     * @details 不经过发送队列，调用前应先flush()
+     * @return 成功返回发送的字节数，失败返回<0
+     */
+    ssize_t sendIovecs(iovec* iovs, size_t n);
+
+    // 返回sendIovecs的调用次数，合并发送时一次flush只调用一次
+    uint64_t getSendCount() const { return m_sendCount; }
+
+    using SocketStream::read;
+    using SocketStream::write;
+
+    /**
+     * @brief 读取数据
+     * @details 接收缓存中还有请求之后多读的数据时先返回这部分数据，
+     *          需要从socket读取时先发送队列中的响应
+     */
+    virtual ssize_t read(void* buff, size_t length) override;
+
+    // 写数据，先发送队列中的响应，保证顺序
+    virtual ssize_t write(const void* buff, size_t length) override;
+
+    // 关闭前先发送队列中的响应
+    virtual bool close() override;
+
+private:
+    // 上一个请求还被外部持有时把它从接收缓存中分离，之后才能覆盖接收缓存
+    void detachRequest();
+
+    // 清空发送队列，保留头部缓存
+    void clearSendQueue();
+
+    /**
+     * @brief 从socket读取更多数据追加到接收缓存
+     * @details 缓存已满时把未处理数据移到开头，移动前先把请求从缓存中分离
+     * @return 缓存中没有空间或者读取失败返回false
+     */
+    bool fillBuffer();
+
+    // 从接收缓存中读取一行(去掉行尾的\r\n)，用于解析chunk头部
+    bool readLine(std::string& line);
+
+    // 客户端等待100 Continue时回复
+    bool sendContinue();
+
+    // 请求的消息体边界无法确定时回复400并关闭连接
+    void sendBadRequest(HttpRequest::ptr req);
+
+    // 读取消息体，处理chunked编码，readBody在出错时记录状态
+    ssize_t doReadBody(void* buff, size_t length);
+
+    // 用sendfile发送响应的文件消息体，成功返回发送的字节数，失败返回<0
+    ssize_t sendFileBody(HttpResponse::ptr response);
+
+    /**
+     * @brief 发送队列中的一个响应
+     * @details header在发送后不释放，下次入队时复用其内存；
+     *          response保证发送完成前消息体有效
+     */
+    struct PendingResponse {
+        std::string header;
+        HttpResponse::ptr response;
+    };
+
+private:
+    HttpRequestParser m_parser;     // 复用的零拷贝解析器
+    std::vector<char> m_buffer;     // 复用的接收缓存
+    size_t m_begin;                 // 接收缓存中未处理数据的开始
+    size_t m_end;                   // 接收缓存中未处理数据的结束
+    HttpRequest::ptr m_request;     // 上一个解析出的请求，可能还指向接收缓存
+    uint64_t m_bodyLeft;            // Content-Length消息体剩余的字节数，chunked时为当前chunk剩余的字节数
+    uint64_t m_bodyRead;            // 已读取的消息体字节数
+    bool m_bodyChunked;             // 消息体是否为chunked
+    bool m_bodyDone;                // 消息体是否已读完
+    bool m_bodyError;               // 读取消息体是否出错
+    bool m_expectContinue;          // 客户端是否在等待100 Continue
+    std::vector<PendingResponse> m_sendQueue;   // 等待合并发送的响应，只增长不收缩
+    size_t m_sendQueueSize;                     // 发送队列中有效的响应个数
+    size_t m_sendQueueBytes;                    // 发送队列中的字节数
+    uint64_t m_sendCount;                       // sendIovecs的调用次数
+};
+
+/**
+ * @brief 请求消息体的流式读取
+ * @details 把HttpSession::readBody封装成Stream，read返回0表示消息体已读完。
+ *          用于设置了HttpServlet::setStreamBody(true)的servlet，消息体不会预先读入内存
+ */
+class HttpBodyStream : public Stream {
+public:
+    typedef std::shared_ptr<HttpBodyStream> ptr;
+
+    // 构造函数
+    HttpBodyStream(HttpSession::ptr session);
+
+    virtual ssize_t read(void* buffer, size_t length) override;
+    virtual ssize_t read(ByteArray::ptr buffer, size_t length) override;
+
+    // 只读，写数据返回-1
+    virtual ssize_t write(const void* buffer, size_t length) override { return -1; }
+    virtual ssize_t write(ByteArray::ptr buffer, size_t length) override { return -1; }
+
+    /**
+     * @brief 丢弃未读的消息体
+     * @return 超过HttpSession::MAX_SKIP_BODY_SIZE时不再丢弃，返回false，连接在响应后关闭
+     */
+    virtual bool close() override;
+
+private:
+    HttpSession::ptr m_session;
+};
+
+/**
+ * @brief 响应消息体的流式发送
+ * @details 第一次写数据(或者调用sendHeader)时发送响应头，之后每次write直接发送:
+ *          1.响应已设置Content-Length时按原样发送数据，写入的总长度由调用方保证
+ *          2.HTTP/1.1使用Transfer-Encoding: chunked，每次write发送一个chunk，close()发送结束chunk
+ *          3.HTTP/1.0不支持chunked，按原样发送并在响应结束后关闭连接
+ *          响应中已经设置的消息体作为第一块数据发送。必须在servlet的handle返回前close(析构时自动close)，
+ *          HttpServer不会再发送该响应
+ */
+class HttpResponseWriter : public Stream {
+public:
+    typedef std::shared_ptr<HttpResponseWriter> ptr;
+
+    /**
+     * @brief 构造函数
+     * @param[in] session HTTP连接
+     * @param[in] response 要发送的响应，发送响应头之后不能再修改
+     */
+    HttpResponseWriter(HttpSession::ptr session, HttpResponse::ptr response);
+
+    // 析构函数，没有close时自动close
+    ~HttpResponseWriter();
+
+    // 只写，读数据返回-1
+    virtual ssize_t read(void* buffer, size_t length) override { return -1; }
+    virtual ssize_t read(ByteArray::ptr buffer, size_t length) override { return -1; }
+
+    /**
+     * @brief 发送一块数据
+     * @return 成功返回length，失败返回<0
+     */
+    virtual ssize_t write(const void* buffer, size_t length) override;
+    virtual ssize_t write(ByteArray::ptr buffer, size_t length) override;
+
+    // 结束响应，chunked时发送结束chunk
+    virtual bool close() override;
+
+    // 发送响应头，已经发送过返回true
+    bool sendHeader();
+
+    // 是否使用chunked编码
+    bool isChunked() const { return m_chunked; }
+
+private:
+    // 发送数据，chunked时加上chunk头部和结尾
+    ssize_t sendData(iovec* iovs, size_t n, size_t length);
+
+private:
+    HttpSession::ptr m_session;
+    HttpResponse::ptr m_response;
+    bool m_chunked;         // 是否使用chunked编码
+    bool m_headerSent;      // 响应头是否已发送
+    bool m_closed;          // 是否已结束
+    bool m_error;           // 是否发送失败
 };
 
 }
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,101 @@
+#ifndef __SYLAR_HTTP_STATIC_FILE_SERVLET_H__
+#define __SYLAR_HTTP_STATIC_FILE_SERVLET_H__
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <sys/stat.h>
+#include "http_servlet.h"
+#include "thread.h"
+
+namespace sylar {
+namespace http {
+
+/**
+ * @brief 静态文件Servlet
+ * @details 把请求路径映射到root目录下的文件，通过ServletDispatch::addGlobServlet注册，
+ *          例如模糊匹配路径为 /static/[*] 时，prefix传"/static/"，/static/a.js 映射到 root/a.js
+ *          文件内容通过HttpResponse::setFileBody交给HttpSession用sendfile发送，
+ *          sendfile被hook，socket不可写时让出协程，受SO_SNDTIMEO约束
+ *          支持GET/HEAD、单个区间的Range(If-Range)、ETag(If-None-Match)和If-Modified-Since
+ *          打开的文件句柄和stat结果保存在LRU缓存中(http.static.max_open_files)，
+ *          超过http.static.check_interval毫秒后才重新stat检查文件是否变化
+ */
+class StaticFileServlet : public HttpServlet {
+public:
+    typedef std::shared_ptr<StaticFileServlet> ptr;
+    typedef Mutex MutexType;
+
+    /**
+     * @brief 构造函数
+     * @param[in] root 文件根目录
+     * @param[in] prefix 请求路径的前缀，映射到文件时去掉
+     */
+    StaticFileServlet(const std::string& root, const std::string& prefix = "/");
+
+    /**
+     * @brief 处理请求
+     * @param[in] req HTTP请求
+     * @param[in] res HTTP响应
+     * @param[in] session HTTP连接
+     * @return 是否处理成功
+     */
+    virtual int32_t handle(HttpRequest::ptr req,
+                           HttpResponse::ptr res,
+                           HttpSession::ptr session) override;
+
+    // 返回文件根目录
+    const std::string& getRoot() const { return m_root; }
+
+    // 返回请求路径的前缀
+    const std::string& getPrefix() const { return m_prefix; }
+
+    // 清空打开文件缓存
+    void clearCache();
+
+    // 通过文件扩展名获取Content-Type
+    static const char* GetMimeType(const std::string& path);
+
+private:
+    /**
+     * @brief 打开文件缓存中的一项
+     * @details 析构时关闭文件句柄，淘汰出缓存的项在正在发送的响应释放后才关闭
+     */
+    struct FileInfo {
+        typedef std::shared_ptr<FileInfo> ptr;
+
+        FileInfo() :fd(-1), checkTime(0) {}
+        ~FileInfo();
+
+        int fd;                     // 文件句柄，目录为-1
+        struct stat st;             // stat结果
+        std::string etag;           // ETag
+        std::string lastModified;   // Last-Modified
+        uint64_t checkTime;         // 上次检查文件是否变化的时间(毫秒)
+    };
+
+    /**
+     * @brief 获取文件，优先从缓存中取
+     * @return 文件不存在或者无法打开返回nullptr
+     */
+    FileInfo::ptr getFile(const std::string& path);
+
+    // 打开文件并stat
+    static FileInfo::ptr OpenFile(const std::string& path);
+
+    // 把请求路径转换成文件路径，路径非法或者不在前缀下返回false
+    bool toFilePath(const std::string& uri, std::string& path) const;
+
+private:
+    std::string m_root;         // 文件根目录
+    std::string m_prefix;       // 请求路径的前缀
+    MutexType m_mutex;          // 保护缓存
+    std::list<std::pair<std::string, FileInfo::ptr> > m_lru;    // 最近使用的在前
+    std::unordered_map<std::string, std::list<std::pair<std::string, FileInfo::ptr> >::iterator> m_cache;
+};
+
+}
+}
+
+#endif
@@ -167,6 +167,13 @@ public:
      * @return 优先精准匹配,其次模糊匹配,最后返回默认
      */
     WSServlet::ptr getMatchWSServlet(const std::string& uri);
+
+    /**
+     * @brief 通过握手请求获取WSServlet，路由捕获的参数写入req的请求参数
+     * @param[in] req 握手请求
+     * @return 优先精准匹配,其次路由,再次模糊匹配,最后返回默认
+     */
+    WSServlet::ptr getMatchWSServlet(HttpRequest::ptr req);
 };
 
 }
@@ -3,6 +3,10 @@
 
 #include "scheduler.h"
 #include "timer.h"
+#include "segment_array.h"
+#include "uring.h"
+#include <vector>
+#include <sys/epoll.h>
 
 namespace sylar {
 
@@ -11,6 +15,9 @@ public:
     typedef std::shared_ptr<IOManager> ptr;
     typedef RWMutex RWMutexType;
 
+    //支持的最大fd(不含)
+    static const size_t MAX_FDS = 1 << 22;
+
     /**
      * @brief IO事件，继承自epoll对事件的定义
      * @details 这里只关心socket fd的读和写事件，其他epoll事件会归类到这两类事件中
@@ -21,6 +28,16 @@ public:
         WRITE = 0x4    // 写事件(EPOLLOUT)
     };
 
+    /**
+     * @brief IO后端
+     * @details EPOLL: 就绪通知，hook函数在EAGAIN时注册事件并让出协程，就绪后重新执行系统调用
+     *          IO_URING: 完成通知，hook的socket读写/accept/connect直接提交给io_uring，完成后恢复协程
+     */
+    enum Backend {
+        EPOLL    = 0,
+        IO_URING = 1
+    };
+
 private:
     /**
      * @brief socket事件上下文类（描述符-事件类型-回调函数三元组）
@@ -38,6 +55,7 @@ private:
             Scheduler* scheduler = nullptr;  //事件执行的调度器
             Fiber::ptr fiber;     //事件回调协程
             std::function<void()> cb;    //事件回调函数
+            int thread = -1;      //注册事件的协程绑定的线程id，事件触发后仍在该线程执行
         };
 
         //获取事件上下文
@@ -57,8 +75,22 @@ private:
         EventContext read;   //读事件上下文
         EventContext write;  //写事件上下文
         int fd = 0;      //事件关联的句柄
+        int epfd = -1;   //fd注册在哪个epoll句柄上，events不为NONE时有效
         Event events = NONE;  //该fd添加了哪些事件的回调函数
         MutexType mutex;
+        std::atomic<int> uringOps = {0};  //该fd上已提交给io_uring还未完成的操作数
+    };
+
+    /**
+     * @brief 每个调度线程的io_uring上下文
+     * @details 每个线程使用自己的io_uring提交和收割，只有close时跨线程取消才会访问其他线程的提交队列
+     */
+    struct UringContext {
+        typedef Mutex MutexType;
+
+        IoUring ring;
+        MutexType mutex;          //保护提交队列
+        bool epollArmed = false;  //是否已经在ring上监听epoll句柄的可读
     };
 
 public:
@@ -67,8 +99,11 @@ public:
      * @param[in] threads 线程数量
      * @param[in] use_caller 是否将调用线程包含进去
      * @param[in] name 调度器的名称
+     * @param[in] timer_type 定时器的存储结构(大量连接都带超时时建议使用时间轮)
+     * @details IO后端由配置 iomanager.backend 决定，内核不支持io_uring时回退到epoll
      */
-    IOManager(size_t threads = 1, bool use_caller = true, const std::string& name = "");
+    IOManager(size_t threads = 1, bool use_caller = true, const std::string& name = ""
+              ,TimerManager::Type timer_type = TimerManager::SET);
 
     //析构函数
     ~IOManager();
@@ -109,6 +144,24 @@ public:
      */
     bool cancelAllEvent(int fd);
 
+    //返回使用的IO后端
+    Backend getBackend() const { return m_backend; }
+
+    /**
+     * @brief 通过当前线程的io_uring执行一次IO操作，完成前让出当前协程
+     * @details 只能在IO_URING后端的调度协程中调用，sqe的各字段由参数原样填充
+     * @param[in] opcode IORING_OP_XXX
+     * @param[in] fd 句柄
+     * @param[in] addr 缓冲区/地址
+     * @param[in] len 长度
+     * @param[in] off 偏移，ACCEPT时为socklen_t*，CONNECT时为地址长度
+     * @param[in] op_flags msg_flags/accept_flags等
+     * @param[in] timeout_ms 超时时间，~0ull表示不超时
+     * @return 成功返回操作结果(>=0)，失败返回-1并设置errno，超时errno为ETIMEDOUT
+     */
+    ssize_t uringIo(int opcode, int fd, const void* addr, uint32_t len, uint64_t off
+                    ,uint32_t op_flags, uint64_t timeout_ms);
+
     //返回当前的IOManager
     static IOManager* GetThis();
 
@@ -141,18 +194,41 @@ protected:
      */
     bool stopping(uint64_t& timeout);
 
+private:
+    //处理epoll_wait返回的就绪事件
+    void processEvents(epoll_event* events, int n);
+
     /**
-     * @brief 重置socket句柄上下文的容器大小
-     * @param[in] size 容量大小
+     * @brief 返回当前线程的epoll句柄
+     * @details 绑定在线程上的协程注册的fd放在所在线程自己的epoll句柄上，就绪事件只会唤醒这个线程；
+     *          线程的epoll句柄里同时监听共享的m_epfd，其他fd的事件和tickle照常可以唤醒
+     * @param[in] create 不存在时是否创建
+     * @return 当前线程的epoll句柄，不存在并且不创建时返回-1
      */
-    void fdContextsResize(size_t size);
+    int getThreadEpfd(bool create);
+
+    //IO_URING后端的idle协程
+    void idleUring();
+
+    //返回当前线程的io_uring上下文，不存在则创建
+    UringContext* getUringContext();
+
+    //取消所有io_uring上fd还未完成的操作
+    void cancelUringOps(int fd);
 
 private: 
-    int m_epfd = 0;      //epoll文件句柄
-    int m_tickleFds[2];  //pipe文件句柄，fd[0]读端，fd[1]写端
+    int m_epfd = 0;      //epoll文件句柄，没有绑定线程的fd都注册在这里
+    int m_tickleFd = -1;   //eventfd文件句柄，用于tickle
+    std::atomic<bool> m_tickled = {false};  //本轮idle是否已经tickle过，避免重复写eventfd
     std::atomic<size_t> m_pendingEventCount = {0};  //当前等待执行的事件数量
-    std::vector<FdContext*> m_fdContexts;  //socket句柄上下文的容器
-    RWMutexType m_mutex;
+    //socket句柄上下文的容器，以fd为下标，分段分配且地址不变，读取不需要加锁
+    SegmentArray<FdContext> m_fdContexts;
+    Backend m_backend = EPOLL;   //IO后端
+    uint64_t m_id = 0;           //实例id，用于识别线程局部的io_uring上下文属于哪个IOManager
+    MutexType m_uringMutex;      //保护m_uringContexts
+    std::vector<std::unique_ptr<UringContext> > m_uringContexts;  //所有线程的io_uring上下文
+    MutexType m_threadEpfdMutex; //保护m_threadEpfds
+    std::vector<int> m_threadEpfds;  //各线程自己的epoll句柄
 };
 
 
@@ -10,6 +10,9 @@
 #include <fstream>
 #include <vector>
 #include <stdarg.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include "util.h"
 #include <map>
 #include "singleton.h"
@@ -21,7 +24,7 @@
 */
 #define SYLAR_LOG_LEVEL(logger, level) \
     if(logger->getLevel() <= level) \
-        sylar::LogEventWrap(std::make_shared<sylar::LogEvent>(logger, \
+        sylar::LogEventWrap(sylar::LogEvent::Create(logger, \
         level, __FILE__, __LINE__, 0, sylar::getThreadId(), \
         sylar::getFiberId(), time(0), sylar::Thread::getCurrThreadName())).getSS()
 
@@ -47,7 +50,7 @@
  */
 #define SYLAR_LOG_FMT_LEVEL(logger, level, fmt, ...) \
     if(logger->getLevel() <= level) \
-        sylar::LogEventWrap(std::make_shared<sylar::LogEvent>(logger, \
+        sylar::LogEventWrap(sylar::LogEvent::Create(logger, \
         level, __FILE__, __LINE__, 0, sylar::getThreadId(), \
         sylar::getFiberId(), time(0), sylar::Thread::getCurrThreadName())).getEvent()->format(fmt, __VA_ARGS__)
 
@@ -76,6 +79,7 @@ namespace sylar
 {   
 
 class Logger;
+class BinLogSite;
 
 //日志级别
 class LogLevel
@@ -100,6 +104,9 @@ public:
 
 
 //日志事件
+//日志内容写入事件自带的字符串(m_content),不经过std::stringstream
+//SYLAR_LOG_*宏通过Create取当前线程缓存的事件对象,没有被其他地方持有时直接复用,每条日志不用分配内存
+//二进制日志(SYLAR_LOG_BIN_*)只保存调用点和编码后的参数,文本内容在第一次getContent()时才生成
 class LogEvent
 {
 public:
@@ -122,6 +129,16 @@ public:
             uint32_t threadId, uint32_t fiberId, uint64_t time, 
             const std::string& threadName);
 
+    /**
+     * @brief 创建日志事件,参数同构造函数
+     * @details 优先复用当前线程缓存的事件对象(引用计数为1说明上一条日志已经处理完),
+     *          否则(例如在输出日志内容时又写了日志)新建一个
+     */
+    static LogEvent::ptr Create(std::shared_ptr<Logger> logger, LogLevel::Level level, 
+            const char* file, int32_t line, uint32_t elapse, 
+            uint32_t threadId, uint32_t fiberId, uint64_t time, 
+            const std::string& threadName);
+
     //返回文件名
     const char* getFile() const { return m_file; }
 
@@ -141,16 +158,16 @@ public:
     uint64_t getTime() const { return m_time; }
 
     //返回线程名称
-    std::string getThreadName() const { return m_threadName; }
+    const std::string& getThreadName() const { return m_threadName; }
 
-    //返回日志内容字符串
-    std::string getContent() const { return m_ss.str(); }
+    //返回日志内容字符串,二进制日志在这里才按调用点的格式生成文本
+    const std::string& getContent() const;
 
-    //返回日志内容字符串流
-    std::stringstream& getSS() { return m_ss; }
+    //返回日志内容输出流
+    std::ostream& getSS() { return m_ss; }
 
     //返回日志器
-    std::shared_ptr<Logger> getLogger() const { return m_logger; }
+    const std::shared_ptr<Logger>& getLogger() const { return m_logger; }
 
     //返回日志等级
     LogLevel::Level getLevel() const { return m_level; }
@@ -158,6 +175,34 @@ public:
     //格式化写入日志内容
     void format(const char* fmt, ...);
 
+    //设置二进制日志的调用点,参数编码在getBinArgs()中
+    void setBinSite(const BinLogSite* site) { m_binSite = site; }
+
+    //返回二进制日志的调用点,文本日志返回nullptr
+    const BinLogSite* getBinSite() const { return m_binSite; }
+
+    //返回二进制日志编码后的参数
+    std::string& getBinArgs() { return m_binArgs; }
+    const std::string& getBinArgs() const { return m_binArgs; }
+
+private:
+    //日志内容流的缓冲区,直接追加到std::string
+    class StringBuf : public std::streambuf {
+    public:
+        StringBuf(std::string& str) :m_str(str) {}
+    protected:
+        int_type overflow(int_type c) override;
+        std::streamsize xsputn(const char* s, std::streamsize n) override;
+    private:
+        std::string& m_str;
+    };
+
+    //复用事件对象时重新设置各个字段
+    void reset(std::shared_ptr<Logger> logger, LogLevel::Level level, 
+            const char* file, int32_t line, uint32_t elapse, 
+            uint32_t threadId, uint32_t fiberId, uint64_t time, 
+            const std::string& threadName);
+
 private:
     std::shared_ptr<Logger> m_logger;    // 日志器
     LogLevel::Level m_level;    // 日志等级
@@ -168,7 +213,11 @@ private:
     uint32_t m_fiberId;     //协程ID
     uint64_t m_time;      //时间戳
     std::string m_threadName;       //线程名称
-    std::stringstream m_ss;    //日志内容流
+    mutable std::string m_content;    //日志内容
+    const BinLogSite* m_binSite = nullptr;    //二进制日志的调用点
+    std::string m_binArgs;    //二进制日志编码后的参数
+    StringBuf m_buf;    //日志内容流的缓冲区
+    std::ostream m_ss;    //日志内容流
 };
 
 
@@ -185,7 +234,7 @@ public:
     LogEvent::ptr getEvent() const { return m_event; }
 
     //获取日志内容流
-    std::stringstream& getSS();
+    std::ostream& getSS();
 
 private:
     LogEvent::ptr m_event;    //日志事件
@@ -224,8 +273,14 @@ public:
      * @param[in] level 日志级别
      * @param[in] event 日志事件
      */
-    std::string format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
-    std::ostream& format(std::ostream& ofs, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
+    std::string format(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event);
+    std::ostream& format(std::ostream& ofs, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event);
+
+    /**
+     * @brief 格式化日志追加到buf末尾
+     * @details 不经过std::ostream,buf容量足够时不分配内存;Appender用线程局部的buf调用
+     */
+    void format(std::string& buf, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event);
 
 public:
     //日志内容项格式化
@@ -237,13 +292,13 @@ public:
         virtual ~FormatItem() {}
 
         /**
-         * @brief 格式化日志到流
-         * @param[in, out] os 日志输出流
+         * @brief 格式化日志,追加到buf末尾
+         * @param[in, out] buf 日志输出缓冲区
          * @param[in] logger 日志器
          * @param[in] level 日志等级
          * @param[in] event 日志事件
          */
-        virtual void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) = 0;
+        virtual void format(std::string& buf, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) = 0;
     };
     
     //初始化：解析日志模版
@@ -311,6 +366,8 @@ friend class LoggerManager;
 public:
     typedef std::shared_ptr<Logger> ptr;
     typedef Spinlock MutexType;
+    //日志目标集合,写时复制: 修改时复制一份整体替换,写日志时只在锁内取快照
+    typedef std::list<LogAppender::ptr> AppenderList;
 
     //构造函数：name为日志器名称
     Logger(const std::string& name = "root");
@@ -351,6 +408,9 @@ public:
     //返回日志名称
     const std::string& getName() const { return m_name; }
 
+    //返回日志器id,进程内唯一,从1开始
+    uint32_t getId() const { return m_id; }
+
     //设置日志格式
     void setFormatter(const LogFormatter::ptr& val);
 
@@ -365,8 +425,9 @@ public:
 
 private:
     std::string m_name;              // 日志名称
+    uint32_t m_id;                  // 日志器id
     LogLevel::Level m_level;        // 日志级别
-    std::list<LogAppender::ptr> m_appenders;      // 日志目标集合
+    std::shared_ptr<const AppenderList> m_appenders;      // 日志目标集合(只读快照)
     LogFormatter::ptr m_formatter;      // 日志格式器
     Logger::ptr m_root;
     mutable MutexType m_mutex;    //锁类型,加mutable表示在const成员函数中仍可修改
@@ -415,12 +476,38 @@ public:
 
 
 //输出到文件的Appender
+//同步模式下在调用线程中格式化后加锁写入文件
+//异步模式下调用线程只把格式化好的日志追加到内存缓冲区,缓冲区写满或者每隔flush_interval毫秒
+//由后台线程整块写入文件;等待写入的缓冲区达到上限时按策略丢弃日志或者阻塞调用线程
+//可以按大小和时间(整点/零点)切分文件,切出来的文件命名为 文件名.打开时间[.序号],
+//由后台线程压缩成.gz并只保留最近的max_files个,写日志的线程只做一次rename和open
 class FileLogAppender : public LogAppender {
 public:
     typedef std::shared_ptr<FileLogAppender> ptr;
 
+    //按时间切分
+    enum RotateTime {
+        ROTATE_NONE = 0,    //不按时间切分
+        ROTATE_HOURLY = 1,    //每个整点
+        ROTATE_DAILY = 2    //每天零点
+    };
+
+    //RotateTime和字符串(none/hourly/daily)互相转换
+    static const char* RotateTimeToString(RotateTime v);
+    static RotateTime RotateTimeFromString(const std::string& str);
+
+    //返回now之后下一个按时间切分的时间点(本地时间的整点或零点),ROTATE_NONE返回0
+    static uint64_t NextRotateTime(uint64_t now, RotateTime rotate_time);
+
     //构造函数
-    FileLogAppender(const std::string& filename);
+    //async 是否异步写入, buffer_size 每块缓冲区大小(字节), flush_interval 后台线程最长刷新间隔(毫秒)
+    //drop_when_full 等待写入的缓冲区满时是否丢弃日志(否则阻塞调用线程)
+    FileLogAppender(const std::string& filename, bool async = false
+                    , uint32_t buffer_size = 1024 * 1024, uint32_t flush_interval = 1000
+                    , bool drop_when_full = false);
+
+    //析构函数,异步模式下写完缓冲区中的日志后停止后台线程
+    ~FileLogAppender();
 
     //重写虚函数
     void log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override;
@@ -431,11 +518,76 @@ public:
     //重新打开日志文件,成功返回true
     bool reopen();
 
+    //异步模式下等待已经写入缓冲区的日志全部写到文件
+    void flush();
+
+    /**
+     * @brief 设置文件切分
+     * @param[in] max_size 文件超过多少字节时切分,0表示不按大小切分
+     * @param[in] rotate_time 按时间切分
+     * @param[in] max_files 保留的切分文件个数,0表示全部保留
+     * @param[in] compress 切分出来的文件是否压缩成.gz
+     */
+    void setRotate(uint64_t max_size, RotateTime rotate_time, uint32_t max_files = 0, bool compress = false);
+
+    //返回当前文件大小
+    uint64_t getFileSize() const;
+
+    //是否异步写入
+    bool isAsync() const { return m_async; }
+
+    //返回异步模式下因缓冲区满被丢弃的日志条数
+    uint64_t getDropped() const { return m_droppedTotal; }
+
+private:
+    //异步模式:把一条日志追加到当前缓冲区
+    void append(const std::string& msg);
+
+    //异步模式:后台线程,把写满的缓冲区写入文件
+    void flushThread();
+
+    //异步模式:当前缓冲区放入待写队列,换上一块空缓冲区(需持有m_asyncMutex)
+    void rotateBuffer();
+
+    //打开文件,记录文件大小、inode和下一次按时间切分的时间(需持有m_mutex)
+    bool openFile();
+
+    //每隔几秒检查一次文件是否被删除或者被外部移走,是的话重新打开
+    void checkFile(uint64_t now);
+
+    //写入len字节之前检查是否需要切分,需要则切分(需持有m_mutex)
+    void rotateIfNeeded(uint64_t now, size_t len);
+
 private:
     std::string m_filename;    //文件路径
     std::ofstream m_filestream;    //文件流
-    uint64_t m_lastTime = 0;    //上次重新打开时间
-
+    uint64_t m_lastTime = 0;    //上次检查文件的时间
+    uint64_t m_fileSize = 0;    //当前文件大小
+    uint64_t m_inode = 0;    //当前文件的inode,用来发现文件被删除或移走
+    uint64_t m_openTime = 0;    //当前文件打开的时间,用作切分文件名
+    uint64_t m_nextRotate = 0;    //下一次按时间切分的时间,0表示不按时间切分
+    std::string m_rotateStamp;    //上一次切分文件名中的时间
+    uint32_t m_rotateSeq = 0;    //同一时间内切分的下一个序号
+    uint64_t m_maxSize = 0;    //按大小切分的阈值
+    RotateTime m_rotateTime = ROTATE_NONE;    //按时间切分
+    uint32_t m_maxFiles = 0;    //保留的切分文件个数
+    bool m_compress = false;    //是否压缩切分出来的文件
+
+    bool m_async = false;    //是否异步写入
+    uint32_t m_bufferSize = 0;    //每块缓冲区大小
+    uint32_t m_flushInterval = 0;    //后台线程最长刷新间隔(毫秒)
+    bool m_dropWhenFull = false;    //缓冲区满时丢弃还是阻塞
+    std::mutex m_asyncMutex;    //缓冲区锁,需要超时等待,所以用std::mutex和条件变量
+    std::condition_variable m_flushCond;    //通知后台线程有写满的缓冲区
+    std::condition_variable m_doneCond;    //通知调用线程缓冲区已经写入文件
+    std::string m_current;    //当前写入的缓冲区
+    std::vector<std::string> m_pending;    //等待写入文件的缓冲区
+    std::vector<std::string> m_spares;    //写完回收的空缓冲区
+    bool m_writing = false;    //后台线程是否正在写文件
+    bool m_stopping = false;    //是否停止后台线程
+    uint64_t m_dropped = 0;    //还没记录到文件中的丢弃条数
+    std::atomic<uint64_t> m_droppedTotal = {0};    //丢弃的总条数
+    Thread::ptr m_thread;    //后台写文件线程
 };
 
 };
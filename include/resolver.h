@@ -0,0 +1,167 @@
+#ifndef __SYLAR_RESOLVER_H__
+#define __SYLAR_RESOLVER_H__
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <netdb.h>
+#include "address.h"
+#include "fiber.h"
+#include "singleton.h"
+#include "thread.h"
+
+namespace sylar {
+
+class Scheduler;
+
+/**
+ * @brief 异步域名解析器
+ * @details getaddrinfo是阻塞调用且不会被hook，直接在调度线程中调用会卡住该线程上的所有协程。
+ *          Resolver把解析交给专门的解析线程执行，发起解析的协程让出执行权，解析完成后
+ *          再被调度回原线程；非调度线程直接同步解析。
+ *          解析结果按(node, service, family, socktype, protocol)缓存，成功结果保存cache_ttl毫秒，
+ *          失败结果保存negative_ttl毫秒；同一个key同时只有一个解析在进行，其余请求等待它的结果。
+ *          数字IP地址不经过解析线程和缓存，直接解析。
+ */
+class Resolver {
+public:
+    typedef Mutex MutexType;
+    typedef RWMutex RWMutexType;
+
+    /**
+     * @brief 统计数据
+     */
+    struct Stats {
+        uint64_t hits = 0;          // 缓存命中次数(成功结果)
+        uint64_t negativeHits = 0;  // 缓存命中次数(失败结果)
+        uint64_t misses = 0;        // 缓存未命中次数
+        uint64_t coalesced = 0;     // 合并到正在进行的解析中的次数
+        uint64_t resolves = 0;      // 实际调用getaddrinfo的次数
+        uint64_t cached = 0;        // 当前缓存条目数
+
+        std::string toString() const;
+    };
+
+    /**
+     * @brief 构造函数
+     */
+    Resolver();
+
+    /**
+     * @brief 析构函数，停止解析线程
+     */
+    ~Resolver();
+
+    /**
+     * @brief 解析地址
+     * @param[out] results 解析得到的地址(每次返回新的Address对象，调用方可以修改)
+     * @param[in] node 主机名或IP地址，为空字符串时和getaddrinfo一样解析失败
+     * @param[in] service 服务名或端口号，可以为空
+     * @param[in] family 协议族
+     * @param[in] socktype 套接字类型
+     * @param[in] protocol 协议
+     * @return 成功返回0，失败返回getaddrinfo的错误码
+     */
+    int resolve(std::vector<Address::ptr>& results, const std::string& node
+                , const std::string& service, int family, int socktype, int protocol);
+
+    /**
+     * @brief 清空缓存
+     */
+    void clear();
+
+    /**
+     * @brief 获取统计数据
+     */
+    Stats getStats();
+
+private:
+    /**
+     * @brief 解析结果
+     */
+    struct Entry {
+        std::vector<Address::ptr> addrs;
+        int error = 0;
+        uint64_t expire = 0;
+    };
+
+    /**
+     * @brief 等待解析结果的协程
+     */
+    struct Waiter {
+        Scheduler* scheduler;
+        Fiber::ptr fiber;
+        pid_t thread;
+    };
+
+    /**
+     * @brief 正在进行的解析
+     */
+    struct Job {
+        typedef std::shared_ptr<Job> ptr;
+        std::string key;
+        std::string node;
+        std::string service;
+        addrinfo hints;
+        Entry entry;
+        std::vector<Waiter> waiters;
+    };
+
+    /**
+     * @brief 调用getaddrinfo解析
+     */
+    int doResolve(std::vector<Address::ptr>& results, const std::string& node
+                  , const std::string& service, const addrinfo& hints);
+
+    /**
+     * @brief 查找缓存，命中返回true
+     */
+    bool lookupCache(const std::string& key, std::vector<Address::ptr>& results, int& error);
+
+    /**
+     * @brief 写入缓存
+     */
+    void insertCache(const std::string& key, const Entry& entry);
+
+    /**
+     * @brief 复制地址，缓存中的地址不直接交给调用方
+     */
+    static void CopyAddrs(const std::vector<Address::ptr>& from, std::vector<Address::ptr>& to);
+
+    /**
+     * @brief 启动解析线程(首次需要时启动)
+     */
+    void startThreads();
+
+    /**
+     * @brief 解析线程入口
+     */
+    void run();
+
+private:
+    RWMutexType m_cacheMutex;                        // 缓存锁
+    std::unordered_map<std::string, Entry> m_cache;  // 解析结果缓存
+
+    MutexType m_mutex;                                    // 任务队列锁
+    std::deque<Job::ptr> m_queue;                         // 等待解析线程处理的任务
+    std::unordered_map<std::string, Job::ptr> m_pending;  // 正在进行的解析, key相同的请求合并
+    Semaphore m_sem;                                      // 通知解析线程有新任务
+    std::vector<Thread::ptr> m_threads;                   // 解析线程
+    bool m_stopping = false;                              // 是否停止
+
+    // 统计数据，见Stats
+    std::atomic<uint64_t> m_hits = {0};
+    std::atomic<uint64_t> m_negativeHits = {0};
+    std::atomic<uint64_t> m_misses = {0};
+    std::atomic<uint64_t> m_coalesced = {0};
+    std::atomic<uint64_t> m_resolves = {0};
+};
+
+typedef Singleton<Resolver> ResolverMgr;
+
+}
+
+#endif
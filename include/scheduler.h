@@ -9,6 +9,7 @@
 #include <atomic>
 #include "thread.h"
 #include "fiber.h"
+#include "work_steal_queue.h"
 
 namespace sylar {
 
@@ -54,6 +55,15 @@ public:
     // 流式输出
     std::ostream& dump(std::ostream& os);
 
+    //返回所有调度线程的id(use_caller时包含caller线程)
+    std::vector<int> getThreadIds();
+
+    //返回真正发出的tickle次数
+    uint64_t getTickleIssued() const { return m_tickleIssued; }
+
+    //返回被合并或没有空闲线程而省略的tickle次数
+    uint64_t getTickleSuppressed() const { return m_tickleSuppressed; }
+
     /**
      * @brief 添加任务,开始调度协程
      * @param[in] fc 协程或执行函数来充当任务
@@ -61,6 +71,13 @@ public:
      */
     template<class FiberOrCb>
     void scheduler(FiberOrCb fc, size_t thread = -1) {
+        if(m_workStealing) {
+            if(schedulerLocal(fc, thread)) {
+                tickle();
+            }
+            return;
+        }
+
         bool need_tickle = false;
         {
             MutexType::Lock lock(m_mutex);
@@ -76,14 +93,25 @@ public:
      * @brief 按照迭代器批量添加任务,开始调度协程
      * @param[in] begin 任务数组的开始
      * @param[in] end 任务数组的结束
+     * @param[in] thread 指定执行的线程id，-1表示任意线程
      */
     template<class InputIterator>
-    void scheduler(InputIterator begin, InputIterator end) {
+    void scheduler(InputIterator begin, InputIterator end, int thread = -1) {
         bool need_tickle = false;
+        if(m_workStealing) {
+            for(auto it = begin; it != end; ++it) {
+                need_tickle = schedulerLocal(*it, thread) || need_tickle;
+            }
+            if(need_tickle) {
+                tickle();
+            }
+            return;
+        }
+
         {
             MutexType::Lock lock(m_mutex);
             for(auto it = begin; it != end; ++it) {
-                need_tickle = schedulerNolock(*it, -1) || need_tickle;
+                need_tickle = schedulerNolock(*it, thread) || need_tickle;
             }
         }
 
@@ -104,6 +132,17 @@ private:
         return need_tickle;
     }
 
+    //工作窃取模式下添加任务，任务放入线程本地队列，返回是否需要tickle
+    template<class FiberOrCb>
+    bool schedulerLocal(FiberOrCb fc, size_t thread) {
+        FiberAndThread* ft = new FiberAndThread(fc, thread);
+        if(!ft->fiber && !ft->cb) {
+            delete ft;
+            return false;
+        }
+        return pushLocalTask(ft);
+    }
+
 protected:
     //协程调度函数(调度协程的实现)
     void run();
@@ -120,6 +159,9 @@ protected:
     //是否有空闲线程
     bool hasIdleThreads() { return m_idleThreadCount > 0; }
 
+    //是否为工作窃取调度模式
+    bool isWorkStealing() const { return m_workStealing; }
+
 private:
     /**
      * @brief 调度任务，协程/函数二选一，可指定在哪个线程上调度
@@ -184,17 +226,47 @@ private:
         }
     };
 
+    /**
+     * @brief 工作窃取模式下每个调度线程的本地任务队列
+     * @details tasks只有拥有者线程push/pop，不加锁，其他线程只能steal；
+     *          inbox接收其他线程投递过来的任务(包括指定该线程执行的任务)，用mutex保护
+     */
+    struct LocalQueue {
+        WorkStealQueue<FiberAndThread*> tasks;   //本地无锁任务队列
+        MutexType mutex;                         //保护inbox
+        std::list<FiberAndThread*> inbox;        //其他线程投递的任务
+        std::atomic<size_t> inboxSize = {0};     //inbox任务数量
+        std::atomic<int> threadId = {-1};        //拥有者线程id
+        size_t index = 0;                        //在m_localQueues中的下标
+    };
+
+    //工作窃取模式下添加任务，返回是否需要tickle
+    bool pushLocalTask(FiberAndThread* ft);
+
+    //工作窃取模式下获取一个任务，依次从本地队列、inbox、全局队列、其他线程中获取，返回是否需要tickle
+    bool takeLocalTask(FiberAndThread& task);
+
+    //根据线程id找到对应的本地队列
+    LocalQueue* getLocalQueue(int thread_id);
+
 private: 
     MutexType m_mutex;    //互斥锁
     std::string m_name;   //协程调度器名称
     std::vector<Thread::ptr> m_threads;   //线程池
     std::list<FiberAndThread> m_fibers;   //待执行的任务队列
     Fiber::ptr m_rootFiber;  //use_caller为true时有效,表示调度协程(不是主协程)
+    std::vector<LocalQueue*> m_localQueues;  //工作窃取模式下每个线程的本地队列,下标与m_threadIds对应
+    std::atomic<size_t> m_localTaskCount = {0};  //工作窃取模式下本地队列中的任务总数
+    std::atomic<size_t> m_globalTaskCount = {0}; //工作窃取模式下m_fibers中的任务数
+    std::atomic<size_t> m_nextQueue = {0};  //外部线程投递任务时轮询的队列下标
+    bool m_workStealing = false;   //是否使用工作窃取调度模式
 protected:
     std::vector<uint64_t> m_threadIds;  //线程id数组
     size_t m_threadCount = 0;   //线程数量
     std::atomic<size_t> m_activeThreadCount = {0};  //工作线程数量
     std::atomic<size_t> m_idleThreadCount = {0};  //空闲线程数量
+    std::atomic<uint64_t> m_tickleIssued = {0};      //真正发出的tickle次数
+    std::atomic<uint64_t> m_tickleSuppressed = {0};  //被合并或没有空闲线程而省略的tickle次数
     bool m_stopping = false;   //是否正在停止
     bool m_autoStop = false;   //是否自动停止
     int m_rootThread = 0;  //use_caller为true时,caller线程id
@@ -0,0 +1,125 @@
+#ifndef __SYLAR_SEGMENT_ARRAY_H__
+#define __SYLAR_SEGMENT_ARRAY_H__
+
+#include <atomic>
+#include <functional>
+#include <stddef.h>
+#include "noncopyable.h"
+
+namespace sylar {
+
+/**
+ * @brief 分段数组(按下标访问，元素地址永不移动)
+ * @details 两级结构: 固定大小的一级数组保存分段指针，每个分段包含 2^BITS 个元素，
+ *          第一次访问某个分段时才分配，分配后直到析构都不会释放或搬移。
+ *          读取只需要两次acquire加载，不需要任何锁；
+ *          多个线程同时分配同一个分段时通过CAS竞争，失败方释放自己分配的分段。
+ *          适合以fd为下标的上下文表，扩容时不会阻塞其他线程的读取
+ * @tparam T 元素类型，必须可以默认构造
+ * @tparam BITS 每个分段的元素个数的位数
+ */
+template<class T, size_t BITS = 10>
+class SegmentArray : Noncopyable {
+public:
+    //每个分段的元素个数
+    static const size_t SEGMENT_SIZE = (size_t)1 << BITS;
+    static const size_t SEGMENT_MASK = SEGMENT_SIZE - 1;
+
+    /**
+     * @brief 新分段中每个元素的初始化函数
+     * @param[in] item 元素
+     * @param[in] index 元素下标
+     */
+    typedef std::function<void(T& item, size_t index)> InitFunc;
+
+    /**
+     * @brief 构造函数
+     * @param[in] max_size 最大元素个数(下标上限)
+     * @param[in] init 新分段中每个元素的初始化函数，在分段发布前调用
+     */
+    SegmentArray(size_t max_size, InitFunc init = nullptr)
+        :m_count((max_size + SEGMENT_MASK) >> BITS)
+        ,m_segments(new std::atomic<T*>[m_count])
+        ,m_init(init) {
+        for(size_t i = 0; i < m_count; ++i) {
+            m_segments[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    //析构函数
+    ~SegmentArray() {
+        for(size_t i = 0; i < m_count; ++i) {
+            delete[] m_segments[i].load(std::memory_order_relaxed);
+        }
+        delete[] m_segments;
+    }
+
+    //最大元素个数
+    size_t capacity() const { return m_count << BITS; }
+
+    /**
+     * @brief 获取元素，所在分段未分配时返回nullptr
+     * @details 无锁
+     */
+    T* get(size_t index) const {
+        size_t seg = index >> BITS;
+        if(seg >= m_count) {
+            return nullptr;
+        }
+        T* s = m_segments[seg].load(std::memory_order_acquire);
+        return s ? &s[index & SEGMENT_MASK] : nullptr;
+    }
+
+    /**
+     * @brief 获取元素，所在分段未分配时先分配
+     * @return 超出最大元素个数时返回nullptr
+     */
+    T* getOrCreate(size_t index) {
+        size_t seg = index >> BITS;
+        if(seg >= m_count) {
+            return nullptr;
+        }
+        T* s = m_segments[seg].load(std::memory_order_acquire);
+        if(!s) {
+            T* tmp = new T[SEGMENT_SIZE];
+            if(m_init) {
+                for(size_t i = 0; i < SEGMENT_SIZE; ++i) {
+                    m_init(tmp[i], (seg << BITS) + i);
+                }
+            }
+            if(m_segments[seg].compare_exchange_strong(s, tmp,
+                        std::memory_order_acq_rel, std::memory_order_acquire)) {
+                s = tmp;
+            } else {
+                //其他线程已经分配好了，s为其分配的分段
+                delete[] tmp;
+            }
+        }
+        return &s[index & SEGMENT_MASK];
+    }
+
+    /**
+     * @brief 遍历所有已分配的元素
+     * @attention 不会和getOrCreate同步，只能在没有并发分配时调用
+     */
+    void foreach(std::function<void(T& item, size_t index)> cb) {
+        for(size_t i = 0; i < m_count; ++i) {
+            T* s = m_segments[i].load(std::memory_order_acquire);
+            if(!s) {
+                continue;
+            }
+            for(size_t j = 0; j < SEGMENT_SIZE; ++j) {
+                cb(s[j], (i << BITS) + j);
+            }
+        }
+    }
+
+private:
+    size_t m_count;                   //分段个数
+    std::atomic<T*>* m_segments;      //分段指针数组
+    InitFunc m_init;                  //新分段的初始化函数
+};
+
+}
+
+#endif
@@ -105,6 +105,13 @@ public:
         return setOption(level, optname, &optval, sizeof(T));
     }
 
+    /**
+     * @brief 设置SO_REUSEPORT，多个socket可以绑定同一个地址，由内核分配新连接
+     * @details 句柄还未创建时先创建句柄
+     * @pre 需要在bind之前调用
+     */
+    bool setReusePort(bool v);
+
     /**
      * @brief 连接地址，客户端发起，连接服务器
      * @param[in] addr 目标地址
@@ -134,6 +141,18 @@ public:
      */
     virtual Socket::ptr accept();
 
+    /**
+     * @brief 批量接收连接，一次把监听队列中已完成的连接取完
+     * @details 第一个连接通过hook的accept4等待，之后直接用accept4取到EAGAIN为止；
+     *          之后的新句柄由accept4直接设置SOCK_NONBLOCK|SOCK_CLOEXEC，远端地址取自accept4的返回，
+     *          本地地址在第一次获取时才解析
+     * @param[out] socks 新生成的socket追加到末尾
+     * @param[in] max_count 本次最多接收的连接数
+     * @return 本次接收的连接数，失败返回0
+     * @pre Socket必须 bind , listen 成功
+     */
+    virtual size_t acceptBatch(std::vector<Socket::ptr>& socks, size_t max_count);
+
     // 关闭socket
     virtual bool close();
     
@@ -187,6 +206,19 @@ public:
      */
     virtual ssize_t sendTo(const iovec* buf, size_t len, const Address::ptr toAddr, int flags = 0);
 
+    /**
+     * @brief 发送文件数据
+     * @details 用sendfile在内核中把文件数据直接写入socket，受SO_SNDTIMEO约束
+     * @param[in] fd 文件句柄
+     * @param[in] offset 文件中的开始位置
+     * @param[in] len 最多发送的长度
+     * @return
+     *      @retval >0 发送成功对应大小的数据
+     *      @retval =0 socket被关闭或者文件已经读完
+     *      @retval <0 socket出错
+     */
+    virtual ssize_t sendFile(int fd, off_t offset, size_t len);
+
     /**
      * @brief 接受数据
      * @param[out] buf 接收数据的内存
@@ -382,6 +414,12 @@ public:
      */
     virtual Socket::ptr accept() override;
 
+    /**
+     * @brief 批量接收连接
+     * @details 每个连接都要完成SSL握手，只接收一个连接，握手仍在accept()中完成
+     */
+    virtual size_t acceptBatch(std::vector<Socket::ptr>& socks, size_t max_count) override;
+
     // 关闭socket
     virtual bool close() override;
     
@@ -435,6 +473,9 @@ public:
      */
     virtual ssize_t sendTo(const iovec* buf, size_t len, const Address::ptr toAddr, int flags = 0) override;
 
+    // 先读出文件数据再加密发送，SSL连接不能使用sendfile
+    virtual ssize_t sendFile(int fd, off_t offset, size_t len) override;
+
     /**
      * @brief 接受数据
      * @param[out] buf 接收数据的内存
@@ -16,6 +16,7 @@ struct TcpServerConf {
     std::vector<std::string> address;
     int keepalive = 0;
     int timeout = 1000 * 60;
+    int reuseport = 0;    //是否每个process_worker线程各自绑定一个SO_REUSEPORT的socket
     std::string name = "wwt";
     std::string type = "http";
     std::string accept_worker;
@@ -29,6 +30,7 @@ struct TcpServerConf {
         return this->address == conf.address
             && this->keepalive == conf.keepalive
             && this->timeout == conf.keepalive
+            && this->reuseport == conf.reuseport
             && this->name == conf.name
             && this->type == conf.type
             && this->accept_worker == accept_worker
@@ -45,6 +47,7 @@ public:
         YAML::Node node = YAML::Load(str);
         conf.keepalive = node["keepalive"].as<int>(conf.keepalive);
         conf.timeout = node["timeout"].as<int>(conf.timeout);
+        conf.reuseport = node["reuseport"].as<int>(conf.reuseport);
         conf.name = node["name"].as<std::string>(conf.name);
         conf.type = node["type"].as<std::string>(conf.type);
         conf.accept_worker = node["accept_worker"].as<std::string>();
@@ -66,6 +69,7 @@ public:
         YAML::Node node(YAML::NodeType::Map);
         node["keepalive"] = conf.keepalive;
         node["timeout"] = conf.timeout;
+        node["reuseport"] = conf.reuseport;
         node["name"] = conf.name;
         node["type"] = conf.type;
         node["accept_worker"] = conf.accept_worker;
@@ -86,6 +90,9 @@ public:
  *          (2)然后开始accept来自客户端的socket(等待用户connect)，成功accept后生成新的Socket用于通信，
  *          (3)然后开始执行指定的任务(即调用回调函数handleClient)，
  *          (4)最后停止服务器服务
+ *          开启reuseport后变为多reactor模式: 每个地址为m_worker的每个线程各绑定一个SO_REUSEPORT的socket，
+ *          由内核在这些socket之间分配新连接，每个线程只accept自己的socket，新连接直接在本线程处理；
+ *          accept协程和连接协程都绑定在本线程上，fd注册在本线程自己的epoll句柄中，之后的IO唤醒也不会跨线程
  */
 class TcpServer : public std::enable_shared_from_this<TcpServer>, Noncopyable {
 public:
@@ -105,6 +112,17 @@ public:
      */
     virtual ~TcpServer();
 
+    /**
+     * @brief 是否为SO_REUSEPORT多reactor模式
+     */
+    bool isReusePort() const { return m_reusePort; }
+
+    /**
+     * @brief 设置SO_REUSEPORT多reactor模式
+     * @pre 需要在bind之前设置
+     */
+    void setReusePort(bool v) { m_reusePort = v; }
+
     /**
      * @brief 服务器绑定地址(单个地址)
      * @details 实际上完成服务器的bind和listen操作
@@ -166,6 +184,12 @@ public:
      */
     void setName(std::string name) { m_name = name; }
 
+    /**
+     * @brief 返回服务器绑定的Socket数组
+     * @details 绑定端口0时可以从中获取系统分配的端口
+     */
+    std::vector<Socket::ptr> getSocks() const { return m_socket; }
+
     TcpServerConf::ptr getConf() const { return m_conf; }
     void setConf(TcpServerConf::ptr conf) { m_conf = conf; }
     void setConf(const TcpServerConf& conf);
@@ -178,19 +202,29 @@ protected:
      */
     virtual void handleClient(Socket::ptr client);
 
+    /**
+     * @brief reuseport模式下处理新连接
+     * @details 把处理连接的协程绑定到当前线程后再执行handleClient
+     * @param[in] client 新连接的Socket类
+     */
+    void handleClientLocal(Socket::ptr client);
+
     /**
      * @brief 完成服务器单个Socket的accept的操作
      * @param[in] sock 服务器绑定的Socket
+     * @param[in] local 新连接是否留在当前线程处理(reuseport模式)
      */
-    virtual void startAccept(Socket::ptr sock);
+    virtual void startAccept(Socket::ptr sock, bool local = false);
 
 protected:
     std::vector<Socket::ptr> m_socket;  // 服务器端绑定的Socket数组
+    std::vector<bool> m_reusePortSocket;  // 与m_socket对应，是否为SO_REUSEPORT的socket
     IOManager* m_worker;                // 调度新连接的Socket工作的协程调度器
     IOManager* m_acceptWorker;          // 调度服务器Socket执行accept的协程调度器
     std::string m_name;                 // 服务器名称
     uint64_t m_recvTimeout;             // 服务器接收超时时间(毫秒)
     bool m_isStop;                      // 服务是否停止
+    bool m_reusePort = false;           // 是否为SO_REUSEPORT多reactor模式
 
     TcpServerConf::ptr m_conf;          // 服务器配置
 };
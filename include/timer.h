@@ -10,9 +10,11 @@
 namespace sylar {
 
 class TimerManager;
+class TimerWheel;
 //定时器类
 class Timer : public std::enable_shared_from_this<Timer> {
 friend class TimerManager;
+friend class TimerWheel;
 public:
     typedef std::shared_ptr<Timer> ptr;
 
@@ -55,6 +57,12 @@ private:
     std::function<void()> m_cb = nullptr;  //回调函数
     TimerManager* m_manager = nullptr;     //定时器管理器
 
+    //时间轮后端使用的侵入式双向链表节点
+    Timer* m_wheelPrev = nullptr;   //同一槽位的前一个定时器
+    Timer* m_wheelNext = nullptr;   //同一槽位的后一个定时器
+    int m_wheelSlot = -1;           //所在槽位，-1表示不在时间轮中
+    Timer::ptr m_wheelSelf;         //在时间轮中时持有自身，保证定时器不被提前释放
+
 private:
     //定时器比较仿函数
     struct Comparator {
@@ -73,8 +81,19 @@ friend class Timer;
 public:
     typedef RWMutex RWMutexType;
 
-    //构造函数
-    TimerManager();
+    //定时器的存储结构
+    enum Type {
+        //按执行时间排序的std::set，插入/删除 O(log n)
+        SET = 0,
+        //分层时间轮，插入/删除 O(1)，精度为1毫秒
+        WHEEL = 1
+    };
+
+    /**
+     * @brief 构造函数
+     * @param[in] type 定时器的存储结构
+     */
+    TimerManager(Type type = SET);
 
     //析构函数
     virtual ~TimerManager();
@@ -109,6 +128,9 @@ public:
     //是否还有定时器
     bool hasTimer();
 
+    //返回定时器的存储结构
+    Type getTimerType() const { return m_type; }
+
 protected:
     //检测到新添加的定时器的超时时间比当前最小的定时器还要小时，
     //TimerManager通过这个方法来通知IOManager立刻更新当前的epoll_wait超时，
@@ -120,9 +142,23 @@ private:
     //检测服务器时间是否被调后了
     bool detectClockRollover(uint64_t now_ms);
 
+    /**
+     * @brief 添加定时器(需要持有写锁)
+     * @return 是否需要通知IOManager更新epoll_wait超时
+     */
+    bool insertTimer(const Timer::ptr& timer);
+
+    /**
+     * @brief 删除定时器(需要持有写锁)
+     * @return 定时器不存在时返回false
+     */
+    bool eraseTimer(const Timer::ptr& timer);
+
 private:
     RWMutexType m_mutex;
-    std::set<Timer::ptr, Timer::Comparator> m_timers;  //定时器集合
+    Type m_type;
+    std::set<Timer::ptr, Timer::Comparator> m_timers;  //定时器集合(SET)
+    TimerWheel* m_wheel = nullptr;                     //时间轮(WHEEL)
     bool m_tickled = false;        //是否触发onTimerInsertedAtFront
     uint64_t m_previouseTime = 0;  //上次执行时间
 };
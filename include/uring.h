@@ -0,0 +1,113 @@
+#ifndef __SYLAR_URING_H__
+#define __SYLAR_URING_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/io_uring.h>
+#include "noncopyable.h"
+
+namespace sylar {
+
+/**
+ * @brief io_uring的最小封装
+ * @details 直接使用 io_uring_setup/io_uring_enter 系统调用和mmap的共享环形队列，不依赖liburing。
+ *          提交队列(SQ)不是线程安全的，多线程提交时由调用方加锁；完成队列(CQ)只能由一个线程消费
+ */
+class IoUring : Noncopyable {
+public:
+    //构造函数
+    IoUring();
+
+    //析构函数
+    ~IoUring();
+
+    /**
+     * @brief 创建io_uring实例
+     * @param[in] entries 提交队列大小
+     * @return 成功返回true，失败返回false并设置errno
+     */
+    bool init(uint32_t entries);
+
+    //是否已经创建
+    bool isInit() const { return m_fd >= 0; }
+
+    //返回io_uring的文件句柄
+    int getFd() const { return m_fd; }
+
+    /**
+     * @brief 获取一个空闲的sqe
+     * @details 返回的sqe已清零，提交队列已满时返回nullptr
+     */
+    io_uring_sqe* getSqe();
+
+    //提交队列剩余的空闲sqe个数
+    uint32_t sqSpace() const;
+
+    /**
+     * @brief 把本地已填充的sqe写入提交队列(不进入内核)
+     * @details 多线程提交时，getSqe、填充和flush要在同一把锁内完成
+     * @return 提交队列中内核尚未取走的sqe个数
+     */
+    uint32_t flush();
+
+    /**
+     * @brief 把已填充的sqe提交给内核
+     * @return 成功返回提交的个数，失败返回-errno
+     */
+    int submit();
+
+    /**
+     * @brief 提交to_submit个已flush的sqe并等待至少一个cqe
+     * @param[in] to_submit 要提交的个数(flush的返回值)
+     * @param[in] timeout_ms 最长等待时间(毫秒)，~0ull表示一直等待
+     * @return 成功返回提交的个数，超时返回-ETIME，其他失败返回-errno
+     */
+    int wait(uint32_t to_submit, uint64_t timeout_ms);
+
+    //提交sqe并等待至少一个cqe，等价于 wait(flush(), timeout_ms)
+    int submitAndWait(uint64_t timeout_ms) { return wait(flush(), timeout_ms); }
+
+    //获取一个已完成的cqe，没有返回nullptr
+    io_uring_cqe* peekCqe();
+
+    //标记peekCqe返回的cqe已处理
+    void cqeSeen();
+
+    /**
+     * @brief 检测内核是否支持IOManager需要的io_uring功能
+     * @details 需要 IORING_FEAT_EXT_ARG(5.11) 以及按fd取消(IORING_OP_SOCKET同期的5.19)
+     */
+    static bool IsSupported();
+
+private:
+    //调用io_uring_enter
+    int enter(uint32_t to_submit, uint32_t min_complete, uint32_t flags, void* arg, size_t arg_size);
+
+private:
+    int m_fd = -1;                     //io_uring文件句柄
+    io_uring_params m_params;          //创建参数(内核回填各个环的偏移)
+
+    void* m_sqRing = nullptr;          //提交队列的映射
+    size_t m_sqRingSize = 0;
+    void* m_cqRing = nullptr;          //完成队列的映射(IORING_FEAT_SINGLE_MMAP时与m_sqRing相同)
+    size_t m_cqRingSize = 0;
+    io_uring_sqe* m_sqes = nullptr;    //sqe数组的映射
+    size_t m_sqesSize = 0;
+
+    uint32_t* m_sqHead = nullptr;
+    uint32_t* m_sqTail = nullptr;
+    uint32_t m_sqMask = 0;
+    uint32_t m_sqEntries = 0;
+    uint32_t* m_sqArray = nullptr;
+    uint32_t m_sqeHead = 0;            //本地: 已写入提交队列的位置
+    uint32_t m_sqeTail = 0;            //本地: 已分配出去的sqe位置
+
+    uint32_t* m_cqHead = nullptr;
+    uint32_t* m_cqTail = nullptr;
+    uint32_t m_cqMask = 0;
+    io_uring_cqe* m_cqes = nullptr;
+};
+
+}
+
+#endif
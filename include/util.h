@@ -19,6 +19,14 @@ pid_t getThreadId();     // pid_t用于定义进程ID，本质上为int
 //返回当前协程的ID
 uint32_t getFiberId();
 
+/**
+ * @brief 返回当前线程的序号
+ * @details 从0开始，总是分配当前最小的空闲序号，线程退出后序号被之后的线程复用，
+ *          所以序号不超过同时存活的线程数，适合作为按线程划分的缓存数组下标。
+ *          线程的thread_local析构阶段(序号已经归还)返回-1
+ */
+int GetThreadIndex();
+
 /**
  * @brief 获取当前的调用栈
  * @param[out] bt 保存调用栈
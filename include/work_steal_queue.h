@@ -0,0 +1,170 @@
+#ifndef __SYLAR_WORK_STEAL_QUEUE_H__
+#define __SYLAR_WORK_STEAL_QUEUE_H__
+
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include "noncopyable.h"
+
+namespace sylar {
+
+/**
+ * @brief 工作窃取双端队列(Chase-Lev deque)
+ * @details 队列的拥有者线程在底部(bottom)执行push/pop，不需要加锁；
+ *          其他线程只能在顶部(top)执行steal，通过CAS竞争一个元素。
+ *          容量不足时拥有者线程会扩容为原来的2倍，旧数组延迟到析构时才释放，
+ *          保证正在steal的线程读取旧数组时不会访问到已释放的内存
+ * @attention T 必须是可平凡拷贝的类型(一般为指针)
+ */
+template<class T>
+class WorkStealQueue : Noncopyable {
+private:
+    //环形数组，下标按容量取模
+    class Array {
+    public:
+        Array(int64_t capacity)
+            :m_capacity(capacity)
+            ,m_mask(capacity - 1)
+            ,m_data(new std::atomic<T>[capacity]) {
+        }
+
+        ~Array() {
+            delete[] m_data;
+        }
+
+        int64_t capacity() const { return m_capacity; }
+
+        void put(int64_t i, T item) {
+            m_data[i & m_mask].store(item, std::memory_order_relaxed);
+        }
+
+        T get(int64_t i) const {
+            return m_data[i & m_mask].load(std::memory_order_relaxed);
+        }
+
+        //扩容为原来的2倍，并拷贝[top, bottom)之间的元素
+        Array* grow(int64_t bottom, int64_t top) const {
+            Array* arr = new Array(m_capacity * 2);
+            for(int64_t i = top; i != bottom; ++i) {
+                arr->put(i, get(i));
+            }
+            return arr;
+        }
+
+    private:
+        int64_t m_capacity;   //容量(2的幂)
+        int64_t m_mask;       //取模掩码
+        std::atomic<T>* m_data;
+    };
+
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] capacity 初始容量，必须是2的幂
+     */
+    WorkStealQueue(int64_t capacity = 256)
+        :m_top(0)
+        ,m_bottom(0)
+        ,m_array(new Array(capacity)) {
+    }
+
+    //析构函数
+    ~WorkStealQueue() {
+        for(auto& i : m_garbage) {
+            delete i;
+        }
+        delete m_array.load(std::memory_order_relaxed);
+    }
+
+    //队列是否为空(非精确值)
+    bool empty() const {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        return b <= t;
+    }
+
+    //队列元素个数(非精确值)
+    size_t size() const {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        return b > t ? (size_t)(b - t) : 0;
+    }
+
+    /**
+     * @brief 在底部压入一个元素
+     * @attention 只能由队列的拥有者线程调用
+     */
+    void push(T item) {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_acquire);
+        Array* a = m_array.load(std::memory_order_relaxed);
+        if(b - t > a->capacity() - 1) {
+            Array* tmp = a->grow(b, t);
+            m_garbage.push_back(a);
+            a = tmp;
+            m_array.store(a, std::memory_order_release);
+        }
+        a->put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 从底部弹出一个元素(后进先出)
+     * @attention 只能由队列的拥有者线程调用
+     * @return 队列为空或最后一个元素被窃取时返回false
+     */
+    bool pop(T& item) {
+        int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+        Array* a = m_array.load(std::memory_order_relaxed);
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        if(t > b) {
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        item = a->get(b);
+        if(t == b) {
+            //只剩最后一个元素，与窃取者竞争
+            bool ok = m_top.compare_exchange_strong(t, t + 1,
+                        std::memory_order_seq_cst, std::memory_order_relaxed);
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return ok;
+        }
+        return true;
+    }
+
+    /**
+     * @brief 从顶部窃取一个元素(先进先出)
+     * @details 可以由任意线程调用
+     * @return 队列为空或竞争失败时返回false
+     */
+    bool steal(T& item) {
+        int64_t t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = m_bottom.load(std::memory_order_acquire);
+        if(t >= b) {
+            return false;
+        }
+        Array* a = m_array.load(std::memory_order_acquire);
+        T tmp = a->get(t);
+        if(!m_top.compare_exchange_strong(t, t + 1,
+                    std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return false;
+        }
+        item = tmp;
+        return true;
+    }
+
+private:
+    std::atomic<int64_t> m_top;       //窃取端
+    std::atomic<int64_t> m_bottom;    //拥有者端
+    std::atomic<Array*> m_array;      //当前使用的数组
+    std::vector<Array*> m_garbage;    //扩容后留下的旧数组(只有拥有者线程访问)
+};
+
+}
+
+#endif
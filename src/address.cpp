@@ -1,6 +1,7 @@
 #include "address.h"
 #include "log.h"
 #include "myendian.h"
+#include "resolver.h"
 #include <stddef.h>
 #include <arpa/inet.h>
 #include <netdb.h>
@@ -77,14 +78,8 @@ Address::ptr Address::Create(const sockaddr* address, socklen_t addrlen) {
 // 因为IP地址是唯一的，而一个主机名可能对应多个IP地址(例如，IPv4和IPv6地址)
 bool Address::Lookup(std::vector<Address::ptr>& results, const std::string& host,
                             int family, int socktype, int protocol) {
-    addrinfo hints, *result;
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family = family;
-    hints.ai_socktype = socktype;
-    hints.ai_protocol = protocol;
-
     std::string node;              //主机名或IP地址字符串
-    const char* service = NULL;    //服务名或端口号
+    std::string service;           //服务名或端口号
 
     /**
      * @brief void *memchr(const void *ptr, int value, size_t num);
@@ -104,16 +99,19 @@ bool Address::Lookup(std::vector<Address::ptr>& results, const std::string& host
             begin++;
         }
         begin++;
-        service = host.substr(begin - host.c_str(), end - begin).c_str();
+        service = host.substr(begin - host.c_str(), end - begin);
     }
     else {  
         // www.sylar.top:80  192.168.88.130:80
-        service = (const char*)memchr(host.c_str(), ':', host.size());
-        if(service) {
+        const char* colon = (const char*)memchr(host.c_str(), ':', host.size());
+        if(colon) {
             // 不存在第二个':'，不能用于ipv6地址
-            if(!memchr(service + 1, ':', host.size() - (service - host.c_str()) - 1)) {
-                node = host.substr(0, service - host.c_str());
-                ++service;
+            if(!memchr(colon + 1, ':', host.size() - (colon - host.c_str()) - 1)) {
+                node = host.substr(0, colon - host.c_str());
+                service = colon + 1;
+            } else {
+                // 不带端口的ipv6地址
+                node = host;
             }
         }
         else {
@@ -125,20 +123,13 @@ bool Address::Lookup(std::vector<Address::ptr>& results, const std::string& host
 
     // SYLAR_LOG_DEBUG(g_logger) << node << "  " << service;
 
-    int rt = getaddrinfo(node.c_str(), service, &hints, &result);
+    // getaddrinfo会阻塞线程，交给Resolver在解析线程中执行并缓存结果
+    int rt = ResolverMgr::GetInstance()->resolve(results, node, service, family, socktype, protocol);
     if(rt) {
         SYLAR_LOG_ERROR(g_logger) << "Address::Lookup getaddrinfo(" << node << ", " 
-                                << service << ") rt=" << rt << " errno=" << errno 
-                                << " errstr=" << strerror(errno);
+                                << service << ") rt=" << rt << " errstr=" << gai_strerror(rt);
         return false;
     }
-    
-    // 循环放入所有符合条件的地址信息
-    for(addrinfo* next = result; next != nullptr; next = next->ai_next) {
-        results.push_back(Create(next->ai_addr, (socklen_t)next->ai_addrlen));
-    }
-
-    freeaddrinfo(result);    // 释放 getaddrinfo() 函数动态分配的内存
     return !results.empty();
 }
 
@@ -167,8 +167,8 @@ int Application::run_fiber(int argc, char** argv) {
     WorkerMgr::GetInstance()->init();
 
     std::vector<TcpServer::ptr> servers;
-    auto confs = g_server_conf->getValue();
-    for(auto& conf : confs) {
+    auto confs = g_server_conf->getSnapshot();
+    for(auto& conf : *confs) {
         // 拿出YAML配置中的地址端口号，绑定服务器地址
         std::vector<Address::ptr> address;
         for(auto& addr : conf.address) {
@@ -250,6 +250,8 @@ int Application::run_fiber(int argc, char** argv) {
         //     server->setName(conf.name);
         // }
         
+        // reuseport模式需要在bind之前设置
+        server->setReusePort(!!conf.reuseport);
         std::vector<Address::ptr> fails;
         if(!server->bind(address, fails)) {
             for(auto i : fails) {
@@ -0,0 +1,673 @@
+#include "binlog.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <yaml-cpp/yaml.h>
+
+namespace sylar {
+
+static_assert(sizeof(BinLogFormat::Record) == 40, "BinLogFormat::Record size changed");
+static_assert(sizeof(BinLogFormat::FileHeader) <= BinLogFormat::HEADER_SIZE, "FileHeader too large");
+
+static const char s_magic[8] = {'S', 'Y', 'B', 'I', 'N', 'L', 'O', 'G'};
+static const char s_meta_magic[8] = {'S', 'Y', 'B', 'L', 'M', 'E', 'T', 'A'};
+
+//数据区最小64KB
+static const uint64_t s_min_capacity = 64 * 1024;
+
+static uint32_t Align8(uint64_t v) {
+    return (v + 7) & ~(uint64_t)7;
+}
+
+/******************* BinLogArgs 类函数实现 *******************/
+//按fmt格式化一个值追加到out,放不下栈上的缓冲区时按实际长度再写一次
+static void AppendFormat(std::string& out, const char* fmt, ...) {
+    char buf[128];
+    va_list vl;
+    va_start(vl, fmt);
+    va_list vl2;
+    va_copy(vl2, vl);
+    int len = vsnprintf(buf, sizeof(buf), fmt, vl);
+    if(len >= (int)sizeof(buf)) {
+        size_t old = out.size();
+        out.resize(old + len + 1);
+        vsnprintf(&out[old], len + 1, fmt, vl2);
+        out.resize(old + len);
+    } else if(len > 0) {
+        out.append(buf, len);
+    }
+    va_end(vl2);
+    va_end(vl);
+}
+
+//依次读取编码后的参数
+class BinLogArgsReader {
+public:
+    BinLogArgsReader(const char* data, size_t len)
+        :m_ptr(data)
+        ,m_end(data + len) {
+    }
+
+    //读取下一个参数,没有参数或者数据不完整返回false
+    bool next(char& type, uint64_t& u, double& d, std::string& str) {
+        if(m_ptr >= m_end) {
+            return false;
+        }
+        type = *m_ptr++;
+        switch(type) {
+            case BinLogArgs::INT:
+            case BinLogArgs::UINT:
+            case BinLogArgs::POINTER:
+                return read(&u, sizeof(u));
+            case BinLogArgs::DOUBLE:
+                return read(&d, sizeof(d));
+            case BinLogArgs::CHAR: {
+                char c = 0;
+                if(!read(&c, 1)) {
+                    return false;
+                }
+                u = (uint64_t)(int64_t)c;
+                return true;
+            }
+            case BinLogArgs::STRING: {
+                uint32_t n = 0;
+                if(!read(&n, sizeof(n)) || n > (size_t)(m_end - m_ptr)) {
+                    m_error = true;
+                    return false;
+                }
+                str.assign(m_ptr, n);
+                m_ptr += n;
+                return true;
+            }
+            default:
+                m_error = true;
+                return false;
+        }
+    }
+
+    //数据是否有错误
+    bool isError() const { return m_error; }
+
+    //是否还有参数
+    bool hasMore() const { return m_ptr < m_end; }
+
+private:
+    bool read(void* v, size_t n) {
+        if(n > (size_t)(m_end - m_ptr)) {
+            m_error = true;
+            return false;
+        }
+        memcpy(v, m_ptr, n);
+        m_ptr += n;
+        return true;
+    }
+
+private:
+    const char* m_ptr;
+    const char* m_end;
+    bool m_error = false;
+};
+
+bool BinLogArgs::Format(std::string& out, const char* fmt, const char* data, size_t len) {
+    BinLogArgsReader reader(data, len);
+    char type = 0;
+    uint64_t u = 0;
+    double d = 0;
+    std::string str;
+    std::string spec;
+    const char* p = fmt;
+    while(*p) {
+        if(*p != '%') {
+            const char* next = strchr(p, '%');
+            if(!next) {
+                out.append(p);
+                break;
+            }
+            out.append(p, next - p);
+            p = next;
+            continue;
+        }
+        if(p[1] == '%') {
+            out.push_back('%');
+            p += 2;
+            continue;
+        }
+        //转换说明: %[标志][宽度][.精度][长度]转换符,长度按参数类型重新生成
+        const char* begin = p++;
+        spec.assign("%");
+        while(*p && strchr("-+ #0", *p)) {
+            spec.push_back(*p++);
+        }
+        while(isdigit((unsigned char)*p)) {
+            spec.push_back(*p++);
+        }
+        if(*p == '.') {
+            spec.push_back(*p++);
+            while(isdigit((unsigned char)*p)) {
+                spec.push_back(*p++);
+            }
+        }
+        while(*p && strchr("hlLqjzt", *p)) {
+            ++p;
+        }
+        char conv = *p;
+        if(!conv) {
+            out.append(begin);
+            break;
+        }
+        ++p;
+        if(!reader.next(type, u, d, str)) {
+            out.append(begin, p - begin);
+            continue;
+        }
+
+        bool int_conv = strchr("diouxXc", conv) != nullptr;
+        bool float_conv = strchr("eEfFgGaA", conv) != nullptr;
+        switch(type) {
+            case INT:
+            case UINT:
+            case CHAR:
+                if(conv == 'c') {
+                    AppendFormat(out, (spec + 'c').c_str(), (int)u);
+                } else if(conv == 'd' || conv == 'i') {
+                    AppendFormat(out, (spec + "lld").c_str(), (long long)u);
+                } else if(int_conv) {
+                    AppendFormat(out, (spec + "ll" + conv).c_str(), (unsigned long long)u);
+                } else if(float_conv) {
+                    AppendFormat(out, (spec + conv).c_str()
+                                 , type == UINT ? (double)u : (double)(int64_t)u);
+                } else if(conv == 'p') {
+                    AppendFormat(out, (spec + 'p').c_str(), (void*)(uintptr_t)u);
+                } else if(type == UINT) {
+                    AppendFormat(out, (spec + "llu").c_str(), (unsigned long long)u);
+                } else {
+                    AppendFormat(out, (spec + "lld").c_str(), (long long)u);
+                }
+                break;
+            case DOUBLE:
+                if(float_conv) {
+                    AppendFormat(out, (spec + conv).c_str(), d);
+                } else if(int_conv && conv != 'c') {
+                    AppendFormat(out, (spec + "lld").c_str(), (long long)d);
+                } else {
+                    AppendFormat(out, (spec + 'g').c_str(), d);
+                }
+                break;
+            case STRING:
+                if(conv == 's') {
+                    AppendFormat(out, (spec + 's').c_str(), str.c_str());
+                } else {
+                    out.append(str);
+                }
+                break;
+            case POINTER:
+                if(int_conv && conv != 'c') {
+                    AppendFormat(out, (spec + "ll" + (conv == 'd' || conv == 'i' ? 'u' : conv)).c_str()
+                                 , (unsigned long long)u);
+                } else {
+                    AppendFormat(out, (spec + 'p').c_str(), (void*)(uintptr_t)u);
+                }
+                break;
+        }
+    }
+    return !reader.isError();
+}
+
+
+/******************* BinLogSite 类函数实现 *******************/
+static std::atomic<uint32_t> s_site_id = {0};
+
+BinLogSite::BinLogSite(const char* file, int32_t line, const char* fmt)
+    :m_id(++s_site_id)
+    ,m_file(file)
+    ,m_line(line)
+    ,m_fmt(fmt) {
+}
+
+const BinLogSite* BinLogSite::GetTextSite(const char* file, int32_t line) {
+    typedef std::map<std::pair<const char*, int32_t>, const BinLogSite*> SiteMap;
+    auto key = std::make_pair(file, line);
+    //先查当前线程的缓存,没有再查全局表
+    static thread_local SiteMap t_sites;
+    auto it = t_sites.find(key);
+    if(it != t_sites.end()) {
+        return it->second;
+    }
+
+    static Mutex s_mutex;
+    static SiteMap s_sites;
+    const BinLogSite* site = nullptr;
+    {
+        Mutex::Lock lock(s_mutex);
+        auto& v = s_sites[key];
+        if(!v) {
+            v = new BinLogSite(file, line, "%s");
+        }
+        site = v;
+    }
+    t_sites[key] = site;
+    return site;
+}
+
+
+/******************* BinaryLogAppender 类函数实现 *******************/
+static void InitSeen(std::atomic<bool>& v, size_t) {
+    v.store(false, std::memory_order_relaxed);
+}
+
+BinaryLogAppender::BinaryLogAppender(const std::string& filename, uint64_t size)
+    :m_filename(filename)
+    ,m_sites(1 << 20, InitSeen)
+    ,m_loggers(1 << 16, InitSeen)
+    ,m_threads(1 << 22, InitSeen) {
+    m_capacity = s_min_capacity;
+    while(m_capacity < size) {
+        m_capacity <<= 1;
+    }
+    m_mask = m_capacity - 1;
+    openFile();
+}
+
+BinaryLogAppender::~BinaryLogAppender() {
+    if(m_map) {
+        munmap(m_map, m_mapSize);
+    }
+    if(m_fd >= 0) {
+        close(m_fd);
+    }
+    if(m_metaFd >= 0) {
+        close(m_metaFd);
+    }
+}
+
+//上一次的文件改名为.old保留,重新创建环形文件和元数据文件
+bool BinaryLogAppender::openFile() {
+    std::string meta = m_filename + ".meta";
+    if(access(m_filename.c_str(), F_OK) == 0) {
+        rename(m_filename.c_str(), (m_filename + ".old").c_str());
+        rename(meta.c_str(), (m_filename + ".old.meta").c_str());
+    }
+
+    m_fd = ::open(m_filename.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    m_metaFd = ::open(meta.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    m_mapSize = BinLogFormat::HEADER_SIZE + m_capacity;
+    if(m_fd < 0 || m_metaFd < 0 || ftruncate(m_fd, m_mapSize) != 0) {
+        std::cout << "BinaryLogAppender open " << m_filename << " failed, errno="
+                  << errno << " " << strerror(errno) << std::endl;
+        return false;
+    }
+    void* map = mmap(nullptr, m_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if(map == MAP_FAILED) {
+        std::cout << "BinaryLogAppender mmap " << m_filename << " failed, errno="
+                  << errno << " " << strerror(errno) << std::endl;
+        return false;
+    }
+    m_map = map;
+    if(::write(m_metaFd, s_meta_magic, sizeof(s_meta_magic)) != sizeof(s_meta_magic)) {
+        std::cout << "BinaryLogAppender write " << meta << " failed, errno="
+                  << errno << " " << strerror(errno) << std::endl;
+    }
+
+    auto header = (BinLogFormat::FileHeader*)map;
+    header->version = BinLogFormat::VERSION;
+    header->headerSize = BinLogFormat::HEADER_SIZE;
+    header->capacity = m_capacity;
+    header->writePos.store(0, std::memory_order_relaxed);
+    header->createTime = time(0);
+    header->pid = getpid();
+    //magic最后写,写到一半崩溃的文件不会被当作有效文件
+    memcpy(header->magic, s_magic, sizeof(s_magic));
+    m_data = (char*)map + BinLogFormat::HEADER_SIZE;
+    m_header = header;
+    return true;
+}
+
+uint64_t BinaryLogAppender::getWritePos() const {
+    return m_header ? m_header->writePos.load(std::memory_order_relaxed) : 0;
+}
+
+void BinaryLogAppender::flush() {
+    if(m_map) {
+        msync(m_map, m_mapSize, MS_SYNC);
+    }
+}
+
+uint64_t BinaryLogAppender::reserve(uint32_t size) {
+    while(true) {
+        uint64_t pos = m_header->writePos.fetch_add(size, std::memory_order_relaxed);
+        uint64_t offset = pos & m_mask;
+        if(offset + size <= m_capacity) {
+            return pos;
+        }
+        //跨越末尾: 末尾剩余部分和绕回开头的部分都填充掉,重新预留
+        uint32_t tail = m_capacity - offset;
+        writePadding(pos, tail);
+        writePadding(pos + tail, size - tail);
+    }
+}
+
+void BinaryLogAppender::writePadding(uint64_t pos, uint32_t size) {
+    auto rec = (BinLogFormat::Record*)(m_data + (pos & m_mask));
+    if(size >= 16) {
+        rec->site = 0;
+    }
+    __atomic_store_n(&rec->end, pos + size, __ATOMIC_RELEASE);
+}
+
+bool BinaryLogAppender::FirstSeen(SegmentArray<std::atomic<bool> >& seen, size_t id) {
+    std::atomic<bool>* v = seen.get(id);
+    if(v && v->load(std::memory_order_acquire)) {
+        return false;
+    }
+    v = seen.getOrCreate(id);
+    return v && !v->load(std::memory_order_acquire);
+}
+
+//元数据按 类型 + id + 字段 追加写入,字符串为 4字节长度 + 内容
+static void AppendMetaString(std::string& buf, const std::string& str) {
+    uint32_t n = str.size();
+    buf.append((const char*)&n, sizeof(n));
+    buf.append(str);
+}
+
+static void AppendMetaInt(std::string& buf, uint32_t v) {
+    buf.append((const char*)&v, sizeof(v));
+}
+
+void BinaryLogAppender::writeMeta(const BinLogSite* site, const std::shared_ptr<Logger>& logger
+                                  , const LogEvent::ptr& event) {
+    bool new_site = FirstSeen(m_sites, site->getId());
+    bool new_logger = FirstSeen(m_loggers, logger->getId());
+    bool new_thread = FirstSeen(m_threads, event->getThreadId());
+    if(!new_site && !new_logger && !new_thread) {
+        return;
+    }
+
+    MetaMutexType::Lock lock(m_metaMutex);
+    std::string buf;
+    std::atomic<bool>* v = nullptr;
+    //加锁后再检查一次,其他线程可能已经写过了
+    if(new_site && (v = m_sites.get(site->getId())) && !v->load(std::memory_order_relaxed)) {
+        buf.push_back(BinLogFormat::META_SITE);
+        AppendMetaInt(buf, site->getId());
+        AppendMetaInt(buf, site->getLine());
+        AppendMetaString(buf, site->getFile());
+        AppendMetaString(buf, site->getFormat());
+        v->store(true, std::memory_order_release);
+    }
+    if(new_logger && (v = m_loggers.get(logger->getId())) && !v->load(std::memory_order_relaxed)) {
+        buf.push_back(BinLogFormat::META_LOGGER);
+        AppendMetaInt(buf, logger->getId());
+        AppendMetaString(buf, logger->getName());
+        v->store(true, std::memory_order_release);
+    }
+    if(new_thread && (v = m_threads.get(event->getThreadId())) && !v->load(std::memory_order_relaxed)) {
+        buf.push_back(BinLogFormat::META_THREAD);
+        AppendMetaInt(buf, event->getThreadId());
+        AppendMetaString(buf, event->getThreadName());
+        v->store(true, std::memory_order_release);
+    }
+    if(!buf.empty() && ::write(m_metaFd, buf.data(), buf.size()) != (ssize_t)buf.size()) {
+        std::cout << "BinaryLogAppender write " << m_filename << ".meta failed, errno="
+                  << errno << " " << strerror(errno) << std::endl;
+    }
+}
+
+//记录头和参数拷贝到预留的位置,最后写end;不加锁
+void BinaryLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) {
+    if(level < m_level || !m_header) {
+        return;
+    }
+    const BinLogSite* site = event->getBinSite();
+    const std::string* args = &event->getBinArgs();
+    if(!site) {
+        //文本日志: 内容作为一个字符串参数
+        static thread_local std::string t_args;
+        t_args.clear();
+        BinLogArgs::Encode(t_args, event->getContent());
+        site = BinLogSite::GetTextSite(event->getFile(), event->getLine());
+        args = &t_args;
+    }
+
+    uint64_t size = Align8(sizeof(BinLogFormat::Record) + args->size());
+    if(size > m_capacity / 4) {
+        ++m_dropped;
+        return;
+    }
+    writeMeta(site, logger, event);
+
+    uint64_t pos = reserve(size);
+    char* ptr = m_data + (pos & m_mask);
+    auto rec = (BinLogFormat::Record*)ptr;
+    rec->site = site->getId();
+    rec->argsLen = args->size();
+    rec->time = event->getTime();
+    rec->threadId = event->getThreadId();
+    rec->fiberId = event->getFiberId();
+    rec->elapse = event->getElapse();
+    rec->loggerId = logger->getId() <= UINT16_MAX ? logger->getId() : 0;
+    rec->level = level;
+    rec->reserved = 0;
+    memcpy(ptr + sizeof(BinLogFormat::Record), args->data(), args->size());
+    __atomic_store_n(&rec->end, pos + size, __ATOMIC_RELEASE);
+}
+
+std::string BinaryLogAppender::toYamlString() {
+    MutexType::Lock lock(m_mutex);
+    YAML::Node node;
+    node["type"] = "BinaryLogAppender";
+    node["file"] = m_filename;
+    node["size"] = m_capacity;
+    if(m_level != LogLevel::UNKOWN) {
+        node["level"] = LogLevel::ToString(m_level);
+    }
+    std::stringstream ss;
+    ss << node;
+    return ss.str();
+}
+
+
+/******************* BinLogReader 类函数实现 *******************/
+BinLogReader::BinLogReader() {
+}
+
+BinLogReader::~BinLogReader() {
+    if(m_map) {
+        munmap(m_map, m_mapSize);
+    }
+    if(m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+bool BinLogReader::open(const std::string& filename) {
+    m_fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if(m_fd < 0 || fstat(m_fd, &st) != 0) {
+        m_error = "open " + filename + " failed: " + strerror(errno);
+        return false;
+    }
+    if((size_t)st.st_size < BinLogFormat::HEADER_SIZE + s_min_capacity) {
+        m_error = filename + " is not a binary log file";
+        return false;
+    }
+    m_mapSize = st.st_size;
+    void* map = mmap(nullptr, m_mapSize, PROT_READ, MAP_SHARED, m_fd, 0);
+    if(map == MAP_FAILED) {
+        m_error = "mmap " + filename + " failed: " + strerror(errno);
+        return false;
+    }
+    m_map = map;
+    auto header = (const BinLogFormat::FileHeader*)map;
+    if(memcmp(header->magic, s_magic, sizeof(s_magic)) != 0
+            || header->version != BinLogFormat::VERSION
+            || header->headerSize != BinLogFormat::HEADER_SIZE
+            || header->capacity < s_min_capacity
+            || (header->capacity & (header->capacity - 1))
+            || header->headerSize + header->capacity > m_mapSize) {
+        m_error = filename + " is not a binary log file";
+        return false;
+    }
+    m_capacity = header->capacity;
+    m_mask = m_capacity - 1;
+    m_writePos = header->writePos.load(std::memory_order_acquire);
+    m_data = (const char*)map + header->headerSize;
+    return loadMeta(filename + ".meta");
+}
+
+bool BinLogReader::loadMeta(const std::string& filename) {
+    std::ifstream ifs(filename, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    if(data.size() < sizeof(s_meta_magic) || memcmp(data.data(), s_meta_magic, sizeof(s_meta_magic)) != 0) {
+        m_error = filename + " is not a binary log meta file";
+        return false;
+    }
+    size_t pos = sizeof(s_meta_magic);
+    auto read_int = [&](uint32_t& v) {
+        if(pos + sizeof(v) > data.size()) {
+            return false;
+        }
+        memcpy(&v, &data[pos], sizeof(v));
+        pos += sizeof(v);
+        return true;
+    };
+    auto read_string = [&](std::string& v) {
+        uint32_t n = 0;
+        if(!read_int(n) || pos + n > data.size()) {
+            return false;
+        }
+        v.assign(&data[pos], n);
+        pos += n;
+        return true;
+    };
+    //最后一条可能只写了一部分(写入时进程崩溃),忽略
+    while(pos < data.size()) {
+        char type = data[pos++];
+        uint32_t id = 0;
+        if(!read_int(id)) {
+            break;
+        }
+        if(type == BinLogFormat::META_SITE) {
+            Site site;
+            uint32_t line = 0;
+            if(!read_int(line) || !read_string(site.file) || !read_string(site.fmt)) {
+                break;
+            }
+            site.line = line;
+            m_sites[id] = site;
+        } else if(type == BinLogFormat::META_LOGGER) {
+            std::string name;
+            if(!read_string(name)) {
+                break;
+            }
+            m_loggers[id] = std::make_shared<Logger>(name);
+        } else if(type == BinLogFormat::META_THREAD) {
+            std::string name;
+            if(!read_string(name)) {
+                break;
+            }
+            m_threads[id] = name;
+        } else {
+            break;
+        }
+    }
+    return true;
+}
+
+uint32_t BinLogReader::check(uint64_t pos, uint64_t limit) const {
+    uint64_t offset = pos & m_mask;
+    if(offset + 8 > m_capacity) {
+        return 0;
+    }
+    uint64_t end = 0;
+    memcpy(&end, m_data + offset, sizeof(end));
+    if(end <= pos || end > limit || (end - pos) % 8 || offset + (end - pos) > m_capacity) {
+        return 0;
+    }
+    uint32_t size = end - pos;
+    if(size < sizeof(BinLogFormat::Record)) {
+        return size;
+    }
+    BinLogFormat::Record rec;
+    memcpy(&rec, m_data + offset, sizeof(rec));
+    if(rec.site == 0) {
+        return size;
+    }
+    if(Align8(sizeof(rec) + rec.argsLen) != size || rec.level > LogLevel::FATAL) {
+        return 0;
+    }
+    return size;
+}
+
+std::shared_ptr<Logger> BinLogReader::getLogger(uint32_t id) {
+    auto& logger = m_loggers[id];
+    if(!logger) {
+        logger = std::make_shared<Logger>("logger_" + std::to_string(id));
+    }
+    return logger;
+}
+
+//从数据区中最旧的位置开始,找到第一条完整的记录后按长度依次向后遍历;
+//遇到不完整的记录(写入时崩溃或正在写)时按8字节向后查找下一条
+uint64_t BinLogReader::foreach(Callback cb, uint64_t skip) {
+    uint64_t limit = m_writePos;
+    uint64_t pos = limit > m_capacity ? limit - m_capacity : 0;
+    bool synced = pos == 0;
+    uint64_t count = 0;
+    m_corrupted = 0;
+    std::string content;
+    while(pos < limit) {
+        uint32_t size = check(pos, limit);
+        if(!size) {
+            if(synced) {
+                ++m_corrupted;
+                synced = false;
+            }
+            pos += 8;
+            continue;
+        }
+        synced = true;
+        BinLogFormat::Record rec;
+        if(size < sizeof(rec)) {
+            pos += size;
+            continue;
+        }
+        memcpy(&rec, m_data + (pos & m_mask), sizeof(rec));
+        if(rec.site == 0) {
+            pos += size;
+            continue;
+        }
+        if(count++ >= skip) {
+            const char* args = m_data + (pos & m_mask) + sizeof(rec);
+            auto it = m_sites.find(rec.site);
+            const char* file = "?";
+            int32_t line = 0;
+            content.clear();
+            if(it != m_sites.end()) {
+                file = it->second.file.c_str();
+                line = it->second.line;
+                if(!BinLogArgs::Format(content, it->second.fmt.c_str(), args, rec.argsLen)) {
+                    ++m_corrupted;
+                }
+            } else {
+                content = "<unknown site " + std::to_string(rec.site) + ">";
+            }
+            auto tit = m_threads.find(rec.threadId);
+            LogEvent::ptr event = std::make_shared<LogEvent>(getLogger(rec.loggerId)
+                                        , (LogLevel::Level)rec.level, file, line, rec.elapse
+                                        , rec.threadId, rec.fiberId, rec.time
+                                        , tit != m_threads.end() ? tit->second : std::string());
+            event->getSS().write(content.data(), content.size());
+            cb(event);
+        }
+        pos += size;
+    }
+    return count;
+}
+
+}
@@ -0,0 +1,76 @@
+/**
+ * @brief 二进制日志解码工具
+ * @details 用法: binlog_decode [-p pattern] [-n count] [-s] file
+ *              -p 日志格式,语法同LogFormatter,默认和Logger的默认格式相同
+ *              -n 只输出最后count条
+ *              -s 输出完后在标准错误输出统计信息
+ *          file为BinaryLogAppender的环形文件,同目录下需要有file.meta
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "binlog.h"
+#include "log.h"
+
+static void usage(const char* name) {
+    fprintf(stderr, "usage: %s [-p pattern] [-n count] [-s] file\n", name);
+}
+
+int main(int argc, char** argv) {
+    std::string pattern = "%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n";
+    int64_t last = -1;
+    bool stats = false;
+    int opt = 0;
+    while((opt = getopt(argc, argv, "p:n:s")) != -1) {
+        switch(opt) {
+            case 'p':
+                pattern = optarg;
+                break;
+            case 'n':
+                last = atoll(optarg);
+                break;
+            case 's':
+                stats = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if(optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    sylar::LogFormatter formatter(pattern);
+    if(formatter.isError()) {
+        fprintf(stderr, "invalid pattern: %s\n", pattern.c_str());
+        return 1;
+    }
+    sylar::BinLogReader reader;
+    if(!reader.open(argv[optind])) {
+        fprintf(stderr, "%s\n", reader.getError().c_str());
+        return 1;
+    }
+
+    uint64_t skip = 0;
+    if(last >= 0) {
+        uint64_t total = reader.foreach([](sylar::LogEvent::ptr) {}, UINT64_MAX);
+        skip = total > (uint64_t)last ? total - last : 0;
+    }
+    std::string buf;
+    uint64_t total = reader.foreach([&](sylar::LogEvent::ptr event) {
+        buf.clear();
+        formatter.format(buf, event->getLogger(), event->getLevel(), event);
+        fwrite(buf.data(), 1, buf.size(), stdout);
+    }, skip);
+
+    if(stats) {
+        fprintf(stderr, "records=%llu printed=%llu corrupted=%llu write_pos=%llu capacity=%llu\n"
+                , (unsigned long long)total, (unsigned long long)(total - skip)
+                , (unsigned long long)reader.getCorrupted()
+                , (unsigned long long)reader.getWritePos()
+                , (unsigned long long)reader.getCapacity());
+    }
+    return 0;
+}
@@ -679,10 +679,10 @@ SQLite3::ptr SQLite3Manager::get(const std::string& name) {
     //             path: ...
     //             sql: ...
     //             ...
-    auto config = g_sqlite3_dbs->getValue();
-    auto sit = config.find(name);
+    auto config = g_sqlite3_dbs->getSnapshot();
+    auto sit = config->find(name);
     std::map<std::string, std::string> args;
-    if(sit != config.end()) {
+    if(sit != config->end()) {
         args = sit->second;
     } else {
         sit = m_dbDefines.find(name);
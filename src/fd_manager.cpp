@@ -8,8 +8,102 @@
 
 namespace sylar {
 
+/**
+ * 基于纪元的回收(epoch based reclamation)
+ * 读取槽位前把当前纪元登记到线程的记录中，读完清零；
+ * 删除时先清空槽位再推进纪元，删除时的纪元小于所有正在读取的线程登记的纪元后，
+ * 就没有线程还能拿到这个FdCtx的裸指针，可以释放集合持有的引用
+ */
+namespace {
+
+struct EpochRecord {
+    std::atomic<uint64_t> epoch;   // 正在读取时为登记的纪元，否则为0
+    std::atomic<bool> used;        // 是否已被某个线程占用
+};
+
+static std::atomic<uint64_t> s_epoch(1);
+
+// 所有线程的记录，只增不减，线程退出后记录留给新线程复用
+static Mutex& GetRecordMutex() {
+    static Mutex s_mutex;
+    return s_mutex;
+}
+
+static std::vector<EpochRecord*>& GetRecords() {
+    static std::vector<EpochRecord*> s_records;
+    return s_records;
+}
+
+static EpochRecord* AcquireRecord() {
+    Mutex::Lock lock(GetRecordMutex());
+    for(auto& i : GetRecords()) {
+        bool used = false;
+        if(i->used.compare_exchange_strong(used, true)) {
+            return i;
+        }
+    }
+    EpochRecord* rec = new EpochRecord;
+    rec->epoch = 0;
+    rec->used = true;
+    GetRecords().push_back(rec);
+    return rec;
+}
+
+static void ReleaseRecord(EpochRecord* rec) {
+    rec->epoch.store(0, std::memory_order_release);
+    rec->used.store(false, std::memory_order_release);
+}
+
+// 当前线程的记录，线程退出时归还
+static thread_local EpochRecord* t_record = nullptr;
+static thread_local bool t_record_released = false;
+
+struct EpochRecordHolder {
+    EpochRecordHolder() {
+        t_record = AcquireRecord();
+    }
+    ~EpochRecordHolder() {
+        ReleaseRecord(t_record);
+        t_record = nullptr;
+        t_record_released = true;
+    }
+};
+
+// 读取槽位期间登记纪元
+class EpochGuard {
+public:
+    EpochGuard()
+        :m_owned(false) {
+        if(!t_record && !t_record_released) {
+            static thread_local EpochRecordHolder s_holder;
+        }
+        m_record = t_record;
+        if(!m_record) {
+            //线程的thread_local已经析构，临时占用一个记录
+            m_record = AcquireRecord();
+            m_owned = true;
+        }
+        m_record->epoch.store(s_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    ~EpochGuard() {
+        if(m_owned) {
+            ReleaseRecord(m_record);
+        } else {
+            m_record->epoch.store(0, std::memory_order_release);
+        }
+    }
+
+private:
+    EpochRecord* m_record;
+    bool m_owned;
+};
+
+}
+
 // 通过文件句柄构造FdCtx
-FdCtx::FdCtx(int fd) 
+FdCtx::FdCtx(int fd, int flags) 
     :m_fd(fd)
     ,m_isInit(false)
     ,m_isSocket(false)
@@ -18,7 +112,7 @@ FdCtx::FdCtx(int fd)
     ,m_systemNonblock(false)
     ,m_recvTimeout(-1)
     ,m_sendTimeout(-1) {
-    init();
+    init(flags);
 }
 
 // 析构函数
@@ -26,13 +120,26 @@ FdCtx::~FdCtx() {
 }
 
 // 初始化
-bool FdCtx::init() {
+bool FdCtx::init(int flags) {
     if(m_isInit) {
         return true;
     }
     m_recvTimeout = -1;   // (uint64_t)-1 == 0xffffffffffffffff
     m_sendTimeout = -1;
 
+    // accept4/socket刚创建的socket，类型和文件状态标志都已知，不需要再查询
+    if(flags >= 0) {
+        if(!(flags & O_NONBLOCK)) {
+            fcntl_f(m_fd, F_SETFL, flags | O_NONBLOCK);
+        }
+        m_isInit = true;
+        m_isSocket = true;
+        m_systemNonblock = true;
+        m_userNonblock = false;
+        m_isClose = false;
+        return m_isInit;
+    }
+
     // stat()用来判断没有打开的文件,而fstat()用来判断打开的文件
     // fstat()用来将参数 m_fd 所指向的文件状态复制到参数 fd_stat 所指向的结构中
     struct stat fd_stat;
@@ -103,8 +210,10 @@ uint64_t FdCtx::getTimeout(int type) {
 
 
 //构造函数
-FdManager::FdManager() {
-    m_datas.resize(64);
+FdManager::FdManager()
+    :m_datas(1 << 22, [](std::atomic<FdCtx*>& item, size_t index) {
+        item.store(nullptr, std::memory_order_relaxed);
+    }) {
 }
 
 /**
@@ -112,43 +221,76 @@ FdManager::FdManager() {
  * @details 如果fd存在则直接获取；若不存在则根据auto_create来选择是否创建
  * @param[in] fd 文件句柄
  * @param[in] auto_create 是否自动创建
+ * @param[in] flags 创建时已知是socket则传入其文件状态标志，-1表示未知
  * @return 返回对应文件句柄类FdCtx::ptr
  */
-FdCtx::ptr FdManager::getFdCtx(int fd, bool auto_create) {
+FdCtx::ptr FdManager::getFdCtx(int fd, bool auto_create, int flags) {
     if(fd < 0) {
         return nullptr;
     }
-    RWMutexType::ReadLock lock(m_mutex);
-    if((int)m_datas.size() <= fd) {
-        if(auto_create == false) {
-            return nullptr;
-        }
-        //m_datas.resize(fd * 1.5);  //加的是读锁
+    std::atomic<FdCtx*>* slot = auto_create ? m_datas.getOrCreate(fd) : m_datas.get(fd);
+    if(!slot) {
+        return nullptr;
     }
-    else {
-        if(m_datas[fd] || !auto_create) {
-            return m_datas[fd];
-        }
+    EpochGuard guard;
+    FdCtx* ctx = slot->load(std::memory_order_acquire);
+    if(ctx) {
+        return ctx->shared_from_this();
+    }
+    if(!auto_create) {
+        return nullptr;
     }
-    lock.unlock();
 
-    //需要创建文件句柄类FdCtx
-    RWMutexType::WriteLock lock2(m_mutex);
-    FdCtx::ptr ctx = std::make_shared<FdCtx>(fd);
-    if((int)m_datas.size() <= fd) {
-        m_datas.resize(fd * 1.5);
+    //需要创建文件句柄类FdCtx，并发创建时以先写入的为准
+    FdCtx::ptr new_ctx = std::make_shared<FdCtx>(fd, flags);
+    new_ctx->m_self = new_ctx;
+    if(slot->compare_exchange_strong(ctx, new_ctx.get(),
+                std::memory_order_acq_rel, std::memory_order_acquire)) {
+        return new_ctx;
     }
-    m_datas[fd] = ctx;
-    return ctx;
+    new_ctx->m_self.reset();
+    return ctx->shared_from_this();
 }
 
 // 删除集合中的文件句柄类
 void FdManager::deleteFdCtx(int fd) {
-    RWMutexType::WriteLock lock(m_mutex);
-    if((int)m_datas.size() <= fd) {
+    if(fd < 0) {
+        return;
+    }
+    std::atomic<FdCtx*>* slot = m_datas.get(fd);
+    if(!slot) {
         return;
     }
-    m_datas[fd].reset();
+    FdCtx* ctx = slot->exchange(nullptr, std::memory_order_acq_rel);
+    if(!ctx) {
+        return;
+    }
+    Mutex::Lock lock(m_retireMutex);
+    m_retired.push_back(std::make_pair(s_epoch.fetch_add(1), std::move(ctx->m_self)));
+    reclaim();
 }
 
-}
\ No newline at end of file
+// 释放已经没有线程在读取的FdCtx(需要持有m_retireMutex)
+void FdManager::reclaim() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t min_epoch = ~0ull;
+    {
+        Mutex::Lock lock(GetRecordMutex());
+        for(auto& i : GetRecords()) {
+            uint64_t e = i->epoch.load(std::memory_order_acquire);
+            if(e && e < min_epoch) {
+                min_epoch = e;
+            }
+        }
+    }
+    //删除时的纪元小于所有正在读取的纪元，说明这些读取都发生在槽位清空之后
+    size_t n = 0;
+    for(size_t i = 0; i < m_retired.size(); ++i) {
+        if(m_retired[i].first >= min_epoch) {
+            m_retired[n++] = std::move(m_retired[i]);
+        }
+    }
+    m_retired.resize(n);
+}
+
+}
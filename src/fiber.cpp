@@ -4,6 +4,12 @@
 #include "util.h"
 #include "scheduler.h"
 #include <atomic>
+#include <vector>
+#include <unordered_set>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 namespace sylar {
 
@@ -35,14 +41,253 @@ public:
     }
 };
 
+//Yaml配置每个线程的协程栈池最多缓存的栈数量,0表示不缓存
+static sylar::ConfigVar<uint32_t>::ptr g_fiber_stack_pool_size =
+    sylar::Config::Lookup<uint32_t>("fiber.stack_pool.max_size", 64, "per thread fiber stack pool max size");
+
+//Yaml配置最多给多少个栈加保护页,0表示不加保护页
+//每个带保护页的栈占用两个内存映射区域,超过 vm.max_map_count 后mmap会失败,
+//超出该数量的栈不加保护页,相邻的栈可以合并为一个映射区域
+static sylar::ConfigVar<uint32_t>::ptr g_fiber_stack_guard_max =
+    sylar::Config::Lookup<uint32_t>("fiber.stack_pool.guard_max_count", 16384, "max number of fiber stacks with guard page");
+
+static std::atomic<uint64_t> s_stack_in_use(0);      //正在使用的栈数量
+static std::atomic<uint64_t> s_stack_high_water(0);  //同时使用的栈数量的最高值
+static std::atomic<uint64_t> s_stack_cached(0);      //所有线程栈池中缓存的栈数量
+static std::atomic<uint64_t> s_stack_mmaps(0);       //通过mmap新分配栈的次数
+static std::atomic<uint64_t> s_stack_reused(0);      //从栈池复用栈的次数
+static std::atomic<uint64_t> s_stack_guarded(0);     //带保护页的栈数量(包括缓存的)
+
+static Spinlock s_unguarded_mutex;
+static std::unordered_set<void*> s_unguarded_stacks;  //没有保护页的栈
+static std::atomic<uint64_t> s_unguarded_count(0);
+
+static std::atomic<uint64_t> s_stacksize_version(0);  //fiber.stacksize 的修改次数,栈池据此发现大小变化
+
+struct _StackPoolIniter {
+    _StackPoolIniter() {
+        g_fiber_stacksize->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+            ++s_stacksize_version;
+        });
+
+        g_fiber_stack_pool_size->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+            SYLAR_LOG_INFO(g_logger) << "fiber stack pool max size changed from "
+                                     << old_value << " to " << new_value;
+        });
+
+        g_fiber_stack_guard_max->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+            SYLAR_LOG_INFO(g_logger) << "fiber stack guard max count changed from "
+                                     << old_value << " to " << new_value;
+        });
+    }
+};
+
+static _StackPoolIniter s_stack_pool_initer;
+
 //内存分配模版类(mmap)
+//在栈的低地址端多映射一个PROT_NONE的保护页,栈溢出时直接触发SIGSEGV,而不是悄悄破坏堆内存
 class MMapStackAllocator {
+public:
+    //页大小
+    static size_t PageSize() {
+        static size_t s_page_size = sysconf(_SC_PAGESIZE);
+        return s_page_size;
+    }
+
+    //栈大小按页对齐
+    static size_t RoundSize(size_t size) {
+        size_t page = PageSize();
+        return (size + page - 1) / page * page;
+    }
+
+    //分配内存,返回保护页之上的可用地址
+    static void* Alloc(size_t size) {
+        size_t page = PageSize();
+        size_t len = RoundSize(size) + page;
+        void* base = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+        if(base == MAP_FAILED) {
+            SYLAR_LOG_ERROR(g_logger) << "mmap fiber stack size=" << len
+                << " errno=" << errno << " errstr=" << strerror(errno);
+            throw std::bad_alloc();
+        }
+        void* ptr = (char*)base + page;
+        ++s_stack_mmaps;
+
+        if(s_stack_guarded < g_fiber_stack_guard_max->getValue()) {
+            if(!mprotect(base, page, PROT_NONE)) {
+                ++s_stack_guarded;
+                return ptr;
+            }
+            SYLAR_LOG_WARN(g_logger) << "mprotect fiber stack guard page errno="
+                << errno << " errstr=" << strerror(errno);
+        }
+
+        //不加保护页,栈的布局不变,保护页位置保持可读写
+        Spinlock::Lock lock(s_unguarded_mutex);
+        s_unguarded_stacks.insert(ptr);
+        ++s_unguarded_count;
+        return ptr;
+    }
+
+    //释放内存
+    static void DealAlloc(void* ptr, size_t size) {
+        size_t page = PageSize();
+        bool guarded = true;
+        if(s_unguarded_count) {
+            Spinlock::Lock lock(s_unguarded_mutex);
+            if(s_unguarded_stacks.erase(ptr)) {
+                --s_unguarded_count;
+                guarded = false;
+            }
+        }
+        if(guarded) {
+            --s_stack_guarded;
+        }
+        munmap((char*)ptr - page, RoundSize(size) + page);
+    }
+};
+
+/**
+ * @brief 线程局部的协程栈池
+ * @details 缓存已析构协程的栈,新建协程时优先复用,避免频繁的mmap/munmap。
+ *          只缓存与 fiber.stacksize 大小一致的栈,其他大小的栈直接释放。
+ *          协程可能在一个线程创建、在另一个线程析构,栈归还到析构所在线程的栈池;
+ *          线程的栈池已经析构(线程退出时thread_local析构之后才析构的协程)时直接munmap
+ */
+class PooledStackAllocator {
+public:
+    PooledStackAllocator() {
+        t_state = ALIVE;
+    }
+
+    ~PooledStackAllocator() {
+        clear();
+        t_state = DESTROYED;
+    }
+
+    //分配内存
+    static void* Alloc(size_t size) {
+        PooledStackAllocator* pool = GetThis();
+        void* ptr = nullptr;
+        if(pool && size == pool->m_size && !pool->m_stacks.empty()) {
+            ptr = pool->m_stacks.back();
+            pool->m_stacks.pop_back();
+            --s_stack_cached;
+            ++s_stack_reused;
+        } else {
+            ptr = MMapStackAllocator::Alloc(size);
+        }
+
+        uint64_t in_use = ++s_stack_in_use;
+        uint64_t high = s_stack_high_water;
+        while(in_use > high && !s_stack_high_water.compare_exchange_weak(high, in_use)) {
+        }
+        return ptr;
+    }
+
+    //释放内存
+    static void DealAlloc(void* ptr, size_t size) {
+        --s_stack_in_use;
+        PooledStackAllocator* pool = GetThis();
+        if(!pool) {
+            MMapStackAllocator::DealAlloc(ptr, size);
+            return;
+        }
+        uint64_t version = s_stacksize_version.load(std::memory_order_relaxed);
+        if(pool->m_version != version) {
+            //fiber.stacksize 被修改,丢弃旧大小的栈
+            pool->m_version = version;
+            uint32_t stack_size = g_fiber_stacksize->getValue();
+            if(pool->m_size != stack_size) {
+                pool->clear();
+                pool->m_size = stack_size;
+            }
+        }
+        if(size == pool->m_size && pool->m_stacks.size() < g_fiber_stack_pool_size->getValue()) {
+            pool->m_stacks.push_back(ptr);
+            ++s_stack_cached;
+            return;
+        }
+        MMapStackAllocator::DealAlloc(ptr, size);
+    }
+
+private:
+    //栈池的状态,普通的thread_local变量,栈池析构之后仍然可以访问
+    enum State {
+        UNINIT = 0,
+        ALIVE = 1,
+        DESTROYED = 2
+    };
+
+    //返回当前线程的栈池,已经析构时返回nullptr
+    static PooledStackAllocator* GetThis() {
+        if(t_state == DESTROYED) {
+            return nullptr;
+        }
+        static thread_local PooledStackAllocator s_pool;
+        return &s_pool;
+    }
+
+    //释放缓存的所有栈
+    void clear() {
+        for(auto& i : m_stacks) {
+            MMapStackAllocator::DealAlloc(i, m_size);
+        }
+        s_stack_cached -= m_stacks.size();
+        m_stacks.clear();
+    }
+
+private:
+    static thread_local int t_state;
 
+    size_t m_size = g_fiber_stacksize->getValue();  //缓存的栈大小
+    uint64_t m_version = s_stacksize_version;       //m_size对应的fiber.stacksize修改次数
+    std::vector<void*> m_stacks;   //空闲的栈
 };
 
-//切换两种内存分配方式
-using StackAllocator = MallocStackAllocator;
-//using StackAllocator = MMapStackAllocator;
+thread_local int PooledStackAllocator::t_state = PooledStackAllocator::UNINIT;
+
+//切换内存分配方式
+//using StackAllocator = MallocStackAllocator;
+using StackAllocator = PooledStackAllocator;
+
+#ifdef SYLAR_FIBER_ASM_CONTEXT
+//汇编实现的上下文切换只保存callee-saved寄存器,不需要系统调用
+typedef void* ContextType;
+
+//初始化协程上下文,切换到该上下文时从MainFunc开始执行
+static void InitContext(ContextType* ctx, void* stack, size_t size) {
+    *ctx = MakeFiberContext(stack, size, &Fiber::MainFunc);
+}
+
+//保存当前上下文到from,然后切换到to
+static void SwapContext(ContextType* from, ContextType* to) {
+    sylar_swap_context(from, *to);
+}
+#else
+typedef ucontext_t ContextType;
+
+//初始化协程上下文,切换到该上下文时从MainFunc开始执行
+static void InitContext(ContextType* ctx, void* stack, size_t size) {
+    //初始化ctx,将当前上下文保存在ctx中,成功返回0
+    if(getcontext(ctx)) {
+        SYLAR_ASSERT2(false, "getcontext error");
+    }
+    ctx->uc_link = nullptr;       //设置当前context执行结束之后要执行的下一个context
+    ctx->uc_stack.ss_sp = stack;  //指定了ctx所用栈的位置
+    ctx->uc_stack.ss_size = size; //指定了ctx所用栈的大小
+    //绑定切换到ctx上下文时的执行函数和函数的参数,不是立即进入MainFunc,需要切换到该上下文时才进入
+    makecontext(ctx, &Fiber::MainFunc, 0);
+}
+
+//保存当前上下文到from,然后切换到to
+static void SwapContext(ContextType* from, ContextType* to) {
+    if(swapcontext(from, to)) {
+        SYLAR_ASSERT2(false, "swapcontext error");
+    }
+}
+#endif
 
 
 //无参构造,放在private中,只能类内使用
@@ -51,10 +296,12 @@ Fiber::Fiber() {
     m_state = EXEC;
     SetThis(this);   //设置当前线程的运行协程
 
+#ifndef SYLAR_FIBER_ASM_CONTEXT
     //初始化m_ctx,将当前上下文保存在m_ctx中,成功返回0
     if(getcontext(&m_ctx)) {  
         SYLAR_ASSERT2(false, "getcontext error");
     }
+#endif
 
     ++s_fiber_count;
 
@@ -76,23 +323,8 @@ Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool runInScheduler)
     m_stacksize = stacksize ? stacksize : g_fiber_stacksize->getValue();
     m_stack = StackAllocator::Alloc(m_stacksize);  //栈用于当上下文切换时保存现场
 
-    //初始化m_ctx,将当前上下文保存在m_ctx中,成功返回0
-    if(getcontext(&m_ctx)) {
-        SYLAR_ASSERT2(false, "getcontext error");
-    }
-    //m_ctx.uc_link = &t_threadFiber->m_ctx;  //当前协程结束后返回到主协程
-    m_ctx.uc_link = nullptr;  //设置当前context执行结束之后要执行的下一个context
-    m_ctx.uc_stack.ss_sp = m_stack;         //指定了m_ctx所用栈的位置
-    m_ctx.uc_stack.ss_size = m_stacksize;   //指定了m_ctx所用栈的大小
-
-    //绑定切换到m_ctx上下文时的执行函数和函数的参数,不是立即进入MainFunc,需要切换到该上下文时才进入
-    // if(m_runInScheduler) {
-    //     makecontext(&m_ctx, &Fiber::MainFunc, 0);
-    // }
-    // else {
-    //     makecontext(&m_ctx, &Fiber::CallerMainFunc, 0);
-    // }
-    makecontext(&m_ctx, &Fiber::MainFunc, 0);
+    //初始化m_ctx,当前协程结束后不会自动返回(uc_link为空),而是在MainFunc中swapOut
+    InitContext(&m_ctx, m_stack, m_stacksize);
 
     SYLAR_LOG_DEBUG(g_logger) << "Fiber::Fiber  id=" << m_id;
 }
@@ -125,18 +357,11 @@ void Fiber::reset(std::function<void()> cb) {
     SYLAR_ASSERT(m_state == TERM || m_state == INIT ||m_state == EXCEPT);
     m_cb = cb;
 
-    //初始化m_ctx,将当前上下文保存在m_ctx中,成功返回0
-    if(getcontext(&m_ctx)) {
-        SYLAR_ASSERT2(false, "getcontext error");
-    }
-    //m_ctx.uc_link = &t_threadFiber->m_ctx;
-    m_ctx.uc_link = nullptr;
-    m_ctx.uc_stack.ss_sp = m_stack;
-    m_ctx.uc_stack.ss_size = m_stacksize;
-    //绑定切换到m_ctx上下文时的执行函数和函数的参数
-    makecontext(&m_ctx, &Fiber::MainFunc, 0);
+    //重新初始化m_ctx,复用原来的栈
+    InitContext(&m_ctx, m_stack, m_stacksize);
 
     m_state = INIT;
+    m_pinThread = -1;
 }
 
 /**
@@ -192,15 +417,11 @@ void Fiber::swapIn() {
     m_state = EXEC;
     if(m_runInScheduler) {
         //保存当前上下文到调度协程
-        if(swapcontext(&Scheduler::GetSchedulerFiber()->m_ctx, &m_ctx)) {
-            SYLAR_ASSERT2(false, "swapcontext error");
-        }
+        SwapContext(&Scheduler::GetSchedulerFiber()->m_ctx, &m_ctx);
     }
     else {
         //保存当前上下文到主协程
-        if(swapcontext(&t_threadFiber->m_ctx, &m_ctx)) {
-            SYLAR_ASSERT2(false, "swapcontext error");
-        }
+        SwapContext(&t_threadFiber->m_ctx, &m_ctx);
     }
 }
 
@@ -209,15 +430,11 @@ void Fiber::swapOut() {
     SetThis(t_threadFiber.get());    //设置当前协程为主协程
     if(m_runInScheduler) {
         //恢复到调度协程
-        if(swapcontext(&m_ctx, &Scheduler::GetSchedulerFiber()->m_ctx)) {
-            SYLAR_ASSERT2(false, "swapcontext error");
-        }
+        SwapContext(&m_ctx, &Scheduler::GetSchedulerFiber()->m_ctx);
     }
     else {
         //恢复到主协程
-        if(swapcontext(&m_ctx, &t_threadFiber->m_ctx)) {
-            SYLAR_ASSERT2(false, "swapcontext error");
-        }
+        SwapContext(&m_ctx, &t_threadFiber->m_ctx);
     }
 }
 
@@ -260,6 +477,17 @@ uint64_t Fiber::TotalFibers() {
     return s_fiber_count;
 }
 
+Fiber::StackStats Fiber::GetStackStats() {
+    StackStats stats;
+    stats.inUse = s_stack_in_use;
+    stats.highWater = s_stack_high_water;
+    stats.cached = s_stack_cached;
+    stats.mmaps = s_stack_mmaps;
+    stats.reused = s_stack_reused;
+    stats.guarded = s_stack_guarded;
+    return stats;
+}
+
 //协程执行函数
 void Fiber::MainFunc() {
     Fiber::ptr curr = GetThis();  // GetThis()的shared_from_this()方法让引用计数加1
@@ -333,5 +561,13 @@ uint64_t Fiber::GetFiberId() {
     return 0;
 }
 
+//返回当前协程绑定的线程id
+int Fiber::GetPinThread() {
+    if(t_fiber) {
+        return t_fiber->getPinThread();
+    }
+    return -1;
+}
+
 
 }
\ No newline at end of file
@@ -0,0 +1,124 @@
+#include "fiber_context.h"
+#include <stdint.h>
+#include <string.h>
+
+#ifdef SYLAR_FIBER_ASM_CONTEXT
+
+#if defined(__x86_64__)
+
+/**
+ * x86-64 System V: callee-saved寄存器为 rbx, rbp, r12-r15，另外保存 MXCSR 和 x87 控制字
+ * 栈布局(从高地址到低地址): rbp rbx r12 r13 r14 r15 [mxcsr|fpucw]
+ */
+__asm__(
+    ".pushsection .text\n"
+    ".globl sylar_swap_context\n"
+    ".type sylar_swap_context, @function\n"
+    ".align 16\n"
+    "sylar_swap_context:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    subq $8, %rsp\n"
+    "    stmxcsr (%rsp)\n"
+    "    fnstcw 4(%rsp)\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    ldmxcsr (%rsp)\n"
+    "    fldcw 4(%rsp)\n"
+    "    addq $8, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size sylar_swap_context, .-sylar_swap_context\n"
+    ".popsection\n"
+);
+
+namespace sylar {
+
+void* MakeFiberContext(void* stack, size_t size, void (*fn)()) {
+    //栈顶按16字节对齐
+    uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+    uint64_t* sp = (uint64_t*)top;
+    *--sp = 0;                  //fn的返回地址(fn不会返回)，进入fn时 rsp % 16 == 8
+    *--sp = (uint64_t)fn;       //ret 跳转的入口地址
+    for(int i = 0; i < 6; ++i) {
+        *--sp = 0;              //rbp rbx r12 r13 r14 r15
+    }
+    --sp;
+    uint32_t mxcsr = 0;
+    uint16_t fpucw = 0;
+    __asm__ __volatile__("stmxcsr %0" : "=m"(mxcsr));
+    __asm__ __volatile__("fnstcw %0" : "=m"(fpucw));
+    memcpy(sp, &mxcsr, sizeof(mxcsr));
+    memcpy((char*)sp + 4, &fpucw, sizeof(fpucw));
+    return sp;
+}
+
+}
+
+#elif defined(__aarch64__)
+
+/**
+ * aarch64 AAPCS64: callee-saved寄存器为 x19-x28, x29(fp), x30(lr), d8-d15
+ * 共保存 20 个寄存器，占用 176 字节(16字节对齐)
+ */
+__asm__(
+    ".pushsection .text\n"
+    ".globl sylar_swap_context\n"
+    ".type sylar_swap_context, %function\n"
+    ".align 4\n"
+    "sylar_swap_context:\n"
+    "    sub sp, sp, #176\n"
+    "    stp x19, x20, [sp, #0]\n"
+    "    stp x21, x22, [sp, #16]\n"
+    "    stp x23, x24, [sp, #32]\n"
+    "    stp x25, x26, [sp, #48]\n"
+    "    stp x27, x28, [sp, #64]\n"
+    "    stp x29, x30, [sp, #80]\n"
+    "    stp d8, d9, [sp, #96]\n"
+    "    stp d10, d11, [sp, #112]\n"
+    "    stp d12, d13, [sp, #128]\n"
+    "    stp d14, d15, [sp, #144]\n"
+    "    mov x9, sp\n"
+    "    str x9, [x0]\n"
+    "    mov sp, x1\n"
+    "    ldp x19, x20, [sp, #0]\n"
+    "    ldp x21, x22, [sp, #16]\n"
+    "    ldp x23, x24, [sp, #32]\n"
+    "    ldp x25, x26, [sp, #48]\n"
+    "    ldp x27, x28, [sp, #64]\n"
+    "    ldp x29, x30, [sp, #80]\n"
+    "    ldp d8, d9, [sp, #96]\n"
+    "    ldp d10, d11, [sp, #112]\n"
+    "    ldp d12, d13, [sp, #128]\n"
+    "    ldp d14, d15, [sp, #144]\n"
+    "    add sp, sp, #176\n"
+    "    ret\n"
+    ".size sylar_swap_context, .-sylar_swap_context\n"
+    ".popsection\n"
+);
+
+namespace sylar {
+
+void* MakeFiberContext(void* stack, size_t size, void (*fn)()) {
+    //栈顶按16字节对齐
+    uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+    uint64_t* sp = (uint64_t*)(top - 176);
+    memset(sp, 0, 176);
+    sp[11] = (uint64_t)fn;      //x30(lr)，ret 跳转的入口地址
+    return sp;
+}
+
+}
+
+#endif
+
+#endif
@@ -6,6 +6,8 @@
 #include "iomanager.h"
 #include "fd_manager.h"
 #include <dlfcn.h>
+#include <string.h>
+#include <limits.h>
 
 
 namespace sylar {
@@ -25,6 +27,7 @@ static thread_local bool t_hook_enable = false;  //表示当前线程是否启
     XX(socket) \
     XX(connect) \
     XX(accept) \
+    XX(accept4) \
     XX(read) \
     XX(readv) \
     XX(recv) \
@@ -35,6 +38,7 @@ static thread_local bool t_hook_enable = false;  //表示当前线程是否启
     XX(send) \
     XX(sendto) \
     XX(sendmsg) \
+    XX(sendfile) \
     XX(close) \
     XX(fcntl) \
     XX(ioctl) \
@@ -55,19 +59,15 @@ bool hook_init() {
     return true;
 }
 
-static uint64_t s_connect_timeout = -1;    //connect连接超时时间
-
 //定义结构，生成一个全局静态的结构实例，使其在main函数之前就要被创造，会执行构造函数
 struct _HookInit {
     //在main函数之前就会执行该构造函数
     _HookInit() {
         hook_init();
 
-        s_connect_timeout = g_tcp_connect_timeout->getValue();
         g_tcp_connect_timeout->addListener([](const uint64_t& oldVal, const uint64_t& newVal){
             SYLAR_LOG_INFO(SYLAR_LOG_ROOT()) << "tcp connect timeout changed from "
                                             << oldVal << " to " << newVal;
-            s_connect_timeout = newVal;
         });
     }
 };
@@ -189,6 +189,36 @@ retry:
 }
 
 
+/**
+ * @brief 判断fd上的操作是否走io_uring
+ * @details 当前IOManager使用io_uring后端，并且fd是hook管理的、用户没有设置非阻塞的socket时，
+ *          hook函数直接把操作提交给io_uring，否则交给do_io按epoll方式处理
+ * @param[in] fd 文件句柄
+ * @param[in] timeout_type FdManager中的超时类型(SO_RCVTIMEO或者SO_SNDTIMEO)
+ * @param[out] timeout_ms 超时时间
+ * @return 走io_uring时返回当前IOManager，否则返回nullptr
+ */
+static sylar::IOManager* uring_iom(int fd, int timeout_type, uint64_t& timeout_ms) {
+    if(!sylar::is_hook_enable()) {
+        return nullptr;
+    }
+    sylar::IOManager* iom = sylar::IOManager::GetThis();
+    if(!iom || iom->getBackend() != sylar::IOManager::IO_URING) {
+        return nullptr;
+    }
+    sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->getFdCtx(fd);
+    if(!ctx || ctx->isClose() || !ctx->isSocket() || ctx->getUserNonblock()) {
+        return nullptr;
+    }
+    timeout_ms = ctx->getTimeout(timeout_type);
+    return iom;
+}
+
+//sqe的长度字段只有32位，超出的部分由调用方下次再读写
+static uint32_t uring_len(size_t len) {
+    return len > UINT_MAX ? UINT_MAX : (uint32_t)len;
+}
+
 // extern "C" 的主要作用是为了方便C++代码与C代码进行交互
 // 当在 extern "C" 块中定义函数或变量时，它们会按照C语言的规则进行处理，以保持与C代码的兼容性
 extern "C" {
@@ -216,7 +246,7 @@ unsigned int sleep(unsigned int seconds) {
     // std::bind(  ( void (sylar::Scheduler::*)(sylar::Fiber::ptr, size_t thread) )&sylar::IOManager::schedule, iom, fiber, -1  );
     iom->addTimer(seconds * 1000, std::bind( (void (sylar::IOManager::*)
             (sylar::Fiber::ptr, size_t thread))&sylar::IOManager::scheduler, 
-            iom, fiber, -1) );    //这里传入的iom相当于this，负责调用scheduler成员函数
+            iom, fiber, fiber->getPinThread()) );    //这里传入的iom相当于this，负责调用scheduler成员函数
 
     sylar::Fiber::YieldToHold();
     //定时器超时后，将执行iom->scheduler(fiber); 调度器执行fiber时，将会回到这里
@@ -236,7 +266,7 @@ int usleep(useconds_t usec) {
     // });
     iom->addTimer(usec / 1000, std::bind( (void (sylar::IOManager::*)
             (sylar::Fiber::ptr, size_t thread))&sylar::IOManager::scheduler, 
-            iom, fiber, -1) );
+            iom, fiber, fiber->getPinThread()) );
 
     sylar::Fiber::YieldToHold();
     return 0;
@@ -256,12 +286,21 @@ int nanosleep(const struct timespec *req, struct timespec *rem) {
     // });
     iom->addTimer(timeout_ms, std::bind( (void (sylar::IOManager::*)
             (sylar::Fiber::ptr, size_t thread))&sylar::IOManager::scheduler, 
-            iom, fiber, -1) );
+            iom, fiber, fiber->getPinThread()) );
 
     sylar::Fiber::YieldToHold();
     return 0;
 }
 
+// socket/accept4新建的句柄加入FdManager
+// 调用者用SOCK_NONBLOCK要求非阻塞时和fcntl设置O_NONBLOCK一样，标记为用户非阻塞，之后的读写直接返回EAGAIN
+static void add_socket_ctx(int fd, int flags) {
+    sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->getFdCtx(fd, true, (flags & SOCK_NONBLOCK) ? O_NONBLOCK : 0);
+    if(ctx && (flags & SOCK_NONBLOCK)) {
+        ctx->setUserNonblock(true);
+    }
+}
+
 // socket
 // socket创建句柄时不会阻塞，所以hook复刻socket函数只需要将创建的句柄加入FdManager
 int socket(int domain, int type, int protocol) {
@@ -272,7 +311,7 @@ int socket(int domain, int type, int protocol) {
     if(fd < 0) {    //创建失败
         return fd;
     }
-    sylar::FdMgr::GetInstance()->getFdCtx(fd, true);
+    add_socket_ctx(fd, type);
     return fd;
 }
 
@@ -306,6 +345,12 @@ int connect_with_timeout(int sockfd, const struct sockaddr *addr, socklen_t addr
         return connect_f(sockfd, addr, addrlen);
     }
 
+    //io_uring后端直接提交connect，完成时就是连接的最终结果
+    sylar::IOManager* uring = sylar::IOManager::GetThis();
+    if(uring && uring->getBackend() == sylar::IOManager::IO_URING) {
+        return uring->uringIo(IORING_OP_CONNECT, sockfd, addr, 0, addrlen, 0, timeout_ms);
+    }
+
     int n = connect_f(sockfd, addr, addrlen);   //先去执行一次函数
     // connect连接成功，直接返回
     if(n == 0) {
@@ -382,7 +427,7 @@ int connect_with_timeout(int sockfd, const struct sockaddr *addr, socklen_t addr
 }
 
 int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
-    return connect_with_timeout(sockfd, addr, addrlen, sylar::s_connect_timeout);
+    return connect_with_timeout(sockfd, addr, addrlen, sylar::g_tcp_connect_timeout->getValue());
 }
 
 // sockfd为阻塞：如果没有连接请求到达，accept函数将会阻塞(暂停执行)直到有连接请求到达为止
@@ -390,10 +435,31 @@ int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
 //                此时还在等待连接请求，通过epoll_wait监测到sockfd可读后，说明有请求，重新再执行该函数获取新的文件描述符
 // 成功:返回一个新的socket文件描述符，用于和客户端通信，需要放入FdManager
 int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
-    // 用读事件，因为accept成功后，sockfd将可读(即触发读事件)
-    int fd = do_io(sockfd, accept_f, "accept", sylar::IOManager::READ, SO_RCVTIMEO, addr, addrlen); 
+    int fd = -1;
+    uint64_t timeout_ms = 0;
+    if(sylar::IOManager* iom = uring_iom(sockfd, SO_RCVTIMEO, timeout_ms)) {
+        fd = iom->uringIo(IORING_OP_ACCEPT, sockfd, addr, 0, (uint64_t)(uintptr_t)addrlen, 0, timeout_ms);
+    } else {
+        // 用读事件，因为accept成功后，sockfd将可读(即触发读事件)
+        fd = do_io(sockfd, accept_f, "accept", sylar::IOManager::READ, SO_RCVTIMEO, addr, addrlen);
+    }
     if(fd >= 0) {
-        sylar::FdMgr::GetInstance()->getFdCtx(fd, true);   //这个得到的fd是用于客户端和服务器通信的句柄
+        sylar::FdMgr::GetInstance()->getFdCtx(fd, true, 0);   //这个得到的fd是用于客户端和服务器通信的句柄
+    }
+    return fd;
+}
+
+// accept4: 在accept的基础上，由flags直接给新句柄设置SOCK_NONBLOCK/SOCK_CLOEXEC，省去之后的fcntl
+int accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags) {
+    int fd = -1;
+    uint64_t timeout_ms = 0;
+    if(sylar::IOManager* iom = uring_iom(sockfd, SO_RCVTIMEO, timeout_ms)) {
+        fd = iom->uringIo(IORING_OP_ACCEPT, sockfd, addr, 0, (uint64_t)(uintptr_t)addrlen, flags, timeout_ms);
+    } else {
+        fd = do_io(sockfd, accept4_f, "accept4", sylar::IOManager::READ, SO_RCVTIMEO, addr, addrlen, flags);
+    }
+    if(fd >= 0) {
+        add_socket_ctx(fd, flags);
     }
     return fd;
 }
@@ -403,22 +469,57 @@ int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
 // fd为非阻塞：如果没有数据可读，read函数会立即返回，并且返回值为-1，同时设置errno为EAGAIN
 //            此时还在等待fd可读，通过epoll_wait监测到fd可读后，说明有数据可读，重新再执行该函数去读取数据
 ssize_t read(int fd, void *buf, size_t count) {
+    uint64_t timeout_ms = 0;
+    if(sylar::IOManager* iom = uring_iom(fd, SO_RCVTIMEO, timeout_ms)) {
+        return iom->uringIo(IORING_OP_RECV, fd, buf, uring_len(count), 0, 0, timeout_ms);
+    }
     return do_io(fd, read_f, "read", sylar::IOManager::READ, SO_RCVTIMEO, buf, count);
 }
 
 ssize_t readv(int fd, const struct iovec *iov, int iovcnt) {
+    uint64_t timeout_ms = 0;
+    if(sylar::IOManager* iom = uring_iom(fd, SO_RCVTIMEO, timeout_ms)) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = (struct iovec*)iov;
+        msg.msg_iovlen = iovcnt;
+        return iom->uringIo(IORING_OP_RECVMSG, fd, &msg, 1, 0, 0, timeout_ms);
+    }
     return do_io(fd, readv_f, "readv", sylar::IOManager::READ, SO_RCVTIMEO, iov, iovcnt);
 }
 
 ssize_t recv(int sockfd, void *buf, size_t len, int flags) {
+    uint64_t timeout_ms = 0;
+    if(sylar::IOManager* iom = uring_iom(sockfd, SO_RCVTIMEO, timeout_ms)) {
+        return iom->uringIo(IORING_OP_RECV, sockfd, buf, uring_len(len), 0, flags, timeout_ms);
+    }
     return do_io(sockfd, recv_f, "recv", sylar::IOManager::READ, SO_RCVTIMEO, buf, len, flags);
 }
 
 ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen) {
+    uint64_t timeout_ms = 0;
+    if(sylar::IOManager* iom = uring_iom(sockfd, SO_RCVTIMEO, timeout_ms)) {
+        struct iovec iov = {buf, len};
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = src_addr;
+        msg.msg_namelen = (src_addr && addrlen) ? *addrlen : 0;
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        ssize_t n = iom->uringIo(IORING_OP_RECVMSG, sockfd, &msg, 1, 0, flags, timeout_ms);
+        if(n >= 0 && src_addr && addrlen) {
+            *addrlen = msg.msg_namelen;
+        }
+        return n;
+    }
     return do_io(sockfd, recvfrom_f, "recvfrom", sylar::IOManager::READ, SO_RCVTIMEO, buf, len, flags, src_addr, addrlen);
 }
 
 ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags) {
+    uint64_t timeout_ms = 0;
+    if(sylar::IOManager* iom = uring_iom(sockfd, SO_RCVTIMEO, timeout_ms)) {
+        return iom->uringIo(IORING_OP_RECVMSG, sockfd, msg, 1, 0, flags, timeout_ms);
+    }
     return do_io(sockfd, recvmsg_f, "recvmsg", sylar::IOManager::READ, SO_RCVTIMEO, msg, flags);
 }
 
@@ -427,25 +528,62 @@ ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags) {
 // fd为非阻塞：如果无法立即写入，write函数会立即返回，并且返回值为-1，同时设置errno为EAGAIN
 //            此时还在等待fd可写，通过epoll_wait监测到fd可写后，说明可以写入数据，重新再执行该函数去写入数据
 ssize_t write(int fd, const void *buf, size_t count) {
+    uint64_t timeout_ms = 0;
+    if(sylar::IOManager* iom = uring_iom(fd, SO_SNDTIMEO, timeout_ms)) {
+        return iom->uringIo(IORING_OP_SEND, fd, buf, uring_len(count), 0, 0, timeout_ms);
+    }
     return do_io(fd, write_f, "write", sylar::IOManager::WRITE, SO_SNDTIMEO, buf, count);
 }
 
 ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
+    uint64_t timeout_ms = 0;
+    if(sylar::IOManager* iom = uring_iom(fd, SO_SNDTIMEO, timeout_ms)) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = (struct iovec*)iov;
+        msg.msg_iovlen = iovcnt;
+        return iom->uringIo(IORING_OP_SENDMSG, fd, &msg, 1, 0, 0, timeout_ms);
+    }
     return do_io(fd, writev_f, "writev", sylar::IOManager::WRITE, SO_SNDTIMEO, iov, iovcnt);
 }
 
 ssize_t send(int sockfd, const void *buf, size_t len, int flags) {
+    uint64_t timeout_ms = 0;
+    if(sylar::IOManager* iom = uring_iom(sockfd, SO_SNDTIMEO, timeout_ms)) {
+        return iom->uringIo(IORING_OP_SEND, sockfd, buf, uring_len(len), 0, flags, timeout_ms);
+    }
     return do_io(sockfd, send_f, "send", sylar::IOManager::WRITE, SO_SNDTIMEO, buf, len, flags);
 }
 
 ssize_t sendto(int sockfd, const void *buf, size_t len, int flags, const struct sockaddr *dest_addr, socklen_t addrlen) {
+    uint64_t timeout_ms = 0;
+    if(sylar::IOManager* iom = uring_iom(sockfd, SO_SNDTIMEO, timeout_ms)) {
+        struct iovec iov = {(void*)buf, len};
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = (void*)dest_addr;
+        msg.msg_namelen = dest_addr ? addrlen : 0;
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        return iom->uringIo(IORING_OP_SENDMSG, sockfd, &msg, 1, 0, flags, timeout_ms);
+    }
     return do_io(sockfd, sendto_f, "sendto", sylar::IOManager::WRITE, SO_SNDTIMEO, buf, len, flags, dest_addr, addrlen);
 }
 
 ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags) {
+    uint64_t timeout_ms = 0;
+    if(sylar::IOManager* iom = uring_iom(sockfd, SO_SNDTIMEO, timeout_ms)) {
+        return iom->uringIo(IORING_OP_SENDMSG, sockfd, msg, 1, 0, flags, timeout_ms);
+    }
     return do_io(sockfd, sendmsg_f, "sendmsg", sylar::IOManager::WRITE, SO_SNDTIMEO, msg, flags);
 }
 
+// sendfile: 在内核中把文件in_fd的数据直接写入socket out_fd，不经过用户态内存
+// io_uring没有对应的操作，两种后端都按epoll方式等待out_fd可写(io_uring后端的addEvent同样可用)
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+    return do_io(out_fd, sendfile_f, "sendfile", sylar::IOManager::WRITE, SO_SNDTIMEO, in_fd, offset, count);
+}
+
 // close关闭句柄不会阻塞，所以hook复刻close函数只需要将句柄从FdManager中删除，并且将该句柄的所有事件触发一次
 int close(int fd) {
     if(!sylar::is_hook_enable()) {
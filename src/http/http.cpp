@@ -99,13 +99,36 @@ HttpRequest::HttpRequest(uint8_t version, bool close)
     ,m_path("/") {
 }
 
+// 用map设置HTTP请求头部
+void HttpRequest::setHeaders(const MapType& headers) {
+    m_headers.clear();
+    for(auto& i : headers) {
+        m_headers.add(i.first.c_str(), i.first.size(), i.second.c_str(), i.second.size());
+    }
+}
+
+// 是否还有片段指向接收缓存
+bool HttpRequest::isBufferAttached() const {
+    return m_pathSlice.data || m_querySlice.data || m_fragmentSlice.data
+        || m_bodySlice.data || m_headers.isAttached();
+}
+
+// 把所有指向接收缓存的片段拷贝成std::string
+void HttpRequest::detachBuffer() {
+    InitSlice(m_pathSlice, m_path);
+    InitSlice(m_querySlice, m_query);
+    InitSlice(m_fragmentSlice, m_fragment);
+    InitSlice(m_bodySlice, m_body);
+    m_headers.detach();
+}
+
 // 根据key值获取HTTP请求头部的value值
-const std::string& HttpRequest::getHeader(const std::string& key, const std::string& def) const {
-    auto it = m_headers.find(key);
-    if(it == m_headers.end()) {
+std::string HttpRequest::getHeader(const std::string& key, const std::string& def) const {
+    const HttpHeaders::Field* f = m_headers.find(key);
+    if(!f) {
         return def;
     }
-    return it->second;
+    return std::string(f->value, f->valueLen);
 }
 
 // 根据key值获取HTTP请求参数的value值
@@ -128,7 +151,7 @@ const std::string& HttpRequest::getCookie(const std::string& key, const std::str
 
 // 根据key值设置HTTP请求头部的value值
 void HttpRequest::setHeader(const std::string& key, const std::string& value) {
-    m_headers[key] = value;
+    m_headers.set(key, value);
 }
 
 // 根据key值设置HTTP请求参数的value值
@@ -143,7 +166,7 @@ void HttpRequest::setCookie(const std::string& key, const std::string& value) {
 
 // 根据key值删除HTTP请求头部的value值
 void HttpRequest::delHeader(const std::string& key) {
-    m_headers.erase(key);
+    m_headers.del(key);
 }
 
 // 根据key值删除HTTP请求参数的value值
@@ -158,12 +181,12 @@ void HttpRequest::delCookie(const std::string& key) {
 
 // 判断HTTP请求的头部参数是否存在
 bool HttpRequest::hasHeader(const std::string& key, std::string* value) const {
-    auto it = m_headers.find(key);
-    if(it == m_headers.end()) {
+    const HttpHeaders::Field* f = m_headers.find(key);
+    if(!f) {
         return false;
     }
     if(value) {
-        *value = it->second;
+        value->assign(f->value, f->valueLen);
     }
     return true;
 }
@@ -195,9 +218,9 @@ bool HttpRequest::hasCookie(const std::string& key, std::string* value) const {
 // 可读性输出HTTP请求所有信息
 std::ostream& HttpRequest::dump(std::ostream& os) const {
     os << HttpMethodToString(m_method) << " "
-        << m_path 
-        << (m_query.empty() ? "" : ("?" + m_query))
-        << (m_fragment.empty() ? "" : ("#" + m_fragment)) 
+        << getPath() 
+        << (getQuery().empty() ? "" : ("?" + m_query))
+        << (getFragment().empty() ? "" : ("#" + m_fragment)) 
         << " HTTP/"
         << (m_version >> 4)  //需不需要转换为uint32_t
         << "."
@@ -208,15 +231,16 @@ std::ostream& HttpRequest::dump(std::ostream& os) const {
         os << "Connection: " << (m_close ? "Close" : "Keep-Alive") << "\r\n";
     }
     for(const auto& i : m_headers) {
-        if(!m_websocket && strcasecmp(i.first.c_str(), "Connection") == 0) {
+        if(!m_websocket && i.id == HttpHeaderId::CONNECTION) {
             continue;
         }
-        if(strcasecmp(i.first.c_str(), "Content-Length") == 0) {
+        if(i.id == HttpHeaderId::CONTENT_LENGTH) {
             continue;
         }
-        os << i.first << ": " << i.second << "\r\n";
+        os.write(i.name, i.nameLen) << ": ";
+        os.write(i.value, i.valueLen) << "\r\n";
     }
-    if(!m_body.empty()) {
+    if(!getBody().empty()) {
         os << "Content-Length: " << m_body.size() << "\r\n\r\n";
         os << m_body;
     }
@@ -239,36 +263,56 @@ HttpResponse::HttpResponse(uint8_t version, bool close)
     :m_status(HttpStatus::OK)
     ,m_version(version)
     ,m_websocket(false)
-    ,m_close(close) {
+    ,m_close(close)
+    ,m_streaming(false)
+    ,m_fileFd(-1)
+    ,m_fileOffset(0)
+    ,m_fileLength(0) {
+}
+
+// 设置文件消息体
+void HttpResponse::setFileBody(int fd, off_t offset, size_t length, std::shared_ptr<void> holder) {
+    m_fileFd = fd;
+    m_fileOffset = offset;
+    m_fileLength = length;
+    m_fileHolder = holder;
 }
 
 // 根据key值获取HTTP响应头部的value值
-const std::string& HttpResponse::getHeader(const std::string& key, const std::string& def) const {
-    auto it = m_headers.find(key);
-    if(it == m_headers.end()) {
+std::string HttpResponse::getHeader(const std::string& key, const std::string& def) const {
+    const HttpHeaders::Field* f = m_headers.find(key);
+    if(!f) {
         return def;
     }
-    return it->second;
+    return std::string(f->value, f->valueLen);
+}
+
+// 用map设置HTTP响应头部
+void HttpResponse::setHeaders(const MapType& headers) {
+    m_headers.clear();
+    for(auto& i : headers) {
+        m_headers.add(i.first.c_str(), i.first.size(), i.second.c_str(), i.second.size());
+    }
 }
 
 // 根据key值设置HTTP响应头部的value值
 void HttpResponse::setHeader(const std::string& key, const std::string& value) {
-    m_headers[key] = value;
+    m_headers.set(key, value);
 }
 
 // 根据key值删除HTTP响应头部的value值
 void HttpResponse::delHeader(const std::string& key) {
-    m_headers.erase(key);
+    m_headers.del(key);
 }
 
 // 判断HTTP响应的头部参数是否存在
 bool HttpResponse::hasHeader(const std::string& key, std::string* value) const {
-    auto it = m_headers.find(key);
-    if(it == m_headers.end()) {
+    const HttpHeaders::Field* f = m_headers.find(key);
+    if(!f) {
         return false;
     }
     if(value) {
-        *value = it->second;
+        value->assign(f->value, f->valueLen);
     }
     return true;
 }
@@ -289,13 +333,14 @@ std::ostream& HttpResponse::dump(std::ostream& os) {
     }
     bool hasContentLen = false;
     for(const auto& i : m_headers) {
-        if(!m_websocket && strcasecmp(i.first.c_str(), "Connection") == 0) {
+        if(!m_websocket && i.id == HttpHeaderId::CONNECTION) {
             continue;
         }
-        if(!hasContentLen && strcasecmp(i.first.c_str(), "Content-Length") == 0) {
+        if(i.id == HttpHeaderId::CONTENT_LENGTH) {
             hasContentLen = true;
         }
-        os << i.first << ": " << i.second << "\r\n";
+        os.write(i.name, i.nameLen) << ": ";
+        os.write(i.value, i.valueLen) << "\r\n";
     }
     if(!m_body.empty()) {
         if(!hasContentLen) {
@@ -311,10 +356,45 @@ std::ostream& HttpResponse::dump(std::ostream& os) {
 
 // 字符串方式输出HTTP请求所有信息
 std::string HttpResponse::toString() {
-    std::stringstream ss;
-    dump(ss);
-    return ss.str();
+    std::string str;
+    str.reserve(256 + m_body.size());
+    dumpHeader(str);
+    str.append(m_body);
+    return str;
 }
 
+// 把状态行和头部追加到out
+void HttpResponse::dumpHeader(std::string& out) const {
+    char buf[64];
+    int n = snprintf(buf, sizeof(buf), "HTTP/%d.%d %u ",
+                     m_version >> 4, m_version & 0x0F, (uint32_t)m_status);
+    out.append(buf, n);
+    out.append(m_reason);
+    out.append("\r\n", 2);
+
+    if(!m_websocket) {
+        out.append(m_close ? "Connection: Close\r\n" : "Connection: Keep-Alive\r\n");
+    }
+    bool hasContentLen = false;
+    for(const auto& i : m_headers) {
+        if(!m_websocket && i.id == HttpHeaderId::CONNECTION) {
+            continue;
+        }
+        if(i.id == HttpHeaderId::CONTENT_LENGTH) {
+            hasContentLen = true;
+        }
+        out.append(i.name, i.nameLen);
+        out.append(": ", 2);
+        out.append(i.value, i.valueLen);
+        out.append("\r\n", 2);
+    }
+    if(!hasContentLen && (!m_body.empty() || hasFileBody())) {
+        n = snprintf(buf, sizeof(buf), "Content-Length: %zu\r\n",
+                     hasFileBody() ? m_fileLength : m_body.size());
+        out.append(buf, n);
+    }
+    out.append("\r\n", 2);
+}
+
+}
 }
-}
\ No newline at end of file
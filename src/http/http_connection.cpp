@@ -1,12 +1,26 @@
 #include "log.h"
+#include "config.h"
+#include "iomanager.h"
 #include "http_connection.h"
 #include "http_parser.h"
+#include <deque>
+#include <string.h>
 
 namespace sylar {
 namespace http {
 
 static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
+// 连接池中每个管线化连接的最大在途请求数
+static ConfigVar<uint32_t>::ptr g_http_client_maxPipeline = 
+            Config::Lookup("http.client.max_pipeline", 
+            (uint32_t)8, "http client max pipelined requests per connection");
+
+// 连接池回收过期空闲连接的间隔(毫秒)
+static ConfigVar<uint64_t>::ptr g_http_client_reapInterval = 
+            Config::Lookup("http.client.reap_interval", 
+            (uint64_t)5000, "http client connection pool reap interval(ms)");
+
 
 // HTTP响应结果的可读性输出
 std::string HttpResult::toString() const {
@@ -18,6 +32,66 @@ std::string HttpResult::toString() const {
     return ss.str();
 }
 
+// 构造函数
+HttpFuture::HttpFuture(Callback cb)
+    :m_cb(cb) {
+}
+
+// 等待并返回结果
+HttpResult::ptr HttpFuture::get() {
+    Semaphore sem;
+    {
+        MutexType::Lock lock(m_mutex);
+        if(m_result) {
+            return m_result;
+        }
+        Scheduler* scheduler = Scheduler::GetThis();
+        if(scheduler) {
+            m_waiters.push_back({scheduler, Fiber::GetThis(), sylar::getThreadId(), nullptr});
+        } else {
+            m_waiters.push_back({nullptr, nullptr, -1, &sem});
+        }
+    }
+    if(Scheduler::GetThis()) {
+        Fiber::YieldToHold();
+    } else {
+        sem.wait();
+    }
+    MutexType::Lock lock(m_mutex);
+    return m_result;
+}
+
+// 是否已经有结果
+bool HttpFuture::isDone() {
+    MutexType::Lock lock(m_mutex);
+    return m_result != nullptr;
+}
+
+// 设置结果，唤醒等待者后执行回调
+void HttpFuture::setResult(HttpResult::ptr result) {
+    std::vector<Waiter> waiters;
+    Callback cb;
+    {
+        MutexType::Lock lock(m_mutex);
+        if(m_result) {
+            return;
+        }
+        m_result = result;
+        waiters.swap(m_waiters);
+        cb.swap(m_cb);
+    }
+    for(auto& i : waiters) {
+        if(i.scheduler) {
+            i.scheduler->scheduler(i.fiber, i.thread);
+        } else {
+            i.sem->notify();
+        }
+    }
+    if(cb) {
+        cb(result);
+    }
+}
+
 // 构造函数
 HttpConnection::HttpConnection(Socket::ptr sock, bool owner) 
     :SocketStream(sock, owner) {
@@ -46,111 +120,113 @@ HttpResponse::ptr HttpConnection::recvHttpResponse() {
         delete[] ptr;
     });
     char* buff = buffer.get();
-    size_t offset = 0;
+    // 管线化时上一个响应之后可能已经读到了这个响应的开头，先解析这部分数据
+    size_t offset = m_pending.size();
+    if(offset) {
+        memcpy(buff, m_pending.c_str(), offset);
+        m_pending.clear();
+    }
+    size_t searched = 0;    // 已经查找过头部结束符的长度
 
     // 读取并解析HTTP响应头部并解析
     while(true) {
-        // 读数据，offset是上次未解析数据的偏移
-        int len = read(buff + offset, buff_size - offset);
-        if(len <= 0) {
-            close();
-            return nullptr;
+        // 头部收全之后再解析，头部从中间截断时解析器不能正确地接着解析后半部分
+        // 管线化时多个响应连续到达，响应头部经常跨越两次读取
+        if(offset >= 4 && memmem(buff + searched, offset - searched, "\r\n\r\n", 4)) {
+            break;
         }
-        // SYLAR_LOG_DEBUG(g_logger) << "read: len=" << len << " content:" << buff;
-        
-        buff[len + offset] = '\0';
-        // 解析数据，len + offset为本次新读取的+上次未解析的
-        size_t nparser = parser->execute(buff, len + offset, false);
-        if(parser->hasError()) {
+        searched = offset > 3 ? offset - 3 : 0;
+        // 缓存区满了都没有收全头部，说明头部过大
+        if(offset == buff_size) {
             close();
             return nullptr;
         }
-        // SYLAR_LOG_DEBUG(g_logger) << "parser: nparser=" << nparser << " content:" << buff;
-
-        // 更新偏移，解析完的数据将被移除，剩余未解析的数据为最新偏移
-        offset = len + offset - nparser;
-        // 缓存区满了都无数据解析，说明解析有问题
-        if(offset == buff_size) {
+        // 读数据，offset是已读取的数据长度
+        int len = read(buff + offset, buff_size - offset);
+        if(len <= 0) {
             close();
             return nullptr;
         }
+        // SYLAR_LOG_DEBUG(g_logger) << "read: len=" << len << " content:" << buff;
+        offset += len;
+    }
 
-        if(parser->isFinished()) {
-            break;
-        }
+    buff[offset] = '\0';
+    // 解析头部，解析完的数据将被移除，剩余未解析的数据为最新偏移
+    size_t nparser = parser->execute(buff, offset, false);
+    if(parser->hasError() || !parser->isFinished()) {
+        close();
+        return nullptr;
     }
+    // SYLAR_LOG_DEBUG(g_logger) << "parser: nparser=" << nparser << " content:" << buff;
+    offset -= nparser;
 
     // 读取HTTP响应数据body，如果是chunk格式要解析chunk头部
     auto& client_parser = parser->getParser();
     std::string body;
     // chunk格式，要解析头部再读取正文
     if(client_parser.chunked) {
-        int len = offset;       // 当前读取到的body长度，即Chunk块长度
+        size_t len = offset;       // buff中未处理的数据长度
         do {
-            bool flag = true;
-            // 该while循环是为了确保能拿到Chunk正文的长度
-            do {
-                // SYLAR_LOG_DEBUG(g_logger) << "len=" << len;
-                // 如果不加条件，在最后解析chunk的结束标志 0 \r\n \r\n 时会再次read，已没有内容可读，会报错
-                // len == 0 表示要开始解析下一块chunk
-                if(!flag || len == 0) {
-                    int rt = read(buff + len, buff_size - len);
-                    // SYLAR_LOG_DEBUG(g_logger) << "rt=" << rt;
-                    if(rt <= 0) {
-                        close();
-                        return nullptr;
-                    }
-                    len += rt;
-                }
-
-                buff[len] = '\0';
-                // 解析chunk格式的头部部分，不解析正文部分
-                size_t nparser = parser->execute(buff, len, true);
-                if(parser->hasError()) {
+            // 收全chunk头部所在的行再解析，原因同响应头部
+            while(len < 2 || !memmem(buff, len, "\r\n", 2)) {
+                if(len == buff_size) {
                     close();
                     return nullptr;
                 }
-
-                len -= nparser;    // 未解析的数据长度
-                if(len == (int)buff_size) {
+                int rt = read(buff + len, buff_size - len);
+                if(rt <= 0) {
                     close();
                     return nullptr;
                 }
-                flag = false;   // flag的目的是当前while中解析未完成，可回去继续读
-            } while(!parser->isFinished());
+                len += rt;
+            }
+
+            buff[len] = '\0';
+            // 解析chunk格式的头部部分，不解析正文部分
+            size_t nparser = parser->execute(buff, len, true);
+            if(parser->hasError() || !parser->isFinished()) {
+                close();
+                return nullptr;
+            }
+            len -= nparser;
 
             // parser->isFinished()后就有content_len了
             // content_len记录的是当前chunk块的正文长度
             SYLAR_LOG_DEBUG(g_logger) << "content_len=" << client_parser.content_len; 
 
-            // 解析时 main := (Response | Chunked_Header) @done; 没有匹配后面的\r\n
-            // 所以 execute 执行后，将已解析的移除，并没有移除\r\n，所以buff的首字符就是\r\n
-            // 而解析 chunk 时，记录 chunk_size 在 \r\n 前，所以 content_len 只包括 chunk内容长度
-            // 而 read 读取的 len 包括 \r\n，所以长度+2
-            if(client_parser.content_len <= len - 2) {  // len中包含chunk正文长度 + '\r\n'两个字符
-                // 当前chunk块的正文长度content_len小于len，说明buff中还有下一个chunk块的信息
+            // 解析时 main := (Response | Chunked_Header) @done; 没有匹配正文后面的\r\n
+            // 所以 execute 执行后buff的开头就是正文，正文后面还有\r\n，一共content_len + 2个字符
+            uint64_t need = client_parser.content_len + 2;
+            if(need <= len) {
+                // buff中已经有完整的chunk块，剩下的是下一个chunk块(或者下一个响应)的数据
                 body.append(buff, client_parser.content_len);
-                memmove(buff, buff + client_parser.content_len + 2, len - client_parser.content_len - 2);
-                len -= client_parser.content_len + 2;
+                memmove(buff, buff + need, len - need);
+                len -= need;
             }
             else {
-                // 当前chunk块的正文长度content_len大于len，说明当前chunk块的正文还没有被完全读完，继续读直到达到content_len
-                body.append(buff, len);
-                int left = client_parser.content_len + 2 - len;
-                while(left > 0) {
-                    int rt = read(buff, left > (int)buff_size ? (int)buff_size : left);
+                // 当前chunk块还没有读完，只读到当前chunk块的结尾，不多读
+                uint64_t got = len;
+                body.append(buff, std::min(got, (uint64_t)client_parser.content_len));
+                while(got < need) {
+                    int rt = read(buff, std::min(need - got, (uint64_t)buff_size));
                     if(rt <= 0) {
                         close();
                         return nullptr;
                     }
-                    body.append(buff, rt);
-                    left -= rt;
+                    if(got < (uint64_t)client_parser.content_len) {
+                        body.append(buff, std::min((uint64_t)rt, client_parser.content_len - got));
+                    }
+                    got += rt;
                 }
-                // body.resize(body.size() - 2);    // 减去body最后的'\r\n'
                 len = 0;
             }
         } while(!client_parser.chunks_done);
         parser->getData()->setBody(body);
+        // 剩下的是下一个响应的数据
+        if(len > 0) {
+            m_pending.assign(buff, len);
+        }
     }
     else {  // 非chunk格式，直接根据Content-Length读取body
         size_t length = parser->getContentLen();
@@ -171,11 +247,37 @@ HttpResponse::ptr HttpConnection::recvHttpResponse() {
             }
             parser->getData()->setBody(body);
         }
+        // 剩下的是下一个响应的数据
+        if(offset > length) {
+            m_pending.assign(buff + length, offset - length);
+        }
     }
 
     return parser->getData();
 }
 
+// 读数据，先返回接收响应时多读的数据
+ssize_t HttpConnection::read(void* buff, size_t length) {
+    if(m_pending.empty()) {
+        return SocketStream::read(buff, length);
+    }
+    size_t len = std::min(length, m_pending.size());
+    memcpy(buff, m_pending.c_str(), len);
+    m_pending.erase(0, len);
+    return len;
+}
+
+// 读数据，先返回接收响应时多读的数据
+ssize_t HttpConnection::read(ByteArray::ptr buff, size_t length) {
+    if(m_pending.empty()) {
+        return SocketStream::read(buff, length);
+    }
+    size_t len = std::min(length, m_pending.size());
+    buff->write(m_pending.c_str(), len);
+    m_pending.erase(0, len);
+    return len;
+}
+
 // 发生HTTP请求
 ssize_t HttpConnection::sendHttpRequest(HttpRequest::ptr request) {
     std::string res = request->toString();
@@ -330,8 +432,12 @@ HttpConnectionPool::ptr HttpConnectionPool::CreateConnectionPool(const std::stri
         SYLAR_LOG_ERROR(g_logger) << "uri parser error, invalid uri=" << uri;
         return nullptr;
     }
-    return std::make_shared<HttpConnectionPool>(uri_ptr->getHost(), vhost, uri_ptr->getPort()
-                                                , maxSize, maxAliveTime, maxRequest);
+    HttpConnectionPool::ptr pool = std::make_shared<HttpConnectionPool>(uri_ptr->getHost(), vhost
+                                                , uri_ptr->getPort(), maxSize, maxAliveTime, maxRequest);
+    if(IOManager::GetThis()) {
+        pool->startReaper();
+    }
+    return pool;
 }
 
 // 构造函数
@@ -346,77 +452,352 @@ HttpConnectionPool::HttpConnectionPool(const std::string& host,
     ,m_port(port) 
     ,m_maxSize(maxSize) 
     ,m_maxAliveTime(maxAliveTime) 
-    ,m_maxRequest(maxRequest) {
+    ,m_maxRequest(maxRequest)
+    ,m_maxPipeline(std::max(g_http_client_maxPipeline->getValue(), (uint32_t)1)) {
+    for(auto& i : m_caches) {
+        i = nullptr;
+    }
 }
 
-// 从连接池中拿连接，如果没有则创建新连接
-HttpConnection::ptr HttpConnectionPool::getConnection(uint64_t timeout_ms) {
-    HttpConnection* ptr = nullptr;
-    std::list<HttpConnection*> invalid_con;
+/**
+ * @brief 管线化连接
+ * @details 请求先放入发送队列，发送协程把队列里的请求拼在一起一次写出，并按顺序移入等待队列
+ *          接收协程依次读取响应，交给等待队列的队头
+ *          两个协程在各自的队列为空时退出，有新请求时再启动，空闲的连接不占用协程
+ *          协程持有连接的智能指针，连接池丢弃连接后在途的请求仍然可以完成
+ */
+class HttpConnectionPool::Pipeline : public std::enable_shared_from_this<Pipeline> {
+public:
+    typedef std::shared_ptr<Pipeline> ptr;
+    typedef Mutex MutexType;
 
-    MutexType::Lock lock(m_mutex);
-    // 连接池有可用的连接，直接拿出来用
-    while(!m_pool.empty()) {
-        auto it = *m_pool.begin();
-        m_pool.pop_front();
-        if(!it->isConnected()) {
-            invalid_con.push_back(it);
-            continue;
+    Pipeline(IOManager* iom, const std::string& host, uint32_t port
+            ,uint32_t maxAliveTime, uint32_t maxRequest)
+        :m_iom(iom)
+        ,m_host(host)
+        ,m_port(port)
+        ,m_maxRequest(maxRequest)
+        ,m_expireTime(GetCurrentMS() + maxAliveTime) {
+    }
+
+    // 放入发送队列，连接已不可用时返回false
+    bool push(std::string&& data, HttpFuture::ptr future, uint64_t timeout_ms) {
+        MutexType::Lock lock(m_mutex);
+        if(m_closed) {
+            return false;
         }
-        if(it->m_createTime + m_maxAliveTime <= GetCurrentMS()) {
-            invalid_con.push_back(it);
-            continue;
+        m_sendQueue.push_back({std::move(data), future, timeout_ms});
+        ++m_count;
+        if(!m_writing) {
+            m_writing = true;
+            m_iom->scheduler(std::bind(&Pipeline::writeLoop, shared_from_this()));
         }
-        ptr = it;
-        break;
+        return true;
     }
-    lock.unlock();
 
-    // 删掉失效的连接
-    for(auto i : invalid_con) {
-        // SYLAR_LOG_ERROR(g_logger) << "m_total=" << m_total 
-        //                         << " m_maxSize=" << m_maxSize
-        //                         << "  |  m_request=" << i->m_request
-        //                         << " m_maxRequest=" << m_maxRequest
-        //                         << "  |  m_createTime=" << i->m_createTime;
+    // 是否还能放入新的请求
+    bool isUsable(uint64_t now) {
+        MutexType::Lock lock(m_mutex);
+        return !m_closed && m_count < m_maxRequest && now < m_expireTime;
+    }
+
+    // 在途的请求数
+    size_t getInflight() {
+        MutexType::Lock lock(m_mutex);
+        return m_sendQueue.size() + m_waitQueue.size();
+    }
+
+private:
+    struct Item {
+        std::string data;           // 序列化后的请求
+        HttpFuture::ptr future;     // 请求的结果
+        uint64_t timeout;           // 超时时间(毫秒)
+    };
+
+    // 发送协程: 建立连接，然后不断发送队列里的请求
+    void writeLoop() {
+        if(!m_conn) {
+            uint64_t timeout = 0;
+            {
+                MutexType::Lock lock(m_mutex);
+                timeout = m_sendQueue.front().timeout;
+            }
+            HttpConnection* con = Connect(m_host, m_port, timeout);
+            if(!con) {
+                fail((int)HttpResult::Status::CONNECT_ERROR
+                    , "connect fail: " + m_host + ":" + std::to_string(m_port));
+                return;
+            }
+            m_conn.reset(con);
+        }
+
+        std::string buf;
+        while(true) {
+            buf.clear();
+            {
+                MutexType::Lock lock(m_mutex);
+                if(m_closed || m_sendQueue.empty()) {
+                    m_writing = false;
+                    return;
+                }
+                // 先移入等待队列再发送，保证接收协程看到的顺序就是发送的顺序
+                for(auto& i : m_sendQueue) {
+                    buf.append(i.data);
+                    m_waitQueue.push_back({std::string(), i.future, i.timeout});
+                }
+                m_sendQueue.clear();
+                if(!m_reading) {
+                    m_reading = true;
+                    m_iom->scheduler(std::bind(&Pipeline::readLoop, shared_from_this()));
+                }
+            }
+            int rt = m_conn->writeFixSize(buf.c_str(), buf.size());
+            if(rt <= 0) {
+                fail(rt == 0 ? (int)HttpResult::Status::SEND_CLOSE_BY_PEER
+                             : (int)HttpResult::Status::SEND_SOCKET_ERROR
+                    , "send http request fail: " + m_host + ":" + std::to_string(m_port)
+                    + " errno=" + std::to_string(errno) + " errstr=" + strerror(errno));
+                return;
+            }
+        }
+    }
+
+    // 接收协程: 依次读取响应，交给等待队列的队头
+    void readLoop() {
+        while(true) {
+            uint64_t timeout = 0;
+            {
+                MutexType::Lock lock(m_mutex);
+                if(m_closed || m_waitQueue.empty()) {
+                    m_reading = false;
+                    return;
+                }
+                timeout = m_waitQueue.front().timeout;
+            }
+            m_conn->getSocket()->setRecvTimeout(timeout);
+            HttpResponse::ptr res = m_conn->recvHttpResponse();
+            if(!res) {
+                fail((int)HttpResult::Status::TIMEOUT
+                    , "recv http response timeout: " + m_host + ":" + std::to_string(m_port)
+                    + " timeout_ms=" + std::to_string(timeout));
+                return;
+            }
+            HttpFuture::ptr future;
+            {
+                MutexType::Lock lock(m_mutex);
+                future = m_waitQueue.front().future;
+                m_waitQueue.pop_front();
+            }
+            // 解析出的响应默认是短连接，按Connection头部判断对端是否会关闭连接
+            StringSlice con = res->getHeaderSlice(HttpHeaderId::CONNECTION);
+            bool close = res->getVersion() == 0x10 ? !con.equalsIgnoreCase("keep-alive", 10)
+                                                   : con.equalsIgnoreCase("close", 5);
+            res->setClose(false);
+            future->setResult(std::make_shared<HttpResult>((int)HttpResult::Status::OK, res, "ok"));
+            if(close) {
+                // 对端不再处理后面的请求
+                fail((int)HttpResult::Status::CLOSE_BY_PEER
+                    , "connection closed by peer: " + m_host + ":" + std::to_string(m_port));
+                return;
+            }
+        }
+    }
+
+    // 连接出错，关闭连接，所有在途的请求返回失败
+    void fail(int status, const std::string& description) {
+        std::deque<Item> items;
+        {
+            MutexType::Lock lock(m_mutex);
+            m_closed = true;
+            m_writing = false;
+            m_reading = false;
+            items.swap(m_waitQueue);
+            for(auto& i : m_sendQueue) {
+                items.push_back(std::move(i));
+            }
+            m_sendQueue.clear();
+        }
+        if(m_conn) {
+            m_conn->close();
+        }
+        SYLAR_LOG_DEBUG(g_logger) << "pipeline fail: " << description << " inflight=" << items.size();
+        for(auto& i : items) {
+            i.future->setResult(std::make_shared<HttpResult>(status, nullptr, description));
+        }
+    }
+
+private:
+    IOManager* m_iom;               // 发送、接收协程所在的调度器
+    std::string m_host;             // 域名
+    uint32_t m_port;                // 端口号
+    uint32_t m_maxRequest;          // 最大请求次数
+    uint64_t m_expireTime;          // 过期时间，之后不再放入新请求
+
+    MutexType m_mutex;
+    HttpConnection::ptr m_conn;     // 连接，由发送协程建立
+    std::deque<Item> m_sendQueue;   // 待发送的请求
+    std::deque<Item> m_waitQueue;   // 已发送、等待响应的请求，按发送顺序
+    uint32_t m_count = 0;           // 放入过的请求数
+    bool m_writing = false;         // 发送协程是否在运行
+    bool m_reading = false;         // 接收协程是否在运行
+    bool m_closed = false;          // 连接是否已关闭
+};
+
+// 解析地址并建立连接
+HttpConnection* HttpConnectionPool::Connect(const std::string& host, uint32_t port, uint64_t timeout_ms) {
+    auto addr = Address::LookupAnyIPAddress(host);
+    if(!addr) {
+        SYLAR_LOG_ERROR(g_logger) << "get addr fail: " << host;
+        return nullptr;
+    }
+    // 因为上述LookupAnyIPAddress(host)中host只有域名没有端口号，所以要手动设置
+    addr->setPort(port);
+
+    Socket::ptr sock = Socket::CreatTcpSocket(addr);
+    if(!sock) {
+        SYLAR_LOG_ERROR(g_logger) << "create sock fail: " << addr->toString();
+        return nullptr;
+    }
+
+    if(!sock->connect(addr, timeout_ms)) {
+        SYLAR_LOG_ERROR(g_logger) << "sock connect fail: " << addr->toString();
+        return nullptr;
+    }
+    
+    sock->setRecvTimeout(timeout_ms);
+
+    HttpConnection* con = new HttpConnection(sock);
+    con->m_createTime = GetCurrentMS();
+    return con;
+}
+
+// 每个线程缓存的空闲连接数
+static const size_t THREAD_CACHE_SIZE = 8;
+
+/**
+ * @brief 线程的空闲连接缓存
+ * @details 每个槽位是一个原子指针，取连接时交换为空，放回时从空交换为连接
+ *          只有所属线程取放，回收定时器也用同样的原子操作检查，所以不需要加锁
+ */
+struct HttpConnectionPool::ThreadCache {
+    ThreadCache() {
+        for(auto& i : conns) {
+            i = nullptr;
+        }
+    }
+    std::atomic<HttpConnection*> conns[THREAD_CACHE_SIZE];
+};
+
+// 当前线程的连接缓存
+// 下标为GetThreadIndex()，线程退出后下标连同缓存里的空闲连接一起交给之后的线程
+HttpConnectionPool::ThreadCache* HttpConnectionPool::getThreadCache() {
+    int index = GetThreadIndex();
+    if(index < 0 || (size_t)index >= MAX_THREAD_CACHES) {
+        return nullptr;
+    }
+    std::atomic<ThreadCache*>& slot = m_caches[index];
+    ThreadCache* cache = slot.load(std::memory_order_acquire);
+    if(!cache) {
+        // 同一时刻只有一个线程使用这个下标，不会有竞争
+        cache = new ThreadCache;
+        slot.store(cache, std::memory_order_release);
+    }
+    return cache;
+}
+
+// 空闲连接是否还能继续使用
+bool HttpConnectionPool::isValid(HttpConnection* ptr, uint64_t now) const {
+    return ptr->isConnected()
+        && ptr->m_createTime + m_maxAliveTime > now
+        && ptr->m_request < m_maxRequest;
+}
+
+// 释放连接并计数
+void HttpConnectionPool::evict(HttpConnection* ptr) {
+    delete ptr;
+    --m_total;
+    ++m_evictions;
+}
+
+// 析构函数，释放所有空闲连接
+HttpConnectionPool::~HttpConnectionPool() {
+    if(m_reapTimer) {
+        m_reapTimer->cancel();
+    }
+    for(auto& i : m_caches) {
+        ThreadCache* cache = i.load();
+        if(!cache) {
+            continue;
+        }
+        for(auto& c : cache->conns) {
+            delete c.load();
+        }
+        delete cache;
+    }
+    for(auto i : m_pool) {
         delete i;
     }
-    m_total -= invalid_con.size();
+}
 
-    // 连接池没有可用的连接，需要新创建
+// 从连接池中拿连接，如果没有则创建新连接
+HttpConnection::ptr HttpConnectionPool::getConnection(uint64_t timeout_ms) {
+    HttpConnection* ptr = nullptr;
+    uint64_t now = GetCurrentMS();
+
+    // 先从当前线程的缓存里拿
+    ThreadCache* cache = getThreadCache();
+    if(cache) {
+        for(auto& i : cache->conns) {
+            HttpConnection* con = i.exchange(nullptr, std::memory_order_acquire);
+            if(!con) {
+                continue;
+            }
+            if(isValid(con, now)) {
+                ptr = con;
+                break;
+            }
+            evict(con);
+        }
+    }
+
+    // 再从共享的连接池里拿
     if(!ptr) {
-        auto addr = Address::LookupAnyIPAddress(m_host);
-        if(!addr) {
-            SYLAR_LOG_ERROR(g_logger) << "get addr fail: " << m_host;
-            return nullptr;
+        std::list<HttpConnection*> invalid_con;
+        MutexType::Lock lock(m_mutex);
+        while(!m_pool.empty()) {
+            auto it = *m_pool.begin();
+            m_pool.pop_front();
+            if(!isValid(it, now)) {
+                invalid_con.push_back(it);
+                continue;
+            }
+            ptr = it;
+            break;
         }
-        // 因为上述LookupAnyIPAddress(m_host)中m_host只有域名没有端口号，所以要手动设置
-        addr->setPort(m_port);
+        lock.unlock();
 
-        Socket::ptr sock = Socket::CreatTcpSocket(addr);
-        if(!sock) {
-            SYLAR_LOG_ERROR(g_logger) << "create sock fail: " << addr->toString();
-            return nullptr;
+        // 删掉失效的连接
+        for(auto i : invalid_con) {
+            evict(i);
         }
+    }
 
-        if(!sock->connect(addr, timeout_ms)) {
-            SYLAR_LOG_ERROR(g_logger) << "sock connect fail: " << addr->toString();
+    // 连接池没有可用的连接，需要新创建
+    if(ptr) {
+        ++m_hits;
+    } else {
+        ++m_misses;
+        ptr = Connect(m_host, m_port, timeout_ms);
+        if(!ptr) {
+            ++m_connectFails;
             return nullptr;
         }
-        
-        sock->setRecvTimeout(timeout_ms);
-
-        ptr = new HttpConnection(sock);
-        ptr->m_createTime = GetCurrentMS();
+        ++m_connects;
         ++m_total;
     }
 
     // std::placeholders::_1为占位符，_1用于代替回调函数中的第一个参数
     return HttpConnection::ptr(ptr, std::bind(&ReleasePtr, std::placeholders::_1, this));
-    // 上述语句的使用类比如下：
-    // std::shared_ptr<char> buffer(new char[buff_size + 1], [](char* ptr) {
-    //     delete[] ptr;
-    // });
 }
 
 // 处理用完之后的连接
@@ -424,25 +805,147 @@ void HttpConnectionPool::ReleasePtr(HttpConnection* ptr, HttpConnectionPool* poo
     ptr->m_request++;
 
     // 连接已失效，则直接删掉
-    if(!ptr->isConnected() 
-            || pool->m_total > pool->m_maxSize
-            || ptr->m_createTime + pool->m_maxAliveTime <= GetCurrentMS()
-            || ptr->m_request >= pool->m_maxRequest) {
-        // SYLAR_LOG_ERROR(g_logger) << "m_total=" << pool->m_total 
-        //                         << " m_maxSize=" << pool->m_maxSize
-        //                         << "  |  m_request=" << ptr->m_request
-        //                         << " m_maxRequest=" << pool->m_maxRequest
-        //                         << "  |  m_createTime=" << ptr->m_createTime;
-        delete ptr;
-        pool->m_total--;
+    if(!pool->isValid(ptr, GetCurrentMS()) || pool->m_total > pool->m_maxSize) {
+        pool->evict(ptr);
         return;
     }
 
-    // 连接还可以继续用，就放回连接池
+    // 连接还可以继续用，优先放回当前线程的缓存
+    ThreadCache* cache = pool->getThreadCache();
+    if(cache) {
+        for(auto& i : cache->conns) {
+            HttpConnection* expected = nullptr;
+            if(i.compare_exchange_strong(expected, ptr, std::memory_order_release)) {
+                return;
+            }
+        }
+    }
+
+    // 线程缓存满了，放回共享的连接池
     MutexType::Lock lock(pool->m_mutex);
     pool->m_pool.push_back(ptr);
 }
 
+// 启动定时回收
+bool HttpConnectionPool::startReaper(uint64_t interval_ms) {
+    IOManager* iom = IOManager::GetThis();
+    if(!iom || m_reapTimer) {
+        return false;
+    }
+    if(!interval_ms) {
+        interval_ms = g_http_client_reapInterval->getValue();
+    }
+    // 定时器只持有弱引用，连接池析构后回调什么也不做
+    std::weak_ptr<HttpConnectionPool> weak_pool;
+    try {
+        weak_pool = shared_from_this();
+    } catch(std::bad_weak_ptr&) {
+        SYLAR_LOG_ERROR(g_logger) << "startReaper: connection pool " << m_host << ":" << m_port
+                                  << " is not owned by a shared_ptr";
+        return false;
+    }
+    m_reapTimer = iom->addTimer(interval_ms, [weak_pool]() {
+        HttpConnectionPool::ptr pool = weak_pool.lock();
+        if(pool) {
+            pool->reap();
+        }
+    }, true);
+    return true;
+}
+
+// 回收失效的空闲连接和不再使用的管线化连接
+void HttpConnectionPool::reap() {
+    uint64_t now = GetCurrentMS();
+    std::vector<HttpConnection*> keep;
+    std::vector<HttpConnection*> invalid_con;
+    for(auto& i : m_caches) {
+        ThreadCache* cache = i.load(std::memory_order_acquire);
+        if(!cache) {
+            continue;
+        }
+        for(auto& c : cache->conns) {
+            HttpConnection* con = c.exchange(nullptr, std::memory_order_acquire);
+            if(!con) {
+                continue;
+            }
+            if(!isValid(con, now)) {
+                invalid_con.push_back(con);
+                continue;
+            }
+            // 放回原槽位，槽位已被所属线程占用时改放共享的连接池
+            HttpConnection* expected = nullptr;
+            if(!c.compare_exchange_strong(expected, con, std::memory_order_release)) {
+                keep.push_back(con);
+            }
+        }
+    }
+
+    {
+        MutexType::Lock lock(m_mutex);
+        for(auto it = m_pool.begin(); it != m_pool.end();) {
+            if(!isValid(*it, now)) {
+                invalid_con.push_back(*it);
+                it = m_pool.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        m_pool.insert(m_pool.end(), keep.begin(), keep.end());
+        for(auto it = m_pipelines.begin(); it != m_pipelines.end();) {
+            if(!(*it)->isUsable(now)) {
+                it = m_pipelines.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    for(auto i : invalid_con) {
+        evict(i);
+    }
+    if(!invalid_con.empty()) {
+        SYLAR_LOG_DEBUG(g_logger) << "connection pool " << m_host << ":" << m_port
+                                  << " reaped " << invalid_con.size() << " connections";
+    }
+}
+
+// 获取统计数据
+HttpConnectionPool::Stats HttpConnectionPool::getStats() const {
+    Stats stats;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.connects = m_connects;
+    stats.connectFails = m_connectFails;
+    stats.evictions = m_evictions;
+    stats.total = m_total;
+    for(auto& i : m_caches) {
+        ThreadCache* cache = i.load(std::memory_order_acquire);
+        if(!cache) {
+            continue;
+        }
+        for(auto& c : cache->conns) {
+            stats.idle += c.load(std::memory_order_relaxed) != nullptr;
+        }
+    }
+    MutexType::Lock lock(m_mutex);
+    stats.idle += m_pool.size();
+    return stats;
+}
+
+// 统计数据的可读性输出
+std::string HttpConnectionPool::Stats::toString() const {
+    std::stringstream ss;
+    ss << "[HttpConnectionPool::Stats hits=" << hits
+       << " misses=" << misses
+       << " connects=" << connects
+       << " connectFails=" << connectFails
+       << " evictions=" << evictions
+       << " total=" << total
+       << " idle=" << idle
+       << "]";
+    return ss.str();
+}
+
 // 发送HTTP的GET请求
 HttpResult::ptr HttpConnectionPool::doGet(const std::string& uri
                                         ,uint64_t timeout_ms
@@ -487,10 +990,9 @@ HttpResult::ptr HttpConnectionPool::doPost(Uri::ptr uri
     return doPost(ss.str(), timeout_ms, headers, body);
 }
 
-// 发送HTTP请求
-HttpResult::ptr HttpConnectionPool::doRequest(HttpMethod method
+// 创建请求，填充Host和Keep-Alive
+HttpRequest::ptr HttpConnectionPool::createRequest(HttpMethod method
                                             ,const std::string& uri
-                                            ,uint64_t timeout_ms
                                             ,const HttpRequest::MapType& headers
                                             ,const std::string& body) {
     HttpRequest::ptr req = std::make_shared<HttpRequest>();
@@ -524,7 +1026,16 @@ HttpResult::ptr HttpConnectionPool::doRequest(HttpMethod method
         
     }
     req->setBody(body);
-    return doRequest(req, timeout_ms);
+    return req;
+}
+
+// 发送HTTP请求
+HttpResult::ptr HttpConnectionPool::doRequest(HttpMethod method
+                                            ,const std::string& uri
+                                            ,uint64_t timeout_ms
+                                            ,const HttpRequest::MapType& headers
+                                            ,const std::string& body) {
+    return doRequest(createRequest(method, uri, headers, body), timeout_ms);
 }
 
 // 发送HTTP请求
@@ -581,6 +1092,59 @@ HttpResult::ptr HttpConnectionPool::doRequest(HttpRequest::ptr request
     return std::make_shared<HttpResult>((int)HttpResult::Status::OK, res, "ok");
 }
 
+// 异步发送HTTP请求
+HttpFuture::ptr HttpConnectionPool::doRequestAsync(HttpMethod method
+                                            ,const std::string& uri
+                                            ,uint64_t timeout_ms
+                                            ,const HttpRequest::MapType& headers
+                                            ,const std::string& body
+                                            ,HttpFuture::Callback cb) {
+    return doRequestAsync(createRequest(method, uri, headers, body), timeout_ms, cb);
+}
+
+// 异步发送HTTP请求，选择在途请求最少的管线化连接
+HttpFuture::ptr HttpConnectionPool::doRequestAsync(HttpRequest::ptr request
+                                            ,uint64_t timeout_ms
+                                            ,HttpFuture::Callback cb) {
+    HttpFuture::ptr future = std::make_shared<HttpFuture>(cb);
+    IOManager* iom = IOManager::GetThis();
+    if(!iom) {
+        future->setResult(doRequest(request, timeout_ms));
+        return future;
+    }
+
+    request->setClose(false);
+    Pipeline::ptr pipeline;
+    {
+        MutexType::Lock lock(m_mutex);
+        uint64_t now = GetCurrentMS();
+        size_t min = -1;
+        for(auto it = m_pipelines.begin(); it != m_pipelines.end();) {
+            // 过期、请求数用完或者出错的连接不再放入新请求，由自己的协程处理完在途的请求后释放
+            if(!(*it)->isUsable(now)) {
+                it = m_pipelines.erase(it);
+                continue;
+            }
+            size_t inflight = (*it)->getInflight();
+            if(inflight < min) {
+                min = inflight;
+                pipeline = *it;
+            }
+            ++it;
+        }
+        if(!pipeline || (min >= m_maxPipeline && m_pipelines.size() < std::max(m_maxSize, (uint32_t)1))) {
+            pipeline = std::make_shared<Pipeline>(iom, m_host, m_port, m_maxAliveTime, m_maxRequest);
+            m_pipelines.push_back(pipeline);
+        }
+    }
+
+    if(!pipeline->push(request->toString(), future, timeout_ms)) {
+        future->setResult(std::make_shared<HttpResult>((int)HttpResult::Status::POOL_INVALID_CONNECTION, nullptr
+            , "pipeline connection closed: Host=" + m_host + ":" + std::to_string(m_port)));
+    }
+    return future;
+}
+
 
 
 }
@@ -0,0 +1,332 @@
+#include "http_headers.h"
+#include <algorithm>
+
+namespace sylar {
+namespace http {
+
+// 预置头部的规范名称，按HttpHeaderId顺序存放
+static const char* s_header_names[] = {
+#define XX(name, string) #string,
+    HTTP_HEADER_MAP(XX)
+#undef XX
+    ""
+};
+
+static const size_t HEADER_COUNT = (size_t)HttpHeaderId::UNKNOWN;
+
+// 预置头部名称最长的长度
+static const size_t MAX_HEADER_NAME_LEN = 32;
+
+/**
+ * @brief 按名称长度分组的预置头部，查找时只和长度相同的几个比较
+ */
+struct HeaderIndex {
+    HeaderIndex() {
+        for(size_t i = 0; i < HEADER_COUNT; ++i) {
+            byLength[strlen(s_header_names[i])].push_back((HttpHeaderId)i);
+        }
+    }
+
+    std::vector<HttpHeaderId> byLength[MAX_HEADER_NAME_LEN + 1];
+};
+
+static const HeaderIndex& GetHeaderIndex() {
+    static HeaderIndex s_index;
+    return s_index;
+}
+
+// 忽略大小写查找预置的头部名称
+HttpHeaderId StringToHttpHeaderId(const char* name, size_t len) {
+    if(len > MAX_HEADER_NAME_LEN) {
+        return HttpHeaderId::UNKNOWN;
+    }
+    for(auto id : GetHeaderIndex().byLength[len]) {
+        if(strncasecmp(s_header_names[(size_t)id], name, len) == 0) {
+            return id;
+        }
+    }
+    return HttpHeaderId::UNKNOWN;
+}
+
+// 返回预置头部的规范名称
+const char* HttpHeaderIdToString(HttpHeaderId id) {
+    size_t index = (size_t)id;
+    if(index >= HEADER_COUNT) {
+        return "";
+    }
+    return s_header_names[index];
+}
+
+
+// 默认构造，头部和数据都先放在对象内部
+HttpHeaders::HttpHeaders()
+    :m_fields(m_inlineFields)
+    ,m_size(0)
+    ,m_capacity(INLINE_FIELDS)
+    ,m_external(0)
+    ,m_cur(m_inlineBytes)
+    ,m_left(INLINE_BYTES)
+    ,m_used(0)
+    ,m_garbage(0) {
+}
+
+// 拷贝构造，逐个拷贝有效的头部
+HttpHeaders::HttpHeaders(const HttpHeaders& rhs)
+    :HttpHeaders() {
+    *this = rhs;
+}
+
+// 赋值，逐个拷贝有效的头部，指向外部缓存的也拷贝进来
+HttpHeaders& HttpHeaders::operator=(const HttpHeaders& rhs) {
+    if(this == &rhs) {
+        return *this;
+    }
+    clear();
+    for(auto& i : rhs) {
+        Field& f = append();
+        f.id = i.id;
+        f.name = i.id == HttpHeaderId::UNKNOWN ? store(i.name, i.nameLen) : i.name;
+        f.nameLen = i.nameLen;
+        f.value = store(i.value, i.valueLen);
+        f.valueLen = i.valueLen;
+    }
+    return *this;
+}
+
+// 是否同名
+bool HttpHeaders::Match(const Field& f, HttpHeaderId id, const char* name, size_t len) {
+    if(id != HttpHeaderId::UNKNOWN) {
+        return f.id == id;
+    }
+    return f.id == HttpHeaderId::UNKNOWN && f.nameLen == len
+        && strncasecmp(f.name, name, len) == 0;
+}
+
+// 从后往前查找同名头部
+int HttpHeaders::findIndex(HttpHeaderId id, const char* name, size_t len) const {
+    for(size_t i = m_size; i > 0; --i) {
+        if(Match(m_fields[i - 1], id, name, len)) {
+            return i - 1;
+        }
+    }
+    return -1;
+}
+
+// 查找头部
+const HttpHeaders::Field* HttpHeaders::find(const char* name, size_t len) const {
+    int idx = findIndex(StringToHttpHeaderId(name, len), name, len);
+    return idx < 0 ? nullptr : m_fields + idx;
+}
+
+// 查找预置头部
+const HttpHeaders::Field* HttpHeaders::find(HttpHeaderId id) const {
+    int idx = findIndex(id, nullptr, 0);
+    return idx < 0 ? nullptr : m_fields + idx;
+}
+
+// 追加一个空的头部，对象内部的数组用完后整体搬到堆上，之后按倍数扩容
+HttpHeaders::Field& HttpHeaders::append() {
+    if(m_size == m_capacity) {
+        std::vector<Field> fields;
+        fields.reserve(m_capacity * 2);
+        fields.assign(m_fields, m_fields + m_size);
+        m_heapFields.swap(fields);
+        m_capacity = m_heapFields.capacity();
+        m_fields = m_heapFields.data();
+    }
+    Field& f = m_fields[m_size++];
+    f.external = false;
+    return f;
+}
+
+// 在缓存块中保存数据，当前块不够时分配新块，旧块不移动也不释放
+const char* HttpHeaders::store(const char* data, size_t len) {
+    if(len > m_left) {
+        size_t size = std::max(len, (size_t)1024);
+        m_blocks.emplace_back(new char[size]);
+        m_cur = m_blocks.back().get();
+        m_left = size;
+    }
+    char* p = m_cur;
+    if(len) {
+        memcpy(p, data, len);
+    }
+    m_cur += len;
+    m_left -= len;
+    m_used += len;
+    return p;
+}
+
+// 追加一个头部(拷贝)
+void HttpHeaders::add(const char* name, size_t nlen, const char* value, size_t vlen) {
+    HttpHeaderId id = StringToHttpHeaderId(name, nlen);
+    Field& f = append();
+    f.id = id;
+    f.name = id == HttpHeaderId::UNKNOWN ? store(name, nlen) : HttpHeaderIdToString(id);
+    f.nameLen = nlen;
+    f.value = store(value, vlen);
+    f.valueLen = vlen;
+}
+
+// 追加一个指向外部缓存的头部，预置头部的名称直接换成规范名称
+void HttpHeaders::addRef(const char* name, size_t nlen, const char* value, size_t vlen) {
+    HttpHeaderId id = StringToHttpHeaderId(name, nlen);
+    Field& f = append();
+    f.id = id;
+    f.name = id == HttpHeaderId::UNKNOWN ? name : HttpHeaderIdToString(id);
+    f.nameLen = nlen;
+    f.value = value;
+    f.valueLen = vlen;
+    f.external = true;
+    ++m_external;
+}
+
+// 设置头部
+void HttpHeaders::set(const char* name, size_t nlen, const char* value, size_t vlen) {
+    set(StringToHttpHeaderId(name, nlen), name, nlen, value, vlen);
+}
+
+// 设置预置头部
+void HttpHeaders::set(HttpHeaderId id, const char* value, size_t vlen) {
+    const char* name = HttpHeaderIdToString(id);
+    set(id, name, strlen(name), value, vlen);
+}
+
+// 设置头部，已存在时替换最后一个，否则追加
+void HttpHeaders::set(HttpHeaderId id, const char* name, size_t nlen, const char* value, size_t vlen) {
+    int idx = findIndex(id, name, nlen);
+    if(idx >= 0) {
+        replace(idx, id, name, nlen, value, vlen);
+        return;
+    }
+    Field& f = append();
+    f.id = id;
+    f.name = id == HttpHeaderId::UNKNOWN ? store(name, nlen) : HttpHeaderIdToString(id);
+    f.nameLen = nlen;
+    f.value = store(value, vlen);
+    f.valueLen = vlen;
+}
+
+// 替换头部的值，新值不比旧值长并且旧值在缓存中时原地覆盖
+void HttpHeaders::replace(int idx, HttpHeaderId id, const char* name, size_t nlen, const char* value, size_t vlen) {
+    Field& f = m_fields[idx];
+    if(!f.external && vlen <= f.valueLen) {
+        memmove((char*)f.value, value, vlen);
+        m_garbage += f.valueLen - vlen;
+    } else {
+        if(f.external) {
+            // 名称也可能指向外部缓存，一起拷贝进来
+            if(f.id == HttpHeaderId::UNKNOWN) {
+                f.name = store(f.name, f.nameLen);
+            }
+            f.external = false;
+            --m_external;
+        } else {
+            m_garbage += f.valueLen;
+        }
+        f.value = store(value, vlen);
+    }
+    f.valueLen = vlen;
+    // 删除前面的同名头部
+    for(int i = idx - 1; i >= 0; --i) {
+        if(Match(m_fields[i], id, name, nlen)) {
+            erase(i);
+        }
+    }
+    compactIfNeeded();
+}
+
+// 删除下标为idx的头部，保持其余头部的顺序
+void HttpHeaders::erase(size_t idx) {
+    Field& f = m_fields[idx];
+    if(f.external) {
+        --m_external;
+    } else {
+        m_garbage += f.valueLen + (f.id == HttpHeaderId::UNKNOWN ? f.nameLen : 0);
+    }
+    memmove(m_fields + idx, m_fields + idx + 1, (m_size - idx - 1) * sizeof(Field));
+    --m_size;
+}
+
+// 删除所有同名头部
+size_t HttpHeaders::del(const char* name, size_t len) {
+    HttpHeaderId id = StringToHttpHeaderId(name, len);
+    size_t count = 0;
+    for(size_t i = m_size; i > 0; --i) {
+        if(Match(m_fields[i - 1], id, name, len)) {
+            erase(i - 1);
+            ++count;
+        }
+    }
+    compactIfNeeded();
+    return count;
+}
+
+// 删除所有同名的预置头部
+size_t HttpHeaders::del(HttpHeaderId id) {
+    size_t count = 0;
+    for(size_t i = m_size; i > 0; --i) {
+        if(m_fields[i - 1].id == id) {
+            erase(i - 1);
+            ++count;
+        }
+    }
+    compactIfNeeded();
+    return count;
+}
+
+// 清空所有头部，保留最后一个缓存块继续使用
+void HttpHeaders::clear() {
+    m_size = 0;
+    m_external = 0;
+    m_used = 0;
+    m_garbage = 0;
+    if(m_blocks.empty()) {
+        m_cur = m_inlineBytes;
+        m_left = INLINE_BYTES;
+    } else {
+        if(m_blocks.size() > 1) {
+            std::unique_ptr<char[]> last = std::move(m_blocks.back());
+            m_blocks.clear();
+            m_blocks.push_back(std::move(last));
+        }
+        // 缓存块至少1024字节，比对象内部的缓存大，优先复用
+        m_cur = m_blocks.back().get();
+        m_left = 1024;
+    }
+}
+
+// 把指向外部缓存的头部拷贝进来
+void HttpHeaders::detach() {
+    if(!m_external) {
+        return;
+    }
+    for(size_t i = 0; i < m_size; ++i) {
+        Field& f = m_fields[i];
+        if(!f.external) {
+            continue;
+        }
+        if(f.id == HttpHeaderId::UNKNOWN) {
+            f.name = store(f.name, f.nameLen);
+        }
+        f.value = store(f.value, f.valueLen);
+        f.external = false;
+    }
+    m_external = 0;
+}
+
+// 废弃的数据超过一半时重新整理缓存，避免反复设置同一个头部时缓存无限增长
+void HttpHeaders::compactIfNeeded() {
+    if(m_garbage < 1024 || m_garbage * 2 < m_used) {
+        return;
+    }
+    HttpHeaders tmp(*this);
+    clear();
+    m_blocks.clear();
+    m_cur = m_inlineBytes;
+    m_left = INLINE_BYTES;
+    *this = tmp;
+}
+
+}
+}
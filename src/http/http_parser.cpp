@@ -29,40 +29,29 @@ static ConfigVar<uint64_t>::ptr g_http_response_maxBodySize =
             Config::Lookup("http.response.max_body_size", 
             (uint64_t)(64 * 1024 * 1024), "http request max body size");
 
-// 专门把数据定义uint64_t出来，而不直接用getValue()和setValue()
-// 因为getValue()和setValue()时要加锁，频繁操作时会导致性能损失
-// 而把数据uint64_t定义出来之后，就算有线程安全问题，也只是针对该数据不一致，仅仅一瞬间的数据不一致，影响不大
-static uint64_t s_http_request_maxHeaderSize = g_http_request_maxHeaderSize->getValue();
-static uint64_t s_http_request_maxBodySize = g_http_request_maxBodySize->getValue();
-static uint64_t s_http_response_maxHeaderSize = g_http_response_maxHeaderSize->getValue();
-static uint64_t s_http_response_maxBodySize = g_http_response_maxBodySize->getValue();
-
 // 匿名空间：将命名空间的名字符号去掉，让其他文件找不到
 // 对于变量或者函数来说，效果类似于static，但是static没法修饰一个类型，例如结构体、类
 // 使用匿名空间就不用担心下面结构体在其它文件重名
 // C++新标准提倡使用匿名命名空间，而不推荐使用static，因为static用在不同的地方涵义不同，容易造成混淆
 namespace {
 
-// 添加监听函数，配置改变时执行回调函数
+// 添加监听函数，配置改变时输出日志
+// 解析时直接调用getValue()读取(无锁)，不需要另外保存一份
 struct HttpMaxSizeConfigInit {
     HttpMaxSizeConfigInit() {
         g_http_request_maxHeaderSize->addListener([](const uint64_t& oldVal, const uint64_t& newVal) {
-            s_http_request_maxHeaderSize = newVal;
             SYLAR_LOG_INFO(g_logger) << "http request max header size " << "old_value=" << oldVal
                                                                         << " new_value=" << newVal;
         });
         g_http_request_maxBodySize->addListener([](const uint64_t& oldVal, const uint64_t& newVal) {
-            s_http_request_maxBodySize = newVal;
             SYLAR_LOG_INFO(g_logger) << "http request max body size " << "old_value=" << oldVal
                                                                         << " new_value=" << newVal;
         });
         g_http_response_maxHeaderSize->addListener([](const uint64_t& oldVal, const uint64_t& newVal) {
-            s_http_response_maxHeaderSize = newVal;
             SYLAR_LOG_INFO(g_logger) << "http response max header size " << "old_value=" << oldVal
                                                                         << " new_value=" << newVal;
         });
         g_http_response_maxBodySize->addListener([](const uint64_t& oldVal, const uint64_t& newVal) {
-            s_http_response_maxBodySize = newVal;
             SYLAR_LOG_INFO(g_logger) << "http response max body size " << "old_value=" << oldVal
                                                                         << " new_value=" << newVal;
         });
@@ -74,22 +63,22 @@ static HttpMaxSizeConfigInit _Init;  // main()函数前执行
 
 // 获取HTTP请求头部的最大长度
 uint64_t HttpRequestParser::GetRequestMaxHeaderSize() {
-    return s_http_request_maxHeaderSize;
+    return g_http_request_maxHeaderSize->getValue();
 }
 
 // 获取HTTP请求消息体的最大长度
 uint64_t HttpRequestParser::GetRequestMaxBodySize() {
-    return s_http_request_maxBodySize;
+    return g_http_request_maxBodySize->getValue();
 }
 
 // 获取HTTP响应头部的最大长度
 uint64_t HttpResponseParser::GetResponseMaxHeaderSize() {
-    return s_http_response_maxHeaderSize;
+    return g_http_response_maxHeaderSize->getValue();
 }
 
 // 获取HTTP响应消息体的最大长度
 uint64_t HttpResponseParser::GetResponseMaxBodySize() {
-    return s_http_response_maxBodySize;
+    return g_http_response_maxBodySize->getValue();
 }
 
 /**
@@ -124,6 +113,10 @@ void cb_request_uri(void *data, const char *at, size_t length) {
 */
 void cb_request_fragment(void *data, const char *at, size_t length) {
     HttpRequestParser* parser = (HttpRequestParser*)data;
+    if(parser->isZeroCopy()) {
+        parser->getData()->setFragmentSlice(at, length);
+        return;
+    }
     parser->getData()->setFragment(std::string(at, length));
 }
 
@@ -135,6 +128,10 @@ void cb_request_fragment(void *data, const char *at, size_t length) {
 */
 void cb_request_path(void *data, const char *at, size_t length) {
     HttpRequestParser* parser = (HttpRequestParser*)data;
+    if(parser->isZeroCopy()) {
+        parser->getData()->setPathSlice(at, length);
+        return;
+    }
     parser->getData()->setPath(std::string(at, length));
 }
 
@@ -146,6 +143,10 @@ void cb_request_path(void *data, const char *at, size_t length) {
 */
 void cb_request_query(void *data, const char *at, size_t length) {
     HttpRequestParser* parser = (HttpRequestParser*)data;
+    if(parser->isZeroCopy()) {
+        parser->getData()->setQuerySlice(at, length);
+        return;
+    }
     parser->getData()->setQuery(std::string(at, length));
 }
 
@@ -201,13 +202,23 @@ void cb_request_http_field(void *data, const char *field, size_t flen,
         // parser->setError(1002);
         return;
     }
-    parser->getData()->setHeader(std::string(field, flen), 
-                                std::string(value, vlen));
+    if(parser->isZeroCopy()) {
+        parser->getData()->addHeaderSlice(field, flen, value, vlen);
+        return;
+    }
+    parser->getData()->addHeader(field, flen, value, vlen);
 }
 
 // 构造函数
-HttpRequestParser::HttpRequestParser() 
-    :m_error(0) {
+HttpRequestParser::HttpRequestParser(bool zero_copy) 
+    :m_error(0)
+    ,m_zeroCopy(zero_copy) {
+    reset();
+}
+
+// 重置解析器，用于解析下一个请求
+void HttpRequestParser::reset() {
+    m_error = 0;
     m_data = std::make_shared<HttpRequest>();
     http_parser_init(&m_parser);
     m_parser.request_method = cb_request_method;
@@ -232,10 +243,13 @@ int HttpRequestParser::isFinished() {
 }
 
 // 解析HTTP请求协议
-size_t HttpRequestParser::execute(char *data, size_t len) {
+size_t HttpRequestParser::execute(char *data, size_t len, bool move) {
     // 对data数据进行解析，将解析得到的各部分数据，通过状态机中的自定义动作(action)进行处理
     // 在自定义动作(action)中，用函数指针执行相应函数对数据进行处理，其中函数参数void *data为this
     size_t offset = http_parser_execute(&m_parser, data, len, 0);
+    if(!move) {
+        return offset;
+    }
 
     /**
      * @brief void *memmove(void *str1, const void *str2, size_t n)
@@ -250,8 +264,19 @@ size_t HttpRequestParser::execute(char *data, size_t len) {
 }
 
 // 获取HTTP请求消息体的长度
+// 直接在头部片段上转换，零拷贝解析时不需要把头部转成map
+// 值为空、不是十进制数字(包括带正负号)或者溢出时设置错误码1003，无法确定消息体的边界
 uint64_t HttpRequestParser::getContentLen() {
-    return m_data->getHeaderValue<uint64_t>("Content-Length", 0);
+    StringSlice v = m_data->getHeaderSlice(HttpHeaderId::CONTENT_LENGTH);
+    if(!v.data) {
+        return 0;
+    }
+    uint64_t len = 0;
+    if(std::memchr(v.data, '+', v.size) || !ConvertValue(v.data, v.size, len)) {
+        setError(1003);  // 1003: invalid Content-Length
+        return 0;
+    }
+    return len;
 }
 
 
@@ -347,8 +372,7 @@ void cb_response_http_field(void *data, const char *field, size_t flen,
         // parser->setError(1002);
         return;
     }
-    parser->getData()->setHeader(std::string(field, flen), 
-                                std::string(value, vlen));
+    parser->getData()->addHeader(field, flen, value, vlen);
 }
 
 // 构造函数
@@ -389,7 +413,7 @@ int HttpResponseParser::execute(char *data, size_t len, bool isChunk) {
 
 // 获取HTTP响应消息体的长度
 uint64_t HttpResponseParser::getContentLen() {
-    return m_data->getHeaderValue<uint64_t>("Content-Length", 0);
+    return m_data->getHeaderValue<uint64_t>(HttpHeaderId::CONTENT_LENGTH, 0);
 }
 
 
@@ -0,0 +1,297 @@
+#include "http_router.h"
+#include "http_servlet.h"
+#include <algorithm>
+
+namespace sylar {
+namespace http {
+
+
+// 递归释放子节点
+HttpRouter::Node::~Node() {
+    for(auto& i : statics) {
+        delete i.second;
+    }
+    delete param;
+}
+
+// 复制节点及其子节点
+HttpRouter::Node* HttpRouter::Node::clone() const {
+    Node* node = new Node;
+    node->statics.reserve(statics.size());
+    for(auto& i : statics) {
+        node->statics.push_back(std::make_pair(i.first, i.second->clone()));
+    }
+    if(param) {
+        node->param = param->clone();
+    }
+    node->paramName = paramName;
+    node->wildcard = wildcard;
+    node->wildcardName = wildcardName;
+    node->servlet = servlet;
+    return node;
+}
+
+// 二分查找静态子节点
+HttpRouter::Node* HttpRouter::Node::findStatic(const char* seg, size_t len) const {
+    size_t left = 0;
+    size_t right = statics.size();
+    while(left < right) {
+        size_t mid = (left + right) / 2;
+        int rt = statics[mid].first.compare(0, std::string::npos, seg, len);
+        if(rt == 0) {
+            return statics[mid].second;
+        } else if(rt < 0) {
+            left = mid + 1;
+        } else {
+            right = mid;
+        }
+    }
+    return nullptr;
+}
+
+// 节点上没有任何路由
+bool HttpRouter::Node::empty() const {
+    return statics.empty() && !param && !wildcard && !servlet;
+}
+
+
+// HttpRouter构造函数
+HttpRouter::HttpRouter()
+    :m_root(new Node)
+    ,m_size(0) {
+}
+
+// HttpRouter拷贝构造函数
+HttpRouter::HttpRouter(const HttpRouter& rhs)
+    :m_root(rhs.m_root->clone())
+    ,m_size(rhs.m_size) {
+}
+
+// HttpRouter赋值运算符
+HttpRouter& HttpRouter::operator=(const HttpRouter& rhs) {
+    if(this != &rhs) {
+        Node* root = rhs.m_root->clone();
+        delete m_root;
+        m_root = root;
+        m_size = rhs.m_size;
+    }
+    return *this;
+}
+
+// HttpRouter析构函数
+HttpRouter::~HttpRouter() {
+    delete m_root;
+}
+
+// 把路由模式拆成路径段，"/"拆成一个空的路径段，"/a/"拆成"a"和空的路径段
+bool HttpRouter::Split(const std::string& pattern, std::vector<std::string>& segs) {
+    if(pattern.empty() || pattern[0] != '/') {
+        return false;
+    }
+    size_t begin = 1;
+    while(true) {
+        size_t end = pattern.find('/', begin);
+        segs.push_back(pattern.substr(begin, end == std::string::npos ? std::string::npos : end - begin));
+        const std::string& seg = segs.back();
+        // 参数段必须有名称，通配段只能是最后一段
+        if(seg == ":" || (!seg.empty() && seg[0] == '*' && end != std::string::npos)) {
+            return false;
+        }
+        if(end == std::string::npos) {
+            break;
+        }
+        begin = end + 1;
+    }
+    return true;
+}
+
+// 添加路由
+bool HttpRouter::add(const std::string& pattern, ServletPtr servlet) {
+    std::vector<std::string> segs;
+    if(!servlet || !Split(pattern, segs)) {
+        return false;
+    }
+    // 名称冲突只可能出现在已有的节点上，一旦新建节点后面就都是新节点，所以失败时不会留下空节点
+    Node* node = m_root;
+    for(auto& seg : segs) {
+        if(!seg.empty() && seg[0] == ':') {
+            if(!node->param) {
+                node->param = new Node;
+                node->paramName = seg.substr(1);
+            } else if(node->paramName.compare(0, std::string::npos, seg, 1, std::string::npos) != 0) {
+                return false;
+            }
+            node = node->param;
+        } else if(!seg.empty() && seg[0] == '*') {
+            if(node->wildcard && node->wildcardName.compare(0, std::string::npos, seg, 1, std::string::npos) != 0) {
+                return false;
+            }
+            if(!node->wildcard) {
+                ++m_size;
+            }
+            node->wildcard = servlet;
+            node->wildcardName = seg.substr(1);
+            return true;
+        } else {
+            Node* child = node->findStatic(seg.c_str(), seg.size());
+            if(!child) {
+                child = new Node;
+                auto it = std::lower_bound(node->statics.begin(), node->statics.end(), seg,
+                        [](const std::pair<std::string, Node*>& a, const std::string& b) {
+                    return a.first < b;
+                });
+                node->statics.insert(it, std::make_pair(seg, child));
+            }
+            node = child;
+        }
+    }
+    if(!node->servlet) {
+        ++m_size;
+    }
+    node->servlet = servlet;
+    return true;
+}
+
+// 删除路由
+bool HttpRouter::del(const std::string& pattern) {
+    std::vector<std::string> segs;
+    if(!Split(pattern, segs) || !del(m_root, segs, 0)) {
+        return false;
+    }
+    --m_size;
+    return true;
+}
+
+// 删除node下segs[idx...]对应的路由
+bool HttpRouter::del(Node* node, const std::vector<std::string>& segs, size_t idx) {
+    if(idx == segs.size()) {
+        if(!node->servlet) {
+            return false;
+        }
+        node->servlet.reset();
+        return true;
+    }
+    const std::string& seg = segs[idx];
+    if(!seg.empty() && seg[0] == ':') {
+        if(!node->param || node->paramName.compare(0, std::string::npos, seg, 1, std::string::npos) != 0
+                || !del(node->param, segs, idx + 1)) {
+            return false;
+        }
+        if(node->param->empty()) {
+            delete node->param;
+            node->param = nullptr;
+            node->paramName.clear();
+        }
+        return true;
+    }
+    if(!seg.empty() && seg[0] == '*') {
+        if(!node->wildcard || node->wildcardName.compare(0, std::string::npos, seg, 1, std::string::npos) != 0) {
+            return false;
+        }
+        node->wildcard.reset();
+        node->wildcardName.clear();
+        return true;
+    }
+    for(auto it = node->statics.begin(); it != node->statics.end(); ++it) {
+        if(it->first != seg) {
+            continue;
+        }
+        if(!del(it->second, segs, idx + 1)) {
+            return false;
+        }
+        if(it->second->empty()) {
+            delete it->second;
+            node->statics.erase(it);
+        }
+        return true;
+    }
+    return false;
+}
+
+// 通过路由模式获取servlet
+HttpRouter::ServletPtr HttpRouter::get(const std::string& pattern) const {
+    std::vector<std::string> segs;
+    if(!Split(pattern, segs)) {
+        return nullptr;
+    }
+    const Node* node = m_root;
+    for(auto& seg : segs) {
+        if(!seg.empty() && seg[0] == ':') {
+            if(!node->param || node->paramName.compare(0, std::string::npos, seg, 1, std::string::npos) != 0) {
+                return nullptr;
+            }
+            node = node->param;
+        } else if(!seg.empty() && seg[0] == '*') {
+            if(node->wildcardName.compare(0, std::string::npos, seg, 1, std::string::npos) != 0) {
+                return nullptr;
+            }
+            return node->wildcard;
+        } else {
+            node = node->findStatic(seg.c_str(), seg.size());
+            if(!node) {
+                return nullptr;
+            }
+        }
+    }
+    return node->servlet;
+}
+
+// 匹配请求路径
+HttpRouter::ServletPtr HttpRouter::match(const std::string& path, ParamList* params) const {
+    if(path.empty() || path[0] != '/') {
+        return nullptr;
+    }
+    return match(m_root, path, 0, params);
+}
+
+// 依次尝试静态段、参数段、通配段，失败时撤销已捕获的参数
+HttpRouter::ServletPtr HttpRouter::match(const Node* node, const std::string& path,
+                                         size_t pos, ParamList* params) const {
+    if(pos >= path.size()) {
+        return node->servlet;
+    }
+    size_t begin = pos + 1;
+    size_t end = path.find('/', begin);
+    if(end == std::string::npos) {
+        end = path.size();
+    }
+    if(!node->statics.empty()) {
+        const Node* child = node->findStatic(path.c_str() + begin, end - begin);
+        if(child) {
+            ServletPtr servlet = match(child, path, end, params);
+            if(servlet) {
+                return servlet;
+            }
+        }
+    }
+    if(node->param && end > begin) {
+        size_t count = params ? params->size() : 0;
+        if(params) {
+            params->emplace_back(node->paramName, path.substr(begin, end - begin));
+        }
+        ServletPtr servlet = match(node->param, path, end, params);
+        if(servlet) {
+            return servlet;
+        }
+        if(params) {
+            params->resize(count);
+        }
+    }
+    if(node->wildcard) {
+        if(params && !node->wildcardName.empty()) {
+            params->emplace_back(node->wildcardName, path.substr(begin));
+        }
+        return node->wildcard;
+    }
+    return nullptr;
+}
+
+// 清空路由
+void HttpRouter::clear() {
+    delete m_root;
+    m_root = new Node;
+    m_size = 0;
+}
+
+}
+}
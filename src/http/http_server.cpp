@@ -19,14 +19,21 @@ void HttpServer::handleClient(sylar::Socket::ptr client) {
     HttpSession::ptr session = std::make_shared<HttpSession>(client);  //流式Socket类
 
     while(true) {
-        // 接收HTTP请求并解析
-        HttpRequest::ptr req = session->recvHttpRequest();
+        // 接收HTTP请求并解析，先只解析头部，由servlet决定消息体是一次读入还是流式读取
+        HttpRequest::ptr req = session->recvHttpRequest(false);
         if(!req) {
             SYLAR_LOG_WARN(g_logger) << "recv http request fail, errno="
                 << errno << " errstr=" << strerror(errno)
                 << " cliet:" << client->toString() << " keep_alive=" << m_isKeepAlive;
             return;
         }
+        HttpServlet::ptr servlet = m_dispatch->getMatchServlet(req);
+        if(!(servlet && servlet->isStreamBody()) && !session->recvHttpBody(req)) {
+            SYLAR_LOG_WARN(g_logger) << "recv http body fail, errno="
+                << errno << " errstr=" << strerror(errno)
+                << " cliet:" << client->toString();
+            break;
+        }
 
         // 发送HTTP响应
         // 响应是close还是keepalive，取决于请求的isClose和m_isKeepalive
@@ -34,8 +41,19 @@ void HttpServer::handleClient(sylar::Socket::ptr client) {
                                                 req->isClose() || !m_isKeepAlive);
         // res->setBody("hello client");
         res->setHeader("Server", getName());
-        m_dispatch->handle(req, res, session);
-        session->sendHttpResponse(res);
+        if(servlet) {
+            servlet->handle(req, res, session);
+        }
+        // 流式servlet没有读完的消息体，少量的直接丢弃以保持长连接，过多的关闭连接
+        if(!session->isBodyDone() && !session->skipBody(HttpSession::MAX_SKIP_BODY_SIZE)) {
+            res->setClose(true);
+        }
+        // 响应先放入发送队列，接收缓存中还有管线化的请求时继续处理，
+        // 直到需要从socket读取下一个请求(或关闭连接)时，所有响应合并成一次writev发送
+        // 已经由HttpResponseWriter流式发送的响应不再发送
+        if(!res->isStreaming() && session->queueHttpResponse(res) < 0) {
+            break;
+        }
 
         // SYLAR_LOG_INFO(g_logger) << "HttpRequest: \n" << req->toString();
         // SYLAR_LOG_INFO(g_logger) << "HttpResponse: \n" << res->toString();
@@ -1,5 +1,6 @@
 #include "http_servlet.h"
 #include "log.h"
+#include "util.h"
 #include <time.h>
 #include <fnmatch.h>
 
@@ -11,7 +12,8 @@ static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
 // HttpServlet构造函数
 HttpServlet::HttpServlet(std::string name) 
-    :m_name(name) {
+    :m_name(name)
+    ,m_streamBody(false) {
 }
 
 
@@ -56,10 +58,16 @@ int32_t NotFoundServlet::handle(HttpRequest::ptr req,
 }
 
 
+// 线程缓存数组的容量(同时存活的线程数上限)
+static const size_t MAX_CACHE_THREADS = 64 * 1024;
+
 // Servlet分发器的构造函数
 ServletDispatch::ServletDispatch()
-    :HttpServlet("ServletDispatch") {
-    m_default = std::make_shared<NotFoundServlet>("wwt/1.0.0");
+    :HttpServlet("ServletDispatch")
+    ,m_table(std::make_shared<RouteTable>())
+    ,m_version(1)
+    ,m_caches(MAX_CACHE_THREADS) {
+    m_table->def = std::make_shared<NotFoundServlet>("wwt/1.0.0");
 }
 
 // Servlet分发器的处理请求
@@ -67,96 +75,204 @@ int32_t ServletDispatch::handle(HttpRequest::ptr req,
                                 HttpResponse::ptr res, 
                                 HttpSession::ptr session) {
     // 仅仅是路径决定要选择哪个servlet，后面的参数、片段标识符没关系
-    HttpServlet::ptr servlet = getMatchServlet(req->getPath());
+    HttpServlet::ptr servlet = getMatchServlet(req);
     if(servlet) {
         return servlet->handle(req, res, session);
     }
     return 0;
 }
 
+// 返回当前线程缓存的快照，版本号变化时加锁取最新快照
+const ServletDispatch::RouteTable* ServletDispatch::getTable(RouteTable::ptr& hold) const {
+    int index = GetThreadIndex();
+    CacheSlot* slot = index < 0 ? nullptr : m_caches.getOrCreate(index);
+    if(!slot) {
+        // 没有缓存槽位时由调用者持有快照，避免match期间被update释放
+        MutexType::Lock lock(m_mutex);
+        hold = m_table;
+        return hold.get();
+    }
+    // 序号只在线程退出后才会被复用，同一时刻只有一个线程访问这个槽位
+    if(slot->version == m_version.load(std::memory_order_acquire)) {
+        return slot->table.get();
+    }
+    MutexType::Lock lock(m_mutex);
+    slot->version = m_version.load(std::memory_order_relaxed);
+    slot->table = m_table;
+    return slot->table.get();
+}
+
+// 复制当前快照，修改后发布
+bool ServletDispatch::update(std::function<bool(RouteTable& table)> cb) {
+    MutexType::Lock lock(m_mutex);
+    RouteTable::ptr table = std::make_shared<RouteTable>(*m_table);
+    if(!cb(*table)) {
+        return false;
+    }
+    m_table = table;
+    m_version.store(m_version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    return true;
+}
+
 // 添加精准匹配servlet
 void ServletDispatch::addServlet(const std::string& uri, HttpServlet::ptr servlet) {
-    MutexType::WriteLock lock(m_mutex);
-    m_datas[uri] = servlet;
+    update([&](RouteTable& table) {
+        table.datas[uri] = servlet;
+        return true;
+    });
 }
 
 // 添加精准匹配servlet
 void ServletDispatch::addServlet(const std::string& uri, FunctionServlet::FuncType cb) {
-    MutexType::WriteLock lock(m_mutex);
-    m_datas[uri] = std::make_shared<FunctionServlet>(cb);
+    addServlet(uri, std::make_shared<FunctionServlet>(cb));
+}
+
+// 添加模糊匹配项，记录第一个通配符之前的固定前缀的长度
+void ServletDispatch::addGlob(const std::string& uri, HttpServlet::ptr servlet) {
+    size_t prefix_len = uri.find_first_of("*?[\\");
+    GlobItem item{uri, prefix_len == std::string::npos ? uri.size() : prefix_len, servlet};
+    update([&](RouteTable& table) {
+        for(auto it = table.globs.begin(); it != table.globs.end(); it++) {
+            if(it->pattern == uri) {
+                table.globs.erase(it);
+                break;
+            }
+        }
+        table.globs.push_back(item);
+        return true;
+    });
 }
 
 // 添加模糊匹配servlet
 void ServletDispatch::addGlobServlet(const std::string& uri, HttpServlet::ptr servlet) {
-    MutexType::WriteLock lock(m_mutex);
-    for(auto it = m_globs.begin(); it != m_globs.end(); it++) {
-        if(it->first == uri) {
-            m_globs.erase(it);
-            break;
-        }
-    }
-    m_globs.push_back(std::make_pair(uri, servlet));
+    addGlob(uri, servlet);
 }
 
 // 添加模糊匹配servlet
 void ServletDispatch::addGlobServlet(const std::string& uri, FunctionServlet::FuncType cb) {
-    MutexType::WriteLock lock(m_mutex);
-    for(auto it = m_globs.begin(); it != m_globs.end(); it++) {
-        if(it->first == uri) {
-            m_globs.erase(it);
-            break;
-        }
+    addGlob(uri, std::make_shared<FunctionServlet>(cb));
+}
+
+// 添加路由servlet
+bool ServletDispatch::addRoute(const std::string& pattern, HttpServlet::ptr servlet) {
+    bool rt = update([&](RouteTable& table) {
+        return table.routes.add(pattern, servlet);
+    });
+    if(!rt) {
+        SYLAR_LOG_ERROR(g_logger) << "addRoute invalid pattern: " << pattern;
     }
-    m_globs.push_back(std::make_pair(uri, std::make_shared<FunctionServlet>(cb)));
+    return rt;
+}
+
+// 添加路由servlet
+bool ServletDispatch::addRoute(const std::string& pattern, FunctionServlet::FuncType cb) {
+    return addRoute(pattern, std::make_shared<FunctionServlet>(cb));
 }
 
 // 删除精准匹配servlet
 void ServletDispatch::delServlet(const std::string& uri) {
-    MutexType::WriteLock lock(m_mutex);
-    auto it = m_datas.find(uri);
-    m_datas.erase(it);
+    update([&](RouteTable& table) {
+        return table.datas.erase(uri) > 0;
+    });
 }
 
 // 删除模糊匹配servlet
 void ServletDispatch::delGlobServlet(const std::string& uri) {
-    MutexType::WriteLock lock(m_mutex);
-    for(auto it = m_globs.begin(); it != m_globs.end(); it++) {
-        if(it->first == uri) {
-            m_globs.erase(it);
-            break;
+    update([&](RouteTable& table) {
+        for(auto it = table.globs.begin(); it != table.globs.end(); it++) {
+            if(it->pattern == uri) {
+                table.globs.erase(it);
+                return true;
+            }
         }
-    }
+        return false;
+    });
+}
+
+// 删除路由servlet
+void ServletDispatch::delRoute(const std::string& pattern) {
+    update([&](RouteTable& table) {
+        return table.routes.del(pattern);
+    });
 }
 
 // 通过uri获取精准匹配servlet
 HttpServlet::ptr ServletDispatch::getServlet(const std::string& uri) {
-    MutexType::ReadLock lock(m_mutex);
-    auto it = m_datas.find(uri);
-    if(it != m_datas.end()) {
-        return m_datas[uri];
+    RouteTable::ptr hold;
+    const RouteTable* table = getTable(hold);
+    auto it = table->datas.find(uri);
+    if(it != table->datas.end()) {
+        return it->second;
     }
     return nullptr;
 }
 
 // 通过uri获取模糊匹配servlet
 HttpServlet::ptr ServletDispatch::getGlobServlet(const std::string& uri) {
-    MutexType::ReadLock lock(m_mutex);
-    for(auto it = m_globs.begin(); it != m_globs.end(); it++) {
-        if(it->first == uri) {
-            return it->second;
+    RouteTable::ptr hold;
+    const RouteTable* table = getTable(hold);
+    for(auto it = table->globs.begin(); it != table->globs.end(); it++) {
+        if(it->pattern == uri) {
+            return it->servlet;
         }
     }
     return nullptr;
 }
 
-// 通过uri获取最佳匹配servlet，即优先精准匹配,其次模糊匹配,最后返回默认
+// 通过路由模式获取路由servlet
+HttpServlet::ptr ServletDispatch::getRouteServlet(const std::string& pattern) {
+    RouteTable::ptr hold;
+    return getTable(hold)->routes.get(pattern);
+}
+
+// 返回默认servlet
+HttpServlet::ptr ServletDispatch::getDefault() const {
+    RouteTable::ptr hold;
+    return getTable(hold)->def;
+}
+
+// 设置默认servlet
+void ServletDispatch::setDefault(HttpServlet::ptr servlet) {
+    update([&](RouteTable& table) {
+        table.def = servlet;
+        return true;
+    });
+}
+
+// 通过uri获取最佳匹配servlet，即优先精准匹配,其次路由,再次模糊匹配,最后返回默认
 HttpServlet::ptr ServletDispatch::getMatchServlet(const std::string& uri) {
-    MutexType::ReadLock lock(m_mutex);
-    auto it = m_datas.find(uri);
-    if(it != m_datas.end()) {
+    return match(uri, nullptr);
+}
+
+// 通过请求路径获取最佳匹配servlet，路由捕获的参数写入请求参数
+HttpServlet::ptr ServletDispatch::getMatchServlet(HttpRequest::ptr req) {
+    HttpRouter::ParamList params;
+    HttpServlet::ptr servlet = match(req->getPath(), &params);
+    for(auto& i : params) {
+        req->setParam(i.first, i.second);
+    }
+    return servlet;
+}
+
+// 按匹配顺序查找servlet
+HttpServlet::ptr ServletDispatch::match(const std::string& uri, HttpRouter::ParamList* params) const {
+    RouteTable::ptr hold;
+    const RouteTable* table = getTable(hold);
+    auto it = table->datas.find(uri);
+    if(it != table->datas.end()) {
         return it->second;
     }
-    for(auto i = m_globs.begin(); i != m_globs.end(); i++) {
+    if(table->routes.size()) {
+        HttpServlet::ptr servlet = table->routes.match(uri, params);
+        if(servlet) {
+            return servlet;
+        }
+    }
+    for(auto i = table->globs.begin(); i != table->globs.end(); i++) {
+        // 固定前缀不同的一定不匹配，省掉fnmatch调用
+        if(uri.compare(0, i->prefixLen, i->pattern, 0, i->prefixLen) != 0) {
+            continue;
+        }
         /**
          * @brief int fnmatch(const char *pattern, const char *string, int flags);
          * @param[in] pattern 模式字符串，例如 "*.txt"
@@ -164,13 +280,12 @@ HttpServlet::ptr ServletDispatch::getMatchServlet(const std::string& uri) {
          * @param[in] flags 匹配标志，一般为0
          * @return 返回0表示匹配成功，返回非0表示匹配失败
         */
-        if(fnmatch(i->first.c_str(), uri.c_str(), 0) == 0) {
-            return i->second;
+        if(fnmatch(i->pattern.c_str(), uri.c_str(), 0) == 0) {
+            return i->servlet;
         }
     }
-    return m_default;
+    return table->def;
 }
 
-
 }
 }
\ No newline at end of file
@@ -7,97 +7,716 @@ namespace http {
 
 static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
+// 发送队列中最多缓存的响应个数和字节数，超过时立即发送
+static const size_t MAX_QUEUED_RESPONSES = 64;
+static const size_t MAX_QUEUED_BYTES = 64 * 1024;
+
+const uint64_t HttpSession::MAX_SKIP_BODY_SIZE;
+
+/**
+ * @brief 在[begin, end)中查找HTTP头部的结束位置(空行)
+ * @details 与解析器一致，行尾可以是\r\n或\n
+ * @return 返回空行之后的位置，没有找到返回nullptr
+ */
+static const char* FindHeaderEnd(const char* begin, const char* end) {
+    const char* p = begin;
+    while(p < end) {
+        p = (const char*)memchr(p, '\n', end - p);
+        if(!p) {
+            return nullptr;
+        }
+        ++p;
+        if(p < end && *p == '\n') {
+            return p + 1;
+        }
+        if(p + 1 < end && p[0] == '\r' && p[1] == '\n') {
+            return p + 2;
+        }
+    }
+    return nullptr;
+}
+
+// Transfer-Encoding是否只有一个chunked编码(忽略大小写和前后空白，允许空的列表元素)
+// 只实现了chunked，其他编码(gzip等)和重复的chunked都不支持
+static bool IsChunkedOnly(const StringSlice& te) {
+    int chunked = 0;
+    size_t begin = 0;
+    while(begin <= te.size) {
+        size_t end = begin;
+        while(end < te.size && te.data[end] != ',') {
+            ++end;
+        }
+        size_t b = begin, e = end;
+        while(b < e && (te.data[b] == ' ' || te.data[b] == '\t')) {
+            ++b;
+        }
+        while(e > b && (te.data[e - 1] == ' ' || te.data[e - 1] == '\t')) {
+            --e;
+        }
+        if(e > b) {
+            if(!StringSlice(te.data + b, e - b).equalsIgnoreCase("chunked", 7)) {
+                return false;
+            }
+            ++chunked;
+        }
+        begin = end + 1;
+    }
+    return chunked == 1;
+}
+
 // 构造函数
 HttpSession::HttpSession(Socket::ptr sock, bool owner) 
-    :SocketStream(sock, owner) {
+    :SocketStream(sock, owner)
+    ,m_parser(true)
+    ,m_begin(0)
+    ,m_end(0)
+    ,m_bodyLeft(0)
+    ,m_bodyRead(0)
+    ,m_bodyChunked(false)
+    ,m_bodyDone(true)
+    ,m_bodyError(false)
+    ,m_expectContinue(false)
+    ,m_sendQueueSize(0)
+    ,m_sendQueueBytes(0)
+    ,m_sendCount(0) {
+}
+
+// 析构函数，接收缓存释放前把还被外部持有的请求分离出来
+HttpSession::~HttpSession() {
+    detachRequest();
+}
+
+// 上一个请求还被外部持有时把它从接收缓存中分离
+void HttpSession::detachRequest() {
+    if(m_request) {
+        // 只有本对象持有时请求已经处理完了，不需要拷贝
+        if(m_request.use_count() > 1) {
+            m_request->detachBuffer();
+        }
+        m_request.reset();
+    }
 }
 
 // 接收HTTP请求
-HttpRequest::ptr HttpSession::recvHttpRequest() {
-    HttpRequestParser::ptr parser = std::make_shared<HttpRequestParser>();
-    size_t buff_size = HttpRequestParser::GetRequestMaxHeaderSize();
-    // size_t buff_size = 100;
-    // char* buffer(new char[buff_size]);    // 普通数组
-    // 智能指针数组，自定义析构
-    std::shared_ptr<char> buffer(new char[buff_size], [](char* ptr) {
-        delete[] ptr;
-    });
-    char* buff = buffer.get();
-    size_t offset = 0;
+// 先把完整的头部读进接收缓存，再一次性解析，解析出的字段都是指向接收缓存的片段
+HttpRequest::ptr HttpSession::recvHttpRequest(bool read_body) {
+    // 上一个请求的消息体没有被读完(流式servlet没有读)，丢弃后才能解析下一个请求，过长时关闭连接
+    if(!m_bodyDone && !skipBody(MAX_SKIP_BODY_SIZE)) {
+        close();
+        return nullptr;
+    }
+    detachRequest();
+    if(m_buffer.empty()) {
+        m_buffer.resize(HttpRequestParser::GetRequestMaxHeaderSize());
+    }
+    // 上一个请求之后多读的数据(管线化的下一个请求)移到缓存开头
+    if(m_begin > 0) {
+        std::memmove(&m_buffer[0], &m_buffer[m_begin], m_end - m_begin);
+        m_end -= m_begin;
+        m_begin = 0;
+    }
 
-    while(true) {
-        // 读数据，offset是上次未解析数据的偏移
-        int len = read(buff + offset, buff_size - offset);
-        if(len <= 0) {
-            // SYLAR_LOG_DEBUG(g_logger) << "====================read len <= 0";
+    char* buff = &m_buffer[0];
+    size_t buff_size = m_buffer.size();
+    size_t scan = 0;
+    const char* header_end = nullptr;
+    while(!(header_end = FindHeaderEnd(buff + scan, buff + m_end))) {
+        // 缓存区满了还没有完整的头部，说明头部过长
+        if(m_end == buff_size) {
             close();
             return nullptr;
         }
-        // SYLAR_LOG_DEBUG(g_logger) << "read: len=" << len << " content:" << buff;
-        
-        // 解析数据，len + offset为本次新读取的+上次未解析的
-        size_t nparser = parser->execute(buff, len + offset);
-        if(parser->hasError()) {
-            // SYLAR_LOG_DEBUG(g_logger) << "====================execute hasError";
+        // 行尾可能被截断在上次读取的末尾，回退两个字节重新查找
+        scan = m_end > 2 ? m_end - 2 : 0;
+        // 缓存中没有完整的请求了，阻塞读之前先把管线化请求的响应发出去
+        if(flush() < 0) {
             close();
             return nullptr;
         }
-        // SYLAR_LOG_DEBUG(g_logger) << "parser: nparser=" << nparser << " content:" << buff;
+        ssize_t len = SocketStream::read(buff + m_end, buff_size - m_end);
+        if(len <= 0) {
+            close();
+            return nullptr;
+        }
+        m_end += len;
+    }
+
+    // 解析完整的头部
+    size_t header_len = header_end - buff;
+    m_parser.reset();
+    m_parser.execute(buff, header_len, false);
+    if(m_parser.hasError() || m_parser.isFinished() != 1) {
+        close();
+        return nullptr;
+    }
+    HttpRequest::ptr req = m_parser.getData();
+    m_begin = header_len;
+    m_request = req;
 
-        // 更新偏移，解析完的数据将被移除，剩余未解析的数据为最新偏移
-        offset = len + offset - nparser;
-        // 缓存区满了都无数据解析，说明解析有问题
-        if(offset == buff_size) {
-            // SYLAR_LOG_DEBUG(g_logger) << "====================offset == buff_size";
+    // 消息体的格式: chunked优先于Content-Length
+    StringSlice te = req->getHeaderSlice(HttpHeaderId::TRANSFER_ENCODING);
+    m_bodyChunked = te.data != nullptr;
+    if(m_bodyChunked && !IsChunkedOnly(te)) {
+        // 不支持的传输编码无法确定消息体的边界，按Content-Length解析会把消息体当作下一个请求
+        SYLAR_LOG_WARN(g_logger) << "http request unsupported Transfer-Encoding: " << te.toString();
+        sendBadRequest(req);
+        return nullptr;
+    }
+    m_bodyRead = 0;
+    m_bodyError = false;
+    if(m_bodyChunked) {
+        m_bodyLeft = 0;
+        m_bodyDone = false;
+    }
+    else {
+        m_bodyLeft = m_parser.getContentLen();
+        if(m_parser.hasError()) {
+            // 消息体的边界无法确定，后面的数据不能再当作下一个请求解析
+            SYLAR_LOG_WARN(g_logger) << "http request invalid Content-Length: "
+                << req->getHeaderSlice(HttpHeaderId::CONTENT_LENGTH).toString();
+            sendBadRequest(req);
+            return nullptr;
+        }
+        if(m_bodyLeft > HttpRequestParser::GetRequestMaxBodySize()) {
+            SYLAR_LOG_WARN(g_logger) << "http request body too large, length=" << m_bodyLeft;
+            m_bodyLeft = 0;
             close();
             return nullptr;
         }
+        m_bodyDone = m_bodyLeft == 0;
+    }
+    m_expectContinue = !m_bodyDone && req->getVersion() >= 0x11
+                        && req->getHeaderSlice(HttpHeaderId::EXPECT).equalsIgnoreCase("100-continue", 12);
+
+    if(read_body && !recvHttpBody(req)) {
+        close();
+        return nullptr;
+    }
+
+    // 根据接收到的Http请求设置连接状态(长连接or关闭连接)
+    StringSlice conStatus = req->getHeaderSlice(HttpHeaderId::CONNECTION);
+    if(!conStatus.empty()) {
+        req->setClose(!conStatus.equalsIgnoreCase("Keep-Alive", 10));
+    }
+    return req;
+}
+
+// 回复400并关闭连接，队列中之前的响应会先发送
+void HttpSession::sendBadRequest(HttpRequest::ptr req) {
+    HttpResponse::ptr rsp = std::make_shared<HttpResponse>(req->getVersion(), true);
+    rsp->setStatus(HttpStatus::BAD_REQUEST);
+    queueHttpResponse(rsp);
+    close();
+}
 
-        if(parser->isFinished()) {
-            break;
+// 读取当前请求剩余的完整消息体
+bool HttpSession::recvHttpBody(HttpRequest::ptr req) {
+    if(m_bodyDone) {
+        return true;
+    }
+    if(m_bodyChunked) {
+        // chunked消息体的长度事先未知，边读边扩容，readBody负责长度限制
+        std::string body;
+        size_t offset = 0;
+        while(true) {
+            body.resize(offset + 16 * 1024);
+            ssize_t rt = readBody(&body[offset], body.size() - offset);
+            if(rt < 0) {
+                return false;
+            }
+            if(rt == 0) {
+                break;
+            }
+            offset += rt;
         }
+        body.resize(offset);
+        req->setBody(std::move(body));
+        return true;
     }
 
-    size_t length = parser->getContentLen();
-    if(length > 0) {
+    size_t buffered = m_end - m_begin;
+    if(m_bodyLeft <= buffered) {
+        // 消息体已经完整地在接收缓存中，直接引用
+        req->setBodySlice(&m_buffer[m_begin], m_bodyLeft);
+        m_begin += m_bodyLeft;
+    }
+    else {
+        // body部分未完全读完，拷贝已读到的部分，再继续向后读取
+        if(!sendContinue()) {
+            return false;
+        }
         std::string body;
-        body.resize(length);
-
-        // body部分不会被解析，所以要手动写入
-        if(length > offset) {
-            // body部分未完全读完，需要继续向后读取一部分
-            std::memcpy(&body[0], buff, offset);
-            if(readFixSize(&body[offset], length - offset) <= 0) {
-                // SYLAR_LOG_DEBUG(g_logger) << "====================readFixSize <= 0";
-                close();
-                return nullptr;
+        body.resize(m_bodyLeft);
+        std::memcpy(&body[0], &m_buffer[m_begin], buffered);
+        m_begin = m_end;
+        if(readFixSize(&body[buffered], m_bodyLeft - buffered) <= 0) {
+            return false;
+        }
+        req->setBody(std::move(body));
+    }
+    m_bodyRead += m_bodyLeft;
+    m_bodyLeft = 0;
+    m_bodyDone = true;
+    return true;
+}
+
+// 流式读取当前请求的消息体
+ssize_t HttpSession::readBody(void* buff, size_t length) {
+    if(m_bodyError) {
+        return -1;
+    }
+    ssize_t rt = doReadBody(buff, length);
+    if(rt < 0) {
+        // 出错之后无法再确定消息体的边界，之后的读取都失败，连接只能关闭
+        m_bodyError = true;
+    }
+    return rt;
+}
+
+// 读取消息体，处理chunked编码
+ssize_t HttpSession::doReadBody(void* buff, size_t length) {
+    if(m_bodyDone) {
+        return 0;
+    }
+    if(length == 0) {
+        return 0;
+    }
+    if(!sendContinue()) {
+        return -1;
+    }
+    if(m_bodyChunked && m_bodyLeft == 0) {
+        // chunk头部: 十六进制长度[;扩展]\r\n
+        std::string line;
+        if(!readLine(line)) {
+            return -1;
+        }
+        char* end = nullptr;
+        uint64_t size = strtoull(line.c_str(), &end, 16);
+        if(end == line.c_str() || (*end && *end != ';' && *end != ' ')) {
+            SYLAR_LOG_WARN(g_logger) << "invalid chunk size line: " << line;
+            errno = EINVAL;
+            return -1;
+        }
+        if(size == 0) {
+            // 结束chunk之后是可选的trailer，以空行结束
+            do {
+                if(!readLine(line)) {
+                    return -1;
+                }
+            } while(!line.empty());
+            m_bodyDone = true;
+            return 0;
+        }
+        if(m_bodyRead + size > HttpRequestParser::GetRequestMaxBodySize()) {
+            SYLAR_LOG_WARN(g_logger) << "http request chunked body too large, length>="
+                                     << m_bodyRead + size;
+            errno = EMSGSIZE;
+            return -1;
+        }
+        m_bodyLeft = size;
+    }
+
+    ssize_t rt = read(buff, std::min((uint64_t)length, m_bodyLeft));
+    if(rt <= 0) {
+        // 消息体没有读完连接就断开了
+        return -1;
+    }
+    m_bodyLeft -= rt;
+    m_bodyRead += rt;
+    if(m_bodyLeft == 0) {
+        if(m_bodyChunked) {
+            // chunk数据之后的\r\n
+            std::string line;
+            if(!readLine(line) || !line.empty()) {
+                errno = EINVAL;
+                return -1;
             }
         }
         else {
-            std::memcpy(&body[0], buff, length);
+            m_bodyDone = true;
         }
-        parser->getData()->setBody(body);
     }
+    return rt;
+}
 
-    // 根据接收到的Http请求设置连接状态(长连接or关闭连接)
-    std::string conStatus = parser->getData()->getHeader("Connection");
-    if(!conStatus.empty()) {
-        if(strcasecmp(conStatus.c_str(), "Keep-Alive") == 0) {
-            parser->getData()->setClose(false);
+// 丢弃当前请求未读的消息体
+bool HttpSession::skipBody(uint64_t max_size) {
+    if(m_bodyDone) {
+        return true;
+    }
+    // 客户端还没有发送消息体，为了丢弃而让它发送没有意义，直接关闭连接
+    if(m_expectContinue) {
+        return false;
+    }
+    char buff[4096];
+    uint64_t skipped = 0;
+    while(!m_bodyDone) {
+        if(skipped >= max_size) {
+            return false;
         }
-        else {
-            parser->getData()->setClose(true);
+        ssize_t rt = readBody(buff, std::min((uint64_t)sizeof(buff), max_size - skipped));
+        if(rt < 0) {
+            return false;
+        }
+        skipped += rt;
+    }
+    return true;
+}
+
+// 客户端等待100 Continue时回复
+bool HttpSession::sendContinue() {
+    if(!m_expectContinue) {
+        return true;
+    }
+    m_expectContinue = false;
+    static const char s_continue[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    return writeFixSize(s_continue, sizeof(s_continue) - 1) > 0;
+}
+
+// 从socket读取更多数据追加到接收缓存
+bool HttpSession::fillBuffer() {
+    if(m_end == m_buffer.size()) {
+        if(m_begin == 0) {
+            return false;
+        }
+        // 移动会覆盖请求的路径和头部片段，先分离
+        if(m_request && m_request->isBufferAttached()) {
+            m_request->detachBuffer();
+        }
+        std::memmove(&m_buffer[0], &m_buffer[m_begin], m_end - m_begin);
+        m_end -= m_begin;
+        m_begin = 0;
+    }
+    if(flush() < 0) {
+        return false;
+    }
+    ssize_t len = SocketStream::read(&m_buffer[m_end], m_buffer.size() - m_end);
+    if(len <= 0) {
+        return false;
+    }
+    m_end += len;
+    return true;
+}
+
+// 从接收缓存中读取一行
+bool HttpSession::readLine(std::string& line) {
+    while(true) {
+        const char* begin = &m_buffer[0] + m_begin;
+        const char* eol = (const char*)memchr(begin, '\n', m_end - m_begin);
+        if(eol) {
+            size_t len = eol - begin;
+            if(len > 0 && begin[len - 1] == '\r') {
+                --len;
+            }
+            line.assign(begin, len);
+            m_begin += eol - begin + 1;
+            return true;
+        }
+        if(!fillBuffer()) {
+            return false;
         }
     }
+}
+
+// 读取数据，先返回接收缓存中多读的数据
+ssize_t HttpSession::read(void* buff, size_t length) {
+    if(m_begin < m_end) {
+        size_t n = std::min(length, m_end - m_begin);
+        std::memcpy(buff, &m_buffer[m_begin], n);
+        m_begin += n;
+        return n;
+    }
+    if(flush() < 0) {
+        return -1;
+    }
+    return SocketStream::read(buff, length);
+}
 
-    return parser->getData();
+// 写数据，先发送队列中的响应
+ssize_t HttpSession::write(const void* buff, size_t length) {
+    if(flush() < 0) {
+        return -1;
+    }
+    return SocketStream::write(buff, length);
+}
+
+// 关闭前先发送队列中的响应
+bool HttpSession::close() {
+    flush();
+    return SocketStream::close();
 }
 
 // 发生HTTP响应
 ssize_t HttpSession::sendHttpResponse(HttpResponse::ptr response) {
-    std::string res = response->toString();
-    return writeFixSize(res.c_str(), res.size());  // 写入固定长度的数据
+    ssize_t rt = queueHttpResponse(response);
+    if(rt < 0) {
+        return rt;
+    }
+    return flush();
+}
+
+// 把HTTP响应放入发送队列
+ssize_t HttpSession::queueHttpResponse(HttpResponse::ptr response) {
+    if(m_sendQueueSize == m_sendQueue.size()) {
+        m_sendQueue.emplace_back();
+    }
+    PendingResponse& item = m_sendQueue[m_sendQueueSize++];
+    item.header.clear();
+    response->dumpHeader(item.header);
+    item.response = response;
+    m_sendQueueBytes += item.header.size() + response->getBody().size() + response->getFileLength();
+    if(m_sendQueueSize >= MAX_QUEUED_RESPONSES || m_sendQueueBytes >= MAX_QUEUED_BYTES) {
+        return flush();
+    }
+    return 0;
+}
+
+// 清空发送队列，保留头部缓存
+void HttpSession::clearSendQueue() {
+    for(size_t i = 0; i < m_sendQueueSize; ++i) {
+        m_sendQueue[i].response.reset();
+    }
+    m_sendQueueSize = 0;
+    m_sendQueueBytes = 0;
+}
+
+// 发送iovec数组中的全部数据，处理部分写入
+ssize_t HttpSession::sendIovecs(iovec* iovs, size_t n) {
+    ++m_sendCount;
+    ssize_t total = 0;
+    size_t idx = 0;
+    while(idx < n) {
+        ssize_t rt = m_socket->send(&iovs[idx], n - idx);
+        if(rt <= 0) {
+            return rt < 0 ? rt : -1;
+        }
+        total += rt;
+        // 跳过已经写完的iovec，调整写了一部分的iovec
+        while(idx < n && (size_t)rt >= iovs[idx].iov_len) {
+            rt -= iovs[idx].iov_len;
+            ++idx;
+        }
+        if(idx < n) {
+            iovs[idx].iov_base = (char*)iovs[idx].iov_base + rt;
+            iovs[idx].iov_len -= rt;
+        }
+    }
+    return total;
+}
+
+// 用sendfile发送响应的文件消息体
+ssize_t HttpSession::sendFileBody(HttpResponse::ptr response) {
+    off_t offset = response->getFileOffset();
+    size_t left = response->getFileLength();
+    while(left > 0) {
+        ssize_t rt = m_socket->sendFile(response->getFileFd(), offset, left);
+        if(rt <= 0) {
+            // 文件被截断时也无法再满足Content-Length，只能断开
+            return rt < 0 ? rt : -1;
+        }
+        offset += rt;
+        left -= rt;
+    }
+    return response->getFileLength();
+}
+
+// 用一次writev发送队列中的所有响应，每个响应占头部和消息体两个iovec
+// 遇到文件消息体时先发送之前的数据(包括它的头部)，再用sendfile发送文件
+ssize_t HttpSession::flush() {
+    if(!m_sendQueueSize) {
+        return 0;
+    }
+    if(!isConnected()) {
+        clearSendQueue();
+        return -1;
+    }
+
+    iovec iovs[MAX_QUEUED_RESPONSES * 2];
+    size_t n = 0;
+    ssize_t total = 0;
+    for(size_t i = 0; i < m_sendQueueSize; ++i) {
+        const std::string& header = m_sendQueue[i].header;
+        HttpResponse::ptr& response = m_sendQueue[i].response;
+        iovs[n].iov_base = (void*)header.c_str();
+        iovs[n].iov_len = header.size();
+        ++n;
+        if(response->hasFileBody()) {
+            ssize_t rt = sendIovecs(iovs, n);
+            n = 0;
+            if(rt < 0) {
+                total = rt;
+                break;
+            }
+            total += rt;
+            rt = sendFileBody(response);
+            if(rt < 0) {
+                total = rt;
+                break;
+            }
+            total += rt;
+        } else if(!response->getBody().empty()) {
+            iovs[n].iov_base = (void*)response->getBody().c_str();
+            iovs[n].iov_len = response->getBody().size();
+            ++n;
+        }
+    }
+    if(n > 0 && total >= 0) {
+        ssize_t rt = sendIovecs(iovs, n);
+        total = rt < 0 ? rt : total + rt;
+    }
+    clearSendQueue();
+    return total;
+}
+
+
+// 构造函数
+HttpBodyStream::HttpBodyStream(HttpSession::ptr session)
+    :m_session(session) {
+}
+
+// 读取消息体
+ssize_t HttpBodyStream::read(void* buffer, size_t length) {
+    return m_session->readBody(buffer, length);
+}
+
+// 读取消息体到ByteArray
+ssize_t HttpBodyStream::read(ByteArray::ptr buffer, size_t length) {
+    std::vector<iovec> iovs;
+    if(length == 0 || buffer->getWriteBuffers(iovs, length) == 0) {
+        return 0;
+    }
+    ssize_t rt = m_session->readBody(iovs[0].iov_base, iovs[0].iov_len);
+    if(rt > 0) {
+        buffer->setPosition(buffer->getPosition() + rt);
+    }
+    return rt;
+}
+
+// 丢弃未读的消息体
+bool HttpBodyStream::close() {
+    return m_session->skipBody(HttpSession::MAX_SKIP_BODY_SIZE);
 }
 
+
+// 构造函数
+HttpResponseWriter::HttpResponseWriter(HttpSession::ptr session, HttpResponse::ptr response)
+    :m_session(session)
+    ,m_response(response)
+    ,m_chunked(false)
+    ,m_headerSent(false)
+    ,m_closed(false)
+    ,m_error(false) {
+}
+
+// 析构函数，没有close时自动close
+HttpResponseWriter::~HttpResponseWriter() {
+    if(!m_closed) {
+        close();
+    }
+}
+
+// 发送响应头
+bool HttpResponseWriter::sendHeader() {
+    if(m_headerSent) {
+        return !m_error;
+    }
+    m_headerSent = true;
+    m_response->setStreaming(true);
+    // 已经设置的消息体作为第一块数据在响应头之后发送
+    std::string body = m_response->getBody();
+    m_response->setBody(std::string());
+    if(!m_response->hasHeader("Content-Length")) {
+        if(m_response->getVersion() >= 0x11) {
+            m_chunked = true;
+            m_response->setHeader("Transfer-Encoding", "chunked");
+        }
+        else {
+            // HTTP/1.0只能用关闭连接表示消息体结束
+            m_response->setClose(true);
+        }
+    }
+    if(m_session->queueHttpResponse(m_response) < 0 || m_session->flush() < 0) {
+        m_error = true;
+        return false;
+    }
+    if(!body.empty() && write(body.c_str(), body.size()) < 0) {
+        return false;
+    }
+    return true;
+}
+
+// 发送数据，chunked时加上chunk头部和结尾
+ssize_t HttpResponseWriter::sendData(iovec* iovs, size_t n, size_t length) {
+    if(m_error || m_closed) {
+        return -1;
+    }
+    if(!sendHeader()) {
+        return -1;
+    }
+    // 空的chunk表示结束，不能发送
+    if(length == 0) {
+        return 0;
+    }
+    ssize_t rt = 0;
+    if(m_chunked) {
+        char head[32];
+        std::vector<iovec> all(n + 2);
+        all[0].iov_base = head;
+        all[0].iov_len = snprintf(head, sizeof(head), "%zx\r\n", length);
+        std::copy(iovs, iovs + n, &all[1]);
+        all[n + 1].iov_base = (void*)"\r\n";
+        all[n + 1].iov_len = 2;
+        rt = m_session->sendIovecs(&all[0], all.size());
+    }
+    else {
+        rt = m_session->sendIovecs(iovs, n);
+    }
+    if(rt < 0) {
+        m_error = true;
+        return rt;
+    }
+    return length;
+}
+
+// 发送一块数据
+ssize_t HttpResponseWriter::write(const void* buffer, size_t length) {
+    iovec iov;
+    iov.iov_base = (void*)buffer;
+    iov.iov_len = length;
+    return sendData(&iov, 1, length);
+}
+
+// 发送ByteArray中的一块数据
+ssize_t HttpResponseWriter::write(ByteArray::ptr buffer, size_t length) {
+    std::vector<iovec> iovs;
+    length = buffer->getReadBuffers(iovs, length);
+    ssize_t rt = sendData(iovs.data(), iovs.size(), length);
+    if(rt > 0) {
+        buffer->setPosition(buffer->getPosition() + rt);
+    }
+    return rt;
+}
+
+// 结束响应
+bool HttpResponseWriter::close() {
+    if(m_closed) {
+        return !m_error;
+    }
+    if(!sendHeader()) {
+        m_closed = true;
+        return false;
+    }
+    m_closed = true;
+    if(m_chunked && !m_error) {
+        iovec iov;
+        iov.iov_base = (void*)"0\r\n\r\n";
+        iov.iov_len = 5;
+        if(m_session->sendIovecs(&iov, 1) < 0) {
+            m_error = true;
+        }
+    }
+    return !m_error;
+}
+
+}
 }
-}
\ No newline at end of file
@@ -0,0 +1,394 @@
+#include "static_file_servlet.h"
+#include "log.h"
+#include "config.h"
+#include "util.h"
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+
+namespace sylar {
+namespace http {
+
+static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+// 每个StaticFileServlet缓存的最大打开文件数
+static ConfigVar<uint32_t>::ptr g_http_static_maxOpenFiles =
+            Config::Lookup("http.static.max_open_files",
+            (uint32_t)1024, "http static file servlet max cached open files");
+
+// 缓存的文件超过该时间(毫秒)后重新stat，检查文件是否被修改
+static ConfigVar<uint32_t>::ptr g_http_static_checkInterval =
+            Config::Lookup("http.static.check_interval",
+            (uint32_t)1000, "http static file servlet cache check interval(ms)");
+
+// HTTP日期格式(RFC 7231)，例如 Sun, 06 Nov 1994 08:49:37 GMT
+static const char* HTTP_DATE_FORMAT = "%a, %d %b %Y %H:%M:%S GMT";
+
+static std::string HttpTimeToStr(time_t t) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char buf[64];
+    strftime(buf, sizeof(buf), HTTP_DATE_FORMAT, &tm);
+    return buf;
+}
+
+// 解析HTTP日期，失败返回-1
+static time_t HttpStrToTime(const std::string& str) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if(!strptime(str.c_str(), HTTP_DATE_FORMAT, &tm)) {
+        return -1;
+    }
+    return timegm(&tm);
+}
+
+// 解码请求路径中的%XX，非法编码返回false
+static bool UrlDecodePath(const std::string& str, std::string& out) {
+    out.clear();
+    out.reserve(str.size());
+    for(size_t i = 0; i < str.size(); ++i) {
+        if(str[i] != '%') {
+            out.push_back(str[i]);
+            continue;
+        }
+        if(i + 2 >= str.size() || !isxdigit(str[i + 1]) || !isxdigit(str[i + 2])) {
+            return false;
+        }
+        char hex[3] = {str[i + 1], str[i + 2], 0};
+        out.push_back((char)strtol(hex, nullptr, 16));
+        i += 2;
+    }
+    return true;
+}
+
+/**
+ * @brief 解析Range头部，只支持单个区间
+ * @param[out] begin 区间开始
+ * @param[out] end 区间结束(包含)
+ * @return 1: 区间有效
+ *         0: 格式不支持(多个区间或者格式错误)，忽略Range返回整个文件
+ *        -1: 区间无法满足，返回416
+ */
+static int ParseRange(const std::string& range, uint64_t size, uint64_t& begin, uint64_t& end) {
+    if(strncasecmp(range.c_str(), "bytes=", 6) != 0
+            || range.find(',') != std::string::npos) {
+        return 0;
+    }
+    const char* p = range.c_str() + 6;
+    char* endptr = nullptr;
+    if(*p == '-') {
+        // bytes=-N 最后N个字节
+        uint64_t n = strtoull(p + 1, &endptr, 10);
+        if(endptr == p + 1 || *endptr) {
+            return 0;
+        }
+        if(n == 0 || size == 0) {
+            return -1;
+        }
+        begin = n >= size ? 0 : size - n;
+        end = size - 1;
+        return 1;
+    }
+    if(!isdigit(*p)) {
+        return 0;
+    }
+    begin = strtoull(p, &endptr, 10);
+    if(*endptr != '-') {
+        return 0;
+    }
+    p = endptr + 1;
+    if(*p) {
+        end = strtoull(p, &endptr, 10);
+        if(*endptr || end < begin) {
+            return 0;
+        }
+        if(end >= size) {
+            end = size - 1;
+        }
+    } else {
+        end = size - 1;
+    }
+    if(begin >= size) {
+        return -1;
+    }
+    return 1;
+}
+
+// 析构时关闭文件句柄
+StaticFileServlet::FileInfo::~FileInfo() {
+    if(fd >= 0) {
+        close(fd);
+    }
+}
+
+// 构造函数
+StaticFileServlet::StaticFileServlet(const std::string& root, const std::string& prefix)
+    :HttpServlet("StaticFileServlet")
+    ,m_root(root)
+    ,m_prefix(prefix) {
+    while(m_root.size() > 1 && m_root.back() == '/') {
+        m_root.pop_back();
+    }
+}
+
+// 通过文件扩展名获取Content-Type
+const char* StaticFileServlet::GetMimeType(const std::string& path) {
+    static const std::unordered_map<std::string, const char*> s_types = {
+        {"html", "text/html; charset=utf-8"},
+        {"htm", "text/html; charset=utf-8"},
+        {"css", "text/css; charset=utf-8"},
+        {"js", "application/javascript; charset=utf-8"},
+        {"json", "application/json"},
+        {"txt", "text/plain; charset=utf-8"},
+        {"xml", "text/xml"},
+        {"png", "image/png"},
+        {"jpg", "image/jpeg"},
+        {"jpeg", "image/jpeg"},
+        {"gif", "image/gif"},
+        {"svg", "image/svg+xml"},
+        {"ico", "image/x-icon"},
+        {"webp", "image/webp"},
+        {"pdf", "application/pdf"},
+        {"zip", "application/zip"},
+        {"gz", "application/gzip"},
+        {"mp4", "video/mp4"},
+        {"wasm", "application/wasm"},
+        {"woff", "font/woff"},
+        {"woff2", "font/woff2"},
+    };
+    size_t pos = path.rfind('.');
+    if(pos != std::string::npos && path.find('/', pos) == std::string::npos) {
+        std::string ext = path.substr(pos + 1);
+        for(auto& c : ext) {
+            c = tolower(c);
+        }
+        auto it = s_types.find(ext);
+        if(it != s_types.end()) {
+            return it->second;
+        }
+    }
+    return "application/octet-stream";
+}
+
+// 把请求路径转换成文件路径，拒绝包含..的路径
+bool StaticFileServlet::toFilePath(const std::string& uri, std::string& path) const {
+    // 前缀只能按整段匹配，前缀为/static时/staticfoo/x不属于本servlet
+    if(uri.compare(0, m_prefix.size(), m_prefix) != 0
+            || (!m_prefix.empty() && m_prefix.back() != '/'
+                && uri.size() != m_prefix.size() && uri[m_prefix.size()] != '/')) {
+        return false;
+    }
+    std::string rel;
+    if(!UrlDecodePath(uri.substr(m_prefix.size()), rel)) {
+        return false;
+    }
+    if(rel.find('\0') != std::string::npos) {
+        return false;
+    }
+    // 逐段检查，不允许跳出根目录
+    size_t pos = 0;
+    while(pos <= rel.size()) {
+        size_t next = rel.find('/', pos);
+        if(next == std::string::npos) {
+            next = rel.size();
+        }
+        if(rel.compare(pos, next - pos, "..") == 0) {
+            return false;
+        }
+        pos = next + 1;
+    }
+    path = m_root;
+    if(rel.empty() || rel[0] != '/') {
+        path.push_back('/');
+    }
+    path.append(rel);
+    return true;
+}
+
+// 打开文件并stat
+StaticFileServlet::FileInfo::ptr StaticFileServlet::OpenFile(const std::string& path) {
+    FileInfo::ptr info = std::make_shared<FileInfo>();
+    if(stat(path.c_str(), &info->st)) {
+        return nullptr;
+    }
+    if(S_ISREG(info->st.st_mode)) {
+        info->fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if(info->fd < 0) {
+            return nullptr;
+        }
+        // 以打开后的句柄为准，避免stat和open之间文件被替换
+        if(fstat(info->fd, &info->st)) {
+            return nullptr;
+        }
+    } else if(!S_ISDIR(info->st.st_mode)) {
+        return nullptr;
+    }
+    char buf[64];
+    snprintf(buf, sizeof(buf), "\"%lx-%lx\"", (unsigned long)info->st.st_mtime,
+             (unsigned long)info->st.st_size);
+    info->etag = buf;
+    info->lastModified = HttpTimeToStr(info->st.st_mtime);
+    info->checkTime = GetCurrentMS();
+    return info;
+}
+
+// 获取文件，优先从缓存中取，缓存的项超过检查间隔后重新stat
+StaticFileServlet::FileInfo::ptr StaticFileServlet::getFile(const std::string& path) {
+    uint64_t now = GetCurrentMS();
+    {
+        MutexType::Lock lock(m_mutex);
+        auto it = m_cache.find(path);
+        if(it != m_cache.end()) {
+            FileInfo::ptr info = it->second->second;
+            if(now - info->checkTime < g_http_static_checkInterval->getValue()) {
+                m_lru.splice(m_lru.begin(), m_lru, it->second);
+                return info;
+            }
+            lock.unlock();
+
+            struct stat st;
+            if(stat(path.c_str(), &st) == 0 && st.st_ino == info->st.st_ino
+                    && st.st_dev == info->st.st_dev && st.st_size == info->st.st_size
+                    && st.st_mtim.tv_sec == info->st.st_mtim.tv_sec
+                    && st.st_mtim.tv_nsec == info->st.st_mtim.tv_nsec) {
+                lock.lock();
+                info->checkTime = now;
+                auto it2 = m_cache.find(path);
+                if(it2 != m_cache.end()) {
+                    m_lru.splice(m_lru.begin(), m_lru, it2->second);
+                }
+                return info;
+            }
+            lock.lock();
+            auto it2 = m_cache.find(path);
+            if(it2 != m_cache.end() && it2->second->second == info) {
+                m_lru.erase(it2->second);
+                m_cache.erase(it2);
+            }
+        }
+    }
+
+    FileInfo::ptr info = OpenFile(path);
+    if(!info || g_http_static_maxOpenFiles->getValue() == 0) {
+        return info;
+    }
+    MutexType::Lock lock(m_mutex);
+    auto it = m_cache.find(path);
+    if(it != m_cache.end()) {
+        m_lru.erase(it->second);
+        m_cache.erase(it);
+    }
+    m_lru.push_front(std::make_pair(path, info));
+    m_cache[path] = m_lru.begin();
+    while(m_lru.size() > g_http_static_maxOpenFiles->getValue()) {
+        m_cache.erase(m_lru.back().first);
+        m_lru.pop_back();
+    }
+    return info;
+}
+
+// 清空打开文件缓存
+void StaticFileServlet::clearCache() {
+    MutexType::Lock lock(m_mutex);
+    m_cache.clear();
+    m_lru.clear();
+}
+
+// 处理请求
+int32_t StaticFileServlet::handle(HttpRequest::ptr req,
+                                  HttpResponse::ptr res,
+                                  HttpSession::ptr session) {
+    bool head = req->getMethod() == HttpMethod::HEAD;
+    if(req->getMethod() != HttpMethod::GET && !head) {
+        res->setStatus(HttpStatus::METHOD_NOT_ALLOWED);
+        res->setHeader("Allow", "GET, HEAD");
+        res->setHeader("Content-Length", "0");
+        return 0;
+    }
+
+    std::string path;
+    if(!toFilePath(req->getPath(), path)) {
+        res->setStatus(HttpStatus::FORBIDDEN);
+        res->setHeader("Content-Length", "0");
+        return 0;
+    }
+    FileInfo::ptr info = getFile(path);
+    if(info && S_ISDIR(info->st.st_mode)) {
+        if(path.back() != '/') {
+            // 目录重定向到以/结尾的路径，使页面中的相对路径正确
+            res->setStatus(HttpStatus::MOVED_PERMANENTLY);
+            res->setHeader("Location", req->getPath() + "/");
+            res->setHeader("Content-Length", "0");
+            return 0;
+        }
+        path.append("index.html");
+        info = getFile(path);
+    }
+    if(!info || !S_ISREG(info->st.st_mode)) {
+        res->setStatus(HttpStatus::NOT_FOUND);
+        res->setHeader("Content-Type", "text/html");
+        res->setBody("<html><head><title>404 Not Found</title></head>"
+                     "<body><center><h1>404 Not Found</h1></center></body></html>");
+        return 0;
+    }
+
+    res->setHeader("ETag", info->etag);
+    res->setHeader("Last-Modified", info->lastModified);
+    res->setHeader("Accept-Ranges", "bytes");
+
+    // 缓存验证: If-None-Match优先于If-Modified-Since
+    std::string inm = req->getHeader("If-None-Match");
+    if(!inm.empty()) {
+        if(inm == "*" || inm.find(info->etag) != std::string::npos) {
+            res->setStatus(HttpStatus::NOT_MODIFIED);
+            return 0;
+        }
+    } else {
+        std::string ims = req->getHeader("If-Modified-Since");
+        if(!ims.empty()) {
+            time_t t = HttpStrToTime(ims);
+            if(t != -1 && info->st.st_mtime <= t) {
+                res->setStatus(HttpStatus::NOT_MODIFIED);
+                return 0;
+            }
+        }
+    }
+
+    uint64_t size = info->st.st_size;
+    uint64_t begin = 0;
+    uint64_t end = size ? size - 1 : 0;
+    uint64_t length = size;
+    std::string range = req->getHeader("Range");
+    if(!range.empty()) {
+        // If-Range不匹配时说明客户端缓存的部分已经过期，返回整个文件
+        std::string ifRange = req->getHeader("If-Range");
+        bool valid = ifRange.empty()
+                    || (ifRange[0] == '"' ? ifRange == info->etag : ifRange == info->lastModified);
+        int rt = valid ? ParseRange(range, size, begin, end) : 0;
+        if(rt < 0) {
+            res->setStatus(HttpStatus::RANGE_NOT_SATISFIABLE);
+            res->setHeader("Content-Range", "bytes */" + std::to_string(size));
+            res->setHeader("Content-Length", "0");
+            return 0;
+        }
+        if(rt > 0) {
+            length = end - begin + 1;
+            res->setStatus(HttpStatus::PARTIAL_CONTENT);
+            res->setHeader("Content-Range", "bytes " + std::to_string(begin) + "-"
+                            + std::to_string(end) + "/" + std::to_string(size));
+        }
+    }
+
+    res->setHeader("Content-Type", GetMimeType(path));
+    if(head) {
+        res->setHeader("Content-Length", std::to_string(length));
+    } else {
+        res->setFileBody(info->fd, begin, length, info);
+    }
+    return 0;
+}
+
+}
+}
@@ -25,7 +25,7 @@ void WSServer::handleClient(sylar::Socket::ptr client) {
         }
 
         // 获取客户端的请求路径对应的servlet
-        WSServlet::ptr servlet = m_dispatch->getMatchWSServlet(header->getPath());
+        WSServlet::ptr servlet = m_dispatch->getMatchWSServlet(header);
         if(!servlet) {
             SYLAR_LOG_INFO(g_logger) << "no match WSServlet";
             break;
@@ -65,7 +65,7 @@ void WSServletDispatch::addGlobServlet(const std::string& uri
                     , FunctionWSServlet::handle_cb handle
                     , FunctionWSServlet::onConnect_cb onConnect
                     , FunctionWSServlet::onClose_cb onClose) {
-    ServletDispatch::addServlet(uri, std::make_shared<FunctionWSServlet>(handle, onConnect, onClose));
+    ServletDispatch::addGlobServlet(uri, std::make_shared<FunctionWSServlet>(handle, onConnect, onClose));
 }
 
 // 通过uri获取WSServlet
@@ -74,5 +74,11 @@ WSServlet::ptr WSServletDispatch::getMatchWSServlet(const std::string& uri) {
     return std::dynamic_pointer_cast<WSServlet>(servlet);
 }
 
+// 通过握手请求获取WSServlet
+WSServlet::ptr WSServletDispatch::getMatchWSServlet(HttpRequest::ptr req) {
+    auto servlet = getMatchServlet(req);
+    return std::dynamic_pointer_cast<WSServlet>(servlet);
+}
+
 }
 }
\ No newline at end of file
@@ -1,7 +1,10 @@
 #include "iomanager.h"
 #include "macro.h"
+#include "config.h"
 #include <string.h>
+#include <poll.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
@@ -10,6 +13,31 @@ namespace sylar {
 
 static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
+static ConfigVar<std::string>::ptr g_iomanager_backend =
+    Config::Lookup("iomanager.backend", std::string("epoll"), "iomanager io backend: epoll or io_uring");
+
+static ConfigVar<uint32_t>::ptr g_iomanager_uring_entries =
+    Config::Lookup("iomanager.uring_entries", (uint32_t)256, "io_uring submission queue size per thread");
+
+static std::atomic<uint64_t> s_iomanager_id = {0};
+
+//当前线程的idle协程是否正在分发就绪的事件/定时器
+static thread_local bool t_idle_dispatch = false;
+
+/**
+ * @brief 一次io_uring操作的状态，分配在发起操作的协程栈上
+ * @details sqe的user_data指向它；带超时时额外链接一个LINK_TIMEOUT，其user_data为地址|1，
+ *          两个cqe都收到后才恢复协程，保证协程返回(栈上的对象失效)后内核不会再引用它
+ */
+struct UringOp {
+    Fiber::ptr fiber;       //等待完成的协程
+    int thread = -1;        //发起操作的协程绑定的线程id，完成后仍在该线程恢复
+    int res = 0;            //操作的cqe结果
+    int pending = 0;        //还未收到的cqe个数
+    bool timedout = false;  //LINK_TIMEOUT是否触发
+    __kernel_timespec ts;   //LINK_TIMEOUT的超时时间
+};
+
 
 //获取事件上下文
 IOManager::FdContext::EventContext& IOManager::FdContext::getEventContext(Event event) {
@@ -28,6 +56,7 @@ void IOManager::FdContext::resetEventContext(EventContext& ctx) {
     ctx.scheduler = nullptr;
     ctx.fiber.reset();
     ctx.cb = nullptr;
+    ctx.thread = -1;
 }
 
 /**
@@ -49,12 +78,13 @@ void IOManager::FdContext::triggerEvent(Event event) {
     //事件触发完后，要把EventContext事件上下文置空
     EventContext& ctx = getEventContext(event);
     if(ctx.cb) {
-        ctx.scheduler->scheduler(&ctx.cb);  //scheduler中swap后，ctx.cb为NULL
+        ctx.scheduler->scheduler(&ctx.cb, ctx.thread);  //scheduler中swap后，ctx.cb为NULL
     } 
     else {
-        ctx.scheduler->scheduler(&ctx.fiber); //scheduler中swap后，ctx.fiber为NULL
+        ctx.scheduler->scheduler(&ctx.fiber, ctx.thread); //scheduler中swap后，ctx.fiber为NULL
     }
     ctx.scheduler = nullptr;
+    ctx.thread = -1;
     return;
 }
 
@@ -63,35 +93,51 @@ void IOManager::FdContext::triggerEvent(Event event) {
  * @param[in] threads 线程数量
  * @param[in] use_caller 是否将调用线程包含进去
  * @param[in] name 调度器的名称
+ * @param[in] timer_type 定时器的存储结构
  */
-IOManager::IOManager(size_t threads, bool use_caller, const std::string& name) 
-    :Scheduler(threads, use_caller, name) {
+IOManager::IOManager(size_t threads, bool use_caller, const std::string& name
+                     ,TimerManager::Type timer_type) 
+    :Scheduler(threads, use_caller, name)
+    ,TimerManager(timer_type)
+    ,m_fdContexts(MAX_FDS, [](FdContext& ctx, size_t fd) {
+        //直接使用fd的值作为FdContext数组的下标，可以快速找到一个fd对应的FdContext
+        ctx.fd = fd;
+    }) {
     //创建epoll实例,在内核区建立红黑树(用于存储以后epoll_ctl传来的socket)和双向链表(用于存储准备就绪的事件)
     //红黑树中每个成员由描述符值和所要监控的文件描述符指向的文件表项的引用等组成
     m_epfd = epoll_create(1000);
     SYLAR_ASSERT2(m_epfd > 0, "epoll_create error");
 
-    int rt = pipe(m_tickleFds);  //创建一个管道，往fd[1]写入的数据可以从fd[0]读出
-    SYLAR_ASSERT2(!rt, "pipe create error");
+    //创建一个eventfd，tickle时写入计数，idle读出计数清零
+    //非阻塞方式，配合边缘触发
+    m_tickleFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    SYLAR_ASSERT2(m_tickleFd >= 0, "eventfd create error");
 
-    //注册pipe读句柄的可读事件，用于tickle调度协程，通过epoll_event.data.fd保存描述符
+    //注册eventfd的可读事件，用于tickle调度协程，通过epoll_event.data.fd保存描述符
     epoll_event event;
     memset(&event, 0, sizeof(epoll_event));  //清零
     event.events = EPOLLIN | EPOLLET;   //设置读事件和边缘触发
-    event.data.fd = m_tickleFds[0];
-    
-    //非阻塞方式，配合边缘触发
-    //epoll的ET模式下是必须使用非阻塞IO的，ET模式指的是当数据从无到有时，才通知该fd
-    //数据读不完，也不会再次通知，所以read时一定要采用循环的方式一直读到read函数返回-1为止
-    rt = fcntl(m_tickleFds[0], F_SETFL, fcntl(m_tickleFds[0], F_GETFD, 0) | O_NONBLOCK);
-    SYLAR_ASSERT2(!rt, "fcntl error");
+    event.data.fd = m_tickleFd;
 
     //将被监听的描述符添加到红黑树中
-    //将管道的读描述符加入epoll多路复用，如果管道可读，idle中的epoll_wait会返回
-    rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFds[0], &event);
+    //将eventfd加入epoll多路复用，如果eventfd可读，idle中的epoll_wait会返回
+    int rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFd, &event);
     SYLAR_ASSERT2(!rt, "epoll_ctl error");
 
-    fdContextsResize(32);  //初始化m_fdContexts容器
+    //选择IO后端，必须在start()之前确定，调度线程一启动就会进入idle
+    m_id = ++s_iomanager_id;
+    auto backend = g_iomanager_backend->getSnapshot();
+    if(*backend == "io_uring") {
+        if(IoUring::IsSupported()) {
+            m_backend = IO_URING;
+        } else {
+            SYLAR_LOG_WARN(g_logger) << "IOManager name=" << getName()
+                << " io_uring not supported by kernel, fallback to epoll";
+        }
+    } else if(*backend != "epoll") {
+        SYLAR_LOG_WARN(g_logger) << "IOManager name=" << getName()
+            << " unknown iomanager.backend=" << *backend << ", use epoll";
+    }
 
     //这里直接开启了Schedluer，也就是说IOManager创建即可调度协程
     start();
@@ -99,17 +145,14 @@ IOManager::IOManager(size_t threads, bool use_caller, const std::string& name)
 
 //析构函数
 IOManager::~IOManager() {
-    //先等Scheduler调度完所有的任务，再关闭epoll句柄和pipe句柄
+    //先等Scheduler调度完所有的任务，再关闭epoll句柄和eventfd句柄
     stop();   //析构时关掉Schedluer
-    close(m_epfd);
-    close(m_tickleFds[0]);
-    close(m_tickleFds[1]);
-
-    for(size_t i = 0; i < m_fdContexts.size(); ++i) {
-        if(m_fdContexts[i]) {
-            delete m_fdContexts[i];
-        }
+    for(auto& i : m_threadEpfds) {
+        close(i);
     }
+    close(m_epfd);
+    close(m_tickleFd);
+    //m_fdContexts析构时释放所有FdContext，m_uringContexts析构时关闭各线程的io_uring
 }
 
 /**
@@ -121,18 +164,11 @@ IOManager::~IOManager() {
  * @return 添加成功返回0，失败返回-1
  */
 int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
-    //找到fd对应的FdContext，如果不存在，那就分配一个
-    FdContext* fd_ctx = nullptr;
-    RWMutexType::ReadLock lock(m_mutex);
-    if((int)m_fdContexts.size() > fd) {
-        fd_ctx = m_fdContexts[fd];
-        lock.unlock();
-    }
-    else {
-        lock.unlock();
-        RWMutexType::WriteLock lock2(m_mutex);
-        fdContextsResize(fd * 1.5);    //扩充1.5倍
-        fd_ctx = m_fdContexts[fd];
+    //找到fd对应的FdContext，如果不存在，那就分配一个(无锁，FdContext分配后地址不变)
+    FdContext* fd_ctx = fd < 0 ? nullptr : m_fdContexts.getOrCreate(fd);
+    if(!fd_ctx) {
+        SYLAR_LOG_ERROR(g_logger) << "addEvent error: fd=" << fd << " out of range";
+        return -1;
     }
 
     //同一个fd不允许重复添加相同的事件
@@ -151,11 +187,22 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
     new_event.data.fd = fd;
     new_event.data.ptr = fd_ctx;
 
+    //第一次注册时决定fd放在哪个epoll句柄上：绑定在本线程的协程注册到本线程的epoll句柄，
+    //事件就绪时由本线程自己的idle取到，不经过其他线程
+    int epfd = fd_ctx->epfd;
+    if(!fd_ctx->events) {
+        epfd = m_epfd;
+        if(m_backend == EPOLL && Scheduler::GetThis() == this
+                && Fiber::GetPinThread() != -1 && Fiber::GetPinThread() == getThreadId()) {
+            epfd = getThreadEpfd(true);
+        }
+    }
+
     //将用户空间new_event拷贝到内核中，后续可以将其转化为epitem作为节点存入红黑树中，
     //fd是红黑树中查找所对应的epitem实例的key，根据传入的op参数对红黑树进行不同的操作
-    int rt = epoll_ctl(m_epfd, op, fd, &new_event);
+    int rt = epoll_ctl(epfd, op, fd, &new_event);
     if(rt) {
-        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
+        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << epfd << ", "
             << op << ", " << fd << ", " << (EPOLL_EVENTS)new_event.events << "):"
             << rt << " (" << errno << ") (" << strerror(errno) << ") fd_ctx->events=" 
             << (EPOLL_EVENTS)fd_ctx->events;
@@ -163,6 +210,7 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
     }
 
     ++m_pendingEventCount;   //待执行IO事件数加1
+    fd_ctx->epfd = epfd;
 
     //虽然fd_ctx已加入到new_event.data.ptr中，但是new_event是引用传递，所以可以同步修改
     //找到这个fd的event事件对应的EventContext，对其中的scheduler, cb, fiber进行赋值
@@ -174,6 +222,7 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
     
     // 赋值scheduler和回调函数，如果回调函数为空，则把当前协程当成回调执行体
     event_ctx.scheduler = Scheduler::GetThis();
+    event_ctx.thread = Fiber::GetPinThread();
     if(cb) {
         event_ctx.cb.swap(cb);    //swap后，cb为NULL
     }
@@ -194,13 +243,11 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
  */
 bool IOManager::delEvent(int fd, Event event) {
     //找到fd对应的FdContext
-    RWMutexType::ReadLock lock(m_mutex);
-    if((int)m_fdContexts.size() <= fd) {
+    FdContext* fd_ctx = fd < 0 ? nullptr : m_fdContexts.get(fd);
+    if(!fd_ctx) {
         SYLAR_LOG_ERROR(g_logger) << "delEvent error: fd=" << fd << " not exist";
         return false;
     }
-    FdContext* fd_ctx = m_fdContexts[fd];
-    lock.unlock();
 
     //要删除的事件不存在
     FdContext::MutexType::Lock lock2(fd_ctx->mutex);
@@ -219,9 +266,9 @@ bool IOManager::delEvent(int fd, Event event) {
     new_event.data.ptr = fd_ctx;
 
     //fd是红黑树中的key，根据fd找到epitem节点进行op操作，new_event记录新的事件信息
-    int rt = epoll_ctl(m_epfd, op, fd, &new_event);
+    int rt = epoll_ctl(fd_ctx->epfd, op, fd, &new_event);
     if(rt) {
-        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
+        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << fd_ctx->epfd << ", "
             << op << ", " << fd << ", " << (EPOLL_EVENTS)new_event.events << "):"
             << rt << " (" << errno << ") (" << strerror(errno) << ") fd_ctx->events=" 
             << (EPOLL_EVENTS)fd_ctx->events;
@@ -246,13 +293,11 @@ bool IOManager::delEvent(int fd, Event event) {
  */
 bool IOManager::cancelEvent(int fd, Event event) {
     //找到fd对应的FdContext
-    RWMutexType::ReadLock lock(m_mutex);
-    if((int)m_fdContexts.size() <= fd) {
+    FdContext* fd_ctx = fd < 0 ? nullptr : m_fdContexts.get(fd);
+    if(!fd_ctx) {
         SYLAR_LOG_ERROR(g_logger) << "cancelEvent error: fd=" << fd << " not exist";
         return false;
     }
-    FdContext* fd_ctx = m_fdContexts[fd];
-    lock.unlock();
 
     //要删除的事件不存在
     FdContext::MutexType::Lock lock2(fd_ctx->mutex);
@@ -271,9 +316,9 @@ bool IOManager::cancelEvent(int fd, Event event) {
     new_event.data.ptr = fd_ctx;
 
     //fd是红黑树中的key，根据fd找到epitem节点进行op操作，new_event记录新的事件信息
-    int rt = epoll_ctl(m_epfd, op, fd, &new_event);
+    int rt = epoll_ctl(fd_ctx->epfd, op, fd, &new_event);
     if(rt) {
-        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
+        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << fd_ctx->epfd << ", "
             << op << ", " << fd << ", " << (EPOLL_EVENTS)new_event.events << "):"
             << rt << " (" << errno << ") (" << strerror(errno) << ") fd_ctx->events=" 
             << (EPOLL_EVENTS)fd_ctx->events;
@@ -294,13 +339,16 @@ bool IOManager::cancelEvent(int fd, Event event) {
  */
 bool IOManager::cancelAllEvent(int fd) {
     //找到fd对应的FdContext
-    RWMutexType::ReadLock lock(m_mutex);
-    if((int)m_fdContexts.size() <= fd) {
+    FdContext* fd_ctx = fd < 0 ? nullptr : m_fdContexts.get(fd);
+    if(!fd_ctx) {
         SYLAR_LOG_ERROR(g_logger) << "cancelEvent error: fd=" << fd << " not exist";
         return false;
     }
-    FdContext* fd_ctx = m_fdContexts[fd];
-    lock.unlock();
+
+    //io_uring上还有该fd的操作，取消后等待的协程会以失败返回
+    if(fd_ctx->uringOps.load(std::memory_order_acquire) > 0) {
+        cancelUringOps(fd);
+    }
 
     //事件为空，没有要删除的事件
     FdContext::MutexType::Lock lock2(fd_ctx->mutex);
@@ -317,9 +365,9 @@ bool IOManager::cancelAllEvent(int fd) {
     new_event.data.ptr = fd_ctx;
 
     //fd是红黑树中的key，根据fd找到epitem节点进行op操作，new_event记录新的事件信息
-    int rt = epoll_ctl(m_epfd, op, fd, &new_event);
+    int rt = epoll_ctl(fd_ctx->epfd, op, fd, &new_event);
     if(rt) {
-        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
+        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << fd_ctx->epfd << ", "
             << op << ", " << fd << ", " << (EPOLL_EVENTS)new_event.events << "):"
             << rt << " (" << errno << ") (" << strerror(errno) << ") fd_ctx->events=" 
             << (EPOLL_EVENTS)fd_ctx->events;
@@ -349,21 +397,25 @@ IOManager* IOManager::GetThis() {
 
 /**
  * @brief 通知调度器有任务要调度
- * @details 写pipe让idle协程从epoll_wait退出，待idle协程yield后Scheduler::run就可以调度其他任务
- *          如果当前没有空闲调度线程，那就没必要发通知
+ * @details 写eventfd让idle协程从epoll_wait退出，待idle协程yield后Scheduler::run就可以调度其他任务
+ *          如果当前没有空闲调度线程，那就没必要发通知；
+ *          一轮idle期间只需要写一次，m_tickled在idle读出eventfd后才会清除，其余的tickle直接合并掉；
+ *          idle协程分发事件时调度的任务会在本线程退出idle后取到，本线程是唯一的空闲线程时也不需要写
  */
 void IOManager::tickle() {
     //SYLAR_LOG_INFO(g_logger) << "IOManager::tickle";    //调试打开
-    if(!hasIdleThreads()) {
+    if(!hasIdleThreads() || (t_idle_dispatch && m_idleThreadCount <= 1)) {
+        ++m_tickleSuppressed;
+        return;
+    }
+    if(m_tickled.exchange(true, std::memory_order_acq_rel)) {
+        ++m_tickleSuppressed;
         return;
     }
-    /**
-     * @brief ssize_t write(int fd, const void * buf, size_t count);
-     * @details write()会把参数buf所指的内存写入count个字节到参数fd所指的文件内
-     * @return 成功:返回实际写入的字节数  失败:返回-1，错误代码存入errno中 
-    */
-    int rt = write(m_tickleFds[1], "T", 1);
-    SYLAR_ASSERT(rt == 1);
+    ++m_tickleIssued;
+    uint64_t one = 1;
+    int rt = write(m_tickleFd, &one, sizeof(one));
+    SYLAR_ASSERT(rt == sizeof(one));
 }
 
 /**
@@ -392,6 +444,10 @@ bool IOManager::stopping() {
  */
 void IOManager::idle() {
     SYLAR_LOG_DEBUG(g_logger) << "IOManager::idle";
+    if(m_backend == IO_URING) {
+        idleUring();
+        return;
+    }
 
     //一次epoll_wait最多检测256个就绪事件，如果就绪事件超过了这个数，那么会在下轮epoll_wait继续处理
     const uint64_t MAX_EVENTS = 256;
@@ -413,9 +469,17 @@ void IOManager::idle() {
         if(stopping(next_timeout)) {
             SYLAR_LOG_INFO(g_logger) << "name=" << getName()
                                     << " idle stopping exit";
+            //tickle会被合并，stop()的多次tickle可能只唤醒一个线程，退出前接力唤醒下一个空闲线程
+            tickle();
             break;
         }
 
+        //本线程有绑定的fd时等待自己的epoll句柄，它同时监听着共享的m_epfd
+        int epfd = getThreadEpfd(false);
+        if(epfd < 0) {
+            epfd = m_epfd;
+        }
+
         //阻塞在epoll_wait上，等待事件发生，返回事件的数目，并将触发的事件写入events数组中
         //判断就绪链表有无数据，有数据就返回，没有数据就sleep，等到timeout时间到后即使链表没数据也返回
         int rt = 0;
@@ -428,14 +492,14 @@ void IOManager::idle() {
                 next_timeout = MAX_TIMEOUT;
             }
             //epoll_wait函数的阻塞与在其队列中socket是否为阻塞没有关系
-            rt = epoll_wait(m_epfd, events, MAX_EVENTS, (int)next_timeout);  //超时返回0
+            rt = epoll_wait(epfd, events, MAX_EVENTS, (int)next_timeout);  //超时返回0
             if(rt < 0) {
                 //函数调用被信号处理函数中断，这些情况并不作为错误
                 //解决方法：重新定义系统调用，忽略错误码为EINTR的情况
                 if(errno == EINTR) {
                     continue;
                 }
-                SYLAR_LOG_ERROR(g_logger) << "epoll_wait(" << m_epfd << ") (rt="
+                SYLAR_LOG_ERROR(g_logger) << "epoll_wait(" << epfd << ") (rt="
                     << rt << ") (" << errno << ") (" << strerror(errno) << ") ";
                 return;
             }
@@ -445,6 +509,25 @@ void IOManager::idle() {
             
         } while(true);
 
+        //共享的m_epfd可读时，把它的就绪事件取到数组剩余的位置中一起处理
+        //所有挂着它的线程都会被唤醒，只有一个线程能取到事件，与io_uring后端一样
+        if(epfd != m_epfd) {
+            for(int i = 0; i < rt; ++i) {
+                if(events[i].data.ptr == &m_epfd) {
+                    events[i] = events[--rt];
+                    int n = 0;
+                    do {
+                        n = epoll_wait(m_epfd, events + rt, MAX_EVENTS - rt, 0);
+                    } while(n < 0 && errno == EINTR);
+                    if(n > 0) {
+                        rt += n;
+                    }
+                    break;
+                }
+            }
+        }
+
+        t_idle_dispatch = true;
         std::vector<std::function<void()> > cbs;
         listTimeoutCbs(cbs);
         if(!cbs.empty()) {
@@ -455,73 +538,8 @@ void IOManager::idle() {
         }
 
         //遍历所有发生的事件，根据epoll_event的私有指针找到对应的FdContext，进行事件处理
-        for(int i = 0; i < rt; ++i) {
-            epoll_event& event = events[i];
-            //ticklefd[0]用于通知协程调度，这时只需要把管道里的内容读完即可，本轮idle结束Scheduler::run会重新执行协程调度
-            if(event.data.fd == m_tickleFds[0]) {
-                //SYLAR_LOG_DEBUG(g_logger) << "rt=" << rt;
-                //SYLAR_LOG_INFO(g_logger) << "---------------- rt = " << rt << " ----------------";
-                /**
-                 * @brief ssize_t read(int fd, void * buf, size_t count);
-                 * @details read()会把参数fd所指的文件传送count个字节到buf指针所指的内存中
-                 * @return 返回实际读取到的字节数，如果返回0，表示已到达文件尾或是无可读取的数据
-                 */
-                char dummy[256];
-                //如果m_tickleFds[0]描述符不是非阻塞的，那这个事件一直读或一直写势必会在最后一次阻塞(因为读到没数据后就会阻塞)
-                //而设置成非阻塞的，会一直读，直到没数据后会返回-1，不会阻塞，并将errno设置为EWOULDBLOCK（或者EAGAIN，是等价的）
-                while(read(m_tickleFds[0], dummy, sizeof(dummy)) > 0);  
-                continue;
-            }
-
-            //通过epoll_event的私有指针获取FdContext
-            FdContext* fd_ctx = (FdContext*)event.data.ptr;
-            FdContext::MutexType::Lock lock(fd_ctx->mutex);
-            /**
-             * EPOLLERR: 出错，比如写读端已经关闭的pipe
-             * EPOLLHUP: 套接字对端关闭
-             * 出现这两种事件，应该同时触发fd_ctx的读和写事件，否则有可能出现注册的事件永远执行不到的情况
-             */
-            if(event.events & (EPOLLERR | EPOLLHUP)) {
-                event.events |= (EPOLLIN | EPOLLOUT) & fd_ctx->events;
-            }
-
-            int real_events = NONE;    //真正要执行的事件
-            if(event.events & EPOLLIN) {
-                real_events |= READ;
-            }
-            if(event.events & EPOLLOUT) {
-                real_events |= WRITE;
-            }
-
-            if((fd_ctx->events & real_events) == NONE) {   //没有要执行的事件
-                continue;
-            }
-
-            //剔除已经发生的事件，将剩下的事件重新加入epoll_wait，
-            //如果剩下的事件为0，表示这个fd已经不需要关注了，直接从epoll中删除
-            int left_events = fd_ctx->events & ~real_events;
-            int op = left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-            event.events = EPOLLET | left_events;
-
-            int rt2 = epoll_ctl(m_epfd, op, fd_ctx->fd, &event);
-            if(rt2) {
-                SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                    << op << ", " << fd_ctx->fd << ", " << (EPOLL_EVENTS)event.events << "):"
-                    << rt2 << " (" << errno << ") (" << strerror(errno) << ") fd_ctx->events=" 
-                    << (EPOLL_EVENTS)fd_ctx->events;
-                continue;
-            }
-
-            //处理已经发生的事件，也就是让调度器调度指定的函数或协程
-            if(real_events & READ) {
-                fd_ctx->triggerEvent(READ); //triggerEvent()内会处理fd_ctx的events和EventContext
-                --m_pendingEventCount;
-            }
-            if(real_events & WRITE) {
-                fd_ctx->triggerEvent(WRITE);
-                --m_pendingEventCount;
-            }
-        } //end for
+        processEvents(events, rt);
+        t_idle_dispatch = false;
 
         //一旦处理完所有的事件，idle协程yield，这样可以让调度协程(Scheduler::run)重新检查是否有新任务要调度
         //上面triggerEvent实际也只是把对应的cb或fiber重新加入调度，要执行的话还要等idle协程退出
@@ -536,25 +554,339 @@ void IOManager::idle() {
     } //end while(true)
 }
 
-void IOManager::newTimerInsertAtFront() {
-    tickle();
+/**
+ * @brief 处理epoll_wait返回的就绪事件
+ * @details 根据epoll_event的私有指针找到对应的FdContext，触发就绪的事件
+ * @param[in] events 就绪事件数组
+ * @param[in] n 就绪事件个数
+ */
+void IOManager::processEvents(epoll_event* events, int n) {
+    for(int i = 0; i < n; ++i) {
+        epoll_event& event = events[i];
+        //eventfd用于通知协程调度，这时只需要把计数读出清零即可，本轮idle结束Scheduler::run会重新执行协程调度
+        if(event.data.fd == m_tickleFd) {
+            uint64_t dummy;
+            //非阻塞的eventfd，一次read即可把计数清零
+            while(read(m_tickleFd, &dummy, sizeof(dummy)) > 0);
+            //必须在读完之后再清除标志，否则读之前写入的通知会被吞掉，而标志却一直保持为true
+            //清除之前被合并掉的tickle，其任务会在本线程回到Scheduler::run后被取到
+            m_tickled.store(false, std::memory_order_release);
+            continue;
+        }
+
+        //通过epoll_event的私有指针获取FdContext
+        FdContext* fd_ctx = (FdContext*)event.data.ptr;
+        FdContext::MutexType::Lock lock(fd_ctx->mutex);
+        /**
+         * EPOLLERR: 出错，比如写读端已经关闭的pipe
+         * EPOLLHUP: 套接字对端关闭
+         * 出现这两种事件，应该同时触发fd_ctx的读和写事件，否则有可能出现注册的事件永远执行不到的情况
+         */
+        if(event.events & (EPOLLERR | EPOLLHUP)) {
+            event.events |= (EPOLLIN | EPOLLOUT) & fd_ctx->events;
+        }
+
+        int real_events = NONE;    //真正要执行的事件
+        if(event.events & EPOLLIN) {
+            real_events |= READ;
+        }
+        if(event.events & EPOLLOUT) {
+            real_events |= WRITE;
+        }
+
+        if((fd_ctx->events & real_events) == NONE) {   //没有要执行的事件
+            continue;
+        }
+
+        //剔除已经发生的事件，将剩下的事件重新加入epoll_wait，
+        //如果剩下的事件为0，表示这个fd已经不需要关注了，直接从epoll中删除
+        int left_events = fd_ctx->events & ~real_events;
+        int op = left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+        event.events = EPOLLET | left_events;
+
+        int rt2 = epoll_ctl(fd_ctx->epfd, op, fd_ctx->fd, &event);
+        if(rt2) {
+            SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << fd_ctx->epfd << ", "
+                << op << ", " << fd_ctx->fd << ", " << (EPOLL_EVENTS)event.events << "):"
+                << rt2 << " (" << errno << ") (" << strerror(errno) << ") fd_ctx->events=" 
+                << (EPOLL_EVENTS)fd_ctx->events;
+            continue;
+        }
+
+        //处理已经发生的事件，也就是让调度器调度指定的函数或协程
+        if(real_events & READ) {
+            fd_ctx->triggerEvent(READ); //triggerEvent()内会处理fd_ctx的events和EventContext
+            --m_pendingEventCount;
+        }
+        if(real_events & WRITE) {
+            fd_ctx->triggerEvent(WRITE);
+            --m_pendingEventCount;
+        }
+    }
+}
+
+//返回当前线程的epoll句柄，不存在时按需创建
+int IOManager::getThreadEpfd(bool create) {
+    //线程局部的epoll句柄及其所属的IOManager实例id
+    static thread_local int t_thread_epfd = -1;
+    static thread_local uint64_t t_thread_epfd_owner = 0;
+    if(t_thread_epfd_owner == m_id) {
+        return t_thread_epfd;
+    }
+    if(!create) {
+        return -1;
+    }
+
+    int epfd = epoll_create(1000);
+    SYLAR_ASSERT2(epfd > 0, "epoll_create error");
+    //水平触发监听共享的m_epfd，本轮没有取完的就绪事件下一轮还能唤醒
+    epoll_event event;
+    memset(&event, 0, sizeof(epoll_event));
+    event.events = EPOLLIN;
+    event.data.ptr = &m_epfd;
+    int rt = epoll_ctl(epfd, EPOLL_CTL_ADD, m_epfd, &event);
+    SYLAR_ASSERT2(!rt, "epoll_ctl error");
+    t_thread_epfd = epfd;
+    t_thread_epfd_owner = m_id;
+
+    MutexType::Lock lock(m_threadEpfdMutex);
+    m_threadEpfds.push_back(epfd);
+    return epfd;
 }
 
 /**
- * @brief 重置socket句柄上下文的容器大小
- * @details m_fdContexts容器膨胀时不会覆盖掉之前的值
- * @param[in] size 容量大小
+ * @brief 通过当前线程的io_uring执行一次IO操作，完成前让出当前协程
+ * @details sqe只放入本线程的提交队列，等本线程进入idle时和其他协程的sqe一起用一次io_uring_enter提交，
+ *          内核完成后由本线程的idle协程收割cqe并重新调度协程
  */
-void IOManager::fdContextsResize(size_t size) {
-    m_fdContexts.resize(size);
-    for(size_t i = 0; i < m_fdContexts.size(); ++i) {
-        if(!m_fdContexts[i]) {
-            m_fdContexts[i] = new FdContext;
-            //直接使用fd的值作为FdContext数组的下标，可以快速找到一个fd对应的FdContext
-            m_fdContexts[i]->fd = i;
+ssize_t IOManager::uringIo(int opcode, int fd, const void* addr, uint32_t len, uint64_t off
+                           ,uint32_t op_flags, uint64_t timeout_ms) {
+    SYLAR_ASSERT(m_backend == IO_URING);
+    FdContext* fd_ctx = fd < 0 ? nullptr : m_fdContexts.getOrCreate(fd);
+    if(!fd_ctx) {
+        errno = EBADF;
+        return -1;
+    }
+
+    UringContext* uctx = getUringContext();
+    UringOp op;
+    op.pending = timeout_ms != ~0ull ? 2 : 1;
+    //先记录在途操作，close时据此决定是否需要去io_uring上取消
+    ++fd_ctx->uringOps;
+    {
+        UringContext::MutexType::Lock lock(uctx->mutex);
+        //带超时的操作和LINK_TIMEOUT必须在同一批提交，空间不够时先把已有的sqe提交给内核
+        if(uctx->ring.sqSpace() < (uint32_t)op.pending) {
+            uctx->ring.submit();
+        }
+        if(uctx->ring.sqSpace() < (uint32_t)op.pending) {
+            --fd_ctx->uringOps;
+            SYLAR_LOG_ERROR(g_logger) << "uringIo fd=" << fd << " opcode=" << opcode
+                                      << " submission queue full";
+            errno = EAGAIN;
+            return -1;
+        }
+
+        io_uring_sqe* sqe = uctx->ring.getSqe();
+        sqe->opcode = opcode;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t)(uintptr_t)addr;
+        sqe->len = len;
+        sqe->off = off;
+        sqe->rw_flags = op_flags;
+        sqe->user_data = (uint64_t)(uintptr_t)&op;
+        if(timeout_ms != ~0ull) {
+            sqe->flags |= IOSQE_IO_LINK;
+            op.ts.tv_sec = timeout_ms / 1000;
+            op.ts.tv_nsec = (timeout_ms % 1000) * 1000 * 1000;
+            io_uring_sqe* tsqe = uctx->ring.getSqe();
+            tsqe->opcode = IORING_OP_LINK_TIMEOUT;
+            tsqe->fd = -1;
+            tsqe->addr = (uint64_t)(uintptr_t)&op.ts;
+            tsqe->len = 1;
+            tsqe->user_data = (uint64_t)(uintptr_t)&op | 1;
+        }
+        op.fiber = Fiber::GetThis();
+        op.thread = Fiber::GetPinThread();
+    }
+    ++m_pendingEventCount;
+
+    Fiber::YieldToHold();
+    //idle收割到全部cqe后才会回到这里
+    --fd_ctx->uringOps;
+    if(op.res < 0) {
+        //被LINK_TIMEOUT取消视为超时，被close取消视为句柄已关闭
+        if(op.res == -ECANCELED) {
+            errno = op.timedout ? ETIMEDOUT : EBADF;
+        } else {
+            errno = -op.res;
+        }
+        return -1;
+    }
+    return op.res;
+}
+
+//返回当前线程的io_uring上下文，不存在则创建
+IOManager::UringContext* IOManager::getUringContext() {
+    //线程局部的io_uring上下文及其所属的IOManager实例id
+    static thread_local UringContext* t_uring_ctx = nullptr;
+    static thread_local uint64_t t_uring_owner = 0;
+    if(t_uring_ctx && t_uring_owner == m_id) {
+        return t_uring_ctx;
+    }
+
+    std::unique_ptr<UringContext> ctx(new UringContext);
+    bool ok = ctx->ring.init(g_iomanager_uring_entries->getValue());
+    SYLAR_ASSERT2(ok, "io_uring_setup error errno=" << errno << " " << strerror(errno));
+    t_uring_ctx = ctx.get();
+    t_uring_owner = m_id;
+
+    MutexType::Lock lock(m_uringMutex);
+    m_uringContexts.push_back(std::move(ctx));
+    return t_uring_ctx;
+}
+
+/**
+ * @brief 取消所有io_uring上fd还未完成的操作
+ * @details 不知道操作提交在哪个线程的io_uring上，所以向每个io_uring都提交一个按fd取消的请求，
+ *          取消前先把提交队列中已有的sqe一起提交，保证取消在这些操作之后执行
+ */
+void IOManager::cancelUringOps(int fd) {
+    MutexType::Lock lock(m_uringMutex);
+    for(auto& i : m_uringContexts) {
+        UringContext::MutexType::Lock lock2(i->mutex);
+        io_uring_sqe* sqe = i->ring.getSqe();
+        if(!sqe) {
+            i->ring.submit();
+            sqe = i->ring.getSqe();
+        }
+        if(!sqe) {
+            SYLAR_LOG_ERROR(g_logger) << "cancelUringOps fd=" << fd << " submission queue full";
+            continue;
+        }
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = fd;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        sqe->user_data = 0;
+        i->ring.submit();
+    }
+}
+
+/**
+ * @brief IO_URING后端的idle协程
+ * @details 阻塞在本线程io_uring的io_uring_enter上，一次系统调用同时完成提交和等待；
+ *          epoll句柄通过一次性的POLL_ADD挂在ring上，所以tickle和addEvent注册的事件照常可以唤醒。
+ *          所有线程的ring都监听同一个epoll句柄，epoll句柄可读时空闲线程会被一起唤醒，
+ *          只有一个线程能从epoll_wait中取到事件，其余线程重新挂上POLL_ADD后继续等待
+ */
+void IOManager::idleUring() {
+    UringContext* uctx = getUringContext();
+    IoUring& ring = uctx->ring;
+
+    const uint64_t MAX_EVENTS = 256;
+    std::unique_ptr<epoll_event[]> events(new epoll_event[MAX_EVENTS]);
+    //epoll句柄可读时cqe的user_data，是偶数并且不会和协程栈上UringOp的地址相同
+    const uint64_t EPOLL_TAG = (uint64_t)(uintptr_t)&m_epfd;
+
+    while(true) {
+        uint64_t next_timeout = 0;
+        if(stopping(next_timeout)) {
+            SYLAR_LOG_INFO(g_logger) << "name=" << getName()
+                                    << " idle stopping exit";
+            tickle();
+            break;
         }
+        const uint64_t MAX_TIMEOUT = 3000;
+        if(next_timeout == ~0ull || next_timeout > MAX_TIMEOUT) {
+            next_timeout = MAX_TIMEOUT;
+        }
+
+        uint32_t to_submit = 0;
+        {
+            UringContext::MutexType::Lock lock(uctx->mutex);
+            if(!uctx->epollArmed) {
+                io_uring_sqe* sqe = ring.getSqe();
+                if(!sqe) {
+                    ring.submit();
+                    sqe = ring.getSqe();
+                }
+                if(sqe) {
+                    sqe->opcode = IORING_OP_POLL_ADD;
+                    sqe->fd = m_epfd;
+                    sqe->poll32_events = POLLIN;
+                    sqe->user_data = EPOLL_TAG;
+                    uctx->epollArmed = true;
+                }
+            }
+            to_submit = ring.flush();
+        }
+
+        int rt = ring.wait(to_submit, next_timeout);
+        if(rt < 0 && rt != -ETIME && rt != -EINTR) {
+            //-EBUSY等错误时完成队列里仍可能有cqe，继续收割
+            SYLAR_LOG_ERROR(g_logger) << "io_uring_enter(" << ring.getFd() << ") (rt="
+                << rt << ") (" << strerror(-rt) << ")";
+        }
+
+        t_idle_dispatch = true;
+        std::vector<std::function<void()> > cbs;
+        listTimeoutCbs(cbs);
+        if(!cbs.empty()) {
+            scheduler(cbs.begin(), cbs.end());
+            cbs.clear();
+        }
+
+        //收割完成队列，操作的cqe都到齐后重新调度等待的协程
+        bool epoll_ready = false;
+        io_uring_cqe* cqe = nullptr;
+        while((cqe = ring.peekCqe())) {
+            uint64_t data = cqe->user_data;
+            int res = cqe->res;
+            ring.cqeSeen();
+            if(!data) {
+                continue;   //取消请求自身的结果
+            }
+            if(data == EPOLL_TAG) {
+                epoll_ready = true;
+                continue;
+            }
+            UringOp* op = (UringOp*)(uintptr_t)(data & ~(uint64_t)1);
+            if(data & 1) {
+                op->timedout = (res == -ETIME);
+            } else {
+                op->res = res;
+            }
+            if(--op->pending == 0) {
+                //scheduler之后协程可能马上在其他线程恢复，op随之失效，不能再访问
+                Fiber::ptr fiber;
+                fiber.swap(op->fiber);
+                scheduler(fiber, op->thread);
+                --m_pendingEventCount;
+            }
+        }
+
+        if(epoll_ready) {
+            uctx->epollArmed = false;
+            int n = 0;
+            do {
+                n = epoll_wait(m_epfd, events.get(), MAX_EVENTS, 0);
+            } while(n < 0 && errno == EINTR);
+            if(n > 0) {
+                processEvents(events.get(), n);
+            }
+        }
+        t_idle_dispatch = false;
+
+        Fiber::ptr curr = Fiber::GetThis();
+        Fiber* temp = curr.get();
+        curr.reset();
+        temp->swapOut();
     }
 }
 
+void IOManager::newTimerInsertAtFront() {
+    tickle();
+}
+
 
 }
\ No newline at end of file
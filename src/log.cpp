@@ -3,6 +3,14 @@
 #include <ctype.h>
 #include <tuple>
 #include <time.h>
+#include <algorithm>
+#include <deque>
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "binlog.h"
 #include "config.h"
 
 namespace sylar {
@@ -58,7 +66,77 @@ LogEvent::LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level,
     m_threadId(threadId),
     m_fiberId(fiberId),
     m_time(time),
-    m_threadName(threadName) {
+    m_threadName(threadName),
+    m_buf(m_content),
+    m_ss(&m_buf) {
+}
+
+LogEvent::ptr LogEvent::Create(std::shared_ptr<Logger> logger, LogLevel::Level level, 
+            const char* file, int32_t line, uint32_t elapse, 
+            uint32_t threadId, uint32_t fiberId, uint64_t time, 
+            const std::string& threadName) {
+    static thread_local LogEvent::ptr t_event;
+    if(t_event && t_event.use_count() == 1) {
+        t_event->reset(logger, level, file, line, elapse, threadId, fiberId, time, threadName);
+        return t_event;
+    }
+    LogEvent::ptr event = std::make_shared<LogEvent>(logger, level, file, line
+                                , elapse, threadId, fiberId, time, threadName);
+    if(!t_event) {
+        t_event = event;
+    }
+    return event;
+}
+
+void LogEvent::reset(std::shared_ptr<Logger> logger, LogLevel::Level level, 
+            const char* file, int32_t line, uint32_t elapse, 
+            uint32_t threadId, uint32_t fiberId, uint64_t time, 
+            const std::string& threadName) {
+    m_logger.swap(logger);
+    m_level = level;
+    m_file = file;
+    m_line = line;
+    m_elapse = elapse;
+    m_threadId = threadId;
+    m_fiberId = fiberId;
+    m_time = time;
+    m_threadName.assign(threadName);
+    //单条超长日志之后不保留大块内存
+    if(m_content.capacity() > 64 * 1024) {
+        std::string().swap(m_content);
+    }
+    m_content.clear();
+    m_binSite = nullptr;
+    if(m_binArgs.capacity() > 64 * 1024) {
+        std::string().swap(m_binArgs);
+    }
+    m_binArgs.clear();
+    //上一条日志可能改过流的状态(std::hex、setprecision等)
+    m_ss.clear();
+    m_ss.flags(std::ios_base::dec | std::ios_base::skipws);
+    m_ss.precision(6);
+    m_ss.width(0);
+    m_ss.fill(' ');
+}
+
+LogEvent::StringBuf::int_type LogEvent::StringBuf::overflow(int_type c) {
+    if(c != traits_type::eof()) {
+        m_str.push_back((char)c);
+    }
+    return traits_type::not_eof(c);
+}
+
+std::streamsize LogEvent::StringBuf::xsputn(const char* s, std::streamsize n) {
+    m_str.append(s, n);
+    return n;
+}
+
+//二进制日志第一次取内容时按调用点的格式还原参数(只有文本Appender会用到)
+const std::string& LogEvent::getContent() const {
+    if(m_binSite && m_content.empty()) {
+        BinLogArgs::Format(m_content, m_binSite->getFormat(), m_binArgs.data(), m_binArgs.size());
+    }
+    return m_content;
 }
 
 // 格式化写入日志内容
@@ -66,12 +144,20 @@ void LogEvent::format(const char* fmt, ...) {
     va_list vl;
     va_start(vl, fmt);    //将vl初始化为指向可变参数列表第一个参数
 
-    char* buf;
-    //vsnprintf(buf, sizeof(fmt)+1, fmt, vl)   函数重载
-    if(vasprintf(&buf, fmt, vl) != -1) {
-        m_ss << std::string(buf);    // char*转为string
-        free(buf);
+    //先写到栈上的缓冲区,放不下时再按实际长度写一次
+    char buf[512];
+    va_list vl2;
+    va_copy(vl2, vl);
+    int len = vsnprintf(buf, sizeof(buf), fmt, vl);
+    if(len >= (int)sizeof(buf)) {
+        size_t old = m_content.size();
+        m_content.resize(old + len + 1);
+        vsnprintf(&m_content[old], len + 1, fmt, vl2);
+        m_content.resize(old + len);
+    } else if(len > 0) {
+        m_content.append(buf, len);
     }
+    va_end(vl2);
 
     va_end(vl);
 }
@@ -82,7 +168,7 @@ LogEventWrap::~LogEventWrap() {
     m_event->getLogger()->log(m_event->getLevel(), m_event);
 }
 
-std::stringstream& LogEventWrap::getSS() {
+std::ostream& LogEventWrap::getSS() {
     return m_event->getSS();
 }
 
@@ -93,20 +179,54 @@ LogFormatter::LogFormatter(const std::string& pattern)
     init();
 }
 
-//返回字符串类型日志文本
-std::string LogFormatter::format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) {
-    std::stringstream ss;
-    for(auto& i : m_items) {
-        i->format(ss, logger, level, event);
+//当前线程格式化日志用的缓冲区,预留4KB,超长日志后超过64KB的部分释放
+static std::string& GetThreadBuffer() {
+    static thread_local std::string t_buf;
+    if(t_buf.capacity() > 64 * 1024) {
+        std::string().swap(t_buf);
     }
-    return ss.str();
+    if(t_buf.capacity() < 4096) {
+        t_buf.reserve(4096);
+    }
+    t_buf.clear();
+    return t_buf;
+}
+
+//返回字符串类型日志文本
+std::string LogFormatter::format(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) {
+    std::string buf;
+    format(buf, logger, level, event);
+    return buf;
 }
 //返回输出流类型日志文本
-std::ostream& LogFormatter::format(std::ostream& ofs, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) {
+std::ostream& LogFormatter::format(std::ostream& ofs, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) {
+    std::string& buf = GetThreadBuffer();
+    format(buf, logger, level, event);
+    return ofs.write(buf.data(), buf.size());
+}
+//日志文本追加到buf
+void LogFormatter::format(std::string& buf, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) {
     for(auto& i : m_items) {
-        i->format(ofs, logger, level, event);
+        i->format(buf, logger, level, event);
+    }
+}
+
+//整数转成十进制追加到buf,不经过流
+template<class T>
+static void AppendInt(std::string& buf, T v) {
+    char tmp[24];
+    char* end = tmp + sizeof(tmp);
+    char* p = end;
+    bool neg = v < 0;
+    uint64_t u = neg ? 0 - (uint64_t)v : (uint64_t)v;
+    do {
+        *--p = '0' + u % 10;
+        u /= 10;
+    } while(u);
+    if(neg) {
+        *--p = '-';
     }
-    return ofs;
+    buf.append(p, end - p);
 }
 
 
@@ -115,8 +235,8 @@ std::ostream& LogFormatter::format(std::ostream& ofs, std::shared_ptr<Logger> lo
 class MessageFormatItem : public LogFormatter::FormatItem {
 public:
     MessageFormatItem(const std::string& str = "") {}
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        os << event->getContent();       // 对应 std::stringstream m_ss;    //日志内容流
+    void format(std::string& buf, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override {
+        buf.append(event->getContent());       // 对应 std::stringstream m_ss;    //日志内容流
     }
 };
 
@@ -124,8 +244,8 @@ public:
 class LevelFormatItem : public LogFormatter::FormatItem {
 public:
     LevelFormatItem(const std::string& str = "") {}
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        os << LogLevel::ToString(level);
+    void format(std::string& buf, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override {
+        buf.append(LogLevel::ToString(level));
     }
 };
 
@@ -133,8 +253,8 @@ public:
 class ElapseFormatItem : public LogFormatter::FormatItem {
 public:
     ElapseFormatItem(const std::string& str = "") {}
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        os << event->getElapse();
+    void format(std::string& buf, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override {
+        AppendInt(buf, event->getElapse());
     }
 };
 
@@ -142,9 +262,9 @@ public:
 class LoggerNameFormatItem : public LogFormatter::FormatItem {
 public:
     LoggerNameFormatItem(const std::string& str = "") {}
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        //os << logger->getName();
-        os << event->getLogger()->getName();
+    void format(std::string& buf, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override {
+        //buf.append(logger->getName());
+        buf.append(event->getLogger()->getName());
     }
 };
 
@@ -152,8 +272,8 @@ public:
 class ThreadIdFormatItem : public LogFormatter::FormatItem {
 public:
     ThreadIdFormatItem(const std::string& str = "") {}
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        os << event->getThreadId();
+    void format(std::string& buf, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override {
+        AppendInt(buf, event->getThreadId());
     }
 };
 
@@ -161,8 +281,8 @@ public:
 class FiberIdFormatItem : public LogFormatter::FormatItem {
 public:
     FiberIdFormatItem(const std::string& str = "") {}
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        os << event->getFiberId();
+    void format(std::string& buf, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override {
+        AppendInt(buf, event->getFiberId());
     }
 };
 
@@ -170,8 +290,8 @@ public:
 class ThreadNameFormatItem : public LogFormatter::FormatItem {
 public:
     ThreadNameFormatItem(const std::string& str = "") {}
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        os << event->getThreadName();
+    void format(std::string& buf, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override {
+        buf.append(event->getThreadName());
     }
 };
 
@@ -179,8 +299,8 @@ public:
 class FileNameFormatItem : public LogFormatter::FormatItem {
 public:
     FileNameFormatItem(const std::string& str = "") {}
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        os << event->getFile();
+    void format(std::string& buf, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override {
+        buf.append(event->getFile() ? event->getFile() : "");
     }
 };
 
@@ -188,8 +308,8 @@ public:
 class LineFormatItem : public LogFormatter::FormatItem {
 public:
     LineFormatItem(const std::string& str = "") {}
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        os << event->getLine();
+    void format(std::string& buf, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override {
+        AppendInt(buf, event->getLine());
     }
 };
 
@@ -197,8 +317,8 @@ public:
 class NewLineFormatItem : public LogFormatter::FormatItem {
 public:
     NewLineFormatItem(const std::string& str = "") {}
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        os << std::endl;
+    void format(std::string& buf, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override {
+        buf.push_back('\n');
     }
 };
 
@@ -206,8 +326,8 @@ public:
 class TabFormatItem : public LogFormatter::FormatItem {
 public:
     TabFormatItem(const std::string& str = "") {}
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        os << "\t";
+    void format(std::string& buf, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override {
+        buf.push_back('\t');
     }
 };
 
@@ -215,8 +335,8 @@ public:
 class StringFormatItem : public LogFormatter::FormatItem {
 public:
     StringFormatItem(const std::string& str) :m_string(str) {}
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        os << m_string;
+    void format(std::string& buf, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override {
+        buf.append(m_string);
     }
 private:
     std::string m_string;
@@ -226,23 +346,55 @@ private:
 class DateTimeFormatItem : public LogFormatter::FormatItem {
 public:
     DateTimeFormatItem(const std::string& format = "%Y-%m-%d %H:%M:%S") 
-        :m_format(format) {
+        :m_format(format),
+        m_id(++s_id) {
         if(format.empty()) {
             m_format = "%Y-%m-%d %H:%M:%S";
         }
     }
-    void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        struct tm tm;
+    //时间戳只精确到秒,每个线程缓存最近格式化过的几个(格式, 秒),同一秒内不再调用localtime_r和strftime
+    void format(std::string& buf, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override {
+        struct Cache {
+            uint64_t id = 0;
+            time_t time = 0;
+            size_t len = 0;
+            char str[64];
+        };
+        static thread_local Cache t_cache[4];
+        static thread_local size_t t_next = 0;
+
         time_t time = event->getTime();
+        for(auto& i : t_cache) {
+            if(i.id == m_id && i.time == time) {
+                buf.append(i.str, i.len);
+                return;
+            }
+        }
+        Cache* cache = nullptr;
+        for(auto& i : t_cache) {
+            if(i.id == m_id) {
+                cache = &i;
+                break;
+            }
+        }
+        if(!cache) {
+            cache = &t_cache[t_next++ % 4];
+        }
+        struct tm tm;
         localtime_r(&time, &tm);
-        char str[64];
-        strftime(str, sizeof(str), m_format.c_str(), &tm);
-        os << str;
+        cache->id = m_id;
+        cache->time = time;
+        cache->len = strftime(cache->str, sizeof(cache->str), m_format.c_str(), &tm);
+        buf.append(cache->str, cache->len);
     }
 private:
     std::string m_format;
+    uint64_t m_id;    //区分不同的格式项,用作线程缓存的key
+    static std::atomic<uint64_t> s_id;
 };
 
+std::atomic<uint64_t> DateTimeFormatItem::s_id = {0};
+
 
 // 把 m_pattern 中 % 后的字符都分离出来
 // m_pattern 为 %d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n
@@ -399,26 +551,36 @@ LogLevel::Level LogAppender::getLevel() const {
 
 /******************* Logger 类函数实现 *******************/
 //构造函数
+static std::atomic<uint32_t> s_logger_id = {0};
+
 Logger::Logger(const std::string& name) 
     :m_name(name),
-    m_level(LogLevel::DEBUG) {
+    m_id(++s_logger_id),
+    m_level(LogLevel::DEBUG),
+    m_appenders(std::make_shared<AppenderList>()) {
     m_formatter = std::make_shared<LogFormatter>("%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n");
 }
 
 //写日志：level 日志级别，event 日志事件
+//锁内只取日志目标集合的快照,格式化和写入在锁外进行,不同线程写日志不会互相等待
 void Logger::log(LogLevel::Level level, LogEvent::ptr event) {
-    MutexType::Lock lock(m_mutex);
-    if(level >= m_level) {
-        auto self = shared_from_this();
-        if(!m_appenders.empty()) {
-            for(auto& i : m_appenders) {
-                i->log(self, level, event);
-            }
+    std::shared_ptr<const AppenderList> appenders;
+    {
+        MutexType::Lock lock(m_mutex);
+        if(level < m_level) {
+            return;
         }
-        else if(m_root) { 
-            m_root->log(level, event);
+        appenders = m_appenders;
+    }
+    if(!appenders->empty()) {
+        auto self = shared_from_this();
+        for(auto& i : *appenders) {
+            i->log(self, level, event);
         }
     }
+    else if(m_root) { 
+        m_root->log(level, event);
+    }
 }
 
 //写debug级别日志
@@ -457,24 +619,28 @@ void Logger::addApender(LogAppender::ptr appender) {
         appender->m_formatter = m_formatter;  //友元，相当于appender->setFormatter(m_formatter);
         appender->setHasFormatter(false);    //appender没有自己的formatter，要用logger的formatter
     }
-    m_appenders.push_back(appender);
+    auto appenders = std::make_shared<AppenderList>(*m_appenders);
+    appenders->push_back(appender);
+    m_appenders = appenders;
 }
 
 //删除日志目标
 void Logger::delAppender(LogAppender::ptr appender) {
     MutexType::Lock lock(m_mutex);
-    for(auto it = m_appenders.begin(); it != m_appenders.end(); ++it) {
+    auto appenders = std::make_shared<AppenderList>(*m_appenders);
+    for(auto it = appenders->begin(); it != appenders->end(); ++it) {
         if(*it == appender) {
-            m_appenders.erase(it);
+            appenders->erase(it);
             break;
         }
     }
+    m_appenders = appenders;
 }
 
 //清空日志目标
 void Logger::clearAppenders() {
     MutexType::Lock lock(m_mutex);
-    m_appenders.clear();
+    m_appenders = std::make_shared<AppenderList>();
 }
 
 //返回日志级别
@@ -493,7 +659,7 @@ void Logger::setLevel(LogLevel::Level level) {
 void Logger::setFormatter(const LogFormatter::ptr& val) {
     MutexType::Lock lock(m_mutex); 
     m_formatter = val;
-    for(auto& i : m_appenders) {
+    for(auto& i : *m_appenders) {
         //LogAppender::MutexType::Lock ll(i->m_mutex); 
         if(!i->getHasFormatter()) {
             i->setFormatter(m_formatter);  //setFormatter内已上锁,上面不能再加锁,避免死锁
@@ -530,7 +696,7 @@ std::string Logger::toYamlString() {
     if(m_formatter) {
         node["formatter"] = m_formatter->getPattern();
     }
-    for(const auto& i: m_appenders) {
+    for(const auto& i: *m_appenders) {
         node["appenders"].push_back(YAML::Load(i->toYamlString()));
     }
     std::stringstream ss;
@@ -582,10 +748,14 @@ void LoggerManager::init() {
 
 /******************* StdoutLogAppender 类函数实现 *******************/
 //输出到控制台的Appender
+//锁外格式化到线程局部缓冲区,锁内只写一次;每条日志都flush,和原来%n输出std::endl的行为一致
 void StdoutLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) {
-    MutexType::Lock lock(m_mutex);
     if(level >= m_level) {
-        m_formatter->format(std::cout, logger, level, event);
+        std::string& buf = GetThreadBuffer();
+        getFormatter()->format(buf, logger, level, event);
+        MutexType::Lock lock(m_mutex);
+        std::cout.write(buf.data(), buf.size());
+        std::cout.flush();
     }
 }
 
@@ -606,25 +776,333 @@ std::string StdoutLogAppender::toYamlString() {
 }
 
 /******************* FileLogAppender 类函数实现 *******************/
+//后台压缩和清理切分出来的日志文件,所有FileLogAppender共用一个线程
+class LogFileCleaner {
+public:
+    struct Task {
+        std::string file;    //切分出来的文件
+        std::string base;    //日志文件路径
+        uint32_t maxFiles;    //保留的切分文件个数
+        bool compress;    //是否压缩
+    };
+
+    //进程退出时后台线程可能还在运行,不析构
+    static LogFileCleaner* GetInstance() {
+        static LogFileCleaner* s_instance = new LogFileCleaner;
+        return s_instance;
+    }
+
+    void add(const Task& task) {
+        {
+            Mutex::Lock lock(m_mutex);
+            m_tasks.push_back(task);
+            if(!m_thread) {
+                m_thread = std::make_shared<Thread>(std::bind(&LogFileCleaner::run, this), "log_compress");
+            }
+        }
+        m_sem.notify();
+    }
+
+private:
+    void run() {
+        while(true) {
+            m_sem.wait();
+            Task task;
+            {
+                Mutex::Lock lock(m_mutex);
+                task = m_tasks.front();
+                m_tasks.pop_front();
+            }
+            if(task.compress) {
+                Compress(task.file);
+            }
+            if(task.maxFiles) {
+                Cleanup(task.base, task.maxFiles);
+            }
+        }
+    }
+
+    //压缩成file.gz后删除原文件,先写临时文件,完成后再rename
+    static void Compress(const std::string& file) {
+        std::string tmp = file + ".gz.tmp";
+        FILE* in = fopen(file.c_str(), "rb");
+        if(!in) {
+            return;
+        }
+        gzFile out = gzopen(tmp.c_str(), "wb6");
+        if(!out) {
+            fclose(in);
+            return;
+        }
+        char buf[64 * 1024];
+        bool ok = true;
+        size_t n = 0;
+        while((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+            if(gzwrite(out, buf, n) != (int)n) {
+                ok = false;
+                break;
+            }
+        }
+        ok = !ferror(in) && ok;
+        fclose(in);
+        ok = gzclose(out) == Z_OK && ok;
+        if(ok && rename(tmp.c_str(), (file + ".gz").c_str()) == 0) {
+            unlink(file.c_str());
+        } else {
+            std::cout << "LogFileCleaner compress " << file << " failed" << std::endl;
+            unlink(tmp.c_str());
+        }
+    }
+
+    //删除最旧的切分文件,只保留max_files个(文件名: base.时间戳[.序号][.gz])
+    //按(时间戳, 序号)排序,同一秒内切分的文件按序号区分先后
+    static void Cleanup(const std::string& base, uint32_t max_files) {
+        std::string dir = FilesUtil::Dirname(base);
+        std::string prefix = FilesUtil::Basename(base) + ".";
+        DIR* d = opendir(dir.c_str());
+        if(!d) {
+            return;
+        }
+        std::vector<std::tuple<std::string, long, std::string> > files;
+        struct dirent* dp = nullptr;
+        while((dp = readdir(d)) != nullptr) {
+            std::string name = dp->d_name;
+            if(name.compare(0, prefix.size(), prefix) != 0) {
+                continue;
+            }
+            //时间戳 YYYYmmdd-HHMMSS
+            std::string rest = name.substr(prefix.size());
+            if(rest.size() < 15 || rest[8] != '-'
+                    || !std::all_of(rest.begin(), rest.begin() + 8, ::isdigit)
+                    || !std::all_of(rest.begin() + 9, rest.begin() + 15, ::isdigit)) {
+                continue;
+            }
+            std::string stamp = rest.substr(0, 15);
+            rest = rest.substr(15);
+            if(rest.size() >= 3 && rest.compare(rest.size() - 3, 3, ".gz") == 0) {
+                rest.resize(rest.size() - 3);
+            }
+            long seq = 0;
+            if(!rest.empty()) {
+                if(rest[0] != '.' || rest.size() == 1
+                        || !std::all_of(rest.begin() + 1, rest.end(), ::isdigit)) {
+                    continue;
+                }
+                seq = atol(rest.c_str() + 1);
+            }
+            files.push_back(std::make_tuple(stamp, seq, dir + "/" + name));
+        }
+        closedir(d);
+        if(files.size() <= max_files) {
+            return;
+        }
+        std::sort(files.begin(), files.end());
+        for(size_t i = 0; i < files.size() - max_files; ++i) {
+            unlink(std::get<2>(files[i]).c_str());
+        }
+    }
+
+private:
+    Mutex m_mutex;
+    std::deque<Task> m_tasks;
+    Semaphore m_sem;
+    Thread::ptr m_thread;
+};
+
+const char* FileLogAppender::RotateTimeToString(RotateTime v) {
+    switch(v) {
+        case ROTATE_HOURLY:
+            return "hourly";
+        case ROTATE_DAILY:
+            return "daily";
+        default:
+            return "none";
+    }
+}
+
+FileLogAppender::RotateTime FileLogAppender::RotateTimeFromString(const std::string& str) {
+    if(str == "hourly" || str == "hour") {
+        return ROTATE_HOURLY;
+    }
+    if(str == "daily" || str == "day") {
+        return ROTATE_DAILY;
+    }
+    return ROTATE_NONE;
+}
+
+uint64_t FileLogAppender::NextRotateTime(uint64_t now, RotateTime rotate_time) {
+    if(rotate_time == ROTATE_NONE) {
+        return 0;
+    }
+    time_t t = now;
+    struct tm tm;
+    localtime_r(&t, &tm);
+    tm.tm_min = 0;
+    tm.tm_sec = 0;
+    if(rotate_time == ROTATE_HOURLY) {
+        tm.tm_hour += 1;
+    } else {
+        tm.tm_hour = 0;
+        tm.tm_mday += 1;
+    }
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+//异步模式下最多有多少块写满的缓冲区等待写入文件
+static const size_t s_max_pending_buffers = 4;
+
 //输出到文件的Appender
-FileLogAppender::FileLogAppender(const std::string& filename) 
-    :m_filename(filename) {
+FileLogAppender::FileLogAppender(const std::string& filename, bool async
+                    , uint32_t buffer_size, uint32_t flush_interval, bool drop_when_full) 
+    :m_filename(filename),
+    m_async(async),
+    m_bufferSize(std::max(buffer_size, (uint32_t)4096)),
+    m_flushInterval(std::max(flush_interval, (uint32_t)1)),
+    m_dropWhenFull(drop_when_full) {
     reopen();
+    if(m_async) {
+        m_current.reserve(m_bufferSize);
+        m_thread = std::make_shared<Thread>(std::bind(&FileLogAppender::flushThread, this), "log_flush");
+    }
+}
+
+FileLogAppender::~FileLogAppender() {
+    if(m_thread) {
+        {
+            std::lock_guard<std::mutex> lock(m_asyncMutex);
+            m_stopping = true;
+        }
+        m_flushCond.notify_one();
+        m_thread->join();
+    }
 }
 
 void FileLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) {
     if(level >= m_level) {
-        //周期性地重新打开文件,防止在另一个终端文件被删除,可以及时重新打开,但之前的日志还是被删除了
-        uint64_t nowTime = event->getTime();
-        if(nowTime >= (m_lastTime + 3)) {    //超过一定时间
-            reopen();
-            m_lastTime = nowTime;
+        if(m_async) {
+            //在调用线程中格式化,锁内只做一次内存拷贝
+            std::string& buf = GetThreadBuffer();
+            getFormatter()->format(buf, logger, level, event);
+            append(buf);
+            return;
         }
 
+        uint64_t now = event->getTime();
+        checkFile(now);
+
+        std::string& buf = GetThreadBuffer();
+        getFormatter()->format(buf, logger, level, event);
         MutexType::Lock lock(m_mutex);
-        if(!m_formatter->format(m_filestream, logger, level, event)) {
+        rotateIfNeeded(now, buf.size());
+        if(!m_filestream.write(buf.data(), buf.size()).flush()) {
             std::cout << "error" << std::endl;
         }
+        m_fileSize += buf.size();
+    }
+}
+
+void FileLogAppender::append(const std::string& msg) {
+    std::unique_lock<std::mutex> lock(m_asyncMutex);
+    if(m_current.size() + msg.size() > m_bufferSize && !m_current.empty()) {
+        if(m_pending.size() >= s_max_pending_buffers) {
+            if(m_dropWhenFull) {
+                ++m_dropped;
+                ++m_droppedTotal;
+                return;
+            }
+            m_doneCond.wait(lock, [this]() {
+                return m_pending.size() < s_max_pending_buffers || m_stopping;
+            });
+        }
+        rotateBuffer();
+        m_flushCond.notify_one();
+    }
+    m_current.append(msg);
+}
+
+void FileLogAppender::rotateBuffer() {
+    m_pending.push_back(std::move(m_current));
+    if(!m_spares.empty()) {
+        m_current = std::move(m_spares.back());
+        m_spares.pop_back();
+    } else {
+        m_current = std::string();
+        m_current.reserve(m_bufferSize);
+    }
+}
+
+void FileLogAppender::flush() {
+    if(!m_async) {
+        MutexType::Lock lock(m_mutex);
+        m_filestream.flush();
+        return;
+    }
+    std::unique_lock<std::mutex> lock(m_asyncMutex);
+    if(!m_current.empty()) {
+        rotateBuffer();
+    }
+    m_flushCond.notify_one();
+    m_doneCond.wait(lock, [this]() {
+        return (m_pending.empty() && !m_writing) || m_stopping;
+    });
+}
+
+void FileLogAppender::flushThread() {
+    std::vector<std::string> buffers;
+    uint64_t dropped = 0;
+    bool stopping = false;
+    while(!stopping) {
+        {
+            std::unique_lock<std::mutex> lock(m_asyncMutex);
+            if(m_pending.empty() && !m_stopping) {
+                m_flushCond.wait_for(lock, std::chrono::milliseconds(m_flushInterval));
+            }
+            if(!m_current.empty()) {
+                rotateBuffer();
+            }
+            buffers.swap(m_pending);
+            dropped = m_dropped;
+            m_dropped = 0;
+            stopping = m_stopping;
+            m_writing = !buffers.empty() || dropped;
+            //待写队列已经清空,阻塞的调用线程可以继续写
+            m_doneCond.notify_all();
+        }
+        if(!m_writing) {
+            continue;
+        }
+
+        //检查文件和切分文件都在后台线程中进行
+        uint64_t now = time(0);
+        checkFile(now);
+        {
+            MutexType::Lock lock(m_mutex);
+            for(auto& i : buffers) {
+                rotateIfNeeded(now, i.size());
+                m_filestream.write(i.data(), i.size());
+                m_fileSize += i.size();
+            }
+            if(dropped) {
+                std::string msg = "FileLogAppender: buffer full, " + std::to_string(dropped)
+                                  + " logs dropped\n";
+                m_filestream.write(msg.data(), msg.size());
+                m_fileSize += msg.size();
+            }
+            m_filestream.flush();
+        }
+
+        std::lock_guard<std::mutex> lock(m_asyncMutex);
+        for(auto& i : buffers) {
+            //只保留两块空缓冲区,突发写入分配的多余缓冲区直接释放
+            if(m_spares.size() < 2) {
+                i.clear();
+                m_spares.push_back(std::move(i));
+            }
+        }
+        buffers.clear();
+        m_writing = false;
+        m_doneCond.notify_all();
     }
 }
 
@@ -634,6 +1112,24 @@ std::string FileLogAppender::toYamlString() {
     YAML::Node node;
     node["type"] = "FileLogAppender";
     node["file"] = m_filename;
+    if(m_async) {
+        node["async"] = true;
+        node["buffer_size"] = m_bufferSize;
+        node["flush_interval"] = m_flushInterval;
+        node["full_policy"] = m_dropWhenFull ? "drop" : "block";
+    }
+    if(m_maxSize) {
+        node["max_size"] = m_maxSize;
+    }
+    if(m_rotateTime != ROTATE_NONE) {
+        node["rotate_time"] = RotateTimeToString(m_rotateTime);
+    }
+    if(m_maxFiles) {
+        node["max_files"] = m_maxFiles;
+    }
+    if(m_compress) {
+        node["compress"] = true;
+    }
     if(m_level != LogLevel::UNKOWN) {
         node["level"] = LogLevel::ToString(m_level);
     }
@@ -648,26 +1144,130 @@ std::string FileLogAppender::toYamlString() {
 //重新打开日志文件,成功返回true
 bool FileLogAppender::reopen() {
     MutexType::Lock lock(m_mutex);
-    if(m_filestream) {
+    if(m_filestream.is_open()) {
         m_filestream.close();
     }
+    return openFile();
+}
+
+bool FileLogAppender::openFile() {
+    m_filestream.clear();
     m_filestream.open(m_filename, std::ios::app); //追加方式:在文件末尾添加新内容
+    struct stat st;
+    if(stat(m_filename.c_str(), &st) == 0) {
+        m_fileSize = st.st_size;
+        m_inode = st.st_ino;
+    } else {
+        m_fileSize = 0;
+        m_inode = 0;
+    }
+    m_openTime = time(0);
+    m_nextRotate = NextRotateTime(m_openTime, m_rotateTime);
     return !! m_filestream;
 }
 
+//原来每3秒无条件close+open一次;现在只stat一次,文件被删除或移走(inode变了)时才重新打开
+void FileLogAppender::checkFile(uint64_t now) {
+    if(now < m_lastTime + 3) {
+        return;
+    }
+    m_lastTime = now;
+    struct stat st;
+    bool exists = stat(m_filename.c_str(), &st) == 0;
+    MutexType::Lock lock(m_mutex);
+    if(!exists || (uint64_t)st.st_ino != m_inode) {
+        if(m_filestream.is_open()) {
+            m_filestream.close();
+        }
+        openFile();
+    } else if((uint64_t)st.st_size < m_fileSize) {
+        //被外部截断(copytruncate)
+        m_fileSize = st.st_size;
+    }
+}
+
+//切分: 当前文件改名为 文件名.打开时间[.序号],重新打开新文件,压缩和清理交给后台线程
+void FileLogAppender::rotateIfNeeded(uint64_t now, size_t len) {
+    bool by_time = m_nextRotate && now >= m_nextRotate;
+    bool by_size = m_maxSize && m_fileSize && m_fileSize + len > m_maxSize;
+    if(!by_time && !by_size) {
+        return;
+    }
+    time_t open_time = m_openTime;
+    struct tm tm;
+    localtime_r(&open_time, &tm);
+    char str[32];
+    strftime(str, sizeof(str), "%Y%m%d-%H%M%S", &tm);
+    //同一秒内多次切分时加递增的序号;旧文件可能已被清理,序号不能复用,否则新文件会被当作最旧的删除
+    if(m_rotateStamp != str) {
+        m_rotateStamp = str;
+        m_rotateSeq = 0;
+    }
+    std::string name;
+    do {
+        name = m_filename + "." + str;
+        if(m_rotateSeq) {
+            name += "." + std::to_string(m_rotateSeq);
+        }
+        ++m_rotateSeq;
+    } while(access(name.c_str(), F_OK) == 0 || access((name + ".gz").c_str(), F_OK) == 0);
+
+    m_filestream.close();
+    if(rename(m_filename.c_str(), name.c_str()) != 0) {
+        std::cout << "FileLogAppender rotate " << m_filename << " to " << name
+                  << " failed, errno=" << errno << std::endl;
+    }
+    openFile();
+    if(m_compress || m_maxFiles) {
+        LogFileCleaner::GetInstance()->add({name, m_filename, m_maxFiles, m_compress});
+    }
+}
+
+void FileLogAppender::setRotate(uint64_t max_size, RotateTime rotate_time, uint32_t max_files, bool compress) {
+    MutexType::Lock lock(m_mutex);
+    m_maxSize = max_size;
+    m_rotateTime = rotate_time;
+    m_maxFiles = max_files;
+    m_compress = compress;
+    m_nextRotate = NextRotateTime(time(0), m_rotateTime);
+}
+
+uint64_t FileLogAppender::getFileSize() const {
+    MutexType::Lock lock(m_mutex);
+    return m_fileSize;
+}
+
 
 /******************* 用 YAML 来配置 Logger *******************/
 struct LogAppenderDefine {
-    int type = 0;    //1:File  2:Stdout  3:Logserver
+    int type = 0;    //1:File  2:Stdout  3:Binary
     LogLevel::Level level = LogLevel::UNKOWN;
     std::string formatter;
     std::string file;
+    bool async = false;    //FileLogAppender是否异步写入
+    uint32_t buffer_size = 1024 * 1024;    //异步缓冲区大小
+    uint32_t flush_interval = 1000;    //异步刷新间隔(毫秒)
+    bool drop_when_full = false;    //异步缓冲区满时丢弃(drop)还是阻塞(block)
+    uint64_t max_size = 0;    //按大小切分
+    int rotate_time = 0;    //按时间切分(FileLogAppender::RotateTime)
+    uint32_t max_files = 0;    //保留的切分文件个数
+    bool compress = false;    //是否压缩切分出来的文件
+    uint64_t size = 64 * 1024 * 1024;    //BinaryLogAppender环形文件的数据区大小
 
     bool operator==(const LogAppenderDefine& lad) const {
         return (type == lad.type && 
                 level == lad.level &&
                 formatter == lad.formatter &&
-                file == lad.file);
+                file == lad.file &&
+                async == lad.async &&
+                buffer_size == lad.buffer_size &&
+                flush_interval == lad.flush_interval &&
+                drop_when_full == lad.drop_when_full &&
+                max_size == lad.max_size &&
+                rotate_time == lad.rotate_time &&
+                max_files == lad.max_files &&
+                compress == lad.compress &&
+                size == lad.size);
     }
 };
 
@@ -730,10 +1330,47 @@ public:
                         continue;
                     }
                     lad.file = n["file"].as<std::string>();
+                    if(n["async"].IsDefined()) {
+                        lad.async = n["async"].as<bool>();
+                    }
+                    if(n["buffer_size"].IsDefined()) {
+                        lad.buffer_size = n["buffer_size"].as<uint32_t>();
+                    }
+                    if(n["flush_interval"].IsDefined()) {
+                        lad.flush_interval = n["flush_interval"].as<uint32_t>();
+                    }
+                    if(n["full_policy"].IsDefined()) {
+                        lad.drop_when_full = n["full_policy"].as<std::string>() == "drop";
+                    }
+                    if(n["max_size"].IsDefined()) {
+                        lad.max_size = n["max_size"].as<uint64_t>();
+                    }
+                    if(n["rotate_time"].IsDefined()) {
+                        lad.rotate_time = FileLogAppender::RotateTimeFromString(
+                                                n["rotate_time"].as<std::string>());
+                    }
+                    if(n["max_files"].IsDefined()) {
+                        lad.max_files = n["max_files"].as<uint32_t>();
+                    }
+                    if(n["compress"].IsDefined()) {
+                        lad.compress = n["compress"].as<bool>();
+                    }
                 }
                 else if(appender_type == "StdoutLogAppender") {    //Stdout
                     lad.type = 2;
                 }
+                else if(appender_type == "BinaryLogAppender") {    //Binary
+                    lad.type = 3;
+                    if(!n["file"].IsDefined()) {
+                        std::cout << "log config error: BinaryLogAppender file is null, "
+                                << n << std::endl;
+                        continue;
+                    }
+                    lad.file = n["file"].as<std::string>();
+                    if(n["size"].IsDefined()) {
+                        lad.size = n["size"].as<uint64_t>();
+                    }
+                }
                 else {    //未定义类型
                     std::cout << "log config error: appender_type is invalid, "
                             << n << std::endl;
@@ -769,10 +1406,34 @@ public:
             if(i.type == 1) {
                 n["type"] = "FileLogAppender";
                 n["file"] = i.file;
+                if(i.async) {
+                    n["async"] = true;
+                    n["buffer_size"] = i.buffer_size;
+                    n["flush_interval"] = i.flush_interval;
+                    n["full_policy"] = i.drop_when_full ? "drop" : "block";
+                }
+                if(i.max_size) {
+                    n["max_size"] = i.max_size;
+                }
+                if(i.rotate_time) {
+                    n["rotate_time"] = FileLogAppender::RotateTimeToString(
+                                            (FileLogAppender::RotateTime)i.rotate_time);
+                }
+                if(i.max_files) {
+                    n["max_files"] = i.max_files;
+                }
+                if(i.compress) {
+                    n["compress"] = true;
+                }
             }
             else if(i.type == 2) {
                 n["type"] = "StdoutLogAppender";
             }
+            else if(i.type == 3) {
+                n["type"] = "BinaryLogAppender";
+                n["file"] = i.file;
+                n["size"] = i.size;
+            }
             if(i.level != LogLevel::UNKOWN) {
                 n["level"] = LogLevel::ToString(i.level);
             }
@@ -820,11 +1481,20 @@ struct LogIniter {
                 for(const auto& j : i.appenders) {
                     LogAppender::ptr ap;
                     if(j.type == 1) {
-                        ap = std::make_shared<FileLogAppender>(j.file);
+                        FileLogAppender::ptr fap = std::make_shared<FileLogAppender>(j.file, j.async
+                                                    , j.buffer_size, j.flush_interval, j.drop_when_full);
+                        if(j.max_size || j.rotate_time) {
+                            fap->setRotate(j.max_size, (FileLogAppender::RotateTime)j.rotate_time
+                                           , j.max_files, j.compress);
+                        }
+                        ap = fap;
                     }
                     else if(j.type == 2) {
                         ap = std::make_shared<StdoutLogAppender>();
                     }
+                    else if(j.type == 3) {
+                        ap = std::make_shared<BinaryLogAppender>(j.file, j.size);
+                    }
                     ap->setLevel(j.level);
                     if(!j.formatter.empty()) {
                         LogFormatter::ptr fmt = std::make_shared<LogFormatter>(j.formatter);
@@ -0,0 +1,281 @@
+#include "resolver.h"
+#include "config.h"
+#include "hook.h"
+#include "log.h"
+#include "scheduler.h"
+#include "util.h"
+#include <algorithm>
+#include <sstream>
+#include <string.h>
+#include <arpa/inet.h>
+
+namespace sylar {
+
+static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+// 解析线程数
+static ConfigVar<uint32_t>::ptr g_dns_threads =
+            Config::Lookup("dns.threads", (uint32_t)2, "dns resolver threads");
+
+// 成功结果的缓存时间(毫秒)，0表示不缓存
+static ConfigVar<uint64_t>::ptr g_dns_cache_ttl =
+            Config::Lookup("dns.cache_ttl", (uint64_t)60 * 1000, "dns cache ttl(ms)");
+
+// 失败结果的缓存时间(毫秒)，0表示不缓存
+static ConfigVar<uint64_t>::ptr g_dns_negative_ttl =
+            Config::Lookup("dns.negative_ttl", (uint64_t)5 * 1000, "dns negative cache ttl(ms)");
+
+// 最大缓存条目数
+static ConfigVar<uint32_t>::ptr g_dns_cache_size =
+            Config::Lookup("dns.cache_size", (uint32_t)4096, "dns cache max entries");
+
+// 是否为数字IP地址(不需要查询DNS)
+static bool IsNumericHost(const std::string& node) {
+    if(node.empty()) {
+        return true;
+    }
+    unsigned char buf[sizeof(in6_addr)];
+    return inet_pton(AF_INET, node.c_str(), buf) == 1
+        || inet_pton(AF_INET6, node.c_str(), buf) == 1;
+}
+
+std::string Resolver::Stats::toString() const {
+    std::stringstream ss;
+    ss << "[Resolver::Stats hits=" << hits
+       << " negativeHits=" << negativeHits
+       << " misses=" << misses
+       << " coalesced=" << coalesced
+       << " resolves=" << resolves
+       << " cached=" << cached
+       << "]";
+    return ss.str();
+}
+
+Resolver::Resolver() {
+}
+
+Resolver::~Resolver() {
+    std::vector<Thread::ptr> threads;
+    {
+        MutexType::Lock lock(m_mutex);
+        m_stopping = true;
+        threads.swap(m_threads);
+    }
+    for(size_t i = 0; i < threads.size(); ++i) {
+        m_sem.notify();
+    }
+    for(auto& i : threads) {
+        i->join();
+    }
+}
+
+int Resolver::resolve(std::vector<Address::ptr>& results, const std::string& node
+                      , const std::string& service, int family, int socktype, int protocol) {
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = family;
+    hints.ai_socktype = socktype;
+    hints.ai_protocol = protocol;
+
+    // 数字IP地址不会查询DNS，直接解析
+    if(IsNumericHost(node)) {
+        return doResolve(results, node, service, hints);
+    }
+
+    std::string key = node + '|' + service + '|' + std::to_string(family)
+                      + '|' + std::to_string(socktype) + '|' + std::to_string(protocol);
+    int error = 0;
+    if(lookupCache(key, results, error)) {
+        return error;
+    }
+    ++m_misses;
+
+    // 非调度线程中没有其他协程会被阻塞，同步解析
+    Scheduler* scheduler = Scheduler::GetThis();
+    if(!scheduler || !is_hook_enable()) {
+        Entry entry;
+        entry.error = doResolve(entry.addrs, node, service, hints);
+        insertCache(key, entry);
+        CopyAddrs(entry.addrs, results);
+        return entry.error;
+    }
+
+    Job::ptr job;
+    bool created = false;
+    {
+        MutexType::Lock lock(m_mutex);
+        auto it = m_pending.find(key);
+        if(it != m_pending.end()) {
+            job = it->second;
+            ++m_coalesced;
+        } else {
+            job = std::make_shared<Job>();
+            job->key = key;
+            job->node = node;
+            job->service = service;
+            job->hints = hints;
+            m_pending[key] = job;
+            m_queue.push_back(job);
+            created = true;
+        }
+        // 必须调度回本线程: 解析线程可能在本协程让出之前就完成了解析
+        job->waiters.push_back({scheduler, Fiber::GetThis(), sylar::getThreadId()});
+    }
+    if(created) {
+        startThreads();
+        m_sem.notify();
+    }
+    Fiber::YieldToHold();
+
+    CopyAddrs(job->entry.addrs, results);
+    return job->entry.error;
+}
+
+void Resolver::clear() {
+    RWMutexType::WriteLock lock(m_cacheMutex);
+    m_cache.clear();
+}
+
+Resolver::Stats Resolver::getStats() {
+    Stats stats;
+    stats.hits = m_hits;
+    stats.negativeHits = m_negativeHits;
+    stats.misses = m_misses;
+    stats.coalesced = m_coalesced;
+    stats.resolves = m_resolves;
+    RWMutexType::ReadLock lock(m_cacheMutex);
+    stats.cached = m_cache.size();
+    return stats;
+}
+
+int Resolver::doResolve(std::vector<Address::ptr>& results, const std::string& node
+                        , const std::string& service, const addrinfo& hints) {
+    ++m_resolves;
+    addrinfo* result = nullptr;
+    // node为空字符串时照常传给getaddrinfo(返回EAI_NONAME)，和原来的Address::Lookup一致
+    int rt = getaddrinfo(node.c_str(), service.empty() ? nullptr : service.c_str(), &hints, &result);
+    if(rt) {
+        return rt;
+    }
+    for(addrinfo* next = result; next != nullptr; next = next->ai_next) {
+        results.push_back(Address::Create(next->ai_addr, (socklen_t)next->ai_addrlen));
+    }
+    freeaddrinfo(result);
+    return 0;
+}
+
+bool Resolver::lookupCache(const std::string& key, std::vector<Address::ptr>& results, int& error) {
+    RWMutexType::ReadLock lock(m_cacheMutex);
+    auto it = m_cache.find(key);
+    if(it == m_cache.end() || it->second.expire <= GetCurrentMS()) {
+        return false;
+    }
+    error = it->second.error;
+    if(error) {
+        ++m_negativeHits;
+    } else {
+        ++m_hits;
+        CopyAddrs(it->second.addrs, results);
+    }
+    return true;
+}
+
+void Resolver::insertCache(const std::string& key, const Entry& entry) {
+    uint64_t ttl = entry.error ? g_dns_negative_ttl->getValue() : g_dns_cache_ttl->getValue();
+    // EAI_AGAIN(DNS服务器失败)也缓存，避免服务器不可用时反复查询；本地错误不缓存
+    if(!ttl || entry.error == EAI_SYSTEM || entry.error == EAI_MEMORY) {
+        return;
+    }
+    uint64_t now = GetCurrentMS();
+    size_t max_size = g_dns_cache_size->getValue();
+
+    RWMutexType::WriteLock lock(m_cacheMutex);
+    if(m_cache.size() >= max_size) {
+        for(auto it = m_cache.begin(); it != m_cache.end();) {
+            if(it->second.expire <= now) {
+                it = m_cache.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        // 过期的清理完仍然满了，按过期时间淘汰最早写入的条目，一次腾出1/8的空间，
+        // 避免整体清空后大量请求同时重新解析，也避免每次写入都扫描一遍
+        if(m_cache.size() >= max_size) {
+            size_t keep = max_size ? max_size - 1 - max_size / 8 : 0;
+            std::vector<std::unordered_map<std::string, Entry>::iterator> its;
+            its.reserve(m_cache.size());
+            for(auto it = m_cache.begin(); it != m_cache.end(); ++it) {
+                its.push_back(it);
+            }
+            size_t evict = its.size() - keep;
+            std::nth_element(its.begin(), its.begin() + evict - 1, its.end()
+                    , [](const std::unordered_map<std::string, Entry>::iterator& a
+                         , const std::unordered_map<std::string, Entry>::iterator& b) {
+                return a->second.expire < b->second.expire;
+            });
+            for(size_t i = 0; i < evict; ++i) {
+                m_cache.erase(its[i]);
+            }
+        }
+    }
+    Entry& e = m_cache[key];
+    e = entry;
+    e.expire = now + ttl;
+}
+
+void Resolver::CopyAddrs(const std::vector<Address::ptr>& from, std::vector<Address::ptr>& to) {
+    for(auto& i : from) {
+        to.push_back(Address::Create(i->getAddr(), i->getAddrlen()));
+    }
+}
+
+void Resolver::startThreads() {
+    MutexType::Lock lock(m_mutex);
+    if(!m_threads.empty() || m_stopping) {
+        return;
+    }
+    uint32_t count = std::max(g_dns_threads->getValue(), (uint32_t)1);
+    for(uint32_t i = 0; i < count; ++i) {
+        m_threads.push_back(std::make_shared<Thread>(std::bind(&Resolver::run, this)
+                                , "dns_" + std::to_string(i)));
+    }
+}
+
+void Resolver::run() {
+    while(true) {
+        m_sem.wait();
+        Job::ptr job;
+        {
+            MutexType::Lock lock(m_mutex);
+            if(m_stopping) {
+                return;
+            }
+            if(m_queue.empty()) {
+                continue;
+            }
+            job = m_queue.front();
+            m_queue.pop_front();
+        }
+
+        job->entry.error = doResolve(job->entry.addrs, job->node, job->service, job->hints);
+        if(job->entry.error) {
+            SYLAR_LOG_DEBUG(g_logger) << "Resolver getaddrinfo(" << job->node << ", "
+                                      << job->service << ") rt=" << job->entry.error
+                                      << " " << gai_strerror(job->entry.error);
+        }
+        // 先写缓存再移出m_pending，之后的请求直接命中缓存
+        insertCache(job->key, job->entry);
+
+        std::vector<Waiter> waiters;
+        {
+            MutexType::Lock lock(m_mutex);
+            m_pending.erase(job->key);
+            waiters.swap(job->waiters);
+        }
+        for(auto& i : waiters) {
+            i.scheduler->scheduler(i.fiber, i.thread);
+        }
+    }
+}
+
+}
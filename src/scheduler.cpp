@@ -2,6 +2,7 @@
 #include "log.h"
 #include "macro.h"
 #include "hook.h"
+#include "config.h"
 
 
 namespace sylar {
@@ -15,10 +16,25 @@ static thread_local Scheduler* t_scheduler = nullptr;    //当前协程调度器
 //加上Fiber模块的t_fiber和t_thread_fiber，每个线程总共可以记录三个协程的上下文信息
 static thread_local Fiber* t_scheduler_fiber = nullptr;  //当前线程的调度协程
 
+//工作窃取模式下当前线程的本地任务队列
+static thread_local void* t_local_queue = nullptr;
+
+//是否使用工作窃取调度模式(每个线程一个本地队列,空闲线程从其他线程窃取任务)
+static ConfigVar<bool>::ptr g_scheduler_work_stealing = 
+    Config::Lookup("scheduler.work_stealing", false, "scheduler work stealing mode");
+
 
 Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name) 
     :m_name(name) {
     SYLAR_ASSERT(threads > 0);
+    m_workStealing = g_scheduler_work_stealing->getValue();
+    if(m_workStealing) {
+        m_localQueues.resize(threads);
+        for(size_t i = 0; i < m_localQueues.size(); ++i) {
+            m_localQueues[i] = new LocalQueue;
+            m_localQueues[i]->index = i;
+        }
+    }
 
     if(use_caller) {    //把创建协程调度器的线程放到协程调度器管理的线程池中
         --threads;
@@ -33,6 +49,9 @@ Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name)
 
         m_rootThread = getThreadId();
         m_threadIds.push_back(m_rootThread);
+        if(m_workStealing) {
+            m_localQueues[0]->threadId = m_rootThread;
+        }
     }
     else {
         m_rootThread = -1;
@@ -46,6 +65,16 @@ Scheduler::~Scheduler() {
     if(GetThis() == this) {
         SetThis(nullptr);
     }
+    for(auto& i : m_localQueues) {
+        FiberAndThread* ft = nullptr;
+        while(i->tasks.pop(ft)) {
+            delete ft;
+        }
+        for(auto& j : i->inbox) {
+            delete j;
+        }
+        delete i;
+    }
 }
 
 //设置当前的协程调度器
@@ -80,6 +109,9 @@ void Scheduler::start() {
         m_threads[i].reset(new Thread(std::bind(&Scheduler::run, this), 
                                     m_name + "_" + std::to_string(i)));
         m_threadIds.push_back(m_threads[i]->getId());
+        if(m_workStealing) {
+            m_localQueues[m_threadIds.size() - 1]->threadId = m_threads[i]->getId();
+        }
     }
 }
 
@@ -123,6 +155,12 @@ void Scheduler::stop() {
     }
 }
 
+//返回所有调度线程的id(use_caller时包含caller线程)
+std::vector<int> Scheduler::getThreadIds() {
+    MutexType::Lock lock(m_mutex);
+    return std::vector<int>(m_threadIds.begin(), m_threadIds.end());
+}
+
 // 流式输出
 std::ostream& Scheduler::dump(std::ostream& os) {
     os << "[Scheduler name=" << m_name
@@ -130,6 +168,9 @@ std::ostream& Scheduler::dump(std::ostream& os) {
        << " active_count=" << m_activeThreadCount
        << " idle_count=" << m_idleThreadCount
        << " stopping=" << m_stopping
+       << " work_stealing=" << m_workStealing
+       << " tickle_issued=" << m_tickleIssued
+       << " tickle_suppressed=" << m_tickleSuppressed
        << " ]" << std::endl << "    ";
     for(size_t i = 0; i < m_threadIds.size(); ++i) {
         if(i) {
@@ -155,6 +196,14 @@ void Scheduler::run() {
     if(getThreadId() != m_rootThread) {
         t_scheduler_fiber = Fiber::GetThis().get();  //创建主协程和调度协程(两者一样)
     }
+    if(m_workStealing) {
+        {
+            //start()持有m_mutex期间写入各线程队列的归属，等待start()完成
+            MutexType::Lock lock(m_mutex);
+        }
+        t_local_queue = getLocalQueue(getThreadId());
+        SYLAR_ASSERT(t_local_queue);
+    }
 
     // bind(&Scheduler::idle, this) 等价于 this->idle()
     Fiber::ptr idle_fiber(new Fiber(std::bind(&Scheduler::idle, this)));  //创建idle协程
@@ -163,7 +212,10 @@ void Scheduler::run() {
     while(true) {
         task.reset();
         bool tickle_me = false;    //是否通知协程调度器还有任务要执行
-        {   
+        if(m_workStealing) {
+            tickle_me = takeLocalTask(task);
+        }
+        else {
             MutexType::Lock lock(m_mutex);
             // 遍历所有调度任务
             for(auto it = m_fibers.begin(); it != m_fibers.end(); ++it) {
@@ -204,7 +256,7 @@ void Scheduler::run() {
             //如果是半路yield，有两种情况：(1)YieldToReady，则调度器把它重新加入到任务队列并等待调度
             //(2)YieldToHold，不会再将协程加入任务队列，协程在yield之前必须自己先将自己加入到协程的调度队列中，否则协程就处于逃逸状态
             if(task.fiber->getState() == Fiber::READY) {
-                scheduler(task.fiber);
+                scheduler(task.fiber, task.fiber->getPinThread());
             } else if(task.fiber->getState() != Fiber::TERM 
                     && task.fiber->getState() != Fiber::EXCEPT) {   //意义不大,可删
                 task.fiber->m_state = Fiber::HOLD;            
@@ -224,7 +276,7 @@ void Scheduler::run() {
             --m_activeThreadCount;
 
             if(cb_fiber->getState() == Fiber::READY) {
-                scheduler(cb_fiber);
+                scheduler(cb_fiber, cb_fiber->getPinThread());
             } else if(cb_fiber->getState() != Fiber::TERM 
                     && cb_fiber->getState() != Fiber::EXCEPT) {   //意义不大,可删
                 cb_fiber->m_state = Fiber::HOLD;
@@ -249,6 +301,153 @@ void Scheduler::run() {
             }
         }
     } //end while(true)
+    t_local_queue = nullptr;
+}
+
+//根据线程id找到对应的本地队列
+Scheduler::LocalQueue* Scheduler::getLocalQueue(int thread_id) {
+    for(auto& i : m_localQueues) {
+        if(i->threadId == thread_id) {
+            return i;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief 工作窃取模式下添加任务
+ * @details 调度线程给自己添加的任务直接放入本地无锁队列；
+ *          指定了线程的任务放入目标线程的inbox；
+ *          其他线程添加的任务轮询放入各线程的inbox
+ * @return 是否需要tickle
+ */
+bool Scheduler::pushLocalTask(FiberAndThread* ft) {
+    LocalQueue* local = (LocalQueue*)t_local_queue;
+    if(ft->threadId == -1 && local && GetThis() == this) {
+        ++m_localTaskCount;
+        local->tasks.push(ft);
+        return hasIdleThreads();
+    }
+
+    LocalQueue* q = nullptr;
+    if(ft->threadId != -1) {
+        q = getLocalQueue(ft->threadId);
+    }
+    else {
+        q = m_localQueues[m_nextQueue++ % m_localQueues.size()];
+    }
+
+    if(!q) {
+        //指定的线程还没有启动，先放入全局队列
+        MutexType::Lock lock(m_mutex);
+        m_fibers.push_back(*ft);
+        ++m_globalTaskCount;
+        delete ft;
+        return true;
+    }
+
+    {
+        MutexType::Lock lock(q->mutex);
+        ++m_localTaskCount;
+        q->inbox.push_back(ft);
+        ++q->inboxSize;
+    }
+    return true;
+}
+
+/**
+ * @brief 工作窃取模式下获取一个任务
+ * @details 依次从本地队列、本线程inbox、全局队列中获取，都没有时再从其他线程的本地队列中窃取，
+ *          最后尝试窃取其他线程inbox中未指定线程的任务
+ * @param[out] task 获取到的任务
+ * @return 是否需要tickle其他线程
+ */
+bool Scheduler::takeLocalTask(FiberAndThread& task) {
+    LocalQueue* local = (LocalQueue*)t_local_queue;
+    FiberAndThread* ft = nullptr;
+    bool tickle_me = false;
+
+    if(!local->tasks.pop(ft)) {
+        ft = nullptr;
+    }
+
+    if(!ft && local->inboxSize > 0) {
+        MutexType::Lock lock(local->mutex);
+        if(!local->inbox.empty()) {
+            ft = local->inbox.front();
+            local->inbox.pop_front();
+            --local->inboxSize;
+        }
+    }
+
+    if(!ft && m_globalTaskCount > 0) {
+        MutexType::Lock lock(m_mutex);
+        for(auto it = m_fibers.begin(); it != m_fibers.end(); ++it) {
+            if(it->threadId != -1 && it->threadId != getThreadId()) {
+                tickle_me = true;
+                continue;
+            }
+            SYLAR_ASSERT(it->fiber || it->cb);
+            task = *it;
+            m_fibers.erase(it);
+            --m_globalTaskCount;
+            ++m_activeThreadCount;
+            return tickle_me;
+        }
+    }
+
+    size_t count = m_localQueues.size();
+    size_t self = local->index;
+
+    //从其他线程的本地队列窃取
+    for(size_t i = 1; !ft && i < count; ++i) {
+        LocalQueue* q = m_localQueues[(self + i) % count];
+        if(q->tasks.steal(ft)) {
+            break;
+        }
+        ft = nullptr;
+    }
+
+    //从其他线程的inbox窃取未指定线程的任务
+    for(size_t i = 1; !ft && i < count; ++i) {
+        LocalQueue* q = m_localQueues[(self + i) % count];
+        if(q->inboxSize == 0) {
+            continue;
+        }
+        MutexType::Lock lock(q->mutex);
+        for(auto it = q->inbox.begin(); it != q->inbox.end(); ++it) {
+            if((*it)->threadId == -1) {
+                ft = *it;
+                q->inbox.erase(it);
+                --q->inboxSize;
+                break;
+            }
+        }
+        //剩下的都是指定了该线程的任务，通知一下
+        tickle_me = tickle_me || !q->inbox.empty();
+    }
+
+    if(!ft) {
+        return tickle_me;
+    }
+
+    --m_localTaskCount;
+    SYLAR_ASSERT(ft->fiber || ft->cb);
+    //任务队列的协程一定只能是INIT、READY、HOLD状态
+    if(ft->fiber) {
+        auto temp = ft->fiber->getState();
+        SYLAR_ASSERT(temp == Fiber::INIT 
+                    || temp == Fiber::READY
+                    || temp == Fiber::HOLD);
+    }
+    task.fiber.swap(ft->fiber);
+    task.cb.swap(ft->cb);
+    task.threadId = ft->threadId;
+    delete ft;
+    ++m_activeThreadCount;
+
+    //本地队列还有任务，通知空闲线程来窃取
+    return tickle_me || (!local->tasks.empty() && hasIdleThreads());
 }
 
 //通知协程调度器有任务要执行
@@ -259,7 +458,8 @@ void Scheduler::tickle() {
 //判断调度器是否已经停止，只有当所有的任务都被执行完，调度器才可以停止
 bool Scheduler::stopping() {
     MutexType::Lock lock(m_mutex);
-    return m_stopping && m_fibers.empty() && m_activeThreadCount == 0;
+    return m_stopping && m_fibers.empty() && m_localTaskCount == 0 
+            && m_activeThreadCount == 0;
 }
 
 //协程无任务可调度时,执行idle协程,等待新任务到来
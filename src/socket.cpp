@@ -5,6 +5,7 @@
 #include "hook.h"
 #include "macro.h"
 #include <netinet/tcp.h>
+#include <fcntl.h>
 
 
 namespace sylar {
@@ -126,6 +127,17 @@ bool Socket::setOption(int level, int optname, const void* optval, socklen_t opt
     return true;
 }
 
+// 设置SO_REUSEPORT，需要在bind之前调用
+bool Socket::setReusePort(bool v) {
+    if(!isValid()) {
+        if(SYLAR_UNLIKELY(!newSocket())) {
+            return false;
+        }
+    }
+    int opt = v ? 1 : 0;
+    return setOption(SOL_SOCKET, SO_REUSEPORT, opt);
+}
+
 /**
  * @brief 客户端需要调用connect()连接服务器 
  *        int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen);
@@ -254,20 +266,73 @@ Socket::ptr Socket::accept() {
 
     // 保存accept()生成的新socket
     Socket::ptr sock = std::make_shared<Socket>(m_family, m_type, m_protocol);  
-    // 不需要用addr和addrlen来接收客户端地址信息，因为会保存在返回值Socket::ptr中
-    int fd = ::accept(m_sock, nullptr, nullptr);
+    // accept直接返回客户端地址，保存到新Socket中，之后不用再getpeername
+    sockaddr_storage addr;
+    socklen_t addrlen = sizeof(addr);
+    int fd = ::accept(m_sock, (sockaddr*)&addr, &addrlen);
     if(fd == -1) {
-        SYLAR_LOG_ERROR(g_logger) << "accept(" << m_sock << ", nullptr, nullptr) fail,"
+        SYLAR_LOG_ERROR(g_logger) << "accept(" << m_sock << ", &addr, &addrlen) fail,"
                             << " errno=" << errno << " errstr=" << strerror(errno); 
         return nullptr;
     }
     
+    sock->m_remoteAddress = Address::Create((sockaddr*)&addr, addrlen);
     if(sock->initSocket(fd)) {
         return sock;
     }
     return nullptr;
 }
 
+// 批量接收连接，连接风暴时一次唤醒取完监听队列，减少协程切换和accept的调度次数
+size_t Socket::acceptBatch(std::vector<Socket::ptr>& socks, size_t max_count) {
+    if(!isValid()) {
+        SYLAR_LOG_ERROR(g_logger) << "accept fail, sock=-1";
+        return 0;
+    }
+
+    // 第一个连接走hook的accept4，监听队列为空时协程让出，等待监听socket可读
+    // accept4同时返回客户端地址，省去之后的getpeername(对端关闭后getpeername会失败)
+    // 不传SOCK_NONBLOCK: hook会把它当作用户要求的非阻塞，Socket的读写要走hook的让出逻辑
+    sockaddr_storage addr;
+    socklen_t addrlen = sizeof(addr);
+    int fd = ::accept4(m_sock, (sockaddr*)&addr, &addrlen, SOCK_CLOEXEC);
+    if(fd == -1) {
+        SYLAR_LOG_ERROR(g_logger) << "accept4(" << m_sock << ", &addr, &addrlen) fail,"
+                            << " errno=" << errno << " errstr=" << strerror(errno); 
+        return 0;
+    }
+
+    size_t count = 0;
+    while(true) {
+        Socket::ptr sock = std::make_shared<Socket>(m_family, m_type, m_protocol);
+        sock->m_remoteAddress = Address::Create((sockaddr*)&addr, addrlen);
+        if(sock->initSocket(fd)) {
+            socks.push_back(sock);
+            ++count;
+        }
+        else {
+            ::close(fd);
+        }
+        // 未启用hook时监听socket可能是阻塞的，不能继续取
+        if(count >= max_count || !is_hook_enable()) {
+            break;
+        }
+        // 监听socket已由hook设置为非阻塞，直接调用原函数，队列取空时返回EAGAIN
+        addrlen = sizeof(addr);
+        fd = accept4_f(m_sock, (sockaddr*)&addr, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd == -1) {
+            if(errno != EAGAIN && errno != EWOULDBLOCK) {
+                SYLAR_LOG_ERROR(g_logger) << "accept4(" << m_sock << ", &addr, &addrlen) fail,"
+                            << " errno=" << errno << " errstr=" << strerror(errno); 
+            }
+            break;
+        }
+        // 和hook的accept4得到的句柄状态一致: 系统非阻塞，用户阻塞
+        FdMgr::GetInstance()->getFdCtx(fd, true, O_NONBLOCK);
+    }
+    return count;
+}
+
 /**
  * @brief int close(int fd);
  * @param[in] fd 需要关闭的文件或套接字的文件描述符
@@ -334,6 +399,14 @@ ssize_t Socket::send(const iovec* buf, size_t len, int flags) {
     return -1;
 }
 
+// 发送文件数据，sendfile被hook，socket不可写时让出协程
+ssize_t Socket::sendFile(int fd, off_t offset, size_t len) {
+    if(isConnected()) {
+        return ::sendfile(m_sock, fd, &offset, len);
+    }
+    return -1;
+}
+
 /**
  * @brief ssize_t sendto(int sockfd, const void *buf, size_t len, int flags,
                         const struct sockaddr *dest_addr, socklen_t addrlen);
@@ -607,8 +680,8 @@ bool Socket::initSocket(int sock) {
         m_sock = sock;
         m_isConnected = true;
         setSocket();
-        getLocolAddress();
-        getRemoteAddress();
+        // 远端地址由accept时一起取得，本地地址在第一次调用getLocolAddress时再解析，
+        // 省去每个新连接的getsockname和getpeername
         return true;
     }
     return false;
@@ -687,20 +760,33 @@ Socket::ptr SSLSocket::accept() {
 
     // 保存accept()生成的新SSLSocket
     SSLSocket::ptr sock = std::make_shared<SSLSocket>(m_family, m_type, m_protocol);  
-    int fd = ::accept(m_sock, nullptr, nullptr);
+    sockaddr_storage addr;
+    socklen_t addrlen = sizeof(addr);
+    int fd = ::accept(m_sock, (sockaddr*)&addr, &addrlen);
     if(fd == -1) {
-        SYLAR_LOG_ERROR(g_logger) << "accept(" << m_sock << ", nullptr, nullptr) fail,"
+        SYLAR_LOG_ERROR(g_logger) << "accept(" << m_sock << ", &addr, &addrlen) fail,"
                             << " errno=" << errno << " errstr=" << strerror(errno); 
         return nullptr;
     }
     
     sock->m_ctx = m_ctx;
+    sock->m_remoteAddress = Address::Create((sockaddr*)&addr, addrlen);
     if(sock->initSocket(fd)) {
         return sock;
     }
     return nullptr;
 }
 
+// 批量接收连接，SSL连接需要逐个握手，只接收一个
+size_t SSLSocket::acceptBatch(std::vector<Socket::ptr>& socks, size_t max_count) {
+    Socket::ptr sock = accept();
+    if(!sock) {
+        return 0;
+    }
+    socks.push_back(sock);
+    return 1;
+}
+
 // 初始化Socket
 bool SSLSocket::initSocket(int sock) {
     bool v = Socket::initSocket(sock);
@@ -748,6 +834,18 @@ ssize_t SSLSocket::send(const iovec* buf, size_t len, int flags) {
     return total;
 }
 
+ssize_t SSLSocket::sendFile(int fd, off_t offset, size_t len) {
+    if(!m_ssl) {
+        return -1;
+    }
+    char buf[16 * 1024];
+    ssize_t rt = pread(fd, buf, std::min(len, sizeof(buf)), offset);
+    if(rt <= 0) {
+        return rt;
+    }
+    return SSL_write(m_ssl.get(), buf, rt);
+}
+
 ssize_t SSLSocket::sendTo(const void* buf, size_t len, const Address::ptr toAddr, int flags) {
     SYLAR_ASSERT(false);
     return -1;
@@ -16,7 +16,6 @@ namespace {
 struct SocketBuffSizeInit {
     SocketBuffSizeInit() {
         g_socket_max_buff_size->addListener([](const uint64_t& oldVal, const uint64_t& newVal) {
-            g_socket_max_buff_size->setValue(newVal);
             SYLAR_LOG_INFO(g_logger) << "Socket max buff size" << " old_value=" << oldVal
                                                                << " new_value=" << newVal;
         });
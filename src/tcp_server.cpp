@@ -11,6 +11,10 @@ static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 static ConfigVar<uint64_t>::ptr g_tcp_server_recv_timeout = Config::Lookup(
         "tcp_server.recv_timeout", (uint64_t)(2 * 60 * 1000), "tcp server recv timeout");
 
+// 每次唤醒最多连续accept的连接数
+static ConfigVar<uint32_t>::ptr g_tcp_server_accept_batch = Config::Lookup(
+        "tcp_server.accept_batch", (uint32_t)64, "tcp server max connections accepted per wakeup");
+
 // 匿名空间：将命名空间的名字符号去掉，让其他文件找不到，效果类似于static
 namespace {
 // 添加监听函数，配置改变时执行回调函数
@@ -41,6 +45,7 @@ TcpServer::~TcpServer() {
         sock->close();
     }
     m_socket.clear();
+    m_reusePortSocket.clear();
 }
 
 // 服务器绑定地址(单个地址)
@@ -53,24 +58,39 @@ bool TcpServer::bind(const Address::ptr addr) {
 
 // 服务器绑定地址(多个地址)
 // 完成所有socket的bind和listen的操作
+// reuseport模式下每个TCP/IP地址为m_worker的每个线程各绑定一个socket，start()时按顺序分给各个线程
 bool TcpServer::bind(const std::vector<Address::ptr> addrs, std::vector<Address::ptr>& fails) {
+    size_t threads = m_reusePort ? m_worker->getThreadIds().size() : 1;
     for(const auto& addr : addrs) {
-        Socket::ptr sock = Socket::CreatTcpSocket(addr);
-        if(!sock->bind(addr)) {
-            SYLAR_LOG_ERROR(g_logger) << "tcp server bind address error";
-            fails.push_back(addr);
-            continue;
+        // Unix域socket不支持SO_REUSEPORT，只绑定一个
+        bool reuse_port = m_reusePort && (addr->getFamily() == AF_INET
+                                        || addr->getFamily() == AF_INET6);
+        size_t count = reuse_port ? threads : 1;
+        for(size_t i = 0; i < count; ++i) {
+            Socket::ptr sock = Socket::CreatTcpSocket(addr);
+            if(reuse_port && !sock->setReusePort(true)) {
+                SYLAR_LOG_ERROR(g_logger) << "tcp server set SO_REUSEPORT error";
+                fails.push_back(addr);
+                break;
+            }
+            if(!sock->bind(addr)) {
+                SYLAR_LOG_ERROR(g_logger) << "tcp server bind address error";
+                fails.push_back(addr);
+                break;
+            }
+            if(!sock->listen()) {
+                SYLAR_LOG_ERROR(g_logger) << "tcp server listen error";
+                fails.push_back(addr);
+                break;
+            }
+            m_socket.push_back(sock);
+            m_reusePortSocket.push_back(reuse_port);
         }
-        if(!sock->listen()) {
-            SYLAR_LOG_ERROR(g_logger) << "tcp server listen error";
-            fails.push_back(addr);
-            continue;
-        }
-        m_socket.push_back(sock);
     }
 
     if(!fails.empty()) {
         m_socket.clear();
+        m_reusePortSocket.clear();
         return false;
     }
 
@@ -81,28 +101,40 @@ bool TcpServer::bind(const std::vector<Address::ptr> addrs, std::vector<Address:
 }
 
 // 完成服务器单个Socket的accept的操作
-void TcpServer::startAccept(Socket::ptr sock) {
-    // sock->setRecvTimeout(3*1000);
+void TcpServer::startAccept(Socket::ptr sock, bool local) {
+    // reuseport模式下accept协程绑定在当前线程，之后每次等待新连接都在本线程唤醒
+    if(local) {
+        Fiber::GetThis()->setPinThread(getThreadId());
+    }
+    std::vector<Socket::ptr> clients;
+    std::vector<std::function<void()> > cbs;
     // 用while的原因，可以让服务器一直等待客户端connect，不关闭
     while(!m_isStop) {
-        // 这里sock的accept()并没有设置超时时间，所以hook中accept()没有设置定时器
-        // 那么会一直阻塞到有客户端connect时，才会继续执行
-        // 如果给其设置超时时间sock->setRecvTimeout(3*1000); 
-        // 那么则不会阻塞，即使没有客户端connect也会继续执行，直到有connect或者定时器超时再回调
-        Socket::ptr client = sock->accept();
+        // 监听socket没有设置超时时间，hook中的accept4不会设置定时器，
+        // 会一直让出到有客户端connect时才继续执行，之后把监听队列中的连接一次取完
+        clients.clear();
+        uint32_t batch = g_tcp_server_accept_batch->getValue();
+        if(!sock->acceptBatch(clients, batch ? batch : 1)) {
+            SYLAR_LOG_ERROR(g_logger) << "tcp server accept error";
+            continue;
+        }
 
-        if(client) {
+        cbs.clear();
+        for(auto& client : clients) {
             // 设置新Socket的接收超时时间
             client->setRecvTimeout(m_recvTimeout);
-            // accept()成功，触发回调，处理新连接的Socket类
-            // m_worker负责调度 新连接的Socket需要做的工作
-            m_worker->scheduler(std::bind(&TcpServer::handleClient, shared_from_this(), client));
-        }
-        else {
-            SYLAR_LOG_ERROR(g_logger) << "tcp server accept error";
+            if(local) {
+                cbs.push_back(std::bind(&TcpServer::handleClientLocal, shared_from_this(), client));
+            }
+            else {
+                cbs.push_back(std::bind(&TcpServer::handleClient, shared_from_this(), client));
+            }
         }
+        // accept()成功，触发回调，处理新连接的Socket类
+        // m_worker负责调度 新连接的Socket需要做的工作，一批连接只加一次锁、tickle一次
+        // reuseport模式下新连接留在accept所在的线程处理，不经过其他线程
+        m_worker->scheduler(cbs.begin(), cbs.end(), local ? getThreadId() : -1);
     }
-    
 }
 
 // 完成服务器所有Socket的accept的操作
@@ -111,10 +143,22 @@ bool TcpServer::start() {
         return true;
     }
     m_isStop = false;
-    for(const auto& sock : m_socket) {
-        // m_acceptWorker负责调度 服务器accept新的socket
+    std::vector<int> threads;
+    size_t next = 0;
+    for(size_t i = 0; i < m_socket.size(); ++i) {
         // 用shared_from_this()的原因是，防止在startAccept()函数执行时，TcpServer析构了
-        m_acceptWorker->scheduler(std::bind(&TcpServer::startAccept, shared_from_this(), sock));
+        if(m_reusePortSocket[i]) {
+            // 同一地址的socket依次分给m_worker的每个线程，每个线程accept自己的socket
+            if(threads.empty()) {
+                threads = m_worker->getThreadIds();
+            }
+            m_worker->scheduler(std::bind(&TcpServer::startAccept, shared_from_this(), m_socket[i], true)
+                                ,threads[next++ % threads.size()]);
+        }
+        else {
+            // m_acceptWorker负责调度 服务器accept新的socket
+            m_acceptWorker->scheduler(std::bind(&TcpServer::startAccept, shared_from_this(), m_socket[i], false));
+        }
     }
     return true;
 }
@@ -131,6 +175,7 @@ void TcpServer::stop() {
             sock->close();
         }
         self->m_socket.clear();
+        self->m_reusePortSocket.clear();
     });
 }
 
@@ -143,4 +188,10 @@ void TcpServer::handleClient(Socket::ptr client) {
     SYLAR_LOG_INFO(g_logger) << "handleClient: " << client->toString();
 }
 
+// reuseport模式下处理新连接，连接的协程绑定在accept所在的线程上，后续的IO唤醒都留在本线程
+void TcpServer::handleClientLocal(Socket::ptr client) {
+    Fiber::GetThis()->setPinThread(getThreadId());
+    handleClient(client);
+}
+
 }
\ No newline at end of file
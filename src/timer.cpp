@@ -1,5 +1,7 @@
 #include "timer.h"
 #include "util.h"
+#include <string.h>
+#include <algorithm>
 
 namespace sylar {
 
@@ -51,12 +53,7 @@ bool Timer::cancel() {
     TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
     if(m_cb) {
         m_cb = nullptr;
-        auto it = m_manager->m_timers.find(shared_from_this());
-        if(it == m_manager->m_timers.end()) {
-            return false;
-        }
-        m_manager->m_timers.erase(it);
-        return true;
+        return m_manager->eraseTimer(shared_from_this());
     }
     return false;
 }
@@ -68,24 +65,16 @@ bool Timer::cancel() {
 bool Timer::refresh() {
     TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
     if(m_cb) {
-        auto it = m_manager->m_timers.find(shared_from_this());
-        if(it == m_manager->m_timers.end()) {
-            return false;
-        }
+        Timer::ptr self = shared_from_this();
         //不能直接修改m_next，是因为set按照m_next来排序，直接修改会影响整个数据结构(set不可以修改key值)
         //应该先删除
-        m_manager->m_timers.erase(it);
+        if(!m_manager->eraseTimer(self)) {
+            return false;
+        }
         //再修改时间
         m_next = m_ms + sylar::GetCurrentMS();
         //最后再添加回去
-        //insert函数在插入元素成功时返回一个pair对象，其中包含两部分：
-        //pair::first：迭代器，指向已插入元素在容器中的位置（或者是一个已经存在的具有相同键的元素）
-        //pair::second：布尔值，表示是否插入成功。如插入成功为true；如果已经存在具有相同键的元素，则为false
-        it = m_manager->m_timers.insert(shared_from_this()).first;  
-        bool at_front = (it == m_manager->m_timers.begin()) && !m_manager->m_tickled;
-        if(at_front) {
-            m_manager->m_tickled = true;  //只触发一次
-        }
+        bool at_front = m_manager->insertTimer(self);
         lock.unlock();
 
         if(at_front) {
@@ -107,12 +96,11 @@ bool Timer::reset(uint64_t ms, bool from_now) {
     }
     TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
     if(m_cb) {
-        auto it = m_manager->m_timers.find(shared_from_this());
-        if(it == m_manager->m_timers.end()) {
+        Timer::ptr self = shared_from_this();
+        //应该先删除
+        if(!m_manager->eraseTimer(self)) {
             return false;
         }
-        //应该先删除
-        m_manager->m_timers.erase(it);
         //再修改时间
         uint64_t start = 0;
         if(from_now) {
@@ -124,11 +112,7 @@ bool Timer::reset(uint64_t ms, bool from_now) {
         m_ms = ms;
         m_next = start + m_ms;
         //最后再添加回去
-        it = m_manager->m_timers.insert(shared_from_this()).first;
-        bool at_front = (it == m_manager->m_timers.begin()) && !m_manager->m_tickled;
-        if(at_front) {
-            m_manager->m_tickled = true;  //只触发一次
-        }
+        bool at_front = m_manager->insertTimer(self);
         lock.unlock();
 
         if(at_front) {
@@ -141,14 +125,290 @@ bool Timer::reset(uint64_t ms, bool from_now) {
 }
 
 
-//构造函数
-TimerManager::TimerManager() {
+/**
+ * @brief 分层时间轮
+ * @details 第0层256个槽，每个槽1毫秒；第1~4层各64个槽，每个槽分别跨越 2^8, 2^14, 2^20, 2^26 毫秒，
+ *          共覆盖 2^32 毫秒(约49天)，更远的定时器先放在最高层，降级时再重新计算位置。
+ *          第0层每转完一圈，就把上一层当前槽位的定时器降级(cascade)到下一层。
+ *          定时器通过侵入式双向链表挂在槽位上，插入/删除都是O(1)；
+ *          每个槽位是否为空记录在位图中，用于快速计算下一次需要唤醒的时间
+ */
+class TimerWheel {
+public:
+    static const int TVR_BITS = 8;                  //第0层槽位数的位数
+    static const int TVN_BITS = 6;                  //第1~4层槽位数的位数
+    static const int TVR_SIZE = 1 << TVR_BITS;
+    static const int TVN_SIZE = 1 << TVN_BITS;
+    static const uint64_t TVR_MASK = TVR_SIZE - 1;
+    static const uint64_t TVN_MASK = TVN_SIZE - 1;
+    static const int LEVELS = 5;
+    static const int SLOTS = TVR_SIZE + TVN_SIZE * (LEVELS - 1);
+    static const uint64_t MAX_TIMEOUT = (1ull << (TVR_BITS + TVN_BITS * (LEVELS - 1))) - 1;
+
+    TimerWheel(uint64_t now_ms)
+        :m_current(now_ms) {
+        memset(m_slots, 0, sizeof(m_slots));
+        memset(m_bitmap, 0, sizeof(m_bitmap));
+    }
+
+    ~TimerWheel() {
+        std::vector<Timer::ptr> timers;
+        takeAll(timers);
+    }
+
+    //定时器数量
+    size_t size() const { return m_size; }
+
+    //添加定时器
+    void add(const Timer::ptr& timer) {
+        timer->m_wheelSelf = timer;
+        link(timer.get(), slotIndex(timer->m_next));
+        ++m_size;
+    }
+
+    //删除定时器，不在时间轮中时返回false
+    bool remove(const Timer::ptr& timer) {
+        if(timer->m_wheelSlot < 0) {
+            return false;
+        }
+        unlink(timer.get());
+        --m_size;
+        timer->m_wheelSelf.reset();
+        return true;
+    }
+
+    /**
+     * @brief 下一次需要处理时间轮的时刻(毫秒)
+     * @details 第0层的定时器是精确的执行时间，上层的定时器取其降级的时刻，
+     *          因此返回值不会晚于最近一个定时器的执行时间
+     */
+    uint64_t nextExpire() const {
+        if(!m_size) {
+            return ~0ull;
+        }
+        uint64_t next = ~0ull;
+        //第0层: 从当前槽位开始循环查找第一个非空槽位，回绕的槽位属于下一圈
+        uint64_t index = m_current & TVR_MASK;
+        int slot = findLevel0(index);
+        if(slot >= 0) {
+            next = m_current - index + slot;
+        } else if((slot = findLevel0(0)) >= 0) {
+            next = m_current - index + TVR_SIZE + slot;
+        }
+        //第1~4层: 槽位被降级的时刻
+        for(int level = 1; level < LEVELS; ++level) {
+            uint64_t bits = m_bitmap[TVR_SIZE / 64 + level - 1];
+            if(!bits) {
+                continue;
+            }
+            int shift = TVR_BITS + (level - 1) * TVN_BITS;
+            uint64_t boundary = ((m_current + (1ull << shift) - 1) >> shift) << shift;
+            uint64_t idx = (boundary >> shift) & TVN_MASK;
+            uint64_t rotated = idx ? (bits >> idx) | (bits << (64 - idx)) : bits;
+            uint64_t t = boundary + ((uint64_t)__builtin_ctzll(rotated) << shift);
+            if(t < next) {
+                next = t;
+            }
+        }
+        return next;
+    }
+
+    //取出执行时间不晚于now_ms的定时器
+    void expire(uint64_t now_ms, std::vector<Timer::ptr>& timeout) {
+        while(m_current <= now_ms) {
+            if(!m_size) {
+                m_current = now_ms + 1;
+                break;
+            }
+            uint64_t index = m_current & TVR_MASK;
+            if(index == 0) {
+                //第0层转完一圈，逐层降级
+                for(int level = 1; level < LEVELS; ++level) {
+                    uint64_t idx = (m_current >> (TVR_BITS + (level - 1) * TVN_BITS)) & TVN_MASK;
+                    cascade(TVR_SIZE + (level - 1) * TVN_SIZE + idx);
+                    if(idx) {
+                        break;
+                    }
+                }
+            }
+            //跳过第0层的空槽位，但不越过下一圈的起点，保证降级不会被漏掉
+            int next = findLevel0(index);
+            if(next < 0 || (uint64_t)next != index) {
+                uint64_t target = next < 0 ? (m_current | TVR_MASK) + 1
+                                           : m_current - index + next;
+                m_current = std::min(target, now_ms + 1);
+                continue;
+            }
+            Timer* t = m_slots[index];
+            while(t) {
+                Timer* n = t->m_wheelNext;
+                unlink(t);
+                --m_size;
+                timeout.push_back(std::move(t->m_wheelSelf));
+                t = n;
+            }
+            ++m_current;
+        }
+    }
+
+    //取出所有定时器
+    void takeAll(std::vector<Timer::ptr>& timers) {
+        for(int i = 0; i < SLOTS; ++i) {
+            Timer* t = m_slots[i];
+            while(t) {
+                Timer* n = t->m_wheelNext;
+                unlink(t);
+                timers.push_back(std::move(t->m_wheelSelf));
+                t = n;
+            }
+        }
+        m_size = 0;
+    }
+
+    //重新设置当前时刻(服务器时间被调后时使用)
+    void setCurrent(uint64_t now_ms) {
+        m_current = now_ms;
+    }
+
+private:
+    //计算执行时间对应的槽位
+    int slotIndex(uint64_t expire) const {
+        if(expire < m_current) {
+            expire = m_current;
+        }
+        uint64_t idx = expire - m_current;
+        if(idx < TVR_SIZE) {
+            return expire & TVR_MASK;
+        }
+        if(idx > MAX_TIMEOUT) {
+            expire = m_current + MAX_TIMEOUT;
+            idx = MAX_TIMEOUT;
+        }
+        for(int level = 1; level < LEVELS; ++level) {
+            int shift = TVR_BITS + (level - 1) * TVN_BITS;
+            if(idx < (1ull << (shift + TVN_BITS))) {
+                return TVR_SIZE + (level - 1) * TVN_SIZE + ((expire >> shift) & TVN_MASK);
+            }
+        }
+        return SLOTS - 1;
+    }
+
+    //挂到槽位链表头
+    void link(Timer* t, int slot) {
+        t->m_wheelSlot = slot;
+        t->m_wheelPrev = nullptr;
+        t->m_wheelNext = m_slots[slot];
+        if(m_slots[slot]) {
+            m_slots[slot]->m_wheelPrev = t;
+        }
+        m_slots[slot] = t;
+        m_bitmap[slot / 64] |= 1ull << (slot % 64);
+    }
+
+    //从槽位链表摘除
+    void unlink(Timer* t) {
+        int slot = t->m_wheelSlot;
+        if(t->m_wheelPrev) {
+            t->m_wheelPrev->m_wheelNext = t->m_wheelNext;
+        } else {
+            m_slots[slot] = t->m_wheelNext;
+        }
+        if(t->m_wheelNext) {
+            t->m_wheelNext->m_wheelPrev = t->m_wheelPrev;
+        }
+        if(!m_slots[slot]) {
+            m_bitmap[slot / 64] &= ~(1ull << (slot % 64));
+        }
+        t->m_wheelPrev = t->m_wheelNext = nullptr;
+        t->m_wheelSlot = -1;
+    }
+
+    //将上层槽位的定时器重新放到下层
+    void cascade(int slot) {
+        Timer* t = m_slots[slot];
+        while(t) {
+            Timer* n = t->m_wheelNext;
+            unlink(t);
+            link(t, slotIndex(t->m_next));
+            t = n;
+        }
+    }
+
+    //第0层中从from开始(不回绕)第一个非空槽位，没有返回-1
+    int findLevel0(uint64_t from) const {
+        for(uint64_t word = from / 64; word < TVR_SIZE / 64; ++word) {
+            uint64_t bits = m_bitmap[word];
+            if(word == from / 64) {
+                bits &= ~0ull << (from % 64);
+            }
+            if(bits) {
+                return word * 64 + __builtin_ctzll(bits);
+            }
+        }
+        return -1;
+    }
+
+private:
+    uint64_t m_current;                //下一个要处理的时刻(毫秒)
+    size_t m_size = 0;                 //定时器数量
+    Timer* m_slots[SLOTS];             //槽位链表头
+    uint64_t m_bitmap[SLOTS / 64];     //槽位是否非空
+};
+
+
+/**
+ * @brief 构造函数
+ * @param[in] type 定时器的存储结构
+ */
+TimerManager::TimerManager(Type type)
+    :m_type(type) {
     m_previouseTime = sylar::GetCurrentMS();
+    if(m_type == WHEEL) {
+        m_wheel = new TimerWheel(m_previouseTime);
+    }
 }
 
 //析构函数
 TimerManager::~TimerManager() {
+    if(m_wheel) {
+        delete m_wheel;
+    }
+}
+
+//添加定时器(需要持有写锁)，返回是否需要通知IOManager更新epoll_wait超时
+bool TimerManager::insertTimer(const Timer::ptr& timer) {
+    bool at_front = false;
+    if(m_type == WHEEL) {
+        //比当前的最早唤醒时间还早，需要通知
+        at_front = timer->m_next < m_wheel->nextExpire();
+        if(!m_wheel->size()) {
+            m_wheel->setCurrent(sylar::GetCurrentMS());
+        }
+        m_wheel->add(timer);
+    }
+    else {
+        auto it = m_timers.insert(timer).first;
+        at_front = (it == m_timers.begin());
+    }
+    //使用m_tickled，在发生频繁添加时，不用频繁触发newTimerInsertAtFront
+    at_front = at_front && !m_tickled;
+    if(at_front) {
+        m_tickled = true;  //只触发一次
+    }
+    return at_front;
+}
 
+//删除定时器(需要持有写锁)
+bool TimerManager::eraseTimer(const Timer::ptr& timer) {
+    if(m_type == WHEEL) {
+        return m_wheel->remove(timer);
+    }
+    auto it = m_timers.find(timer);
+    if(it == m_timers.end()) {
+        return false;
+    }
+    m_timers.erase(it);
+    return true;
 }
 
 /**
@@ -162,12 +422,7 @@ Timer::ptr TimerManager::addTimer(uint64_t ms, std::function<void()> cb, bool re
     // Timer::ptr timer = std::make_shared<Timer>(ms, recurring, cb, this);
     Timer::ptr timer(new Timer(ms, recurring, cb, this));
     RWMutexType::WriteLock lock(m_mutex);
-    auto it = m_timers.insert(timer).first;
-    //使用m_tickled，在发生频繁添加时，不用频繁触发newTimerInsertAtFront
-    bool at_front = (it == m_timers.begin()) && !m_tickled;
-    if(at_front) {
-        m_tickled = true;  //只触发一次
-    }
+    bool at_front = insertTimer(timer);
     lock.unlock();
 
     if(at_front) {
@@ -202,18 +457,27 @@ Timer::ptr TimerManager::addConditionTimer(uint64_t ms, std::function<void()> cb
 uint64_t TimerManager::getNextTimer() {
     RWMutexType::ReadLock lock(m_mutex);
     m_tickled = false;
-    if(m_timers.empty()) {
+    uint64_t next = 0;
+    if(m_type == WHEEL) {
+        next = m_wheel->nextExpire();
+    }
+    else if(!m_timers.empty()) {
+        next = (*m_timers.begin())->m_next;
+    }
+    else {
+        next = ~0ull;
+    }
+    if(next == ~0ull) {
         //uint64_t的最大值
         return ~0ull;   //u表示unsigned无符号，l表示long长整数
     }
 
-    const Timer::ptr& next = *m_timers.begin();
     uint64_t now_ms = sylar::GetCurrentMS();
-    if(next->m_next <= now_ms) {
+    if(next <= now_ms) {
         return 0;
     }
     else {
-        return next->m_next - now_ms;
+        return next - now_ms;
     }
 }
 
@@ -226,6 +490,35 @@ void TimerManager::listTimeoutCbs(std::vector<std::function<void()> >& cbs) {
     std::vector<Timer::ptr> timeout;
 
     RWMutexType::WriteLock lock(m_mutex);
+    if(m_type == WHEEL) {
+        //空闲时也要检查系统时间是否被调后，否则空闲期间的调后检测不到
+        bool rollover = detectClockRollover(now_ms);
+        if(!m_wheel->size()) {
+            //空闲时也推进当前时刻，避免之后添加的定时器从很久之前的时刻开始逐槽扫描
+            m_wheel->setCurrent(now_ms);
+            return;
+        }
+        if(rollover) {
+            m_wheel->takeAll(timeout);
+            m_wheel->setCurrent(now_ms);
+        }
+        else {
+            m_wheel->expire(now_ms, timeout);
+        }
+        cbs.reserve(timeout.size());
+        for(auto& timer : timeout) {
+            cbs.push_back(timer->m_cb);
+            if(timer->m_recurring) {
+                timer->m_next = now_ms + timer->m_ms;
+                m_wheel->add(timer);
+            }
+            else {
+                timer->m_cb = nullptr;
+            }
+        }
+        return;
+    }
+
     if(m_timers.empty()) {
         return;
     }
@@ -260,6 +553,9 @@ void TimerManager::listTimeoutCbs(std::vector<std::function<void()> >& cbs) {
 //是否还有定时器
 bool TimerManager::hasTimer() {
     RWMutexType::ReadLock lock(m_mutex);
+    if(m_type == WHEEL) {
+        return m_wheel->size() > 0;
+    }
     return !m_timers.empty();
 }
 
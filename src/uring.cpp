@@ -0,0 +1,180 @@
+#include "uring.h"
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace sylar {
+
+IoUring::IoUring() {
+    memset(&m_params, 0, sizeof(m_params));
+}
+
+IoUring::~IoUring() {
+    if(m_sqes) {
+        munmap(m_sqes, m_sqesSize);
+    }
+    if(m_cqRing && m_cqRing != m_sqRing) {
+        munmap(m_cqRing, m_cqRingSize);
+    }
+    if(m_sqRing) {
+        munmap(m_sqRing, m_sqRingSize);
+    }
+    if(m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+bool IoUring::init(uint32_t entries) {
+    memset(&m_params, 0, sizeof(m_params));
+    m_fd = syscall(__NR_io_uring_setup, entries, &m_params);
+    if(m_fd < 0) {
+        m_fd = -1;
+        return false;
+    }
+
+    //映射提交队列和完成队列，新内核可以一次映射
+    m_sqRingSize = m_params.sq_off.array + m_params.sq_entries * sizeof(uint32_t);
+    m_cqRingSize = m_params.cq_off.cqes + m_params.cq_entries * sizeof(io_uring_cqe);
+    if(m_params.features & IORING_FEAT_SINGLE_MMAP) {
+        if(m_cqRingSize > m_sqRingSize) {
+            m_sqRingSize = m_cqRingSize;
+        }
+        m_cqRingSize = m_sqRingSize;
+    }
+    m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if(m_sqRing == MAP_FAILED) {
+        m_sqRing = nullptr;
+        return false;
+    }
+    if(m_params.features & IORING_FEAT_SINGLE_MMAP) {
+        m_cqRing = m_sqRing;
+    } else {
+        m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+        if(m_cqRing == MAP_FAILED) {
+            m_cqRing = nullptr;
+            return false;
+        }
+    }
+    m_sqesSize = m_params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = (io_uring_sqe*)mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+    if(m_sqes == MAP_FAILED) {
+        m_sqes = nullptr;
+        return false;
+    }
+
+    char* sq = (char*)m_sqRing;
+    m_sqHead = (uint32_t*)(sq + m_params.sq_off.head);
+    m_sqTail = (uint32_t*)(sq + m_params.sq_off.tail);
+    m_sqMask = *(uint32_t*)(sq + m_params.sq_off.ring_mask);
+    m_sqEntries = *(uint32_t*)(sq + m_params.sq_off.ring_entries);
+    m_sqArray = (uint32_t*)(sq + m_params.sq_off.array);
+    m_sqeHead = m_sqeTail = *m_sqTail;
+
+    char* cq = (char*)m_cqRing;
+    m_cqHead = (uint32_t*)(cq + m_params.cq_off.head);
+    m_cqTail = (uint32_t*)(cq + m_params.cq_off.tail);
+    m_cqMask = *(uint32_t*)(cq + m_params.cq_off.ring_mask);
+    m_cqes = (io_uring_cqe*)(cq + m_params.cq_off.cqes);
+    return true;
+}
+
+io_uring_sqe* IoUring::getSqe() {
+    uint32_t head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+    if(m_sqeTail - head >= m_sqEntries) {
+        return nullptr;
+    }
+    io_uring_sqe* sqe = &m_sqes[m_sqeTail & m_sqMask];
+    ++m_sqeTail;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+uint32_t IoUring::sqSpace() const {
+    return m_sqEntries - (m_sqeTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE));
+}
+
+uint32_t IoUring::flush() {
+    uint32_t tail = *m_sqTail;
+    while(m_sqeHead != m_sqeTail) {
+        m_sqArray[tail & m_sqMask] = m_sqeHead & m_sqMask;
+        ++tail;
+        ++m_sqeHead;
+    }
+    __atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);
+    return tail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+}
+
+int IoUring::enter(uint32_t to_submit, uint32_t min_complete, uint32_t flags, void* arg, size_t arg_size) {
+    int rt = 0;
+    do {
+        rt = syscall(__NR_io_uring_enter, m_fd, to_submit, min_complete, flags, arg, arg_size);
+    } while(rt < 0 && errno == EINTR && !min_complete);
+    return rt < 0 ? -errno : rt;
+}
+
+int IoUring::submit() {
+    uint32_t n = flush();
+    if(!n) {
+        return 0;
+    }
+    return enter(n, 0, 0, nullptr, 0);
+}
+
+int IoUring::wait(uint32_t n, uint64_t timeout_ms) {
+    if(timeout_ms == ~0ull) {
+        return enter(n, 1, IORING_ENTER_GETEVENTS, nullptr, _NSIG / 8);
+    }
+    __kernel_timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000 * 1000;
+    io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = (uint64_t)(uintptr_t)&ts;
+    return enter(n, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+io_uring_cqe* IoUring::peekCqe() {
+    uint32_t head = *m_cqHead;
+    uint32_t tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    if(head == tail) {
+        return nullptr;
+    }
+    return &m_cqes[head & m_cqMask];
+}
+
+void IoUring::cqeSeen() {
+    __atomic_store_n(m_cqHead, *m_cqHead + 1, __ATOMIC_RELEASE);
+}
+
+bool IoUring::IsSupported() {
+    IoUring ring;
+    if(!ring.init(4)) {
+        return false;
+    }
+    if(!(ring.m_params.features & IORING_FEAT_EXT_ARG)) {
+        return false;
+    }
+    //探测需要的操作码
+    size_t len = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+    io_uring_probe* probe = (io_uring_probe*)calloc(1, len);
+    int rt = syscall(__NR_io_uring_register, ring.getFd(), IORING_REGISTER_PROBE, probe, 256);
+    bool ok = rt >= 0;
+    const int ops[] = {IORING_OP_RECV, IORING_OP_SEND, IORING_OP_RECVMSG, IORING_OP_SENDMSG,
+                       IORING_OP_ACCEPT, IORING_OP_CONNECT, IORING_OP_POLL_ADD,
+                       IORING_OP_LINK_TIMEOUT, IORING_OP_ASYNC_CANCEL, IORING_OP_SOCKET};
+    for(size_t i = 0; ok && i < sizeof(ops) / sizeof(ops[0]); ++i) {
+        ok = ops[i] <= probe->last_op && (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return ok;
+}
+
+}
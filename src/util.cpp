@@ -2,13 +2,17 @@
 #include "log.h"
 #include "fiber.h"
 #include "env.h"
+#include "macro.h"
+#include "thread.h"
 #include <execinfo.h>
 #include <sys/time.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <string.h>
 #include <dirent.h>
 #include <fstream>
+#include <set>
 
 
 namespace sylar 
@@ -16,11 +20,78 @@ namespace sylar
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
+//当前线程ID的缓存,每条日志都要取线程ID,避免每次都调用gettid
+static thread_local pid_t t_thread_id = 0;
+
+//fork之后子进程中只剩调用fork的线程,它的线程ID变了,清掉缓存
+static void ResetThreadIdCache() {
+    t_thread_id = 0;
+}
+
+struct ThreadIdCacheIniter {
+    ThreadIdCacheIniter() {
+        pthread_atfork(nullptr, nullptr, &ResetThreadIdCache);
+    }
+};
+static ThreadIdCacheIniter s_thread_id_cache_initer;
+
 //返回当前线程的ID
 pid_t getThreadId() {
-    return syscall(SYS_gettid);
+    if(!t_thread_id) {
+        t_thread_id = syscall(SYS_gettid);
+    }
+    return t_thread_id;
 }    
 
+namespace {
+
+// 线程序号分配器，线程可能在静态变量析构之后才退出，所以不释放
+struct ThreadIndexAllocator {
+    Mutex mutex;
+    std::set<int> free;     // 已归还的序号
+    int next = 0;           // 从未分配过的最小序号
+
+    static ThreadIndexAllocator* Get() {
+        static ThreadIndexAllocator* s_allocator = new ThreadIndexAllocator;
+        return s_allocator;
+    }
+};
+
+static thread_local int t_thread_index = -1;
+static thread_local bool t_thread_index_released = false;
+
+// 线程退出时归还序号
+struct ThreadIndexHolder {
+    ThreadIndexHolder() {
+        ThreadIndexAllocator* alloc = ThreadIndexAllocator::Get();
+        Mutex::Lock lock(alloc->mutex);
+        if(alloc->free.empty()) {
+            t_thread_index = alloc->next++;
+        } else {
+            t_thread_index = *alloc->free.begin();
+            alloc->free.erase(alloc->free.begin());
+        }
+    }
+    ~ThreadIndexHolder() {
+        ThreadIndexAllocator* alloc = ThreadIndexAllocator::Get();
+        Mutex::Lock lock(alloc->mutex);
+        alloc->free.insert(t_thread_index);
+        t_thread_index = -1;
+        t_thread_index_released = true;
+    }
+};
+
+}
+
+//返回当前线程的序号
+int GetThreadIndex() {
+    if(SYLAR_LIKELY(t_thread_index >= 0) || t_thread_index_released) {
+        return t_thread_index;
+    }
+    static thread_local ThreadIndexHolder s_holder;
+    return t_thread_index;
+}
+
 //返回当前协程的ID
 uint32_t getFiberId() {
     return sylar::Fiber::GetFiberId();
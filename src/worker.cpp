@@ -16,8 +16,8 @@ WorkerManager::WorkerManager()
 }
 
 bool WorkerManager::init() {
-    auto m = g_worker_config->getValue();
-    return init(m);
+    auto m = g_worker_config->getSnapshot();
+    return init(*m);
 }
 
 bool WorkerManager::init(const std::map<std::string, std::map<std::string, std::string> >& v) {
@@ -26,16 +26,19 @@ bool WorkerManager::init(const std::map<std::string, std::map<std::string, std::
         std::string name = i.first; // IOManager名称
         int thread_num = GetParamValue(i.second, "thread_num", 1);   // 线程池数量
         int worker_num = GetParamValue(i.second, "worker_num", 1);
+        // timer: set(默认) 或 wheel(时间轮)
+        TimerManager::Type timer_type = GetParamValue(i.second, "timer", std::string("set")) == "wheel"
+                                        ? TimerManager::WHEEL : TimerManager::SET;
 
         // worker_num == 1
         for(int j = 0; j < worker_num; j++) {
             Scheduler::ptr s;
             if(!j) {
                 // 创建YAML中指定名称和线程数量的IOManager
-                s = std::make_shared<IOManager>(thread_num, false, name);
+                s = std::make_shared<IOManager>(thread_num, false, name, timer_type);
             }
             else {
-                s = std::make_shared<IOManager>(thread_num, false, name + "-" + std::to_string(j));
+                s = std::make_shared<IOManager>(thread_num, false, name + "-" + std::to_string(j), timer_type);
             }
             add(s);
         }
@@ -0,0 +1,260 @@
+/**
+ * @brief BinaryLogAppender和BinLogReader测试
+ * @details 用法: binlog_test [条数]
+ *              1.各种类型的参数编码后还原的文本和snprintf一致;文本日志写入二进制文件也能还原
+ *              2.同一条二进制日志交给文本Appender时按格式还原
+ *              3.写满后覆盖最旧的记录,解码出来的是最后写入的连续记录
+ *              4.多个线程同时写,每条都能解码,每个线程内的顺序不变
+ *              5.重新打开时上一次的文件改名为.old,仍然可以解码;通过logs配置BinaryLogAppender
+ *              6.对比二进制日志和FileLogAppender同步/异步写入的每条耗时
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
+#include <thread>
+#include <vector>
+#include <yaml-cpp/yaml.h>
+#include "binlog.h"
+#include "config.h"
+#include "log.h"
+#include "util.h"
+#include "check.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const std::string LOG_DIR = "/tmp/binlog_test";
+static int s_count = 200000;
+
+static sylar::Logger::ptr make_logger(const std::string& name, sylar::LogAppender::ptr appender) {
+    sylar::Logger::ptr logger = std::make_shared<sylar::Logger>(name);
+    logger->addApender(appender);
+    return logger;
+}
+
+// 解码文件中所有记录,返回格式化后的文本
+static std::vector<std::string> decode(const std::string& file, const std::string& pattern = "%m"
+                                       , uint64_t* corrupted = nullptr) {
+    std::vector<std::string> lines;
+    sylar::BinLogReader reader;
+    if(!reader.open(file)) {
+        SYLAR_LOG_ERROR(g_logger) << reader.getError();
+        return lines;
+    }
+    sylar::LogFormatter formatter(pattern);
+    reader.foreach([&](sylar::LogEvent::ptr event) {
+        lines.push_back(formatter.format(event->getLogger(), event->getLevel(), event));
+    });
+    if(corrupted) {
+        *corrupted = reader.getCorrupted();
+    }
+    return lines;
+}
+
+static std::string sprintf_str(const char* fmt, ...) {
+    char buf[1024];
+    va_list vl;
+    va_start(vl, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, vl);
+    va_end(vl);
+    return buf;
+}
+
+void test_types() {
+    std::string file = LOG_DIR + "/types.blog";
+    auto appender = std::make_shared<sylar::BinaryLogAppender>(file, 64 * 1024);
+    CHECK(appender->isOpen());
+    auto logger = make_logger("bin_types", appender);
+    std::string str = "hello";
+    int i = -42;
+    unsigned long long u = 18446744073709551615ULL;
+    double d = 3.14159;
+    void* p = &i;
+    char c = 'x';
+    short sh = -7;
+    bool b = true;
+    std::vector<std::string> expect;
+    SYLAR_LOG_BIN_INFO(logger, "no args");
+    expect.push_back("no args");
+    SYLAR_LOG_BIN_INFO(logger, "i=%d u=%llu d=%.2f s=%s c=%c p=%p", i, u, d, str, c, p);
+    expect.push_back(sprintf_str("i=%d u=%llu d=%.2f s=%s c=%c p=%p", i, u, d, str.c_str(), c, p));
+    SYLAR_LOG_BIN_WARN(logger, "[%5d] [%-6s] [%08.3f] [%x] [%hd] %d%%", 12, "ab", d, 255, sh, b);
+    expect.push_back(sprintf_str("[%5d] [%-6s] [%08.3f] [%x] [%hd] %d%%", 12, "ab", d, 255, sh, (int)b));
+    // 类型和转换说明不一致,参数缺少
+    SYLAR_LOG_BIN_ERROR(logger, "%d %s %f", "text", 5);
+    expect.push_back("text 5 %f");
+    SYLAR_LOG_INFO(logger) << "text record " << 1;
+    expect.push_back("text record 1");
+
+    auto lines = decode(file);
+    CHECK(lines == expect);
+    for(size_t n = 0; n < lines.size() && n < expect.size(); ++n) {
+        if(lines[n] != expect[n]) {
+            SYLAR_LOG_ERROR(g_logger) << "decode: [" << lines[n] << "] expect: [" << expect[n] << "]";
+        }
+    }
+    // 其他字段
+    lines = decode(file, "%p %c %N %f %t");
+    std::string expect_head = std::string("INFO bin_types ") + sylar::Thread::getCurrThreadName()
+                        + " tests/binlog_test.cpp " + std::to_string(sylar::getThreadId());
+    CHECK(!lines.empty() && lines[0] == expect_head);
+    CHECK(lines.size() > 2 && lines[2].substr(0, 5) == "WARN ");
+}
+
+void test_text_appender() {
+    unlink((LOG_DIR + "/text.log").c_str());
+    auto appender = std::make_shared<sylar::FileLogAppender>(LOG_DIR + "/text.log");
+    appender->setFormatter(std::make_shared<sylar::LogFormatter>("%m%n"));
+    auto logger = make_logger("bin_text", appender);
+    SYLAR_LOG_BIN_INFO(logger, "lazy %s %d", std::string("render"), 7);
+    appender->flush();
+    std::ifstream ifs(LOG_DIR + "/text.log");
+    std::string line;
+    std::getline(ifs, line);
+    CHECK(line == "lazy render 7");
+}
+
+void test_wrap() {
+    std::string file = LOG_DIR + "/wrap.blog";
+    auto appender = std::make_shared<sylar::BinaryLogAppender>(file, 64 * 1024);
+    auto logger = make_logger("bin_wrap", appender);
+    int count = 20000;
+    for(int i = 0; i < count; ++i) {
+        SYLAR_LOG_BIN_DEBUG(logger, "seq=%d pad=%s", i, i % 7 ? "x" : "longer string argument");
+    }
+    CHECK(appender->getWritePos() > appender->getCapacity());
+    uint64_t corrupted = 0;
+    auto lines = decode(file, "%m", &corrupted);
+    bool ok = !lines.empty();
+    int first = count - (int)lines.size();
+    for(size_t i = 0; i < lines.size() && ok; ++i) {
+        int seq = first + i;
+        ok = lines[i] == sprintf_str("seq=%d pad=%s", seq, seq % 7 ? "x" : "longer string argument");
+    }
+    SYLAR_LOG_INFO(g_logger) << "wrap: " << lines.size() << " of " << count << " records in ring";
+    CHECK(ok);
+    CHECK(lines.size() > 1000 && lines.size() < (size_t)count);
+    CHECK(corrupted == 0);
+}
+
+void test_threads() {
+    std::string file = LOG_DIR + "/threads.blog";
+    auto appender = std::make_shared<sylar::BinaryLogAppender>(file, 32 * 1024 * 1024);
+    auto logger = make_logger("bin_threads", appender);
+    const int threads = 4;
+    const int count = 50000;
+    std::vector<std::thread> ths;
+    for(int t = 0; t < threads; ++t) {
+        ths.emplace_back([logger, t, count]() {
+            for(int i = 0; i < count; ++i) {
+                SYLAR_LOG_BIN_INFO(logger, "thread=%d seq=%d", t, i);
+            }
+        });
+    }
+    for(auto& i : ths) {
+        i.join();
+    }
+    auto lines = decode(file);
+    std::vector<int> next(threads, 0);
+    bool ok = true;
+    for(auto& i : lines) {
+        int t = -1, seq = -1;
+        if(sscanf(i.c_str(), "thread=%d seq=%d", &t, &seq) != 2 || t < 0 || t >= threads || next[t] != seq) {
+            ok = false;
+            break;
+        }
+        ++next[t];
+    }
+    CHECK(ok);
+    CHECK(lines.size() == (size_t)threads * count);
+}
+
+void test_reopen_config() {
+    std::string file = LOG_DIR + "/conf.blog";
+    {
+        auto appender = std::make_shared<sylar::BinaryLogAppender>(file, 64 * 1024);
+        auto logger = make_logger("bin_old", appender);
+        SYLAR_LOG_BIN_INFO(logger, "previous run %d", 1);
+    }
+    YAML::Node root = YAML::Load(
+        "logs:\n"
+        "    - name: bin_conf\n"
+        "      level: debug\n"
+        "      appenders:\n"
+        "          - type: BinaryLogAppender\n"
+        "            file: /tmp/binlog_test/conf.blog\n"
+        "            size: 100000\n");
+    sylar::Config::LoadFromYaml(root);
+    auto logger = SYLAR_LOG_NAME("bin_conf");
+    std::string yaml = logger->toYamlString();
+    CHECK(yaml.find("type: BinaryLogAppender") != std::string::npos);
+    CHECK(yaml.find("size: 131072") != std::string::npos);
+    SYLAR_LOG_BIN_INFO(logger, "from config %s", "ok");
+
+    auto lines = decode(file + ".old");
+    CHECK(lines.size() == 1 && lines[0] == "previous run 1");
+    lines = decode(file, "[%c] %m");
+    CHECK(lines.size() == 1 && lines[0] == "[bin_conf] from config ok");
+}
+
+// 单线程写count条,返回每条的纳秒数
+template<class F>
+static double bench(int count, F f) {
+    uint64_t begin = sylar::GetCurrentUS();
+    for(int i = 0; i < count; ++i) {
+        f(i);
+    }
+    return (sylar::GetCurrentUS() - begin) * 1000.0 / count;
+}
+
+void test_bench() {
+    std::string str = "GET /index.html";
+    double d = 0.125;
+
+    auto bin = std::make_shared<sylar::BinaryLogAppender>(LOG_DIR + "/bench.blog", 64 * 1024 * 1024);
+    auto bin_logger = make_logger("bench_bin", bin);
+    double bin_ns = bench(s_count, [&](int i) {
+        SYLAR_LOG_BIN_INFO(bin_logger, "request id=%d uri=%s cost=%.3f", i, str, d);
+    });
+
+    unlink((LOG_DIR + "/bench_sync.log").c_str());
+    auto sync = std::make_shared<sylar::FileLogAppender>(LOG_DIR + "/bench_sync.log");
+    auto sync_logger = make_logger("bench_sync", sync);
+    double sync_ns = bench(s_count, [&](int i) {
+        SYLAR_LOG_FMT_INFO(sync_logger, "request id=%d uri=%s cost=%.3f", i, str.c_str(), d);
+    });
+
+    unlink((LOG_DIR + "/bench_async.log").c_str());
+    auto async = std::make_shared<sylar::FileLogAppender>(LOG_DIR + "/bench_async.log", true);
+    auto async_logger = make_logger("bench_async", async);
+    double async_ns = bench(s_count, [&](int i) {
+        SYLAR_LOG_FMT_INFO(async_logger, "request id=%d uri=%s cost=%.3f", i, str.c_str(), d);
+    });
+    async->flush();
+
+    SYLAR_LOG_INFO(g_logger) << "bench " << s_count << " events: binary=" << (int)bin_ns
+                             << " ns/event, file sync=" << (int)sync_ns
+                             << " ns/event, file async=" << (int)async_ns << " ns/event";
+    CHECK(decode(LOG_DIR + "/bench.blog").size() == (size_t)s_count);
+    CHECK(bin->getDropped() == 0);
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1) {
+        s_count = atoi(argv[1]);
+    }
+    if(s_count < 1000) {
+        s_count = 1000;
+    }
+    mkdir(LOG_DIR.c_str(), 0755);
+    test_types();
+    test_text_appender();
+    test_wrap();
+    test_threads();
+    test_reopen_config();
+    test_bench();
+
+    _exit(check_report("binlog test"));
+}
@@ -0,0 +1,38 @@
+/**
+ * @file check.h
+ * @brief 测试程序共用的检查宏
+ * @details CHECK失败时记录日志并计数，不中断测试；
+ *          main结束前用check_report输出结果，以s_failed决定进程的返回值
+ */
+#ifndef __SYLAR_TESTS_CHECK_H__
+#define __SYLAR_TESTS_CHECK_H__
+
+#include <string>
+#include "log.h"
+
+// 失败的检查个数
+static int s_failed = 0;
+
+#define CHECK(cond) \
+    do { \
+        if(!(cond)) { \
+            ++s_failed; \
+            SYLAR_LOG_ERROR(SYLAR_LOG_ROOT()) << "check failed: " #cond; \
+        } \
+    } while(0)
+
+/**
+ * @brief 输出检查结果
+ * @param[in] name 测试名称
+ * @return 有检查失败时返回1，否则返回0
+ */
+static inline int check_report(const std::string& name) {
+    if(s_failed) {
+        SYLAR_LOG_ERROR(SYLAR_LOG_ROOT()) << name << ": " << s_failed << " checks failed";
+    } else {
+        SYLAR_LOG_INFO(SYLAR_LOG_ROOT()) << name << ": all checks passed";
+    }
+    return s_failed ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,153 @@
+/**
+ * @brief ConfigVar无锁读取测试和压测
+ * @details 用法: config_var_test [每个线程读取次数] [线程数]
+ *              1.回调函数在新值生效前调用,参数是旧值和新值,回调中getValue()得到旧值;值相同时不调用回调
+ *              2.修改前取得的快照在参数被修改后仍然有效,保持修改前的值
+ *              3.多个线程读取的同时不断修改,读到的值都是完整的(某一次设置的值);
+ *                停止修改后每个线程都读到最后设置的值,被替换的快照在各线程读到新值后释放
+ *              4.对比getValue()和加读锁读取的每次耗时
+ */
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+#include <unistd.h>
+#include "config.h"
+#include "log.h"
+#include "thread.h"
+#include "util.h"
+#include "check.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static int s_count = 10000000;
+static int s_threads = 4;
+
+static sylar::ConfigVar<uint64_t>::ptr g_int_var =
+    sylar::Config::Lookup("test.var.int", (uint64_t)1, "test int");
+
+static sylar::ConfigVar<std::string>::ptr g_str_var =
+    sylar::Config::Lookup("test.var.str", std::string(64, 'a'), "test string");
+
+void test_listener() {
+    int calls = 0;
+    bool ok = true;
+    uint64_t id = g_int_var->addListener([&](const uint64_t& old_value, const uint64_t& new_value) {
+        ++calls;
+        ok = ok && old_value == 1 && new_value == 2 && g_int_var->getValue() == 1;
+    });
+    std::shared_ptr<const uint64_t> snapshot = g_int_var->getSnapshot();
+    g_int_var->setValue(2);
+    CHECK(calls == 1 && ok);
+    CHECK(g_int_var->getValue() == 2);
+    CHECK(*snapshot == 1);
+    CHECK(*g_int_var->getSnapshot() == 2);
+    g_int_var->setValue(2);
+    CHECK(calls == 1);
+    g_int_var->delListener(id);
+    g_int_var->setValue(3);
+    CHECK(calls == 1 && g_int_var->getValue() == 3);
+    CHECK(g_int_var->fromString("4") && g_int_var->toString() == "4");
+}
+
+void test_concurrent() {
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> bad(0);
+    std::atomic<uint64_t> reads(0);
+    std::atomic<int> stale(0);
+    std::weak_ptr<const std::string> first = g_str_var->getSnapshot();
+    std::vector<std::thread> readers;
+    for(int i = 0; i < s_threads; ++i) {
+        readers.emplace_back([&]() {
+            uint64_t n = 0;
+            while(!stop) {
+                std::string v = g_str_var->getValue();
+                // 每次设置的值都是同一个字符重复64次
+                if(v.size() != 64 || v.find_first_not_of(v[0]) != std::string::npos) {
+                    ++bad;
+                }
+                ++n;
+            }
+            if(g_str_var->getValue() != std::string(64, 'z')) {
+                ++stale;
+            }
+            reads += n;
+        });
+    }
+    int sets = 0;
+    uint64_t begin = sylar::GetCurrentMS();
+    while(sylar::GetCurrentMS() - begin < 500 && sets < 100000) {
+        g_str_var->setValue(std::string(64, 'a' + sets % 26));
+        ++sets;
+    }
+    g_str_var->setValue(std::string(64, 'z'));
+    stop = true;
+    for(auto& i : readers) {
+        i.join();
+    }
+    SYLAR_LOG_INFO(g_logger) << "concurrent: sets=" << sets << " reads=" << reads << " bad=" << bad;
+    CHECK(bad == 0);
+    CHECK(stale == 0);
+    // 读取线程已经退出,本线程也读到了新值,最初的快照没有人再持有
+    CHECK(g_str_var->getValue() == std::string(64, 'z'));
+    CHECK(first.expired());
+}
+
+// 每个线程读取s_count次,返回每次的纳秒数
+template<class F>
+static double bench(F f) {
+    std::vector<std::thread> threads;
+    std::atomic<uint64_t> sum(0);
+    uint64_t begin = sylar::GetCurrentUS();
+    for(int i = 0; i < s_threads; ++i) {
+        threads.emplace_back([&]() {
+            uint64_t s = 0;
+            for(int j = 0; j < s_count; ++j) {
+                s += f();
+            }
+            sum += s;
+        });
+    }
+    for(auto& i : threads) {
+        i.join();
+    }
+    uint64_t us = sylar::GetCurrentUS() - begin;
+    CHECK(sum > 0);
+    return us * 1000.0 / s_count;
+}
+
+void test_bench() {
+    sylar::RWMutex mutex;
+    uint64_t value = 16 * 1024;
+    double locked = bench([&]() {
+        sylar::RWMutex::ReadLock lock(mutex);
+        return value;
+    });
+    g_int_var->setValue(16 * 1024);
+    double lock_free = bench([&]() {
+        return g_int_var->getValue();
+    });
+    SYLAR_LOG_INFO(g_logger) << "bench threads=" << s_threads << " reads=" << s_count
+                             << " per thread: rwlock=" << locked << " ns/read, getValue="
+                             << lock_free << " ns/read";
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1) {
+        s_count = atoi(argv[1]);
+    }
+    if(argc > 2) {
+        s_threads = atoi(argv[2]);
+    }
+    if(s_count <= 0) {
+        s_count = 1;
+    }
+    if(s_threads <= 0) {
+        s_threads = 1;
+    }
+    test_listener();
+    test_concurrent();
+    test_bench();
+
+    _exit(check_report("config var test"));
+}
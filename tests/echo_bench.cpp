@@ -0,0 +1,262 @@
+/**
+ * @brief echo_server压测: 对比epoll和io_uring两种IO后端
+ * @details 用法: echo_bench [echo_server路径] [连接数] [每个连接的请求数] [消息大小] [服务端线程数]
+ *          每种后端跑两轮:
+ *              1.不跟踪，统计吞吐
+ *              2.用ptrace跟踪服务端所有线程，统计请求期间服务端每个请求的系统调用次数
+ */
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <string>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ptrace.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "log.h"
+#include "util.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static std::string s_server = "bin/echo_server";
+static int s_conns = 8;
+static int s_reqs = 5000;
+static int s_size = 64;
+static std::string s_threads = "1";
+static const int PORT = 8020;
+
+//连接echo_server，失败返回-1
+static int connect_server() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(connect(fd, (sockaddr*)&addr, sizeof(addr))) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+//等待服务端开始监听
+static bool wait_server() {
+    for(int i = 0; i < 500; ++i) {
+        int fd = connect_server();
+        if(fd >= 0) {
+            close(fd);
+            return true;
+        }
+        usleep(10 * 1000);
+    }
+    return false;
+}
+
+//每个连接串行发送s_reqs个请求，每个请求等待完整回显后再发下一个
+static bool run_clients() {
+    std::atomic<int> failed = {0};
+    std::vector<std::thread> thrs;
+    for(int i = 0; i < s_conns; ++i) {
+        thrs.emplace_back([&failed](){
+            int fd = connect_server();
+            if(fd < 0) {
+                ++failed;
+                return;
+            }
+            std::string msg(s_size, 'x');
+            std::string buf(s_size, 0);
+            for(int j = 0; j < s_reqs; ++j) {
+                if(write(fd, &msg[0], msg.size()) != (ssize_t)msg.size()) {
+                    ++failed;
+                    break;
+                }
+                int n = 0;
+                while(n < s_size) {
+                    ssize_t rt = read(fd, &buf[n], s_size - n);
+                    if(rt <= 0) {
+                        break;
+                    }
+                    n += rt;
+                }
+                if(n != s_size) {
+                    ++failed;
+                    break;
+                }
+            }
+            close(fd);
+        });
+    }
+    for(auto& i : thrs) {
+        i.join();
+    }
+    return failed == 0;
+}
+
+//启动echo_server，traced为true时子进程先停下等待父进程跟踪
+static pid_t start_server(bool uring, bool traced) {
+    pid_t pid = fork();
+    if(pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        if(traced) {
+            ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+            raise(SIGSTOP);
+        }
+        execl(s_server.c_str(), s_server.c_str(), "-e", uring ? "-u" : "-", s_threads.c_str(), (char*)nullptr);
+        _exit(127);
+    }
+    return pid;
+}
+
+/**
+ * @brief 等待端口可以重新绑定
+ * @details io_uring实例在进程退出后由内核异步回收，回收前挂在上面的accept仍持有监听socket，
+ *          直接启动下一个服务端会bind失败，旧的监听socket还会接受连接
+ */
+static void wait_port_free() {
+    for(int i = 0; i < 500; ++i) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(PORT);
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        int rt = bind(fd, (sockaddr*)&addr, sizeof(addr));
+        close(fd);
+        if(rt == 0) {
+            return;
+        }
+        usleep(10 * 1000);
+    }
+}
+
+static void stop_server(pid_t pid) {
+    kill(pid, SIGKILL);
+    while(waitpid(pid, nullptr, 0) < 0 && errno == EINTR);
+    wait_port_free();
+}
+
+//不跟踪，返回QPS
+static double bench_qps(bool uring) {
+    pid_t pid = start_server(uring, false);
+    if(!wait_server()) {
+        SYLAR_LOG_ERROR(g_logger) << "echo_server not ready: " << s_server;
+        stop_server(pid);
+        return 0;
+    }
+    uint64_t begin = sylar::GetCurrentUS();
+    bool ok = run_clients();
+    uint64_t used = sylar::GetCurrentUS() - begin;
+    stop_server(pid);
+    if(!ok) {
+        SYLAR_LOG_ERROR(g_logger) << "bench failed";
+        return 0;
+    }
+    return (double)s_conns * s_reqs * 1000000 / (used ? used : 1);
+}
+
+/**
+ * @brief 跟踪服务端的所有线程，返回请求期间服务端的系统调用次数
+ * @details ptrace的请求必须由跟踪者线程发出，所以主线程负责跟踪，压测在另一个线程执行；
+ *          每个系统调用会产生进入和退出两次syscall-stop
+ */
+static uint64_t bench_syscalls(bool uring) {
+    pid_t pid = start_server(uring, true);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    ptrace(PTRACE_SETOPTIONS, pid, nullptr,
+           (void*)(long)(PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_TRACEEXEC));
+    ptrace(PTRACE_SYSCALL, pid, nullptr, nullptr);
+
+    std::atomic<uint64_t> stops = {0};
+    std::atomic<uint64_t> begin_stops = {0};
+    std::atomic<uint64_t> end_stops = {0};
+    std::atomic<bool> ok = {false};
+    std::thread driver([&](){
+        if(wait_server()) {
+            begin_stops = stops.load();
+            ok = run_clients();
+            end_stops = stops.load();
+        } else {
+            SYLAR_LOG_ERROR(g_logger) << "echo_server not ready: " << s_server;
+        }
+        kill(pid, SIGKILL);
+    });
+
+    while(true) {
+        pid_t tid = waitpid(-1, &status, __WALL);
+        if(tid < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            break;   //ECHILD: 所有线程都已退出
+        }
+        if(!WIFSTOPPED(status)) {
+            continue;
+        }
+        int sig = WSTOPSIG(status);
+        if(sig == (SIGTRAP | 0x80)) {
+            ++stops;
+            sig = 0;
+        } else if(status >> 16) {
+            sig = 0;   //clone/exec事件
+        } else if(sig == SIGSTOP) {
+            sig = 0;   //新线程被自动跟踪时的SIGSTOP
+        }
+        ptrace(PTRACE_SYSCALL, tid, nullptr, (void*)(long)sig);
+    }
+    driver.join();
+    wait_port_free();
+    if(!ok) {
+        SYLAR_LOG_ERROR(g_logger) << "traced bench failed";
+        return 0;
+    }
+    return (end_stops - begin_stops) / 2;
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1) {
+        s_server = argv[1];
+    }
+    if(argc > 2) {
+        s_conns = atoi(argv[2]);
+    }
+    if(argc > 3) {
+        s_reqs = atoi(argv[3]);
+    }
+    if(argc > 4) {
+        s_size = atoi(argv[4]);
+    }
+    if(argc > 5) {
+        s_threads = argv[5];
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    uint64_t total = (uint64_t)s_conns * s_reqs;
+    SYLAR_LOG_INFO(g_logger) << "echo_bench server=" << s_server << " conns=" << s_conns
+                             << " reqs/conn=" << s_reqs << " size=" << s_size
+                             << " server_threads=" << s_threads;
+    const char* names[] = {"epoll", "io_uring"};
+    for(int i = 0; i < 2; ++i) {
+        double qps = bench_qps(i == 1);
+        uint64_t syscalls = bench_syscalls(i == 1);
+        SYLAR_LOG_INFO(g_logger) << names[i] << ": qps=" << (uint64_t)qps
+                                 << " syscalls=" << syscalls
+                                 << " syscalls/request=" << (double)syscalls / total;
+    }
+    return 0;
+}
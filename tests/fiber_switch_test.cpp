@@ -0,0 +1,103 @@
+#include <iostream>
+#include <stdlib.h>
+#include <ucontext.h>
+#include "log.h"
+#include "fiber.h"
+#include "fiber_context.h"
+#include "util.h"
+
+sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const uint64_t N = 1000000;     //每种方式切换的轮数(每轮两次切换)
+static const size_t STACK_SIZE = 128 * 1024;
+
+//输出每秒切换次数
+static void report(const std::string& name, uint64_t us) {
+    uint64_t switches = N * 2;
+    SYLAR_LOG_INFO(g_logger) << name << ": " << switches << " switches in " << us / 1000 << "ms, "
+                             << (uint64_t)(switches * 1000000.0 / (us ? us : 1)) << " switches/sec";
+}
+
+/******************* Fiber::swapIn / YieldToHold *******************/
+static void fiber_loop() {
+    while(true) {
+        sylar::Fiber::YieldToHold();
+    }
+}
+
+//测试当前编译进Fiber的上下文切换后端
+void test_fiber() {
+    sylar::Fiber::GetThis();
+    sylar::Fiber::ptr f(new sylar::Fiber(fiber_loop, STACK_SIZE, false));
+    uint64_t begin = sylar::GetCurrentUS();
+    for(uint64_t i = 0; i < N; ++i) {
+        f->swapIn();
+    }
+#ifdef SYLAR_FIBER_ASM_CONTEXT
+    report("Fiber(asm)", sylar::GetCurrentUS() - begin);
+#else
+    report("Fiber(ucontext)", sylar::GetCurrentUS() - begin);
+#endif
+    //f处于HOLD状态，不能析构，随进程退出释放
+    new sylar::Fiber::ptr(f);
+}
+
+/******************* ucontext swapcontext *******************/
+static ucontext_t s_main_uctx;
+static ucontext_t s_uctx;
+
+static void ucontext_loop() {
+    while(true) {
+        swapcontext(&s_uctx, &s_main_uctx);
+    }
+}
+
+void test_ucontext() {
+    void* stack = malloc(STACK_SIZE);
+    getcontext(&s_uctx);
+    s_uctx.uc_link = nullptr;
+    s_uctx.uc_stack.ss_sp = stack;
+    s_uctx.uc_stack.ss_size = STACK_SIZE;
+    makecontext(&s_uctx, &ucontext_loop, 0);
+
+    uint64_t begin = sylar::GetCurrentUS();
+    for(uint64_t i = 0; i < N; ++i) {
+        swapcontext(&s_main_uctx, &s_uctx);
+    }
+    report("ucontext", sylar::GetCurrentUS() - begin);
+}
+
+/******************* sylar_swap_context *******************/
+#ifdef SYLAR_FIBER_ASM_CONTEXT
+static void* s_main_sp = nullptr;
+static void* s_sp = nullptr;
+
+static void asm_loop() {
+    while(true) {
+        sylar_swap_context(&s_sp, s_main_sp);
+    }
+}
+
+void test_asm() {
+    void* stack = malloc(STACK_SIZE);
+    s_sp = sylar::MakeFiberContext(stack, STACK_SIZE, &asm_loop);
+
+    uint64_t begin = sylar::GetCurrentUS();
+    for(uint64_t i = 0; i < N; ++i) {
+        sylar_swap_context(&s_main_sp, s_sp);
+    }
+    report("asm", sylar::GetCurrentUS() - begin);
+}
+#endif
+
+int main(int argc, char** argv) {
+    //屏蔽Fiber构造/析构的调试日志
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::INFO);
+
+    test_ucontext();
+#ifdef SYLAR_FIBER_ASM_CONTEXT
+    test_asm();
+#endif
+    test_fiber();
+    return 0;
+}
@@ -4,6 +4,7 @@
 #include "log.h"
 #include "fiber.h"
 #include "thread.h"
+#include "macro.h"
 
 sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
 
@@ -23,9 +24,27 @@ void test_fiber() {
     SYLAR_LOG_INFO(g_logger) << "test_fiber end";
 }
 
+//测试协程栈池:已析构协程的栈会被新协程复用
+void test_stack_pool() {
+    sylar::Fiber::GetThis();
+    sylar::Fiber::StackStats before = sylar::Fiber::GetStackStats();
+    for(int i = 0; i < 1000; ++i) {
+        sylar::Fiber::ptr f(new sylar::Fiber([](){}, 0, false));
+        f->swapIn();
+    }
+    sylar::Fiber::StackStats after = sylar::Fiber::GetStackStats();
+    SYLAR_LOG_INFO(g_logger) << "stack pool in_use=" << after.inUse
+        << " high_water=" << after.highWater
+        << " cached=" << after.cached
+        << " mmaps=" << after.mmaps - before.mmaps
+        << " reused=" << after.reused - before.reused
+        << " guarded=" << after.guarded;
+    SYLAR_ASSERT(after.mmaps - before.mmaps <= 1);
+}
 
 int main(int argc, char** argv) {
     sylar::Thread::setCurrThreadName("main");
+    test_stack_pool();
     std::vector<sylar::Thread::ptr> thr;
     for(int i = 0; i < 3; ++i) {
         thr.push_back(sylar::Thread::ptr(new sylar::Thread(test_fiber, 
@@ -2,6 +2,9 @@
 #include "hook.h"
 #include "log.h"
 #include "iomanager.h"
+#include "config.h"
+#include "fd_manager.h"
+#include "util.h"
 #include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -61,8 +64,48 @@ void test_hook_socket() {
     SYLAR_LOG_INFO(g_logger) << buff;
 }
 
+//io_uring后端: 读超时、close取消阻塞中的读、普通收发
+void test_hook_uring() {
+    sylar::Config::Lookup<std::string>("iomanager.backend")->setValue("io_uring");
+    sylar::IOManager iom(2, false);
+    SYLAR_LOG_INFO(g_logger) << "backend=" << (iom.getBackend() == sylar::IOManager::IO_URING ? "io_uring" : "epoll");
+
+    iom.scheduler([](){
+        int sv[2];
+        socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+        sylar::FdMgr::GetInstance()->getFdCtx(sv[0], true);
+        sylar::FdMgr::GetInstance()->getFdCtx(sv[1], true);
+
+        struct timeval tv = {0, 100 * 1000};
+        setsockopt(sv[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        char buf[16];
+        uint64_t begin = sylar::GetCurrentMS();
+        int rt = recv(sv[0], buf, sizeof(buf), 0);
+        SYLAR_LOG_INFO(g_logger) << "recv timeout rt=" << rt << " errno=" << strerror(errno)
+                                 << " used=" << sylar::GetCurrentMS() - begin << "ms";
+
+        sylar::IOManager::GetThis()->scheduler([sv](){
+            write(sv[1], "hello", 5);
+        });
+        rt = read(sv[0], buf, sizeof(buf));
+        SYLAR_LOG_INFO(g_logger) << "read rt=" << rt << " data=" << std::string(buf, rt > 0 ? rt : 0);
+
+        int fd = sv[1];
+        sylar::IOManager::GetThis()->addTimer(100, [fd](){
+            close(fd);
+        });
+        rt = read(sv[1], buf, sizeof(buf));
+        SYLAR_LOG_INFO(g_logger) << "read after close rt=" << rt << " errno=" << strerror(errno);
+        close(sv[0]);
+    });
+}
+
 int main(int argc, char** argv) {
     // test_hook_sleep();
+    if(argc > 1 && strcmp(argv[1], "-u") == 0) {
+        test_hook_uring();
+        return 0;
+    }
 
     sylar::IOManager iom(1, false);
     iom.scheduler(&test_hook_socket);
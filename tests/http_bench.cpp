@@ -0,0 +1,277 @@
+/**
+ * @brief HTTP请求解析压测
+ * @details 用法: http_bench [请求总数] [管线深度]
+ *              1.纯解析: 每个请求新建解析器并拷贝头部 vs 复用零拷贝解析器
+ *              2.解析+分发: 零拷贝解析后查找servlet、读取几个头部、按类型读取Content-Length、生成响应头部，
+ *                对比头部拷贝进map(原HttpRequest的头部存储)和扁平的HttpHeaders
+ *              3.管线化长连接: 客户端每次连续发送[管线深度]个请求，统计HttpServer每秒处理的请求数
+ */
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <string>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <boost/lexical_cast.hpp>
+#include "http_server.h"
+#include "http_parser.h"
+#include "log.h"
+#include "util.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static int s_count = 200000;
+static int s_depth = 16;
+static std::atomic<int> s_port(0);     // 服务器绑定127.0.0.1:0后由系统分配的端口，绑定失败为-1
+
+// 一个典型的浏览器请求
+static const std::string s_request = "GET /bench/hello?name=sylar&id=1 HTTP/1.1\r\n"
+                            "Host: 127.0.0.1:8021\r\n"
+                            "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36\r\n"
+                            "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+                            "Accept-Encoding: gzip, deflate\r\n"
+                            "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+                            "Cache-Control: no-cache\r\n"
+                            "Connection: Keep-Alive\r\n\r\n";
+
+static void report(const std::string& name, uint64_t count, uint64_t us) {
+    SYLAR_LOG_INFO(g_logger) << name << ": " << count << " requests in " << us / 1000 << "ms, "
+                             << (uint64_t)(count * 1000000.0 / (us ? us : 1)) << " requests/sec";
+}
+
+/******************* 纯解析 *******************/
+// 每个请求新建解析器，头部拷贝成std::string放入map
+void bench_parse_copy() {
+    std::string data = s_request;
+    uint64_t begin = sylar::GetCurrentUS();
+    size_t total = 0;
+    for(int i = 0; i < s_count; ++i) {
+        sylar::http::HttpRequestParser::ptr parser = std::make_shared<sylar::http::HttpRequestParser>();
+        parser->execute(&data[0], data.size(), false);
+        total += parser->getData()->getPath().size() + parser->getData()->getHeader("Host").size();
+    }
+    report("parse(copy)", s_count, sylar::GetCurrentUS() - begin);
+    SYLAR_LOG_DEBUG(g_logger) << total;
+}
+
+// 复用同一个零拷贝解析器，路径和头部以片段的形式指向数据
+void bench_parse_zero_copy() {
+    std::string data = s_request;
+    sylar::http::HttpRequestParser parser(true);
+    static const std::string host = "Host";
+    uint64_t begin = sylar::GetCurrentUS();
+    size_t total = 0;
+    for(int i = 0; i < s_count; ++i) {
+        parser.reset();
+        parser.execute(&data[0], data.size(), false);
+        total += parser.getData()->getPath().size() + parser.getData()->getHeaderSlice(host).size;
+    }
+    report("parse(zero copy)", s_count, sylar::GetCurrentUS() - begin);
+    SYLAR_LOG_DEBUG(g_logger) << total;
+}
+
+/******************* 解析+分发 *******************/
+// 带请求体的表单提交
+static const std::string s_post_request = "POST /bench/form HTTP/1.1\r\n"
+                            "Host: 127.0.0.1:8021\r\n"
+                            "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36\r\n"
+                            "Accept: */*\r\n"
+                            "Accept-Encoding: gzip, deflate\r\n"
+                            "Content-Type: application/x-www-form-urlencoded\r\n"
+                            "Content-Length: 16\r\n"
+                            "Cookie: sid=0123456789abcdef; theme=dark\r\n"
+                            "X-Request-Id: 5f0c6c1e-7f5a-4d7e-9a55-1c2b3d4e5f60\r\n"
+                            "Connection: Keep-Alive\r\n\r\n"
+                            "name=sylar&id=1";
+
+static sylar::http::ServletDispatch::ptr make_dispatch() {
+    sylar::http::ServletDispatch::ptr dispatch = std::make_shared<sylar::http::ServletDispatch>();
+    dispatch->addServlet("/bench/form", [](sylar::http::HttpRequest::ptr req,
+                                           sylar::http::HttpResponse::ptr res,
+                                           sylar::http::HttpSession::ptr session) {
+        return 0;
+    });
+    return dispatch;
+}
+
+// 头部拷贝进map，按字符串查找，lexical_cast转换类型，响应头部同样放在map里
+void bench_dispatch_map() {
+    std::string data = s_post_request;
+    sylar::http::HttpRequestParser parser(true);
+    sylar::http::ServletDispatch::ptr dispatch = make_dispatch();
+    uint64_t begin = sylar::GetCurrentUS();
+    size_t total = 0;
+    for(int i = 0; i < s_count; ++i) {
+        parser.reset();
+        parser.execute(&data[0], data.size(), false);
+        sylar::http::HttpRequest::ptr req = parser.getData();
+        sylar::http::HttpRequest::MapType headers;
+        for(auto& h : req->getHeaders()) {
+            headers[std::string(h.name, h.nameLen)] = std::string(h.value, h.valueLen);
+        }
+        total += dispatch->getMatchServlet(req) != nullptr;
+        total += headers["Host"].size() + headers["Connection"].size() + headers["Cookie"].size();
+        total += boost::lexical_cast<uint64_t>(headers["Content-Length"]);
+
+        sylar::http::HttpResponse::MapType rsp_headers;
+        rsp_headers["Content-Type"] = "text/plain";
+        rsp_headers["Server"] = "sylar";
+        rsp_headers["Content-Length"] = "5";
+        std::string out;
+        for(auto& h : rsp_headers) {
+            out.append(h.first).append(": ").append(h.second).append("\r\n");
+        }
+        total += out.size();
+    }
+    report("parse+dispatch(map)", s_count, sylar::GetCurrentUS() - begin);
+    SYLAR_LOG_DEBUG(g_logger) << total;
+}
+
+// 扁平的HttpHeaders: 头部指向读缓存，预置头部按编号查找，按类型读取时不分配内存
+void bench_dispatch_flat() {
+    std::string data = s_post_request;
+    sylar::http::HttpRequestParser parser(true);
+    sylar::http::ServletDispatch::ptr dispatch = make_dispatch();
+    uint64_t begin = sylar::GetCurrentUS();
+    size_t total = 0;
+    for(int i = 0; i < s_count; ++i) {
+        parser.reset();
+        parser.execute(&data[0], data.size(), false);
+        sylar::http::HttpRequest::ptr req = parser.getData();
+        total += dispatch->getMatchServlet(req) != nullptr;
+        total += req->getHeaderSlice(sylar::http::HttpHeaderId::HOST).size
+                + req->getHeaderSlice(sylar::http::HttpHeaderId::CONNECTION).size
+                + req->getHeaderSlice(sylar::http::HttpHeaderId::COOKIE).size;
+        total += req->getHeaderValue<uint64_t>(sylar::http::HttpHeaderId::CONTENT_LENGTH);
+
+        sylar::http::HttpResponse rsp;
+        rsp.setHeader(sylar::http::HttpHeaderId::CONTENT_TYPE, "text/plain");
+        rsp.setHeader(sylar::http::HttpHeaderId::SERVER, "sylar");
+        rsp.setBody("hello");
+        std::string out;
+        rsp.dumpHeader(out);
+        total += out.size();
+    }
+    report("parse+dispatch(flat)", s_count, sylar::GetCurrentUS() - begin);
+    SYLAR_LOG_DEBUG(g_logger) << total;
+}
+
+/******************* 管线化长连接 *******************/
+// 等待服务器绑定后连接，失败返回-1
+static int connect_server() {
+    while(!s_port) {
+        usleep(1000);
+    }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(s_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(s_port < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr))) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// 读取n个字节，失败返回false
+static bool read_n(int fd, std::string& buf, size_t n) {
+    buf.resize(n);
+    size_t offset = 0;
+    while(offset < n) {
+        ssize_t rt = read(fd, &buf[offset], n - offset);
+        if(rt <= 0) {
+            return false;
+        }
+        offset += rt;
+    }
+    return true;
+}
+
+// 客户端: 每次连续写入s_depth个请求，再读回s_depth个响应(响应长度固定)
+void pipeline_client() {
+    int fd = connect_server();
+    if(fd < 0) {
+        SYLAR_LOG_ERROR(g_logger) << "connect server fail";
+        return;
+    }
+    // 先发一个请求得到响应长度
+    std::string buf(4096, 0);
+    write(fd, s_request.c_str(), s_request.size());
+    ssize_t rsp_len = read(fd, &buf[0], buf.size());
+    if(rsp_len <= 0) {
+        SYLAR_LOG_ERROR(g_logger) << "recv response fail";
+        close(fd);
+        return;
+    }
+
+    std::string batch;
+    for(int i = 0; i < s_depth; ++i) {
+        batch += s_request;
+    }
+    int rounds = s_count / s_depth;
+    uint64_t begin = sylar::GetCurrentUS();
+    for(int i = 0; i < rounds; ++i) {
+        if(write(fd, batch.c_str(), batch.size()) != (ssize_t)batch.size()
+                || !read_n(fd, buf, rsp_len * s_depth)) {
+            SYLAR_LOG_ERROR(g_logger) << "pipeline fail at round " << i;
+            close(fd);
+            return;
+        }
+    }
+    report("pipeline(depth=" + std::to_string(s_depth) + ")",
+            (uint64_t)rounds * s_depth, sylar::GetCurrentUS() - begin);
+    close(fd);
+}
+
+void run_server() {
+    sylar::http::HttpServer::ptr server = std::make_shared<sylar::http::HttpServer>(true);
+    sylar::Address::ptr addr = sylar::Address::LookupAny("127.0.0.1:0");
+    if(!server->bind(addr)) {
+        SYLAR_LOG_ERROR(g_logger) << "bind fail";
+        s_port = -1;
+        return;
+    }
+    server->getDispatch()->addServlet("/bench/hello", [](sylar::http::HttpRequest::ptr req,
+                                                    sylar::http::HttpResponse::ptr res,
+                                                    sylar::http::HttpSession::ptr session) {
+        res->setBody("hello");
+        return 0;
+    });
+    server->start();
+    s_port = std::dynamic_pointer_cast<sylar::IPAddress>(server->getSocks()[0]->getLocolAddress())->getPort();
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1) {
+        s_count = atoi(argv[1]);
+    }
+    if(argc > 2) {
+        s_depth = atoi(argv[2]);
+    }
+    if(s_depth <= 0) {
+        s_depth = 1;
+    }
+    // 屏蔽每个连接的日志
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::ERROR);
+
+    bench_parse_copy();
+    bench_parse_zero_copy();
+    bench_dispatch_map();
+    bench_dispatch_flat();
+
+    sylar::IOManager iom(1, false);
+    iom.scheduler(&run_server);
+    std::thread client(pipeline_client);
+    client.join();
+    _exit(0);
+    return 0;
+}
@@ -0,0 +1,229 @@
+/**
+ * @brief HttpConnectionPool管线化异步请求测试
+ * @details 两个HttpServer作为上游，客户端在另一个IOManager的一个协程中:
+ *              1.同时向两个连接池发出[请求数]个异步请求，依次get()收集结果，校验响应和请求一一对应
+ *              2.回调方式发出请求，统计回调次数
+ *              3.chunked响应和普通响应在同一个连接上连续到达
+ *              4.对端返回Connection: close后，同一连接上排在后面的请求失败；连接失败时返回CONNECT_ERROR
+ *              5.同一个连接池分别用同步doRequest和异步doRequestAsync发送[请求数]个请求，对比每秒请求数
+ *          最后主线程(非调度线程)等待一个异步请求的结果
+ *          用法: http_pipeline_test [请求数]
+ */
+#include <atomic>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "http_server.h"
+#include "http_connection.h"
+#include "log.h"
+#include "util.h"
+#include "check.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+// 两个上游绑定127.0.0.1:0后由系统分配的端口，绑定失败为-1
+static std::atomic<int> s_port_a(0);
+static std::atomic<int> s_port_b(0);
+static int s_count = 2000;
+
+static sylar::http::HttpConnectionPool::ptr s_pool_a;
+static sylar::http::HttpConnectionPool::ptr s_pool_b;
+static sylar::Semaphore s_sem;
+
+static void start_server(std::atomic<int>& port) {
+    sylar::http::HttpServer::ptr server = std::make_shared<sylar::http::HttpServer>(true);
+    sylar::Address::ptr addr = sylar::Address::LookupAny("127.0.0.1:0");
+    if(!server->bind(addr)) {
+        SYLAR_LOG_ERROR(g_logger) << "bind fail";
+        port = -1;
+        return;
+    }
+    int bound = std::dynamic_pointer_cast<sylar::IPAddress>(server->getSocks()[0]->getLocolAddress())->getPort();
+    std::string name = std::to_string(bound);
+    // 返回"端口:查询串"
+    server->getDispatch()->addServlet("/echo", [name](sylar::http::HttpRequest::ptr req,
+                                                    sylar::http::HttpResponse::ptr res,
+                                                    sylar::http::HttpSession::ptr session) {
+        res->setBody(name + ":" + req->getQuery());
+        return 0;
+    });
+    server->getDispatch()->addServlet("/slow", [](sylar::http::HttpRequest::ptr req,
+                                                    sylar::http::HttpResponse::ptr res,
+                                                    sylar::http::HttpSession::ptr session) {
+        usleep(50 * 1000);
+        res->setBody("slow");
+        return 0;
+    });
+    server->getDispatch()->addServlet("/chunk", [](sylar::http::HttpRequest::ptr req,
+                                                    sylar::http::HttpResponse::ptr res,
+                                                    sylar::http::HttpSession::ptr session) {
+        sylar::http::HttpResponseWriter writer(session, res);
+        for(int i = 0; i < 3; ++i) {
+            std::string chunk = "c" + std::to_string(i);
+            writer.write(chunk.c_str(), chunk.size());
+        }
+        writer.close();
+        return 0;
+    });
+    server->getDispatch()->addServlet("/close", [](sylar::http::HttpRequest::ptr req,
+                                                    sylar::http::HttpResponse::ptr res,
+                                                    sylar::http::HttpSession::ptr session) {
+        res->setClose(true);
+        res->setBody("bye");
+        return 0;
+    });
+    server->start();
+    port = bound;
+}
+
+void run_server() {
+    start_server(s_port_a);
+    start_server(s_port_b);
+}
+
+// 返回一个绑定了但没有监听的端口，连接会被拒绝；socket在进程退出前一直占用该端口
+static int unused_port() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if(bind(fd, (sockaddr*)&addr, sizeof(addr)) || getsockname(fd, (sockaddr*)&addr, &len)) {
+        return -1;
+    }
+    return ntohs(addr.sin_port);
+}
+
+static std::string body_of(sylar::http::HttpResult::ptr result) {
+    return result && result->response ? result->response->getBody() : "";
+}
+
+static void report(const std::string& name, uint64_t count, uint64_t us) {
+    SYLAR_LOG_INFO(g_logger) << name << ": " << count << " requests in " << us / 1000 << "ms, "
+                             << (uint64_t)(count * 1000000.0 / (us ? us : 1)) << " requests/sec";
+}
+
+void run_client() {
+    // 等服务端启动
+    while(!s_port_a || !s_port_b) {
+        usleep(1000);
+    }
+    CHECK(s_port_a > 0 && s_port_b > 0);
+    s_pool_a = std::make_shared<sylar::http::HttpConnectionPool>(
+                    "127.0.0.1", "", s_port_a, 2, 30 * 1000, 1000000);
+    s_pool_b = std::make_shared<sylar::http::HttpConnectionPool>(
+                    "127.0.0.1", "", s_port_b, 2, 30 * 1000, 1000000);
+
+    // 1.向两个上游扇出，收集结果
+    std::vector<sylar::http::HttpFuture::ptr> futures;
+    for(int i = 0; i < s_count; ++i) {
+        auto pool = i % 2 ? s_pool_b : s_pool_a;
+        futures.push_back(pool->doRequestAsync(sylar::http::HttpMethod::GET,
+                    "/echo?i=" + std::to_string(i), 3000));
+    }
+    int ok = 0;
+    for(int i = 0; i < s_count; ++i) {
+        std::string expect = std::to_string(i % 2 ? s_port_b : s_port_a) + ":i=" + std::to_string(i);
+        ok += body_of(futures[i]->get()) == expect;
+    }
+    CHECK(ok == s_count);
+    futures.clear();
+
+    // 2.回调
+    std::atomic<int> callbacks = {0};
+    for(int i = 0; i < 100; ++i) {
+        futures.push_back(s_pool_a->doRequestAsync(sylar::http::HttpMethod::GET, "/echo?i=" + std::to_string(i), 3000
+                    , {}, "", [&callbacks, i](sylar::http::HttpResult::ptr result) {
+            if(body_of(result) == std::to_string(s_port_a) + ":i=" + std::to_string(i)) {
+                ++callbacks;
+            }
+        }));
+    }
+    for(auto& i : futures) {
+        i->get();
+    }
+    CHECK(callbacks == 100);
+    futures.clear();
+
+    // 3.chunked响应后面紧跟着普通响应
+    for(int i = 0; i < 20; ++i) {
+        futures.push_back(s_pool_a->doRequestAsync(sylar::http::HttpMethod::GET,
+                    i % 2 ? "/echo?i=" + std::to_string(i) : "/chunk", 3000));
+    }
+    ok = 0;
+    for(int i = 0; i < 20; ++i) {
+        ok += body_of(futures[i]->get()) == (i % 2 ? std::to_string(s_port_a) + ":i=" + std::to_string(i) : "c0c1c2");
+    }
+    CHECK(ok == 20);
+    futures.clear();
+
+    // 4.对端关闭和连接失败
+    auto single = std::make_shared<sylar::http::HttpConnectionPool>(
+                    "127.0.0.1", "", s_port_b, 1, 30 * 1000, 1000000);
+    auto closed = single->doRequestAsync(sylar::http::HttpMethod::GET, "/close", 3000);
+    auto after = single->doRequestAsync(sylar::http::HttpMethod::GET, "/echo?i=1", 3000);
+    CHECK(body_of(closed->get()) == "bye");
+    CHECK(after->get()->status == (int)sylar::http::HttpResult::Status::CLOSE_BY_PEER);
+    CHECK(body_of(single->doRequestAsync(sylar::http::HttpMethod::GET, "/echo?i=2", 3000)->get())
+            == std::to_string(s_port_b) + ":i=2");
+    auto none = std::make_shared<sylar::http::HttpConnectionPool>(
+                    "127.0.0.1", "", unused_port(), 1, 30 * 1000, 1000000);
+    CHECK(none->doRequestAsync(sylar::http::HttpMethod::GET, "/", 1000)->get()->status
+            == (int)sylar::http::HttpResult::Status::CONNECT_ERROR);
+
+    // 5.同步和异步对比
+    uint64_t begin = sylar::GetCurrentUS();
+    ok = 0;
+    for(int i = 0; i < s_count; ++i) {
+        ok += body_of(s_pool_a->doGet("/echo?i=1", 3000)) == std::to_string(s_port_a) + ":i=1";
+    }
+    report("sync doRequest", s_count, sylar::GetCurrentUS() - begin);
+    CHECK(ok == s_count);
+
+    begin = sylar::GetCurrentUS();
+    for(int i = 0; i < s_count; ++i) {
+        futures.push_back(s_pool_a->doRequestAsync(sylar::http::HttpMethod::GET, "/echo?i=1", 3000));
+    }
+    ok = 0;
+    for(auto& i : futures) {
+        ok += body_of(i->get()) == std::to_string(s_port_a) + ":i=1";
+    }
+    report("async pipelined", s_count, sylar::GetCurrentUS() - begin);
+    CHECK(ok == s_count);
+    futures.clear();
+
+    s_sem.notify();
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1) {
+        s_count = atoi(argv[1]);
+    }
+    if(s_count <= 0) {
+        s_count = 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::FATAL);
+    sylar::IOManager server_iom(1, false);
+    server_iom.scheduler(&run_server);
+    sylar::IOManager client_iom(1, false);
+    client_iom.scheduler(&run_client);
+    s_sem.wait();
+
+    // 非调度线程等待异步请求: 请求在客户端IOManager中发出，主线程阻塞在信号量上等待结果
+    sylar::http::HttpFuture::ptr future;
+    client_iom.scheduler([&future]() {
+        future = s_pool_b->doRequestAsync(sylar::http::HttpMethod::GET, "/slow", 3000);
+        s_sem.notify();
+    });
+    s_sem.wait();
+    CHECK(!future->isDone());
+    CHECK(body_of(future->get()) == "slow");
+
+    _exit(check_report("http pipeline test"));
+}
@@ -0,0 +1,175 @@
+/**
+ * @brief HttpConnectionPool连接缓存测试和压测
+ * @details 用法: http_pool_test [每个线程的次数] [线程数]
+ *              1.多个线程同时从同一个连接池取连接再放回，统计每秒次数；再用连接池发送请求，统计每秒请求数
+ *              2.校验统计数据: 命中、未命中、新建连接
+ *              3.连接达到最大请求次数或超出最大连接数时放回即释放；过期的空闲连接由后台定时器回收
+ *              4.线程退出后新线程复用它的缓存，线程先后超过缓存数上限仍能取到缓存的连接
+ */
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include "http_server.h"
+#include "http_connection.h"
+#include "config.h"
+#include "log.h"
+#include "util.h"
+#include "check.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static std::atomic<int> s_port(0);     // 服务器绑定127.0.0.1:0后由系统分配的端口，绑定失败为-1
+static int s_count = 100000;
+static int s_threads = 4;
+
+void run_server() {
+    sylar::http::HttpServer::ptr server = std::make_shared<sylar::http::HttpServer>(true);
+    sylar::Address::ptr addr = sylar::Address::LookupAny("127.0.0.1:0");
+    if(!server->bind(addr)) {
+        SYLAR_LOG_ERROR(g_logger) << "bind fail";
+        s_port = -1;
+        return;
+    }
+    server->getDispatch()->addServlet("/hello", [](sylar::http::HttpRequest::ptr req,
+                                                    sylar::http::HttpResponse::ptr res,
+                                                    sylar::http::HttpSession::ptr session) {
+        res->setBody("hello");
+        return 0;
+    });
+    server->start();
+    s_port = std::dynamic_pointer_cast<sylar::IPAddress>(server->getSocks()[0]->getLocolAddress())->getPort();
+}
+
+static void report(const std::string& name, uint64_t count, uint64_t us) {
+    SYLAR_LOG_INFO(g_logger) << name << ": " << count << " ops in " << us / 1000 << "ms, "
+                             << (uint64_t)(count * 1000000.0 / (us ? us : 1)) << " ops/sec";
+}
+
+// 多个线程同时执行fn(count)
+static void bench(const std::string& name, int count, std::function<void(int)> fn) {
+    std::vector<std::thread> threads;
+    uint64_t begin = sylar::GetCurrentUS();
+    for(int i = 0; i < s_threads; ++i) {
+        threads.emplace_back(fn, count);
+    }
+    for(auto& i : threads) {
+        i.join();
+    }
+    report(name, (uint64_t)count * s_threads, sylar::GetCurrentUS() - begin);
+}
+
+void test_bench() {
+    auto pool = std::make_shared<sylar::http::HttpConnectionPool>(
+                    "127.0.0.1", "", s_port, s_threads * 2, 60 * 1000, 100000000);
+    std::atomic<int> fails = {0};
+    bench("get+release", s_count, [pool, &fails](int count) {
+        for(int i = 0; i < count; ++i) {
+            auto con = pool->getConnection(1000);
+            if(!con) {
+                ++fails;
+            }
+        }
+    });
+    bench("doGet", s_count / 10, [pool, &fails](int count) {
+        for(int i = 0; i < count; ++i) {
+            auto result = pool->doGet("/hello", 1000);
+            if(!result->response || result->response->getBody() != "hello") {
+                ++fails;
+            }
+        }
+    });
+    CHECK(fails == 0);
+    sylar::http::HttpConnectionPool::Stats stats = pool->getStats();
+    SYLAR_LOG_INFO(g_logger) << stats.toString();
+    CHECK(stats.hits + stats.misses == (uint64_t)s_count * s_threads + s_count / 10 * s_threads);
+    CHECK(stats.connects == stats.misses);
+}
+
+// 依次启动的线程复用已退出线程的缓存下标和其中的空闲连接
+void test_thread_reuse() {
+    auto pool = std::make_shared<sylar::http::HttpConnectionPool>(
+                    "127.0.0.1", "", s_port, 4, 60 * 1000, 100000000);
+    for(int i = 0; i < 100; ++i) {
+        std::thread t([pool]() {
+            CHECK(pool->getConnection(1000));
+        });
+        t.join();
+    }
+    auto stats = pool->getStats();
+    CHECK(stats.connects == 1 && stats.hits == 99);
+}
+
+static sylar::Semaphore s_sem;
+
+// 在IOManager中运行，回收定时器依赖IOManager
+void test_reap() {
+    sylar::Config::Lookup<uint64_t>("http.client.reap_interval")->setValue(100);
+    auto pool = sylar::http::HttpConnectionPool::CreateConnectionPool(
+                    "http://127.0.0.1:" + std::to_string(s_port), "", 4, 300, 3);
+
+    // 第3次放回时达到最大请求次数，释放连接
+    for(int i = 0; i < 3; ++i) {
+        CHECK(pool->getConnection(1000));
+    }
+    auto stats = pool->getStats();
+    CHECK(stats.misses == 1 && stats.hits == 2 && stats.connects == 1);
+    CHECK(stats.evictions == 1 && stats.total == 0 && stats.idle == 0);
+
+    // 超过最大连接数的连接放回时释放
+    std::vector<sylar::http::HttpConnection::ptr> cons;
+    for(int i = 0; i < 10; ++i) {
+        cons.push_back(pool->getConnection(1000));
+    }
+    CHECK(pool->getStats().total == 10);
+    cons.clear();
+    stats = pool->getStats();
+    CHECK(stats.total == 4 && stats.idle == 4 && stats.evictions == 7);
+
+    // 过期的空闲连接由定时器回收
+    usleep(600 * 1000);
+    stats = pool->getStats();
+    SYLAR_LOG_INFO(g_logger) << stats.toString();
+    CHECK(stats.total == 0 && stats.idle == 0 && stats.evictions == 11);
+
+    // 不是由shared_ptr管理的连接池不能启动回收定时器
+    sylar::http::HttpConnectionPool local("127.0.0.1", "", s_port, 4, 300, 3);
+    CHECK(!local.startReaper());
+    s_sem.notify();
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1) {
+        s_count = atoi(argv[1]);
+    }
+    if(argc > 2) {
+        s_threads = atoi(argv[2]);
+    }
+    if(s_count < 10) {
+        s_count = 10;
+    }
+    if(s_threads <= 0) {
+        s_threads = 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::FATAL);
+    sylar::IOManager server_iom(1, false);
+    server_iom.scheduler(&run_server);
+    while(!s_port) {
+        usleep(1000);
+    }
+    if(s_port < 0) {
+        CHECK(s_port > 0);
+        _exit(check_report("http pool test"));
+    }
+
+    test_bench();
+    test_thread_reuse();
+    sylar::IOManager client_iom(1, false);
+    client_iom.scheduler(&test_reap);
+    s_sem.wait();
+
+    _exit(check_report("http pool test"));
+}
@@ -1,6 +1,17 @@
+#include <atomic>
+#include <thread>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
 #include "http_server.h"
 #include "http.h"
+#include "http_parser.h"
+#include "log.h"
+#include "util.h"
+#include "check.h"
 
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
 
 void test() {
     // 创建HTTP服务器
@@ -31,9 +42,158 @@ void test() {
     server->start();
 }
 
+/******************* 管线化压测 *******************/
+static std::atomic<int> s_port(0);     // 服务器绑定127.0.0.1:0后由系统分配的端口，绑定失败为-1
+static int s_count = 100000;   // 请求总数
+static int s_depth = 16;       // 每次连续发送的请求数
+
+// 长连接服务器，响应体为请求参数，用于校验响应顺序
+// X-Send-Count为处理该请求时连接上已经合并发送的次数，用于校验一批响应只用一次writev发送
+void pipeline_server() {
+    sylar::http::HttpServer::ptr server = std::make_shared<sylar::http::HttpServer>(true);
+    sylar::Address::ptr addr = sylar::Address::LookupAny("127.0.0.1:0");
+    if(!server->bind(addr)) {
+        SYLAR_LOG_ERROR(g_logger) << "bind fail";
+        s_port = -1;
+        return;
+    }
+    server->getDispatch()->addServlet("/pipeline", [](sylar::http::HttpRequest::ptr req, 
+                                                    sylar::http::HttpResponse::ptr res, 
+                                                    sylar::http::HttpSession::ptr session) {
+        res->setBody(req->getQuery());
+        res->setHeader("X-Send-Count", std::to_string(session->getSendCount()));
+        return 0;
+    });
+    server->start();
+    s_port = std::dynamic_pointer_cast<sylar::IPAddress>(server->getSocks()[0]->getLocolAddress())->getPort();
+}
+
+/**
+ * @brief 从buf的offset开始解析一个完整的响应
+ * @param[out] body 响应体
+ * @param[out] sends 响应头部X-Send-Count的值
+ * @return 返回响应的长度，数据不完整返回0
+ */
+static size_t parse_response(const std::string& buf, size_t offset, std::string& body, int& sends) {
+    size_t header_end = buf.find("\r\n\r\n", offset);
+    if(header_end == std::string::npos) {
+        return 0;
+    }
+    size_t pos = buf.find("Content-Length: ", offset);
+    size_t len = 0;
+    if(pos != std::string::npos && pos < header_end) {
+        len = atoi(buf.c_str() + pos + 16);
+    }
+    if(buf.size() < header_end + 4 + len) {
+        return 0;
+    }
+    body = buf.substr(header_end + 4, len);
+    pos = buf.find("X-Send-Count: ", offset);
+    sends = pos != std::string::npos && pos < header_end ? atoi(buf.c_str() + pos + 14) : -1;
+    return header_end + 4 + len - offset;
+}
+
+// 客户端: 每次连续写入s_depth个请求，再按顺序读回并校验s_depth个响应
+// 一批请求能被服务端一次读完(不超过头部缓存大小和发送队列上限)时，这一批的响应应该只用一次writev发送，
+// 即第r批的每个响应处理时服务端都已经发送过r次
+void pipeline_client() {
+    while(!s_port) {
+        usleep(1000);
+    }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(s_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bool connected = s_port > 0 && connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0;
+    CHECK(connected);
+    if(!connected) {
+        close(fd);
+        return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    std::string buf;
+    std::string body;
+    char tmp[64 * 1024];
+    int rounds = s_count / s_depth;
+    int sends = 0;
+    int bad_flush = 0;
+    uint64_t begin = sylar::GetCurrentUS();
+    for(int r = 0; r < rounds; ++r) {
+        std::string batch;
+        for(int j = 0; j < s_depth; ++j) {
+            batch += "GET /pipeline?id=" + std::to_string(r * s_depth + j) + " HTTP/1.1\r\n"
+                     "Host: 127.0.0.1\r\nConnection: Keep-Alive\r\n\r\n";
+        }
+        if(write(fd, batch.c_str(), batch.size()) != (ssize_t)batch.size()) {
+            SYLAR_LOG_ERROR(g_logger) << "write fail, round=" << r;
+            CHECK(false);
+            close(fd);
+            return;
+        }
+        bool one_flush = s_depth <= 64 && batch.size() <= sylar::http::HttpRequestParser::GetRequestMaxHeaderSize();
+        int got = 0;
+        size_t offset = 0;
+        buf.clear();
+        while(got < s_depth) {
+            size_t n = parse_response(buf, offset, body, sends);
+            if(n == 0) {
+                ssize_t rt = read(fd, tmp, sizeof(tmp));
+                if(rt <= 0) {
+                    SYLAR_LOG_ERROR(g_logger) << "read fail, round=" << r << " got=" << got;
+                    CHECK(false);
+                    close(fd);
+                    return;
+                }
+                buf.append(tmp, rt);
+                continue;
+            }
+            if(body != "id=" + std::to_string(r * s_depth + got)) {
+                SYLAR_LOG_ERROR(g_logger) << "response out of order, round=" << r
+                                          << " expect id=" << r * s_depth + got << " got " << body;
+                CHECK(false);
+                close(fd);
+                return;
+            }
+            if(one_flush && sends != r) {
+                ++bad_flush;
+            }
+            offset += n;
+            ++got;
+        }
+    }
+    CHECK(bad_flush == 0);
+    uint64_t used = sylar::GetCurrentUS() - begin;
+    uint64_t total = (uint64_t)rounds * s_depth;
+    SYLAR_LOG_INFO(g_logger) << "pipeline(depth=" << s_depth << "): " << total << " requests in "
+                             << used / 1000 << "ms, " << (uint64_t)(total * 1000000.0 / (used ? used : 1))
+                             << " requests/sec, all responses in order, "
+                             << bad_flush << " responses not sent in their burst's single writev";
+    close(fd);
+}
+
+// 执行http_server_test -p [请求总数] [管线深度] 进行管线化压测
 int main(int argc, char** argv) {
+    if(argc > 1 && strcmp(argv[1], "-p") == 0) {
+        if(argc > 2) {
+            s_count = atoi(argv[2]);
+        }
+        if(argc > 3) {
+            s_depth = std::max(1, atoi(argv[3]));
+        }
+        SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::ERROR);
+        sylar::IOManager iom(1, false);
+        iom.scheduler(&pipeline_server);
+        std::thread client(pipeline_client);
+        client.join();
+        _exit(check_report("http pipeline"));
+    }
+
     sylar::IOManager iom(2);
     iom.scheduler(&test);
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,320 @@
+/**
+ * @brief HTTP流式消息体测试
+ * @details 服务端: /upload 为流式servlet，用HttpBodyStream边读边统计长度和校验和，不把消息体读入内存；
+ *                  /download 用HttpResponseWriter以chunked编码分块发送
+ *                  /ignore 为流式servlet，不读消息体，直接关闭HttpBodyStream
+ *          客户端线程在同一个长连接上依次:
+ *              1.用Content-Length上传[上传大小]MB，再用chunked上传同样的数据，校验服务端统计的长度和校验和
+ *              2.chunked上传超过http.request.max_body_size，服务端应断开连接
+ *              3.用HttpConnection下载chunked响应并校验内容
+ *              4.请求/ignore，少量未读的消息体被丢弃后长连接继续可用，超过HttpSession::MAX_SKIP_BODY_SIZE时关闭连接
+ *              5.Content-Length无效(溢出、带符号、非数字)或Transfer-Encoding不是单独的chunked时回复400并关闭连接；
+ *                chunked忽略大小写和前后空白
+ *          最后输出进程的最大常驻内存，应远小于上传大小
+ *          用法: http_stream_test [上传大小(MB)]
+ */
+#include <atomic>
+#include <thread>
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "http_server.h"
+#include "http_connection.h"
+#include "config.h"
+#include "log.h"
+#include "check.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static std::atomic<int> s_port(0);     // 服务器绑定127.0.0.1:0后由系统分配的端口，绑定失败为-1
+static uint64_t s_upload_size = 256ull * 1024 * 1024;
+
+// 第i个字节的内容
+static inline char byte_at(uint64_t i) {
+    return 'a' + i % 23;
+}
+
+static uint64_t expect_sum(uint64_t size) {
+    uint64_t sum = 0;
+    for(uint64_t i = 0; i < size; ++i) {
+        sum += (unsigned char)byte_at(i);
+    }
+    return sum;
+}
+
+void run_server() {
+    sylar::http::HttpServer::ptr server = std::make_shared<sylar::http::HttpServer>(true);
+    sylar::Address::ptr addr = sylar::Address::LookupAny("127.0.0.1:0");
+    if(!server->bind(addr)) {
+        SYLAR_LOG_ERROR(g_logger) << "bind fail";
+        s_port = -1;
+        return;
+    }
+    s_port = std::dynamic_pointer_cast<sylar::IPAddress>(server->getSocks()[0]->getLocolAddress())->getPort();
+    // 流式上传: 返回"长度 校验和"
+    auto upload = std::make_shared<sylar::http::FunctionServlet>([](sylar::http::HttpRequest::ptr req,
+                                                    sylar::http::HttpResponse::ptr res,
+                                                    sylar::http::HttpSession::ptr session) {
+        sylar::http::HttpBodyStream in(session);
+        char buf[64 * 1024];
+        uint64_t total = 0;
+        uint64_t sum = 0;
+        ssize_t rt = 0;
+        while((rt = in.read(buf, sizeof(buf))) > 0) {
+            for(ssize_t i = 0; i < rt; ++i) {
+                sum += (unsigned char)buf[i];
+            }
+            total += rt;
+        }
+        if(rt < 0) {
+            res->setStatus(sylar::http::HttpStatus::PAYLOAD_TOO_LARGE);
+            res->setClose(true);
+            return 0;
+        }
+        res->setBody(std::to_string(total) + " " + std::to_string(sum));
+        return 0;
+    });
+    upload->setStreamBody(true);
+    server->getDispatch()->addServlet("/upload", upload);
+
+    // 不读消息体的流式servlet，直接关闭消息体流(丢弃未读的部分)
+    auto ignore = std::make_shared<sylar::http::FunctionServlet>([](sylar::http::HttpRequest::ptr req,
+                                                    sylar::http::HttpResponse::ptr res,
+                                                    sylar::http::HttpSession::ptr session) {
+        sylar::http::HttpBodyStream in(session);
+        in.close();
+        res->setBody("ignored");
+        return 0;
+    });
+    ignore->setStreamBody(true);
+    server->getDispatch()->addServlet("/ignore", ignore);
+
+    // chunked下载: 100个chunk，每个chunk为"chunk-i;"
+    server->getDispatch()->addServlet("/download", [](sylar::http::HttpRequest::ptr req,
+                                                    sylar::http::HttpResponse::ptr res,
+                                                    sylar::http::HttpSession::ptr session) {
+        res->setHeader("Content-Type", "text/plain");
+        sylar::http::HttpResponseWriter writer(session, res);
+        for(int i = 0; i < 100; ++i) {
+            std::string chunk = "chunk-" + std::to_string(i) + ";";
+            if(writer.write(chunk.c_str(), chunk.size()) < 0) {
+                break;
+            }
+        }
+        writer.close();
+        return 0;
+    });
+    server->start();
+}
+
+// 等待服务器绑定后连接
+static int connect_server() {
+    while(!s_port) {
+        usleep(1000);
+    }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(s_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(s_port > 0 && connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0);
+    return fd;
+}
+
+static bool write_all(int fd, const char* data, size_t len) {
+    while(len > 0) {
+        ssize_t rt = write(fd, data, len);
+        if(rt <= 0) {
+            return false;
+        }
+        data += rt;
+        len -= rt;
+    }
+    return true;
+}
+
+// 上传s_upload_size字节，chunked为false时使用Content-Length
+static bool send_upload(int fd, bool chunked, uint64_t size, const std::string& te = "chunked") {
+    std::string head = "POST /upload HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: Keep-Alive\r\n";
+    head += chunked ? "Transfer-Encoding: " + te + "\r\n\r\n"
+                    : "Content-Length: " + std::to_string(size) + "\r\n\r\n";
+    if(!write_all(fd, head.c_str(), head.size())) {
+        return false;
+    }
+    std::string buf(60000, 0);
+    uint64_t sent = 0;
+    while(sent < size) {
+        size_t n = std::min((uint64_t)buf.size(), size - sent);
+        for(size_t i = 0; i < n; ++i) {
+            buf[i] = byte_at(sent + i);
+        }
+        if(chunked) {
+            char line[32];
+            int len = snprintf(line, sizeof(line), "%zx\r\n", n);
+            if(!write_all(fd, line, len) || !write_all(fd, buf.c_str(), n) || !write_all(fd, "\r\n", 2)) {
+                return false;
+            }
+        } else if(!write_all(fd, buf.c_str(), n)) {
+            return false;
+        }
+        sent += n;
+    }
+    return !chunked || write_all(fd, "0\r\n\r\n", 5);
+}
+
+// 读取一个带Content-Length的响应，返回消息体，失败返回false
+static bool read_response(int fd, int& status, std::string& body) {
+    std::string buf;
+    char tmp[4096];
+    size_t header_end = std::string::npos;
+    while((header_end = buf.find("\r\n\r\n")) == std::string::npos) {
+        ssize_t rt = read(fd, tmp, sizeof(tmp));
+        if(rt <= 0) {
+            return false;
+        }
+        buf.append(tmp, rt);
+    }
+    status = atoi(buf.c_str() + 9);
+    size_t pos = buf.find("Content-Length: ");
+    size_t len = pos < header_end ? atoi(buf.c_str() + pos + 16) : 0;
+    body = buf.substr(header_end + 4);
+    while(body.size() < len) {
+        ssize_t rt = read(fd, tmp, std::min(sizeof(tmp), len - body.size()));
+        if(rt <= 0) {
+            return false;
+        }
+        body.append(tmp, rt);
+    }
+    return true;
+}
+
+// 发送带有给定头部的请求，消息体是一个完整的请求，期望得到400后连接被关闭
+static bool bad_request(const std::string& header) {
+    int fd = connect_server();
+    struct timeval tv = {3, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    std::string req = "POST /ignore HTTP/1.1\r\nHost: 127.0.0.1\r\n" + header + "\r\n"
+                      "GET /download HTTP/1.1\r\n\r\n";
+    int status = 0;
+    std::string body;
+    bool ok = write_all(fd, req.c_str(), req.size())
+                && read_response(fd, status, body) && status == 400
+                && !read_response(fd, status, body);
+    close(fd);
+    if(!ok) {
+        SYLAR_LOG_ERROR(g_logger) << "bad request not rejected: " << header;
+    }
+    return ok;
+}
+
+void run_client() {
+    std::string expect = std::to_string(s_upload_size) + " " + std::to_string(expect_sum(s_upload_size));
+    int fd = connect_server();
+    int status = 0;
+    std::string body;
+
+    // 1.Content-Length和chunked上传
+    uint64_t begin = sylar::GetCurrentMS();
+    CHECK(send_upload(fd, false, s_upload_size));
+    CHECK(read_response(fd, status, body));
+    CHECK(status == 200 && body == expect);
+    CHECK(send_upload(fd, true, s_upload_size));
+    CHECK(read_response(fd, status, body));
+    CHECK(status == 200 && body == expect);
+    uint64_t used = sylar::GetCurrentMS() - begin;
+    SYLAR_LOG_INFO(g_logger) << "uploaded 2 x " << (s_upload_size >> 20) << "MB in " << used << "ms";
+
+    // 2.chunked上传超过http.request.max_body_size(测试中设为上传大小)，服务端读到超限的chunk头部时失败并断开连接
+    char line[64];
+    int len = snprintf(line, sizeof(line), "%lx\r\n", (unsigned long)s_upload_size + 1);
+    std::string head = "POST /upload HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: Keep-Alive\r\n"
+                       "Transfer-Encoding: chunked\r\n\r\n" + std::string(line, len);
+    write_all(fd, head.c_str(), head.size());
+    bool ok = read_response(fd, status, body);
+    CHECK(!ok || status == 413);
+    CHECK(!read_response(fd, status, body));
+    close(fd);
+
+    // 3.chunked下载
+    sylar::http::HttpResult::ptr result = sylar::http::HttpConnection::DoGet(
+                "http://127.0.0.1:" + std::to_string(s_port) + "/download", 3000);
+    std::string expect_download;
+    for(int i = 0; i < 100; ++i) {
+        expect_download += "chunk-" + std::to_string(i) + ";";
+    }
+    CHECK(result->response);
+    if(result->response) {
+        CHECK(result->response->getBody() == expect_download);
+        CHECK(result->response->getHeader("Transfer-Encoding") == "chunked");
+    }
+
+    // 4.servlet没有读的消息体: 少量时丢弃并保持长连接，超过上限时关闭连接，不会等待读完整个消息体
+    fd = connect_server();
+    struct timeval tv = {3, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    std::string small = "POST /ignore HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: Keep-Alive\r\n"
+                        "Content-Length: 1000\r\n\r\n"
+                        + std::string(1000, 'x');
+    for(int i = 0; i < 2; ++i) {
+        CHECK(write_all(fd, small.c_str(), small.size()));
+        CHECK(read_response(fd, status, body));
+        CHECK(status == 200 && body == "ignored");
+    }
+    uint64_t large = sylar::http::HttpSession::MAX_SKIP_BODY_SIZE * 16;
+    head = "POST /ignore HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: Keep-Alive\r\n"
+           "Content-Length: " + std::to_string(large) + "\r\n\r\n";
+    write_all(fd, head.c_str(), head.size());
+    write_all(fd, std::string(sylar::http::HttpSession::MAX_SKIP_BODY_SIZE * 2, 'x').c_str()
+                , sylar::http::HttpSession::MAX_SKIP_BODY_SIZE * 2);
+    // 连接应被关闭(响应可能因RST丢失)，而不是等待剩余的消息体直到超时
+    char tmp[4096];
+    ssize_t rt = 0;
+    while((rt = read(fd, tmp, sizeof(tmp))) > 0);
+    CHECK(rt == 0 || errno != EAGAIN);
+    close(fd);
+
+    // 5.消息体边界无法确定的请求回复400并关闭连接，消息体中的数据不会被当作下一个请求
+    const char* bad_lengths[] = {"99999999999999999999999", "-1", "+31", "31x", ""};
+    for(auto i : bad_lengths) {
+        CHECK(bad_request("Content-Length: " + std::string(i) + "\r\n"));
+    }
+    const char* bad_codings[] = {"gzip", "gzip, chunked", "chunked, gzip", "chunked, chunked", "xchunked", ""};
+    for(auto i : bad_codings) {
+        CHECK(bad_request("Transfer-Encoding: " + std::string(i) + "\r\nContent-Length: 31\r\n"));
+    }
+    fd = connect_server();
+    for(auto i : {"Chunked ", "CHUNKED\t", " , chunked"}) {
+        CHECK(send_upload(fd, true, 1000, i));
+        CHECK(read_response(fd, status, body));
+        CHECK(status == 200 && body == "1000 " + std::to_string(expect_sum(1000)));
+    }
+    close(fd);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    SYLAR_LOG_INFO(g_logger) << "max rss: " << usage.ru_maxrss / 1024 << "MB";
+    CHECK((uint64_t)usage.ru_maxrss * 1024 < s_upload_size / 2 || s_upload_size < 64 * 1024 * 1024);
+
+    check_report("http stream test");
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1) {
+        s_upload_size = strtoull(argv[1], nullptr, 10) * 1024 * 1024;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::ERROR);
+    // 消息体的长度上限设为上传大小，流式读取时内存占用与上限无关
+    sylar::Config::Lookup<uint64_t>("http.request.max_body_size")->setValue(s_upload_size);
+    sylar::IOManager iom(1, false);
+    iom.scheduler(&run_server);
+    std::thread client(run_client);
+    client.join();
+    _exit(s_failed ? 1 : 0);
+}
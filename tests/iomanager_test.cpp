@@ -1,4 +1,6 @@
 #include <iostream>
+#include <sstream>
+#include <atomic>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -7,6 +9,8 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include "iomanager.h"
+#include "util.h"
+#include "check.h"
 
 sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
 
@@ -69,11 +73,120 @@ void test_timer() {
     }, true);
 }
 
+//时间轮定时器：跨多层的定时器按时间先后触发，循环、取消、重置、刷新都生效
+void test_timer_wheel() {
+    //单线程调度，触发的回调按到期顺序执行
+    sylar::IOManager iom(1, false, "timer_wheel", sylar::TimerManager::WHEEL);
+    uint64_t start = sylar::GetCurrentMS();
+    sylar::Mutex mutex;
+    std::vector<std::pair<int, uint64_t> > fired;   //定时器编号及触发时距开始的毫秒数
+    auto record = [&](int id) {
+        sylar::Mutex::Lock lock(mutex);
+        fired.push_back(std::make_pair(id, sylar::GetCurrentMS() - start));
+    };
+
+    //第0层(<256ms)和第1层(<16384ms)的定时器，乱序加入
+    const int delays[] = {1500, 5, 700, 250, 100, 2600, 300};
+    for(int ms : delays) {
+        iom.addTimer(ms, [&record, ms](){ record(ms); });
+    }
+
+    //循环定时器，触发5次后在回调里取消自己
+    std::atomic<int> recurring(0);
+    sylar::Timer::ptr rtimer;
+    rtimer = iom.addTimer(120, [&recurring, &rtimer](){
+        if(++recurring == 5) {
+            rtimer->cancel();
+        }
+    }, true);
+
+    //取消的定时器不会触发，重复取消返回false
+    std::atomic<bool> cancelled_fired(false);
+    sylar::Timer::ptr ctimer = iom.addTimer(400, [&cancelled_fired](){ cancelled_fired = true; });
+    CHECK(ctimer->cancel());
+    CHECK(!ctimer->cancel());
+
+    //第2层的定时器重置到第0/1层，较早的定时器重置到更晚
+    sylar::Timer::ptr far = iom.addTimer(60000, [&record](){ record(60000); });
+    CHECK(far->reset(450, true));
+    sylar::Timer::ptr later = iom.addTimer(200, [&record](){ record(200); });
+    CHECK(later->reset(900, true));
+
+    //刷新的定时器从刷新时刻重新计时
+    sylar::Timer::ptr rf = iom.addTimer(300, [&record](){ record(301); });
+    iom.addTimer(200, [&rf](){ rf->refresh(); });
+
+    //析构时等所有定时器执行完
+    iom.stop();
+
+    //期望的触发顺序(按编号): 重置后的far为450，later为900，刷新后的rf不早于500
+    const int expect[] = {5, 100, 250, 300, 60000, 301, 700, 200, 1500, 2600};
+    const uint64_t expect_ms[] = {5, 100, 250, 300, 450, 500, 700, 900, 1500, 2600};
+    CHECK(fired.size() == sizeof(expect) / sizeof(expect[0]));
+    for(size_t i = 0; i < fired.size() && i < sizeof(expect) / sizeof(expect[0]); ++i) {
+        CHECK(fired[i].first == expect[i]);
+        //不能提前触发，也不能晚得离谱
+        CHECK(fired[i].second >= expect_ms[i]);
+        CHECK(fired[i].second < expect_ms[i] + 200);
+    }
+    CHECK(recurring == 5);
+    CHECK(!cancelled_fired);
+    SYLAR_LOG_INFO(g_logger) << "timer_wheel: " << fired.size() << " timers fired, recurring=" << recurring;
+}
+
+//对比两种定时器存储结构添加+取消定时器的耗时(模拟每次IO都带超时)
+void bench_timer(sylar::TimerManager::Type type, const std::string& name) {
+    static const int N = 200000;
+    sylar::IOManager iom(1, false, name, type);
+    std::vector<sylar::Timer::ptr> timers;
+    timers.reserve(N);
+    uint64_t begin = sylar::GetCurrentUS();
+    for(int i = 0; i < N; ++i) {
+        timers.push_back(iom.addTimer(5000 + i % 30000, [](){}));
+    }
+    uint64_t added = sylar::GetCurrentUS();
+    for(auto& i : timers) {
+        i->cancel();
+    }
+    uint64_t end = sylar::GetCurrentUS();
+    SYLAR_LOG_INFO(g_logger) << name << ": add " << N << " timers " << (added - begin) / 1000 << "ms, "
+                             << "cancel " << (end - added) / 1000 << "ms";
+}
+
+//突发调度大量任务，观察tickle的合并情况
+void test_tickle() {
+    //屏蔽协程构造/析构的调试日志
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::INFO);
+    sylar::IOManager iom(4, false, "tickle");
+    std::atomic<int> count(0);
+    for(int round = 0; round < 10; ++round) {
+        for(int i = 0; i < 1000; ++i) {
+            iom.scheduler([&count](){ ++count; });
+        }
+        usleep(10 * 1000);
+    }
+    iom.stop();
+    std::stringstream ss;
+    iom.dump(ss);
+    SYLAR_LOG_INFO(g_logger) << "count=" << count << " " << ss.str();
+    //所有任务都执行了，突发调度时大部分tickle被合并掉
+    CHECK(count == 10000);
+    CHECK(iom.getTickleSuppressed() > 0);
+    CHECK(iom.getTickleIssued() < 10000 / 2);
+}
+
 int main(int argc, char** argv) {
     //test();
 
+    test_tickle();
+
+    bench_timer(sylar::TimerManager::SET, "timer_set");
+    bench_timer(sylar::TimerManager::WHEEL, "timer_wheel");
+
+    test_timer_wheel();
+
     test_timer();
     
-    return 0;
+    return check_report("iomanager_test");
 }
 
@@ -0,0 +1,152 @@
+/**
+ * @brief FileLogAppender异步写入测试和压测
+ * @details 用法: log_async_test [每个线程的条数] [线程数]
+ *              1.多个线程同时写日志，对比同步和异步模式的每秒条数，校验文件中的行数
+ *              2.缓冲区很小时，drop策略下写入的行数加上丢弃的条数等于总条数；block策略下不丢日志
+ *              3.通过logs配置异步appender，没有调用flush时后台线程按flush_interval写入文件
+ */
+#include <thread>
+#include <vector>
+#include <fstream>
+#include <stdlib.h>
+#include <unistd.h>
+#include <yaml-cpp/yaml.h>
+#include "log.h"
+#include "config.h"
+#include "util.h"
+#include "check.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static int s_count = 100000;
+static int s_threads = 4;
+
+// 统计文件中包含pattern的行数
+static uint64_t count_lines(const std::string& file, const std::string& pattern) {
+    std::ifstream ifs(file);
+    std::string line;
+    uint64_t count = 0;
+    while(std::getline(ifs, line)) {
+        if(line.find(pattern) != std::string::npos) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+static sylar::Logger::ptr make_logger(const std::string& name, sylar::FileLogAppender::ptr appender) {
+    sylar::Logger::ptr logger = std::make_shared<sylar::Logger>(name);
+    logger->setFormatter("%d{%Y-%m-%d %H:%M:%S}%T%t%T%F%T[%p]%T[%c]%T%f:%l%T%m%n");
+    logger->addApender(appender);
+    return logger;
+}
+
+// 多个线程同时写count条日志，返回耗时(微秒)
+static uint64_t run(sylar::Logger::ptr logger, int count) {
+    std::vector<std::thread> threads;
+    uint64_t begin = sylar::GetCurrentUS();
+    for(int i = 0; i < s_threads; ++i) {
+        threads.emplace_back([logger, count, i]() {
+            for(int j = 0; j < count; ++j) {
+                SYLAR_LOG_INFO(logger) << "record thread=" << i << " seq=" << j;
+            }
+        });
+    }
+    for(auto& i : threads) {
+        i.join();
+    }
+    return sylar::GetCurrentUS() - begin;
+}
+
+static void report(const std::string& name, uint64_t count, uint64_t us) {
+    SYLAR_LOG_INFO(g_logger) << name << ": " << count << " records in " << us / 1000 << "ms, "
+                             << (uint64_t)(count * 1000000.0 / (us ? us : 1)) << " records/sec";
+}
+
+void test_bench() {
+    uint64_t total = (uint64_t)s_count * s_threads;
+
+    unlink("/tmp/log_sync.txt");
+    auto sync = std::make_shared<sylar::FileLogAppender>("/tmp/log_sync.txt");
+    auto us = run(make_logger("sync", sync), s_count);
+    sync->flush();
+    report("sync", total, us);
+    CHECK(count_lines("/tmp/log_sync.txt", "record") == total);
+
+    unlink("/tmp/log_async.txt");
+    auto async = std::make_shared<sylar::FileLogAppender>("/tmp/log_async.txt", true);
+    uint64_t begin = sylar::GetCurrentUS();
+    us = run(make_logger("async", async), s_count);
+    report("async", total, us);
+    async->flush();
+    report("async+flush", total, sylar::GetCurrentUS() - begin);
+    CHECK(count_lines("/tmp/log_async.txt", "record") == total);
+    CHECK(async->getDropped() == 0);
+}
+
+void test_policy() {
+    uint64_t total = (uint64_t)s_count * s_threads;
+
+    unlink("/tmp/log_drop.txt");
+    auto drop = std::make_shared<sylar::FileLogAppender>("/tmp/log_drop.txt", true, 4096, 1000, true);
+    run(make_logger("drop", drop), s_count);
+    drop->flush();
+    uint64_t written = count_lines("/tmp/log_drop.txt", "record");
+    SYLAR_LOG_INFO(g_logger) << "drop policy: written=" << written << " dropped=" << drop->getDropped();
+    CHECK(written + drop->getDropped() == total);
+    CHECK(count_lines("/tmp/log_drop.txt", "dropped") > 0 || drop->getDropped() == 0);
+
+    unlink("/tmp/log_block.txt");
+    auto block = std::make_shared<sylar::FileLogAppender>("/tmp/log_block.txt", true, 4096, 1000, false);
+    run(make_logger("block", block), s_count);
+    block->flush();
+    CHECK(count_lines("/tmp/log_block.txt", "record") == total);
+    CHECK(block->getDropped() == 0);
+}
+
+void test_config() {
+    unlink("/tmp/log_conf.txt");
+    YAML::Node root = YAML::Load(
+        "logs:\n"
+        "    - name: async_conf\n"
+        "      level: info\n"
+        "      appenders:\n"
+        "          - type: FileLogAppender\n"
+        "            file: /tmp/log_conf.txt\n"
+        "            async: true\n"
+        "            buffer_size: 65536\n"
+        "            flush_interval: 50\n"
+        "            full_policy: drop\n");
+    sylar::Config::LoadFromYaml(root);
+    auto logger = SYLAR_LOG_NAME("async_conf");
+    std::string yaml = logger->toYamlString();
+    CHECK(yaml.find("async: true") != std::string::npos);
+    CHECK(yaml.find("full_policy: drop") != std::string::npos);
+    for(int i = 0; i < 10; ++i) {
+        SYLAR_LOG_INFO(logger) << "record conf " << i;
+    }
+    // 还在缓冲区中
+    CHECK(count_lines("/tmp/log_conf.txt", "record") == 0);
+    usleep(200 * 1000);
+    CHECK(count_lines("/tmp/log_conf.txt", "record") == 10);
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1) {
+        s_count = atoi(argv[1]);
+    }
+    if(argc > 2) {
+        s_threads = atoi(argv[2]);
+    }
+    if(s_count <= 0) {
+        s_count = 1;
+    }
+    if(s_threads <= 0) {
+        s_threads = 1;
+    }
+    test_bench();
+    test_policy();
+    test_config();
+
+    _exit(check_report("log async test"));
+}
@@ -0,0 +1,231 @@
+/**
+ * @brief FileLogAppender文件切分和压缩测试
+ * @details 用法: log_rotate_test [条数]
+ *              1.按大小切分，不压缩不清理：所有切分文件加当前文件的行数等于写入的条数，每个文件不超过max_size
+ *              2.按大小切分，压缩并只保留3个：后台线程压缩成.gz，删除旧文件，.gz可以解压
+ *              3.异步模式下按大小切分，行数不丢
+ *              4.按时间切分的时间点是下一个本地整点/零点
+ *              5.文件被外部删除后重新创建
+ *              6.通过logs配置切分参数
+ */
+#include <algorithm>
+#include <fstream>
+#include <vector>
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <yaml-cpp/yaml.h>
+#include "log.h"
+#include "config.h"
+#include "util.h"
+#include "check.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const std::string LOG_DIR = "/tmp/log_rotate_test";
+static int s_count = 20000;
+
+// 目录下以prefix开头的文件
+static std::vector<std::string> list_files(const std::string& prefix) {
+    std::vector<std::string> files;
+    DIR* d = opendir(LOG_DIR.c_str());
+    struct dirent* dp = nullptr;
+    while(d && (dp = readdir(d)) != nullptr) {
+        std::string name = dp->d_name;
+        if(name.compare(0, prefix.size(), prefix) == 0) {
+            files.push_back(LOG_DIR + "/" + name);
+        }
+    }
+    if(d) {
+        closedir(d);
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+static bool ends_with(const std::string& str, const std::string& suffix) {
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// 文件的内容，.gz文件解压
+static std::string read_file(const std::string& file) {
+    std::string data;
+    if(ends_with(file, ".gz")) {
+        gzFile gz = gzopen(file.c_str(), "rb");
+        char buf[4096];
+        int n = 0;
+        while(gz && (n = gzread(gz, buf, sizeof(buf))) > 0) {
+            data.append(buf, n);
+        }
+        if(gz) {
+            gzclose(gz);
+        }
+    } else {
+        std::ifstream ifs(file);
+        data.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    }
+    return data;
+}
+
+static uint64_t count_lines(const std::string& data, const std::string& pattern) {
+    uint64_t count = 0;
+    for(size_t pos = data.find(pattern); pos != std::string::npos; pos = data.find(pattern, pos + 1)) {
+        ++count;
+    }
+    return count;
+}
+
+static sylar::Logger::ptr make_logger(sylar::FileLogAppender::ptr appender) {
+    sylar::Logger::ptr logger = std::make_shared<sylar::Logger>("rotate");
+    logger->setFormatter("%d{%Y-%m-%d %H:%M:%S}%T%t%T[%p]%T%m%n");
+    logger->addApender(appender);
+    return logger;
+}
+
+void test_size() {
+    const uint64_t max_size = 64 * 1024;
+    auto appender = std::make_shared<sylar::FileLogAppender>(LOG_DIR + "/size.log");
+    appender->setRotate(max_size, sylar::FileLogAppender::ROTATE_NONE);
+    auto logger = make_logger(appender);
+    for(int i = 0; i < s_count; ++i) {
+        SYLAR_LOG_INFO(logger) << "record size " << i;
+    }
+    auto files = list_files("size.log");
+    uint64_t lines = 0;
+    bool size_ok = true;
+    for(auto& i : files) {
+        std::string data = read_file(i);
+        lines += count_lines(data, "record size ");
+        size_ok = size_ok && data.size() <= max_size;
+    }
+    SYLAR_LOG_INFO(g_logger) << "size rotate: " << files.size() << " files, " << lines << " lines";
+    CHECK(files.size() > 2);
+    CHECK(lines == (uint64_t)s_count);
+    CHECK(size_ok);
+    CHECK(appender->getFileSize() <= max_size);
+}
+
+void test_compress() {
+    auto appender = std::make_shared<sylar::FileLogAppender>(LOG_DIR + "/gz.log");
+    appender->setRotate(16 * 1024, sylar::FileLogAppender::ROTATE_NONE, 3, true);
+    auto logger = make_logger(appender);
+    for(int i = 0; i < s_count; ++i) {
+        SYLAR_LOG_INFO(logger) << "record gz " << i;
+    }
+    // 等后台线程压缩和清理
+    std::vector<std::string> files;
+    for(int i = 0; i < 300; ++i) {
+        files = list_files("gz.log.");
+        int gz = std::count_if(files.begin(), files.end(), [](const std::string& f) {
+            return ends_with(f, ".gz");
+        });
+        if(files.size() == 3 && gz == 3) {
+            break;
+        }
+        usleep(10 * 1000);
+    }
+    CHECK(files.size() == 3);
+    bool ok = true;
+    for(auto& i : files) {
+        std::string data = read_file(i);
+        ok = ok && ends_with(i, ".gz") && count_lines(data, "record gz ") > 0;
+    }
+    CHECK(ok);
+    // 保留的是最新的3个: 和当前文件中的日志是连续的
+    uint64_t kept = count_lines(read_file(LOG_DIR + "/gz.log"), "record gz ");
+    for(auto& i : files) {
+        kept += count_lines(read_file(i), "record gz ");
+    }
+    std::string first = "record gz " + std::to_string(s_count - kept) + "\n";
+    bool found = false;
+    for(auto& i : files) {
+        found = found || count_lines(read_file(i), first) == 1;
+    }
+    CHECK(found);
+    // 最后写的一条在当前文件中
+    CHECK(count_lines(read_file(LOG_DIR + "/gz.log"), "record gz " + std::to_string(s_count - 1)) == 1);
+}
+
+void test_async() {
+    auto appender = std::make_shared<sylar::FileLogAppender>(LOG_DIR + "/async.log", true, 16 * 1024);
+    appender->setRotate(64 * 1024, sylar::FileLogAppender::ROTATE_NONE);
+    auto logger = make_logger(appender);
+    for(int i = 0; i < s_count; ++i) {
+        SYLAR_LOG_INFO(logger) << "record async " << i;
+    }
+    appender->flush();
+    auto files = list_files("async.log");
+    uint64_t lines = 0;
+    for(auto& i : files) {
+        lines += count_lines(read_file(i), "record async ");
+    }
+    CHECK(files.size() > 2);
+    CHECK(lines == (uint64_t)s_count);
+}
+
+void test_time() {
+    uint64_t now = time(0);
+    uint64_t hour = sylar::FileLogAppender::NextRotateTime(now, sylar::FileLogAppender::ROTATE_HOURLY);
+    uint64_t day = sylar::FileLogAppender::NextRotateTime(now, sylar::FileLogAppender::ROTATE_DAILY);
+    struct tm tm;
+    time_t t = hour;
+    localtime_r(&t, &tm);
+    CHECK(hour > now && hour <= now + 3600 && tm.tm_min == 0 && tm.tm_sec == 0);
+    t = day;
+    localtime_r(&t, &tm);
+    CHECK(day > now && day <= now + 25 * 3600 && tm.tm_hour == 0 && tm.tm_min == 0 && tm.tm_sec == 0);
+    CHECK(sylar::FileLogAppender::NextRotateTime(now, sylar::FileLogAppender::ROTATE_NONE) == 0);
+}
+
+void test_deleted() {
+    auto appender = std::make_shared<sylar::FileLogAppender>(LOG_DIR + "/deleted.log");
+    auto logger = make_logger(appender);
+    SYLAR_LOG_INFO(logger) << "record before";
+    unlink((LOG_DIR + "/deleted.log").c_str());
+    // 每3秒检查一次文件
+    sleep(4);
+    SYLAR_LOG_INFO(logger) << "record after";
+    CHECK(count_lines(read_file(LOG_DIR + "/deleted.log"), "record after") == 1);
+}
+
+void test_config() {
+    YAML::Node root = YAML::Load(
+        "logs:\n"
+        "    - name: rotate_conf\n"
+        "      appenders:\n"
+        "          - type: FileLogAppender\n"
+        "            file: /tmp/log_rotate_test/conf.log\n"
+        "            max_size: 1048576\n"
+        "            rotate_time: daily\n"
+        "            max_files: 7\n"
+        "            compress: true\n");
+    sylar::Config::LoadFromYaml(root);
+    std::string yaml = SYLAR_LOG_NAME("rotate_conf")->toYamlString();
+    CHECK(yaml.find("max_size: 1048576") != std::string::npos);
+    CHECK(yaml.find("rotate_time: daily") != std::string::npos);
+    CHECK(yaml.find("max_files: 7") != std::string::npos);
+    CHECK(yaml.find("compress: true") != std::string::npos);
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1) {
+        s_count = atoi(argv[1]);
+    }
+    if(s_count < 10000) {
+        s_count = 10000;
+    }
+    mkdir(LOG_DIR.c_str(), 0755);
+    for(auto& i : list_files("")) {
+        unlink(i.c_str());
+    }
+    test_size();
+    test_compress();
+    test_async();
+    test_time();
+    test_deleted();
+    test_config();
+
+    _exit(check_report("log rotate test"));
+}
@@ -1,8 +1,66 @@
 #include <iostream>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
 #include "../include/log.h"
 #include "../include/util.h"
 
+//只格式化不输出的Appender，用来测量日志事件创建和格式化的开销
+class NullLogAppender : public sylar::LogAppender {
+public:
+    void log(std::shared_ptr<sylar::Logger> logger, sylar::LogLevel::Level level, sylar::LogEvent::ptr event) override {
+        if(level >= m_level) {
+            m_buf.clear();
+            m_formatter->format(m_buf, logger, level, event);
+            m_bytes += m_buf.size();
+        }
+    }
+    std::string toYamlString() override { return ""; }
+    std::string m_buf;
+    uint64_t m_bytes = 0;
+};
+
+//threads个线程各写count条日志，输出每条日志的平均耗时(ns)
+void bench(int count, int threads) {
+    std::vector<std::shared_ptr<NullLogAppender> > appenders;
+    std::vector<sylar::Logger::ptr> loggers;
+    for(int i = 0; i < threads; ++i) {
+        //每个线程一个Appender，避免统计字节数时的竞争
+        sylar::Logger::ptr l(std::make_shared<sylar::Logger>("bench"));
+        appenders.push_back(std::make_shared<NullLogAppender>());
+        l->addApender(appenders.back());
+        loggers.push_back(l);
+    }
+    std::vector<std::thread> ths;
+    uint64_t begin = sylar::GetCurrentUS();
+    for(int i = 0; i < threads; ++i) {
+        ths.emplace_back([&loggers, count, i]() {
+            sylar::Logger::ptr logger = loggers[i];
+            for(int j = 0; j < count; ++j) {
+                SYLAR_LOG_INFO(logger) << "bench message seq=" << j << " value=" << 3.14;
+            }
+        });
+    }
+    for(auto& i : ths) {
+        i.join();
+    }
+    uint64_t us = sylar::GetCurrentUS() - begin;
+    uint64_t total = (uint64_t)count * threads;
+    std::cout << "bench threads=" << threads << " events=" << total
+              << " time=" << us / 1000 << "ms " << us * 1000 / total << " ns/event"
+              << " bytes=" << appenders[0]->m_bytes << std::endl;
+}
+
 int main(int argc, char** argv) {
+    if(argc > 1) {
+        //压测: log_test 条数 [线程数]
+        int count = atoi(argv[1]);
+        int threads = argc > 2 ? atoi(argv[2]) : 4;
+        bench(count > 0 ? count : 1, 1);
+        bench(count > 0 ? count : 1, threads > 0 ? threads : 1);
+        return 0;
+    }
+
     sylar::Logger::ptr logger(std::make_shared<sylar::Logger>());
     logger->addApender(sylar::LogAppender::ptr(std::make_shared<sylar::StdoutLogAppender>()));
 
@@ -0,0 +1,163 @@
+/**
+ * @brief Resolver异步域名解析和缓存测试
+ * @details 用法: resolver_test [次数]
+ *              1.非调度线程同步解析，第二次命中缓存；返回的地址是副本，修改端口不影响缓存
+ *              2.解析失败的结果被缓存(negative cache)；空主机名解析失败；数字IP地址不经过缓存
+ *              3.缓存过期后重新解析；缓存满了淘汰最早写入的条目，最近的仍然命中
+ *              4.调度线程中多个协程同时解析同一个域名，解析在解析线程中执行，协程被调度回原线程
+ *              5.对比缓存命中和每次都调用getaddrinfo时的每秒解析次数
+ */
+#include <atomic>
+#include <stdlib.h>
+#include <unistd.h>
+#include "address.h"
+#include "config.h"
+#include "iomanager.h"
+#include "resolver.h"
+#include "log.h"
+#include "util.h"
+#include "check.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static int s_count = 10000;
+
+static sylar::ConfigVar<uint64_t>::ptr s_cache_ttl =
+            sylar::Config::Lookup<uint64_t>("dns.cache_ttl");
+
+static sylar::Resolver* resolver() {
+    return sylar::ResolverMgr::GetInstance();
+}
+
+static void report(const std::string& name, uint64_t count, uint64_t us) {
+    SYLAR_LOG_INFO(g_logger) << name << ": " << count << " lookups in " << us / 1000 << "ms, "
+                             << (uint64_t)(count * 1000000.0 / (us ? us : 1)) << " lookups/sec";
+}
+
+void test_cache() {
+    auto before = resolver()->getStats();
+    auto addr = sylar::Address::LookupAnyIPAddress("localhost:80");
+    CHECK(addr && addr->toString() == "127.0.0.1:80");
+    addr->setPort(81);
+    addr = sylar::Address::LookupAnyIPAddress("localhost:80");
+    CHECK(addr && addr->toString() == "127.0.0.1:80");
+    auto stats = resolver()->getStats();
+    CHECK(stats.misses == before.misses + 1 && stats.hits == before.hits + 1);
+    CHECK(stats.resolves == before.resolves + 1);
+
+    // 失败结果
+    CHECK(!sylar::Address::LookupAny("no-such-host.invalid"));
+    CHECK(!sylar::Address::LookupAny("no-such-host.invalid"));
+    stats = resolver()->getStats();
+    CHECK(stats.negativeHits == before.negativeHits + 1);
+    // 空主机名和原来直接调用getaddrinfo时一样解析失败
+    CHECK(!sylar::Address::LookupAny(":80"));
+
+    // 数字IP地址
+    before = resolver()->getStats();
+    CHECK(sylar::Address::LookupAny("127.0.0.1:8080")->toString() == "127.0.0.1:8080");
+    stats = resolver()->getStats();
+    CHECK(stats.resolves == before.resolves + 1 && stats.misses == before.misses
+            && stats.hits == before.hits);
+
+    // 过期
+    s_cache_ttl->setValue(100);
+    resolver()->clear();
+    CHECK(sylar::Address::LookupAny("localhost:81"));
+    usleep(150 * 1000);
+    before = resolver()->getStats();
+    CHECK(sylar::Address::LookupAny("localhost:81"));
+    stats = resolver()->getStats();
+    CHECK(stats.misses == before.misses + 1);
+    s_cache_ttl->setValue(60 * 1000);
+
+    // 缓存满了
+    auto cache_size = sylar::Config::Lookup<uint32_t>("dns.cache_size");
+    cache_size->setValue(8);
+    resolver()->clear();
+    for(int i = 0; i < 12; ++i) {
+        CHECK(sylar::Address::LookupAny("localhost:" + std::to_string(8000 + i)));
+        usleep(2 * 1000);
+    }
+    stats = resolver()->getStats();
+    CHECK(stats.cached > 0 && stats.cached <= 8);
+    before = stats;
+    CHECK(sylar::Address::LookupAny("localhost:8011"));
+    CHECK(sylar::Address::LookupAny("localhost:8010"));
+    stats = resolver()->getStats();
+    CHECK(stats.hits == before.hits + 2);
+    CHECK(sylar::Address::LookupAny("localhost:8000"));
+    CHECK(resolver()->getStats().misses == stats.misses + 1);
+    cache_size->setValue(4096);
+}
+
+static sylar::Semaphore s_sem;
+static std::atomic<int> s_done = {0};
+static std::atomic<int> s_ok = {0};
+static const int FIBERS = 50;
+
+void test_fibers() {
+    resolver()->clear();
+    auto before = resolver()->getStats();
+    sylar::IOManager iom(2, false, "resolver");
+    for(int i = 0; i < FIBERS; ++i) {
+        iom.scheduler([]() {
+            pid_t tid = sylar::getThreadId();
+            auto addr = sylar::Address::LookupAnyIPAddress("localhost:" + std::to_string(8000 + s_done % 3));
+            if(addr && addr->toString().substr(0, 10) == "127.0.0.1:"
+                    && sylar::getThreadId() == tid) {
+                ++s_ok;
+            }
+            if(++s_done == FIBERS) {
+                s_sem.notify();
+            }
+        });
+    }
+    s_sem.wait();
+    CHECK(s_ok == FIBERS);
+    auto stats = resolver()->getStats();
+    SYLAR_LOG_INFO(g_logger) << stats.toString();
+    // 未命中的请求要么自己解析，要么合并到正在进行的解析中
+    CHECK(stats.misses - before.misses
+            == stats.resolves - before.resolves + stats.coalesced - before.coalesced);
+    CHECK(stats.hits + stats.misses - before.hits - before.misses == FIBERS);
+    iom.stop();
+}
+
+void test_bench() {
+    resolver()->clear();
+    uint64_t begin = sylar::GetCurrentUS();
+    int ok = 0;
+    for(int i = 0; i < s_count; ++i) {
+        ok += sylar::Address::LookupAny("localhost:80") != nullptr;
+    }
+    report("cached", s_count, sylar::GetCurrentUS() - begin);
+    CHECK(ok == s_count);
+
+    s_cache_ttl->setValue(0);
+    resolver()->clear();
+    int count = s_count / 10;
+    begin = sylar::GetCurrentUS();
+    ok = 0;
+    for(int i = 0; i < count; ++i) {
+        ok += sylar::Address::LookupAny("localhost:80") != nullptr;
+    }
+    report("getaddrinfo", count, sylar::GetCurrentUS() - begin);
+    CHECK(ok == count);
+    s_cache_ttl->setValue(60 * 1000);
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1) {
+        s_count = atoi(argv[1]);
+    }
+    if(s_count < 10) {
+        s_count = 10;
+    }
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::ERROR);
+    test_cache();
+    test_fibers();
+    test_bench();
+
+    _exit(check_report("resolver test"));
+}
@@ -0,0 +1,248 @@
+/**
+ * @brief 路由匹配测试和压测
+ * @details 用法: router_bench [路由数量] [每种路径的查找次数]
+ *              1.校验HttpRouter的静态段、参数段、通配段、优先级、回溯和删除
+ *              2.注册[路由数量]个 /api/v1/resN/:id 形式的路由，分别用
+ *                  逐个fnmatch(原ServletDispatch的模糊匹配)、前缀过滤后fnmatch(现在的模糊匹配)、路由树
+ *                查找第一个路由、最后一个路由和不存在的路径，统计每次查找的耗时
+ *              3.多个线程同时查找，对比无锁的快照查找和每次加读锁(原ServletDispatch的做法)的耗时
+ *              4.其他线程缓存过快照后，分发器析构时servlet随之释放，新的分发器不会读到旧快照
+ */
+#include <thread>
+#include <fnmatch.h>
+#include <stdlib.h>
+#include "http_servlet.h"
+#include "http_router.h"
+#include "log.h"
+#include "thread.h"
+#include "util.h"
+#include "check.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static int s_routes = 500;
+static int s_count = 200000;
+
+static sylar::http::HttpServlet::ptr make_servlet(const std::string& name) {
+    auto servlet = std::make_shared<sylar::http::FunctionServlet>(nullptr);
+    servlet->setName(name);
+    return servlet;
+}
+
+// 匹配path，返回servlet名称和参数，没有匹配返回空串
+static std::string route(const sylar::http::HttpRouter& router, const std::string& path,
+                         const std::string& param = "") {
+    sylar::http::HttpRouter::ParamList params;
+    auto servlet = router.match(path, &params);
+    if(!servlet) {
+        return "";
+    }
+    std::string rt = servlet->getName();
+    for(auto& i : params) {
+        if(param.empty() || i.first == param) {
+            rt += " " + i.first + "=" + i.second;
+        }
+    }
+    return rt;
+}
+
+void test_router() {
+    sylar::http::HttpRouter router;
+    CHECK(router.add("/", make_servlet("root")));
+    CHECK(router.add("/user/:id", make_servlet("user")));
+    CHECK(router.add("/user/me", make_servlet("me")));
+    CHECK(router.add("/user/:id/posts/:pid", make_servlet("post")));
+    CHECK(router.add("/user/:id/files/*path", make_servlet("files")));
+    CHECK(router.add("/static/*", make_servlet("static")));
+    CHECK(router.add("/a/:x/c", make_servlet("axc")));
+    CHECK(router.add("/a/b/d", make_servlet("abd")));
+    CHECK(!router.add("/user/:name", make_servlet("conflict")));
+    CHECK(!router.add("/bad/*/x", make_servlet("bad")));
+    CHECK(!router.add("/bad/:", make_servlet("bad")));
+    CHECK(!router.add("bad", make_servlet("bad")));
+    CHECK(router.size() == 8);
+
+    CHECK(route(router, "/") == "root");
+    CHECK(route(router, "/user/42") == "user id=42");
+    CHECK(route(router, "/user/me") == "me");
+    CHECK(route(router, "/user/") == "");
+    CHECK(route(router, "/user/42/posts/7") == "post id=42 pid=7");
+    CHECK(route(router, "/user/42/files/a/b.txt") == "files id=42 path=a/b.txt");
+    CHECK(route(router, "/user/42/files/") == "files id=42 path=");
+    CHECK(route(router, "/static/js/app.js") == "static");
+    CHECK(route(router, "/static") == "");
+    // /a/b/c: 静态段b下没有c，回溯到参数段
+    CHECK(route(router, "/a/b/c") == "axc x=b");
+    CHECK(route(router, "/a/b/d") == "abd");
+    CHECK(route(router, "/none") == "");
+
+    CHECK(router.get("/user/:id")->getName() == "user");
+    CHECK(!router.get("/user/:name"));
+    CHECK(router.del("/user/:id"));
+    CHECK(!router.del("/user/:id"));
+    CHECK(route(router, "/user/42") == "");
+    CHECK(route(router, "/user/42/posts/7") == "post id=42 pid=7");
+    CHECK(router.del("/user/:id/posts/:pid"));
+    CHECK(router.del("/user/:id/files/*path"));
+    // 参数名不再冲突
+    CHECK(router.add("/user/:name", make_servlet("name")));
+    CHECK(route(router, "/user/sylar") == "name name=sylar");
+    CHECK(router.size() == 6);
+
+    // ServletDispatch: 精准匹配优先于路由，路由优先于模糊匹配，参数写入请求
+    sylar::http::ServletDispatch dispatch;
+    dispatch.addServlet("/item/list", make_servlet("list"));
+    dispatch.addGlobServlet("/item/*", make_servlet("glob"));
+    CHECK(dispatch.addRoute("/item/:id", make_servlet("item")));
+    sylar::http::HttpRequest::ptr req = std::make_shared<sylar::http::HttpRequest>();
+    req->setPath("/item/100");
+    CHECK(dispatch.getMatchServlet(req)->getName() == "item");
+    CHECK(req->getParam("id") == "100");
+    CHECK(dispatch.getMatchServlet("/item/list")->getName() == "list");
+    CHECK(dispatch.getMatchServlet("/item/1/x")->getName() == "glob");
+    CHECK(dispatch.getMatchServlet("/other") == dispatch.getDefault());
+    dispatch.delRoute("/item/:id");
+    CHECK(dispatch.getMatchServlet("/item/100")->getName() == "glob");
+}
+
+// 原ServletDispatch的模糊匹配: 逐个调用fnmatch
+static sylar::http::HttpServlet::ptr fnmatch_loop(
+        const std::vector<std::pair<std::string, sylar::http::HttpServlet::ptr> >& globs,
+        const std::string& uri) {
+    for(auto& i : globs) {
+        if(fnmatch(i.first.c_str(), uri.c_str(), 0) == 0) {
+            return i.second;
+        }
+    }
+    return nullptr;
+}
+
+static void report(const std::string& name, uint64_t us) {
+    SYLAR_LOG_INFO(g_logger) << name << ": " << s_count << " lookups in " << us / 1000 << "ms, "
+                             << (uint64_t)(us * 1000.0 / s_count) << " ns/lookup";
+}
+
+void bench_route() {
+    std::vector<std::pair<std::string, sylar::http::HttpServlet::ptr> > globs;
+    sylar::http::ServletDispatch glob_dispatch;
+    sylar::http::ServletDispatch route_dispatch;
+    for(int i = 0; i < s_routes; ++i) {
+        auto servlet = make_servlet("res" + std::to_string(i));
+        std::string prefix = "/api/v1/res" + std::to_string(i) + "/";
+        globs.push_back(std::make_pair(prefix + "*", servlet));
+        glob_dispatch.addGlobServlet(prefix + "*", servlet);
+        route_dispatch.addRoute(prefix + ":id", servlet);
+    }
+
+    std::vector<std::pair<std::string, std::string> > paths = {
+        {"first", "/api/v1/res0/12345"},
+        {"last", "/api/v1/res" + std::to_string(s_routes - 1) + "/12345"},
+        {"miss", "/api/v2/none/12345"}
+    };
+    for(auto& p : paths) {
+        sylar::http::HttpRequest::ptr req = std::make_shared<sylar::http::HttpRequest>();
+        req->setPath(p.second);
+        size_t hits = 0;
+
+        uint64_t begin = sylar::GetCurrentUS();
+        for(int i = 0; i < s_count; ++i) {
+            hits += fnmatch_loop(globs, p.second) != nullptr;
+        }
+        report(p.first + " fnmatch loop", sylar::GetCurrentUS() - begin);
+
+        begin = sylar::GetCurrentUS();
+        for(int i = 0; i < s_count; ++i) {
+            hits += glob_dispatch.getMatchServlet(p.second) != glob_dispatch.getDefault();
+        }
+        report(p.first + " glob dispatch", sylar::GetCurrentUS() - begin);
+
+        begin = sylar::GetCurrentUS();
+        for(int i = 0; i < s_count; ++i) {
+            hits += route_dispatch.getMatchServlet(req) != route_dispatch.getDefault();
+        }
+        report(p.first + " radix router", sylar::GetCurrentUS() - begin);
+
+        CHECK(hits == (p.first == "miss" ? 0 : 3u * s_count));
+        CHECK(p.first == "miss" || req->getParam("id") == "12345");
+    }
+}
+
+// 多线程查找，rwlock为true时每次查找前加读锁
+static void bench_threads(sylar::http::ServletDispatch& dispatch, bool rwlock, int threads) {
+    sylar::RWMutex mutex;
+    std::vector<std::thread> workers;
+    uint64_t begin = sylar::GetCurrentUS();
+    for(int t = 0; t < threads; ++t) {
+        workers.emplace_back([&]() {
+            std::string path = "/api/v1/res0/12345";
+            size_t hits = 0;
+            for(int i = 0; i < s_count; ++i) {
+                if(rwlock) {
+                    sylar::RWMutex::ReadLock lock(mutex);
+                    hits += dispatch.getMatchServlet(path) != nullptr;
+                } else {
+                    hits += dispatch.getMatchServlet(path) != nullptr;
+                }
+            }
+            CHECK(hits == (size_t)s_count);
+        });
+    }
+    for(auto& i : workers) {
+        i.join();
+    }
+    uint64_t us = sylar::GetCurrentUS() - begin;
+    SYLAR_LOG_INFO(g_logger) << threads << " threads " << (rwlock ? "rwlock" : "snapshot") << ": "
+                             << (uint64_t)threads * s_count << " lookups in " << us / 1000 << "ms, "
+                             << (uint64_t)(threads * (uint64_t)s_count * 1000000.0 / (us ? us : 1)) << " lookups/sec";
+}
+
+// 线程缓存的快照随分发器一起释放
+void test_cache_lifetime() {
+    auto servlet = make_servlet("old");
+    {
+        auto dispatch = std::make_shared<sylar::http::ServletDispatch>();
+        dispatch->addServlet("/old", servlet);
+        std::thread t([&]() {
+            CHECK(dispatch->getMatchServlet("/old") == servlet);
+        });
+        t.join();
+        CHECK(dispatch->getMatchServlet("/old") == servlet);
+    }
+    CHECK(servlet.use_count() == 1);
+
+    // 同一个线程先后访问多个分发器，地址可能相同，各自只看到自己的路由
+    for(int i = 0; i < 100; ++i) {
+        sylar::http::ServletDispatch dispatch;
+        std::string path = "/d" + std::to_string(i);
+        dispatch.addServlet(path, make_servlet(path));
+        CHECK(dispatch.getMatchServlet(path)->getName() == path);
+        CHECK(dispatch.getMatchServlet("/d" + std::to_string(i - 1))->getName() != "/d" + std::to_string(i - 1));
+    }
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1) {
+        s_routes = atoi(argv[1]);
+    }
+    if(argc > 2) {
+        s_count = atoi(argv[2]);
+    }
+    if(s_routes <= 0) {
+        s_routes = 1;
+    }
+    if(s_count <= 0) {
+        s_count = 1;
+    }
+    test_router();
+    test_cache_lifetime();
+    bench_route();
+
+    sylar::http::ServletDispatch dispatch;
+    for(int i = 0; i < s_routes; ++i) {
+        dispatch.addRoute("/api/v1/res" + std::to_string(i) + "/:id", make_servlet("res" + std::to_string(i)));
+    }
+    int threads = std::max(2u, std::min(8u, std::thread::hardware_concurrency()));
+    bench_threads(dispatch, true, threads);
+    bench_threads(dispatch, false, threads);
+    return check_report("router test");
+}
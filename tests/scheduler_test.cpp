@@ -1,6 +1,9 @@
 #include <iostream>
 #include "log.h"
 #include "scheduler.h"
+#include "config.h"
+#include "macro.h"
+#include "util.h"
 
 sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
 
@@ -19,7 +22,45 @@ void task() {
     sylar::Scheduler::GetThis()->scheduler(&task);
 }
 
+static std::atomic<uint64_t> s_count = {0};
+
+void count_task() {
+    ++s_count;
+}
+
+/**
+ * @brief 工作窃取模式测试
+ * @details 调度线程内部产生的任务进入本地队列，空闲线程窃取执行，
+ *          指定线程的任务放入目标线程的inbox
+ */
+void test_work_stealing() {
+    sylar::Config::Lookup<bool>("scheduler.work_stealing")->setValue(true);
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::WARN);  //屏蔽tickle日志
+
+    const uint64_t N = 100000;
+    uint64_t begin = sylar::GetCurrentMS();
+    {
+        sylar::Scheduler sc(4, false, "ws");
+        sc.start();
+        sc.scheduler([&sc, N](){
+            //在调度线程内部批量添加任务，全部进入本地队列
+            for(uint64_t i = 0; i < N; ++i) {
+                sc.scheduler(&count_task);
+            }
+        });
+        sc.stop();
+    }
+    SYLAR_LOG_INFO(g_logger) << "work stealing count=" << s_count
+                             << " used=" << sylar::GetCurrentMS() - begin << "ms";
+    SYLAR_ASSERT(s_count == N);
+
+    sylar::Config::Lookup<bool>("scheduler.work_stealing")->setValue(false);
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::DEBUG);
+}
+
 int main(int agrv, char** argv) {
+    test_work_stealing();
+
     SYLAR_LOG_INFO(g_logger) << "main begin";
     sylar::Scheduler sc(1, true, "test");
     sc.start();
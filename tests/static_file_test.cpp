@@ -0,0 +1,188 @@
+/**
+ * @brief StaticFileServlet测试
+ * @details 在临时目录下生成文件，启动HttpServer，客户端线程用原始socket在同一个长连接上
+ *          依次校验整个文件、Range、If-None-Match、If-Modified-Since、416、HEAD、目录、非法路径和前缀匹配
+ */
+#include <atomic>
+#include <map>
+#include <thread>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "http_server.h"
+#include "static_file_servlet.h"
+#include "log.h"
+#include "check.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static std::atomic<int> s_port(0);     // 服务器绑定127.0.0.1:0后由系统分配的端口，绑定失败为-1
+static const std::string ROOT = "/tmp/sylar_static_test";
+static const size_t FILE_SIZE = 3 * 1024 * 1024 + 7;
+static std::string s_content;
+
+struct Response {
+    int status = 0;
+    std::map<std::string, std::string> headers;
+    std::string body;
+};
+
+void make_files() {
+    mkdir(ROOT.c_str(), 0755);
+    mkdir((ROOT + "/dir").c_str(), 0755);
+    s_content.resize(FILE_SIZE);
+    for(size_t i = 0; i < FILE_SIZE; ++i) {
+        s_content[i] = 'a' + i % 26;
+    }
+    int fd = open((ROOT + "/big.txt").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    write(fd, s_content.c_str(), s_content.size());
+    close(fd);
+    fd = open((ROOT + "/dir/index.html").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    write(fd, "<html>index</html>", 18);
+    close(fd);
+}
+
+void run_server() {
+    sylar::http::HttpServer::ptr server = std::make_shared<sylar::http::HttpServer>(true);
+    sylar::Address::ptr addr = sylar::Address::LookupAny("127.0.0.1:0");
+    if(!server->bind(addr)) {
+        SYLAR_LOG_ERROR(g_logger) << "bind fail";
+        s_port = -1;
+        return;
+    }
+    s_port = std::dynamic_pointer_cast<sylar::IPAddress>(server->getSocks()[0]->getLocolAddress())->getPort();
+    server->getDispatch()->addGlobServlet("/static/*",
+            std::make_shared<sylar::http::StaticFileServlet>(ROOT, "/static/"));
+    // 前缀不以/结尾时只按整段匹配
+    server->getDispatch()->addGlobServlet("/files*",
+            std::make_shared<sylar::http::StaticFileServlet>(ROOT, "/files"));
+    server->start();
+}
+
+// 发送请求并读回一个完整的响应，HEAD请求不读消息体
+static bool request(int fd, const std::string& method, const std::string& path,
+                    const std::string& headers, Response& rsp) {
+    std::string req = method + " " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: Keep-Alive\r\n" + headers + "\r\n";
+    if(write(fd, req.c_str(), req.size()) != (ssize_t)req.size()) {
+        return false;
+    }
+    std::string buf;
+    char tmp[64 * 1024];
+    size_t header_end = std::string::npos;
+    while((header_end = buf.find("\r\n\r\n")) == std::string::npos) {
+        ssize_t rt = read(fd, tmp, sizeof(tmp));
+        if(rt <= 0) {
+            return false;
+        }
+        buf.append(tmp, rt);
+    }
+    rsp = Response();
+    rsp.status = atoi(buf.c_str() + 9);
+    size_t pos = buf.find("\r\n") + 2;
+    while(pos < header_end) {
+        size_t eol = buf.find("\r\n", pos);
+        size_t colon = buf.find(':', pos);
+        rsp.headers[buf.substr(pos, colon - pos)] = buf.substr(colon + 2, eol - colon - 2);
+        pos = eol + 2;
+    }
+    size_t len = atoi(rsp.headers["Content-Length"].c_str());
+    if(method == "HEAD" || rsp.status == 304) {
+        len = 0;
+    }
+    rsp.body = buf.substr(header_end + 4);
+    while(rsp.body.size() < len) {
+        ssize_t rt = read(fd, tmp, std::min(sizeof(tmp), len - rsp.body.size()));
+        if(rt <= 0) {
+            return false;
+        }
+        rsp.body.append(tmp, rt);
+    }
+    return rsp.body.size() == len;
+}
+
+void run_client() {
+    while(!s_port) {
+        usleep(1000);
+    }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(s_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bool connected = s_port > 0 && connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0;
+    CHECK(connected);
+    if(!connected) {
+        close(fd);
+        return;
+    }
+
+    Response rsp;
+    // 整个文件，第二次命中打开文件缓存
+    for(int n = 0; n < 2; ++n) {
+        CHECK(request(fd, "GET", "/static/big.txt", "", rsp));
+        CHECK(rsp.status == 200);
+        CHECK(rsp.body == s_content);
+        CHECK(rsp.headers["Content-Type"] == "text/plain; charset=utf-8");
+    }
+    std::string etag = rsp.headers["ETag"];
+    std::string last_modified = rsp.headers["Last-Modified"];
+    CHECK(!etag.empty() && !last_modified.empty());
+
+    // 区间
+    CHECK(request(fd, "GET", "/static/big.txt", "Range: bytes=100-199\r\n", rsp));
+    CHECK(rsp.status == 206);
+    CHECK(rsp.body == s_content.substr(100, 100));
+    CHECK(rsp.headers["Content-Range"] == "bytes 100-199/" + std::to_string(FILE_SIZE));
+    CHECK(request(fd, "GET", "/static/big.txt", "Range: bytes=-10\r\n", rsp));
+    CHECK(rsp.status == 206 && rsp.body == s_content.substr(FILE_SIZE - 10));
+    CHECK(request(fd, "GET", "/static/big.txt", "Range: bytes=3145000-\r\n", rsp));
+    CHECK(rsp.status == 206 && rsp.body == s_content.substr(3145000));
+    CHECK(request(fd, "GET", "/static/big.txt", "Range: bytes=99999999-\r\n", rsp));
+    CHECK(rsp.status == 416);
+    CHECK(request(fd, "GET", "/static/big.txt", "Range: bytes=0-9\r\nIf-Range: \"stale\"\r\n", rsp));
+    CHECK(rsp.status == 200 && rsp.body.size() == FILE_SIZE);
+
+    // 缓存验证
+    CHECK(request(fd, "GET", "/static/big.txt", "If-None-Match: " + etag + "\r\n", rsp));
+    CHECK(rsp.status == 304 && rsp.body.empty());
+    CHECK(request(fd, "GET", "/static/big.txt", "If-Modified-Since: " + last_modified + "\r\n", rsp));
+    CHECK(rsp.status == 304);
+    CHECK(request(fd, "GET", "/static/big.txt", "If-Modified-Since: Thu, 01 Jan 1970 00:00:00 GMT\r\n", rsp));
+    CHECK(rsp.status == 200 && rsp.body == s_content);
+
+    // HEAD、目录、不存在的文件、跳出根目录
+    CHECK(request(fd, "HEAD", "/static/big.txt", "", rsp));
+    CHECK(rsp.status == 200 && rsp.headers["Content-Length"] == std::to_string(FILE_SIZE));
+    CHECK(request(fd, "GET", "/static/dir", "", rsp));
+    CHECK(rsp.status == 301 && rsp.headers["Location"] == "/static/dir/");
+    CHECK(request(fd, "GET", "/static/dir/", "", rsp));
+    CHECK(rsp.status == 200 && rsp.body == "<html>index</html>");
+    CHECK(rsp.headers["Content-Type"] == "text/html; charset=utf-8");
+    CHECK(request(fd, "GET", "/static/none.txt", "", rsp));
+    CHECK(rsp.status == 404);
+    CHECK(request(fd, "GET", "/static/%2e%2e/etc/passwd", "", rsp));
+    CHECK(rsp.status == 403);
+    CHECK(request(fd, "HEAD", "/files/big.txt", "", rsp));
+    CHECK(rsp.status == 200);
+    CHECK(request(fd, "GET", "/filesdir/index.html", "", rsp));
+    CHECK(rsp.status == 403);
+    close(fd);
+
+    check_report("static file test");
+}
+
+int main(int argc, char** argv) {
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::ERROR);
+    make_files();
+    sylar::IOManager iom(1, false);
+    iom.scheduler(&run_server);
+    std::thread client(run_client);
+    client.join();
+    _exit(s_failed ? 1 : 0);
+}